@@ -111,7 +111,9 @@ LOCAL_SRC_FILES+= \
 	Programs/device.c \
 	Programs/parse.c \
 	Programs/timing.c \
-	Programs/io_misc.c
+	Programs/io_misc.c \
+	Programs/iotrace.c \
+	Programs/metrics.c
 
 # Braille objects
 LOCAL_SRC_FILES+= \
@@ -140,6 +142,7 @@ LOCAL_SRC_FILES+= \
 	Programs/async.c \
 	Programs/datafile.c \
 	Programs/dataarea.c \
+	Programs/dataimage.c \
 	Programs/touch.c \
 	Programs/hidkeys.c
 
@@ -1752,10 +1752,16 @@ brl_destruct (BrailleDisplay *brl) {
   io->closePort();
 }
 
+/* A write's header costs about as much as a few cells. */
+#define TEXT_RANGE_GAP 4
+#define TEXT_RANGE_LIMIT 8
+
 static int
 brl_writeWindow (BrailleDisplay *brl, const wchar_t *text) {
-  unsigned int from;
-  unsigned int to;
+  BrailleCellRange ranges[TEXT_RANGE_LIMIT];
+  unsigned int rangeLimit = ARRAY_COUNT(ranges);
+  unsigned int rangeCount;
+  unsigned int index;
 
   if (textRewriteInterval) {
     TimeValue now;
@@ -1764,7 +1770,15 @@ brl_writeWindow (BrailleDisplay *brl, const wchar_t *text) {
     if (textRewriteRequired) textRewriteTime = now;
   }
 
-  if (cellsHaveChanged(previousText, brl->buffer, brl->textColumns, &from, &to, &textRewriteRequired)) {
+  if (model->flags & MOD_FLAG_SEMI_PARTIAL_UPDATES) rangeLimit = 1;
+  rangeCount = getChangedCellRanges(previousText, brl->buffer, brl->textColumns,
+                                    ranges, rangeLimit, TEXT_RANGE_GAP,
+                                    &textRewriteRequired);
+
+  for (index=0; index<rangeCount; index+=1) {
+    unsigned int from = ranges[index].from;
+    unsigned int to = ranges[index].to;
+
     if (model->flags & MOD_FLAG_SEMI_PARTIAL_UPDATES) from = 0;
     size_t count = to - from;
     unsigned char cells[count];
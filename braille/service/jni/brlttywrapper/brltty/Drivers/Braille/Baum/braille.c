@@ -398,13 +398,21 @@ clearCellRange (BrailleDisplay *brl, unsigned int start, unsigned int count) {
   return updateCellRange(brl, start, count);
 }
 
+/* Modular displays write each range into their data registers. */
+#define CELL_RANGE_GAP 4
+#define CELL_RANGE_LIMIT 8
+
 static int
 putCells (BrailleDisplay *brl, const unsigned char *cells, unsigned int start, unsigned int count) {
-  unsigned int from;
-  unsigned int to;
-
-  if (cellsHaveChanged(&internalCells[start], cells, count, &from, &to, NULL)) {
-    if (!updateCellRange(brl, start+from, to-from)) return 0;
+  BrailleCellRange ranges[CELL_RANGE_LIMIT];
+  unsigned int rangeCount = getChangedCellRanges(&internalCells[start], cells, count,
+                                                 ranges, ARRAY_COUNT(ranges),
+                                                 CELL_RANGE_GAP, NULL);
+  unsigned int index;
+
+  for (index=0; index<rangeCount; index+=1) {
+    const BrailleCellRange *range = &ranges[index];
+    if (!updateCellRange(brl, start+range->from, range->to-range->from)) return 0;
   }
 
   return 1;
@@ -741,9 +741,10 @@ readPacket2 (BrailleDisplay *brl, void *packet, size_t size) {
   }
 }
 
-static int
-writePacket2 (BrailleDisplay *brl, unsigned char command, unsigned char count, const unsigned char *data) {
-  unsigned char buffer[(count * 2) + 5];
+#define PM2_PACKET_SIZE(count) (((count) * 2) + 5)
+
+static size_t
+makePacket2 (unsigned char *buffer, unsigned char command, unsigned char count, const unsigned char *data) {
   unsigned char *byte = buffer;
 
   *byte++ = STX;
@@ -758,9 +759,19 @@ writePacket2 (BrailleDisplay *brl, unsigned char command, unsigned char count, c
   }
 
   *byte++ = ETX;
-  return writePacket(brl, buffer, byte-buffer);
+  return byte - buffer;
+}
+
+static int
+writePacket2 (BrailleDisplay *brl, unsigned char command, unsigned char count, const unsigned char *data) {
+  unsigned char buffer[PM2_PACKET_SIZE(count)];
+  size_t size = makePacket2(buffer, command, count, data);
+  return writePacket(brl, buffer, size);
 }
 
+/* Each one contains all of the cells, so a newer one replaces a queued one. */
+#define PM2_UPDATE_CELLS 1
+
 static int
 interpretIdentity2 (BrailleDisplay *brl, const unsigned char *identity) {
   {
@@ -808,7 +819,12 @@ flushCells2 (BrailleDisplay *brl) {
       }
     }
 
-    writePacket2(brl, 3, byte-buffer, buffer);
+    {
+      unsigned char packet[PM2_PACKET_SIZE(byte-buffer)];
+      size_t size = makePacket2(packet, 3, byte-buffer, buffer);
+      writeBrailleUpdate(brl, gioEndpoint, PM2_UPDATE_CELLS, packet, size);
+    }
+
     refreshRequired2 = 0;
   }
 }
@@ -1179,6 +1195,7 @@ connectResource (const char *identifier) {
 
   if ((gioEndpoint = gioConnectResource(identifier, &descriptor))) {
     io = gioGetApplicationData(gioEndpoint);
+    gioEnableOutputQueue(gioEndpoint);
     return 1;
   }
 
@@ -62,6 +62,7 @@
 #include "timing.h"
 #include "charset.h"
 #include "cmd.h"
+#include "metrics.h"
 
 #define BRL_STATUS_FIELDS sfGeneric
 #define BRL_HAVE_STATUS_CELLS
@@ -1207,6 +1208,7 @@ brl_readCommand (BrailleDisplay *brl, KeyTableCommandContext context) {
   if (line) {
     const char *word;
     logMessage(LOG_DEBUG, "Command received: %s", line);
+    beginLatency(LATENCY_KEY_COMMAND);
 
     if ((word = strtok(line, inputDelimiters))) {
       if (testWord(word, "cells")) {
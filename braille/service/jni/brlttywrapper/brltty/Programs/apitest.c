@@ -27,9 +27,11 @@
 #include "options.h"
 #include "brldefs.h"
 #include "cmd.h"
+#include "metrics.h"
 
 #define BRLAPI_NO_DEPRECATED
 #include "brlapi.h"
+#include "brlapi_protocol.h"
 
 static brlapi_connectionSettings_t settings;
 
@@ -37,6 +39,7 @@ static int opt_learnMode;
 static int opt_showDots;
 static int opt_showName;
 static int opt_showSize;
+static int opt_showMetrics;
 static int opt_showKeyCodes;
 static int opt_suspendMode;
 
@@ -53,6 +56,12 @@ BEGIN_OPTION_TABLE(programOptions)
     .description = "Show the dimensions of the braille window."
   },
 
+  { .letter = 'm',
+    .word = "metrics",
+    .setting.flag = &opt_showMetrics,
+    .description = "Show the latency histograms and counters."
+  },
+
   { .letter = 'd',
     .word = "dots",
     .setting.flag = &opt_showDots,
@@ -114,6 +123,71 @@ static void showDriverName(void)
   fprintf(stderr, "%s\n", name);
 }
 
+static void showMetrics(void)
+{
+  uint32_t metrics[0X400];
+  const uint32_t *value = metrics;
+  ssize_t count;
+  unsigned int latencies, buckets, counters, index;
+
+  fprintf(stderr, "Getting metrics: ");
+  if ((count = brlapi_getMetrics(metrics, ARRAY_COUNT(metrics)))<0) {
+    brlapi_perror("failed");
+    exit(PROG_EXIT_FATAL);
+  }
+
+  if (count<BRLAPI_METRICS_HEADER_SIZE) goto badSize;
+  if (count>ARRAY_COUNT(metrics)) goto badSize;
+  latencies = *value++;
+  buckets = *value++;
+  counters = *value++;
+
+  if (buckets!=LATENCY_BUCKET_COUNT) {
+    fprintf(stderr, "unsupported bucket count: %u\n", buckets);
+    exit(PROG_EXIT_SEMANTIC);
+  }
+
+  if (latencies>count) goto badSize;
+  if (counters>count) goto badSize;
+  if (count!=(BRLAPI_METRICS_HEADER_SIZE + (latencies * BRLAPI_METRICS_HISTOGRAM_SIZE(buckets)) + counters)) goto badSize;
+  fprintf(stderr, "done\n");
+
+  for (index=0; index<latencies; index++) {
+    LatencyHistogram histogram;
+    char name[0X20];
+    char buffer[0X200];
+    unsigned int bucket;
+
+    histogram.count = *value++;
+    histogram.maximum = *value++;
+    histogram.total = (uint64_t)*value++ << 32;
+    histogram.total |= *value++;
+    for (bucket=0; bucket<buckets; bucket++) histogram.buckets[bucket] = *value++;
+
+    if (index<LATENCY_COUNT) {
+      snprintf(name, sizeof(name), "%s", getLatencyName(index));
+    } else {
+      snprintf(name, sizeof(name), "latency %u", index);
+    }
+
+    formatLatencyHistogram(buffer, sizeof(buffer), name, &histogram);
+    printf("%s\n", buffer);
+  }
+
+  for (index=0; index<counters; index++) {
+    if (index<COUNTER_COUNT) {
+      printf("%s: %" PRIu32 "\n", getCounterName(index), *value++);
+    } else {
+      printf("counter %u: %" PRIu32 "\n", index, *value++);
+    }
+  }
+  return;
+
+badSize:
+  fprintf(stderr, "unexpected size: %d\n", (int)count);
+  exit(PROG_EXIT_SEMANTIC);
+}
+
 #define DOTS_TEXT "dots: "
 #define DOTS_TEXTLEN (strlen(DOTS_TEXT))
 #define DOTS_LEN 8
@@ -286,6 +360,10 @@ main (int argc, char *argv[]) {
       showDisplaySize();
     }
 
+    if (opt_showMetrics) {
+      showMetrics();
+    }
+
     if (opt_showDots) {
       showDots();
     }
@@ -828,6 +828,42 @@ asyncRelativeAlarm (
   return asyncAbsoluteAlarm(&time, callback, data);
 }
 
+typedef struct {
+  AsyncAlarmCallback callback;
+  void *data;
+} AlarmKey;
+
+static int
+testAlarmEntry (const void *item, const void *data) {
+  const AlarmEntry *alarm = item;
+  const AlarmKey *key = data;
+  return (alarm->callback == key->callback) &&
+         (alarm->data == key->data);
+}
+
+int
+asyncCancelAlarm (
+  AsyncAlarmCallback callback,
+  void *data
+) {
+  Queue *alarms = getAlarmQueue(0);
+
+  if (alarms) {
+    AlarmKey key;
+    Element *element;
+
+    key.callback = callback;
+    key.data = data;
+
+    if ((element = findElement(alarms, testAlarmEntry, &key))) {
+      deleteElement(element);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
 void
 asyncWait (int duration) {
   long int elapsed = 0;
@@ -75,6 +75,11 @@ extern int asyncRelativeAlarm (
   void *data
 );
 
+extern int asyncCancelAlarm (
+  AsyncAlarmCallback callback,
+  void *data
+);
+
 
 extern void asyncWait (int duration);
 
@@ -20,6 +20,7 @@
 
 #include <string.h>
 
+#include "log.h"
 #include "file.h"
 #include "datafile.h"
 #include "dataarea.h"
@@ -168,21 +169,45 @@ AttributesTable *
 compileAttributesTable (const char *name) {
   AttributesTable *table = NULL;
 
+  {
+    DataImage *image = loadDataImage(name, ATTRIBUTES_TABLE_IMAGE_TYPE, "");
+
+    if (image) {
+      if ((table = malloc(sizeof(*table)))) {
+        table->header.bytes = getDataImageContent(image, &table->size);
+        table->image = image;
+        return table;
+      } else {
+        logMallocError();
+      }
+
+      destroyDataImage(image);
+    }
+  }
+
   if (setGlobalTableVariables(ATTRIBUTES_TABLE_EXTENSION, ATTRIBUTES_SUBTABLE_EXTENSION)) {
     AttributesTableData atd;
     memset(&atd, 0, sizeof(atd));
 
     if ((atd.area = newDataArea())) {
       if (allocateDataItem(atd.area, NULL, sizeof(AttributesTableHeader), __alignof__(AttributesTableHeader))) {
+        beginDataImageSources();
+
         if (processDataFile(name, processAttributesTableLine, &atd)) {
           if (makeAttributesToDots(&atd)) {
             if ((table = malloc(sizeof(*table)))) {
               table->header.fields = getAttributesTableHeader(&atd);
               table->size = getDataSize(atd.area);
+              table->image = NULL;
               resetDataArea(atd.area);
+
+              saveDataImage(name, ATTRIBUTES_TABLE_IMAGE_TYPE, "",
+                            table->header.bytes, table->size);
             }
           }
         }
+
+        endDataImageSources();
       }
 
       destroyDataArea(atd.area);
@@ -195,7 +220,12 @@ compileAttributesTable (const char *name) {
 void
 destroyAttributesTable (AttributesTable *table) {
   if (table->size) {
-    free(table->header.fields);
+    if (table->image) {
+      destroyDataImage(table->image);
+    } else {
+      free(table->header.fields);
+    }
+
     free(table);
   }
 }
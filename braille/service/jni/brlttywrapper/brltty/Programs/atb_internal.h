@@ -23,6 +23,8 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include "dataimage.h"
+
 typedef uint32_t AttributesTableOffset;
 
 typedef struct {
@@ -36,8 +38,11 @@ struct AttributesTableStruct {
   } header;
 
   size_t size;
+  DataImage *image;
 };
 
+#define ATTRIBUTES_TABLE_IMAGE_TYPE "atb-1"
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
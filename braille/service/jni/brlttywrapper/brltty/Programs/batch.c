@@ -0,0 +1,403 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+
+#include "prologue.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_POSIX_THREADS
+#include <pthread.h>
+#endif /* HAVE_POSIX_THREADS */
+
+#include "log.h"
+#include "file.h"
+#include "timing.h"
+#include "batch.h"
+
+#define BATCH_CHUNK_SIZE 0X10000
+
+/* How many chunks the workers may get ahead of the writer. */
+#define BATCH_CHUNKS_PER_WORKER 4
+
+unsigned int
+getProcessorCount (void) {
+#ifdef _SC_NPROCESSORS_ONLN
+  long int count = sysconf(_SC_NPROCESSORS_ONLN);
+  if (count > 0) return count;
+#endif /* _SC_NPROCESSORS_ONLN */
+
+  return 1;
+}
+
+#ifdef HAVE_OPEN_MEMSTREAM
+typedef struct {
+  const char *bytes;
+  size_t count;
+
+  char *output;
+  size_t length;
+
+  unsigned done:1;
+  unsigned ok:1;
+} BatchChunk;
+
+typedef struct {
+  const BatchDescriptor *descriptor;
+  BatchChunk *chunks;
+  unsigned int chunkCount;
+
+  unsigned int nextChunk;
+  unsigned int writtenChunks;
+  unsigned failed:1;
+
+#ifdef HAVE_POSIX_THREADS
+  pthread_mutex_t mutex;
+  pthread_cond_t condition;
+#endif /* HAVE_POSIX_THREADS */
+} BatchJob;
+
+static int
+mapBatchFile (FileContents *contents, const char *path) {
+  int ok = 0;
+  int file;
+
+  if ((file = open(path, O_RDONLY)) != -1) {
+    if (mapFileContents(contents, file)) ok = 1;
+    close(file);
+  } else {
+    logMessage(LOG_ERR, "cannot open input file: %s: %s", path, strerror(errno));
+  }
+
+  return ok;
+}
+
+static size_t
+findLineEnd (const char *bytes, size_t from, size_t to) {
+  const char *end = memchr(&bytes[from], '\n', to-from);
+  return end? (end - bytes + 1): to;
+}
+
+static size_t
+findChunkEnd (const BatchDescriptor *descriptor, const char *bytes, size_t from, size_t size) {
+  size_t target = from + BATCH_CHUNK_SIZE;
+  size_t end;
+
+  if (target >= size) return size;
+  end = findLineEnd(bytes, target, size);
+  if (descriptor->splitAtLines) return end;
+
+  /* a paragraph ends with a blank line or just before an indented one */
+  while (end < size) {
+    size_t next = findLineEnd(bytes, end, size);
+    size_t length = next - end;
+    char first = bytes[end];
+
+    if ((first == ' ') || (first == '\t')) return end;
+    if ((length == 1) || ((length == 2) && (first == '\r'))) return next;
+    end = next;
+  }
+
+  return size;
+}
+
+static int
+makeBatchChunks (BatchJob *job, const char *bytes, size_t size, unsigned long int *characters) {
+  unsigned int count = 0;
+  unsigned int allocated = 0;
+  size_t from = 0;
+
+  job->chunks = NULL;
+  *characters = 0;
+
+  while (from < size) {
+    size_t to = findChunkEnd(job->descriptor, bytes, from, size);
+
+    if (count == allocated) {
+      unsigned int newSize = allocated? (allocated << 1): 0X10;
+      BatchChunk *newChunks = realloc(job->chunks, ARRAY_SIZE(newChunks, newSize));
+
+      if (!newChunks) {
+        logMallocError();
+        return 0;
+      }
+
+      job->chunks = newChunks;
+      allocated = newSize;
+    }
+
+    {
+      BatchChunk *chunk = &job->chunks[count++];
+
+      memset(chunk, 0, sizeof(*chunk));
+      chunk->bytes = &bytes[from];
+      chunk->count = to - from;
+    }
+
+    /* count characters rather than UTF-8 continuation bytes */
+    while (from < to) {
+      if ((bytes[from++] & 0XC0) != 0X80) *characters += 1;
+    }
+  }
+
+  job->chunkCount = count;
+  return 1;
+}
+
+static int
+processBatchChunk (BatchJob *job, BatchChunk *chunk, void *worker) {
+  int ok = 0;
+  FILE *stream;
+
+  if ((stream = open_memstream(&chunk->output, &chunk->length))) {
+    if (job->descriptor->processChunk(chunk->bytes, chunk->count,
+                                      chunk == job->chunks,
+                                      stream, worker)) {
+      ok = 1;
+    }
+
+    if (fclose(stream) == EOF) {
+      logSystemError("fclose");
+      ok = 0;
+    }
+  } else {
+    logSystemError("open_memstream");
+  }
+
+  return ok;
+}
+
+#ifdef HAVE_POSIX_THREADS
+typedef struct {
+  BatchJob *job;
+  void *worker;
+} BatchWorker;
+
+static void *
+runBatchWorker (void *argument) {
+  BatchWorker *bw = argument;
+  BatchJob *job = bw->job;
+  unsigned int window = job->descriptor->workerCount * BATCH_CHUNKS_PER_WORKER;
+
+  pthread_mutex_lock(&job->mutex);
+
+  while (!job->failed && (job->nextChunk < job->chunkCount)) {
+    if ((job->nextChunk - job->writtenChunks) >= window) {
+      pthread_cond_wait(&job->condition, &job->mutex);
+    } else {
+      BatchChunk *chunk = &job->chunks[job->nextChunk++];
+      int ok;
+
+      pthread_mutex_unlock(&job->mutex);
+      ok = processBatchChunk(job, chunk, bw->worker);
+      pthread_mutex_lock(&job->mutex);
+
+      chunk->ok = ok;
+      chunk->done = 1;
+      if (!ok) job->failed = 1;
+      pthread_cond_broadcast(&job->condition);
+    }
+  }
+
+  pthread_mutex_unlock(&job->mutex);
+  return NULL;
+}
+#endif /* HAVE_POSIX_THREADS */
+
+static int
+awaitBatchChunk (BatchJob *job, BatchChunk *chunk) {
+#ifdef HAVE_POSIX_THREADS
+  pthread_mutex_lock(&job->mutex);
+  while (!chunk->done && !job->failed) pthread_cond_wait(&job->condition, &job->mutex);
+  pthread_mutex_unlock(&job->mutex);
+#else /* HAVE_POSIX_THREADS */
+  if (!chunk->done) {
+    chunk->ok = processBatchChunk(job, chunk, job->descriptor->workers[0]);
+    chunk->done = 1;
+  }
+#endif /* HAVE_POSIX_THREADS */
+
+  return chunk->done && chunk->ok;
+}
+
+static void
+releaseBatchChunk (BatchJob *job, BatchChunk *chunk) {
+  if (chunk->output) {
+    free(chunk->output);
+    chunk->output = NULL;
+  }
+
+#ifdef HAVE_POSIX_THREADS
+  pthread_mutex_lock(&job->mutex);
+  job->writtenChunks += 1;
+  pthread_cond_broadcast(&job->condition);
+  pthread_mutex_unlock(&job->mutex);
+#else /* HAVE_POSIX_THREADS */
+  job->writtenChunks += 1;
+#endif /* HAVE_POSIX_THREADS */
+}
+
+static void
+failBatchJob (BatchJob *job) {
+#ifdef HAVE_POSIX_THREADS
+  pthread_mutex_lock(&job->mutex);
+  job->failed = 1;
+  pthread_cond_broadcast(&job->condition);
+  pthread_mutex_unlock(&job->mutex);
+#else /* HAVE_POSIX_THREADS */
+  job->failed = 1;
+#endif /* HAVE_POSIX_THREADS */
+}
+
+static int
+writeBatchChunks (BatchJob *job, FILE *outputStream) {
+  unsigned int index;
+
+  for (index=0; index<job->chunkCount; index+=1) {
+    BatchChunk *chunk = &job->chunks[index];
+
+    if (!awaitBatchChunk(job, chunk)) return 0;
+    fwrite(chunk->output, 1, chunk->length, outputStream);
+    releaseBatchChunk(job, chunk);
+
+    if (ferror(outputStream)) {
+      logSystemError("output");
+      return 0;
+    }
+  }
+
+  fflush(outputStream);
+  if (!ferror(outputStream)) return 1;
+
+  logSystemError("output");
+  return 0;
+}
+
+static int
+runBatchJob (BatchJob *job, FILE *outputStream) {
+  int ok = 0;
+
+#ifdef HAVE_POSIX_THREADS
+  unsigned int workerCount = job->descriptor->workerCount;
+  pthread_t threads[workerCount];
+  BatchWorker workers[workerCount];
+  unsigned int started = 0;
+
+  pthread_mutex_init(&job->mutex, NULL);
+  pthread_cond_init(&job->condition, NULL);
+
+  while (started < workerCount) {
+    BatchWorker *bw = &workers[started];
+    int error;
+
+    bw->job = job;
+    bw->worker = job->descriptor->workers[started];
+
+    if ((error = pthread_create(&threads[started], NULL, runBatchWorker, bw))) {
+      errno = error;
+      logSystemError("pthread_create");
+      break;
+    }
+
+    started += 1;
+  }
+
+  if (started) {
+    if (writeBatchChunks(job, outputStream)) ok = 1;
+    if (!ok) failBatchJob(job);
+  }
+
+  while (started) pthread_join(threads[--started], NULL);
+
+  pthread_cond_destroy(&job->condition);
+  pthread_mutex_destroy(&job->mutex);
+#else /* HAVE_POSIX_THREADS */
+  if (writeBatchChunks(job, outputStream)) ok = 1;
+  if (!ok) failBatchJob(job);
+#endif /* HAVE_POSIX_THREADS */
+
+  {
+    unsigned int index;
+
+    for (index=0; index<job->chunkCount; index+=1) {
+      BatchChunk *chunk = &job->chunks[index];
+      if (chunk->output) free(chunk->output);
+    }
+  }
+
+  return ok;
+}
+
+int
+processFileInBatches (
+  const BatchDescriptor *descriptor,
+  const char *path, FILE *outputStream
+) {
+  int ok = 0;
+  FileContents file;
+
+  if (mapBatchFile(&file, path)) {
+    BatchJob job = {
+      .descriptor = descriptor,
+      .nextChunk = 0,
+      .writtenChunks = 0,
+      .failed = 0
+    };
+
+    TimeValue start;
+    unsigned long int characters;
+
+    getMonotonicTime(&start);
+
+    if (makeBatchChunks(&job, (const char *)file.bytes, file.size, &characters)) {
+      if (runBatchJob(&job, outputStream)) {
+        TimeValue end;
+        long int milliseconds;
+
+        getMonotonicTime(&end);
+        milliseconds = millisecondsBetween(&start, &end);
+
+        logMessage(LOG_NOTICE,
+                   "%s: %lu characters in %ld ms (%lu characters per second, %u chunks, %u workers)",
+                   path, characters, milliseconds,
+                   (unsigned long int)((characters * 1000.0) / (milliseconds? milliseconds: 1)),
+                   job.chunkCount, descriptor->workerCount);
+
+        ok = 1;
+      }
+    }
+
+    if (job.chunks) free(job.chunks);
+    unmapFileContents(&file);
+  }
+
+  return ok;
+}
+#else /* HAVE_OPEN_MEMSTREAM */
+int
+processFileInBatches (
+  const BatchDescriptor *descriptor,
+  const char *path, FILE *outputStream
+) {
+  logMessage(LOG_ERR, "batch processing not supported");
+  return 0;
+}
+#endif /* HAVE_OPEN_MEMSTREAM */
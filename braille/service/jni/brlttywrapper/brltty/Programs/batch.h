@@ -0,0 +1,55 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+
+
+#ifndef BRLTTY_INCLUDED_BATCH
+#define BRLTTY_INCLUDED_BATCH
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* A file is split into chunks which are processed concurrently, each by
+ * whichever worker is free, and whose output is then written in order.
+ * Chunks end at paragraph boundaries - after a blank line or before an
+ * indented one - or, if the processor allows it, at any line boundary.
+ */
+typedef int BatchChunkProcessor (
+  const char *bytes, size_t count, int first,
+  FILE *stream, void *worker
+);
+
+typedef struct {
+  BatchChunkProcessor *processChunk;
+  void *const *workers;
+  unsigned int workerCount;
+  unsigned splitAtLines:1;
+} BatchDescriptor;
+
+extern unsigned int getProcessorCount (void);
+
+extern int processFileInBatches (
+  const BatchDescriptor *descriptor,
+  const char *path, FILE *outputStream
+);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* BRLTTY_INCLUDED_BATCH */
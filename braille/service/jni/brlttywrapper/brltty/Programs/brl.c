@@ -25,6 +25,7 @@
 
 #include "log.h"
 #include "timing.h"
+#include "metrics.h"
 #include "async.h"
 #include "message.h"
 #include "charset.h"
@@ -539,8 +540,8 @@ getCurrentCommandContext (void) {
   return currentCommandContext;
 }
 
-int
-readBrailleCommand (BrailleDisplay *brl, KeyTableCommandContext context) {
+static int
+getBrailleCommand (BrailleDisplay *brl, KeyTableCommandContext context) {
   currentCommandContext = context;
 
   {
@@ -578,6 +579,49 @@ readBrailleCommand (BrailleDisplay *brl, KeyTableCommandContext context) {
   }
 }
 
+int
+readBrailleCommand (BrailleDisplay *brl, KeyTableCommandContext context) {
+  int command = getBrailleCommand(brl, context);
+
+  if (command != EOF) {
+    addToCounter(COUNTER_COMMANDS, 1);
+    endLatency(LATENCY_KEY_COMMAND, 0);
+  } else {
+    cancelLatency(LATENCY_KEY_COMMAND);
+  }
+
+  return command;
+}
+
+int
+writeBrailleWindow (
+  BrailleDisplay *brl, const BrailleDriver *driver, const wchar_t *text,
+  LatencyMetric latency, const TimeValue *start
+) {
+  uint32_t changes = getCounterValue(COUNTER_CELLS_CHANGED);
+  unsigned int delay = brl->writeDelay;
+  TimeValue begin;
+  int ok;
+
+  getMonotonicTime(&begin);
+  ok = driver->writeWindow(brl, text);
+  addLatencySince(LATENCY_WINDOW_WRITE, &begin);
+
+  if (ok && start) {
+    /* Not every driver uses cellsHaveChanged(), but those which don't
+     * still account for what they've written in writeDelay.
+     */
+    if ((getCounterValue(COUNTER_CELLS_CHANGED) != changes) || (brl->writeDelay > delay)) {
+      TimeValue drained = *start;
+
+      adjustTimeValue(&drained, -(int)brl->writeDelay);
+      addLatencySince(latency, &drained);
+    }
+  }
+
+  return ok;
+}
+
 int
 writeBraillePacket (
   BrailleDisplay *brl, GioEndpoint *endpoint,
@@ -589,6 +633,18 @@ writeBraillePacket (
   return 1;
 }
 
+int
+writeBrailleUpdate (
+  BrailleDisplay *brl, GioEndpoint *endpoint, unsigned int class,
+  const void *packet, size_t size
+) {
+  /* The endpoint's output queue does the pacing, so writeDelay isn't
+   * increased - a queued update may yet be superseded by a newer one.
+   * For the same reason, the packet is logged when it's actually written.
+   */
+  return gioQueueData(endpoint, class, packet, size) != -1;
+}
+
 int
 probeBrailleDisplay (
   BrailleDisplay *brl, unsigned int retryLimit,
@@ -675,73 +731,226 @@ learnMode (BrailleDisplay *brl, int poll, int timeout) {
 }
 #endif /* ENABLE_LEARN_MODE */
 
-int
-cellsHaveChanged (
-  unsigned char *cells, const unsigned char *new, unsigned int count,
-  unsigned int *from, unsigned int *to, int *force
+/* Cells are compared a machine word at a time, and only the word which
+ * contains the boundary of a run is then looked at cell by cell.
+ */
+typedef unsigned long CellWord;
+#define CELL_WORD_SIZE sizeof(CellWord)
+#define CELL_WORD_ONES (~(CellWord)0 / 0XFF)
+#define CELL_WORD_HIGHS (CELL_WORD_ONES * 0X80)
+
+static inline CellWord
+getCellWord (const unsigned char *cells) {
+  CellWord word;
+  memcpy(&word, cells, sizeof(word));
+  return word;
+}
+
+static unsigned int
+findChangedCell (const void *old, const void *new, unsigned int index, unsigned int count) {
+  const unsigned char *oldCells = old;
+  const unsigned char *newCells = new;
+
+  while ((count - index) >= CELL_WORD_SIZE) {
+    if (getCellWord(&oldCells[index]) != getCellWord(&newCells[index])) break;
+    index += CELL_WORD_SIZE;
+  }
+
+  while (index < count) {
+    if (oldCells[index] != newCells[index]) break;
+    index += 1;
+  }
+
+  return index;
+}
+
+static unsigned int
+findUnchangedCell (const void *old, const void *new, unsigned int index, unsigned int count) {
+  const unsigned char *oldCells = old;
+  const unsigned char *newCells = new;
+
+  while ((count - index) >= CELL_WORD_SIZE) {
+    CellWord difference = getCellWord(&oldCells[index]) ^ getCellWord(&newCells[index]);
+
+    /* nonzero if any byte of the difference is zero */
+    if ((difference - CELL_WORD_ONES) & ~difference & CELL_WORD_HIGHS) break;
+    index += CELL_WORD_SIZE;
+  }
+
+  while (index < count) {
+    if (oldCells[index] == newCells[index]) break;
+    index += 1;
+  }
+
+  return index;
+}
+
+static unsigned int
+findChangedCharacter (const void *old, const void *new, unsigned int index, unsigned int count) {
+  const wchar_t *oldText = old;
+  const wchar_t *newText = new;
+
+  while (index < count) {
+    if (oldText[index] != newText[index]) break;
+    index += 1;
+  }
+
+  return index;
+}
+
+static unsigned int
+findUnchangedCharacter (const void *old, const void *new, unsigned int index, unsigned int count) {
+  const wchar_t *oldText = old;
+  const wchar_t *newText = new;
+
+  while (index < count) {
+    if (oldText[index] == newText[index]) break;
+    index += 1;
+  }
+
+  return index;
+}
+
+typedef unsigned int ChangeFinder (const void *old, const void *new, unsigned int index, unsigned int count);
+
+typedef struct {
+  ChangeFinder *findChanged;
+  ChangeFinder *findUnchanged;
+} ChangeFinders;
+
+static const ChangeFinders cellChangeFinders = {
+  .findChanged = findChangedCell,
+  .findUnchanged = findUnchangedCell
+};
+
+static const ChangeFinders textChangeFinders = {
+  .findChanged = findChangedCharacter,
+  .findUnchanged = findUnchangedCharacter
+};
+
+/* Fills in at most limit ranges (limit must be nonzero). The old contents
+ * aren't updated.
+ */
+static unsigned int
+findChangedRanges (
+  const void *old, const void *new, unsigned int count,
+  BrailleCellRange *ranges, unsigned int limit, unsigned int gap, int *force,
+  const ChangeFinders *finders
 ) {
-  unsigned int first = 0;
+  unsigned int rangeCount = 0;
 
   if (force && *force) {
     *force = 0;
-  } else if (memcmp(cells, new, count) != 0) {
-    if (to) {
-      while (count) {
-        unsigned int last = count - 1;
-        if (cells[last] != new[last]) break;
-        count = last;
-      }
-    }
 
-    if (from) {
-      while (first < count) {
-        if (cells[first] != new[first]) break;
-        first += 1;
-      }
+    if (count) {
+      ranges[rangeCount].from = 0;
+      ranges[rangeCount].to = count;
+      rangeCount += 1;
     }
   } else {
+    unsigned int from = finders->findChanged(old, new, 0, count);
+
+    while (from < count) {
+      /* the last range reaches as far as the last changed cell */
+      unsigned int maximumGap = ((rangeCount + 1) == limit)? count: gap;
+      unsigned int to = finders->findUnchanged(old, new, from, count);
+      unsigned int next = finders->findChanged(old, new, to, count);
+
+      /* runs separated by only a few unchanged cells are cheaper to
+       * write together than as separate ranges
+       */
+      while ((next < count) && ((next - to) <= maximumGap)) {
+        to = finders->findUnchanged(old, new, next, count);
+        next = finders->findChanged(old, new, to, count);
+      }
+
+      ranges[rangeCount].from = from;
+      ranges[rangeCount].to = to;
+      rangeCount += 1;
+
+      from = next;
+    }
+  }
+
+  return rangeCount;
+}
+
+unsigned int
+getChangedCellRanges (
+  unsigned char *cells, const unsigned char *new, unsigned int count,
+  BrailleCellRange *ranges, unsigned int limit, unsigned int gap, int *force
+) {
+  unsigned int rangeCount;
+
+  if (!limit) return 0;
+  rangeCount = findChangedRanges(cells, new, count, ranges, limit, gap, force, &cellChangeFinders);
+
+  if (!rangeCount) {
+    addToCounter(COUNTER_CELLS_UNCHANGED, 1);
     return 0;
   }
 
-  if (from) *from = first;
-  if (to) *to = count;
+  {
+    unsigned int index;
 
-  memcpy(cells+first, new+first, count-first);
-  return 1;
+    for (index=0; index<rangeCount; index+=1) {
+      const BrailleCellRange *range = &ranges[index];
+      memcpy(cells+range->from, new+range->from, range->to-range->from);
+    }
+  }
+
+  addToCounter(COUNTER_CELLS_CHANGED, 1);
+  return rangeCount;
 }
 
-int
-textHasChanged (
+unsigned int
+getChangedTextRanges (
   wchar_t *text, const wchar_t *new, unsigned int count,
-  unsigned int *from, unsigned int *to, int *force
+  BrailleCellRange *ranges, unsigned int limit, unsigned int gap, int *force
 ) {
-  unsigned int first = 0;
+  unsigned int rangeCount;
 
-  if (force && *force) {
-    *force = 0;
-  } else if (wmemcmp(text, new, count) != 0) {
-    if (to) {
-      while (count) {
-        unsigned int last = count - 1;
-        if (text[last] != new[last]) break;
-        count = last;
-      }
-    }
+  if (!limit) return 0;
+  rangeCount = findChangedRanges(text, new, count, ranges, limit, gap, force, &textChangeFinders);
 
-    if (from) {
-      while (first < count) {
-        if (text[first] != new[first]) break;
-        first += 1;
-      }
+  {
+    unsigned int index;
+
+    for (index=0; index<rangeCount; index+=1) {
+      const BrailleCellRange *range = &ranges[index];
+      wmemcpy(text+range->from, new+range->from, range->to-range->from);
     }
-  } else {
-    return 0;
   }
 
-  if (from) *from = first;
-  if (to) *to = count;
+  return rangeCount;
+}
+
+/* The single span from the first to the last change is the one range
+ * which the range functions return when their limit is 1.
+ */
+int
+cellsHaveChanged (
+  unsigned char *cells, const unsigned char *new, unsigned int count,
+  unsigned int *from, unsigned int *to, int *force
+) {
+  BrailleCellRange range;
+
+  if (!getChangedCellRanges(cells, new, count, &range, 1, 0, force)) return 0;
+  if (from) *from = range.from;
+  if (to) *to = range.to;
+  return 1;
+}
+
+int
+textHasChanged (
+  wchar_t *text, const wchar_t *new, unsigned int count,
+  unsigned int *from, unsigned int *to, int *force
+) {
+  BrailleCellRange range;
 
-  wmemcpy(text+first, new+first, count-first);
+  if (!getChangedTextRanges(text, new, count, &range, 1, 0, force)) return 0;
+  if (from) *from = range.from;
+  if (to) *to = range.to;
   return 1;
 }
 
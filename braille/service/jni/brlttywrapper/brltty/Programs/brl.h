@@ -25,6 +25,7 @@
 #include "io_generic.h"
 #include "brldefs.h"
 #include "ktbdefs.h"
+#include "metrics.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -101,6 +102,11 @@ extern int writeBraillePacket (
   const void *packet, size_t size
 );
 
+extern int writeBrailleUpdate (
+  BrailleDisplay *brl, GioEndpoint *endpoint, unsigned int class,
+  const void *packet, size_t size
+);
+
 typedef int BrailleRequestWriter (BrailleDisplay *brl);
 
 typedef size_t BraillePacketReader (
@@ -164,16 +170,36 @@ extern void identifyBrailleDrivers (int full);
 extern const BrailleDriver *braille;
 extern const BrailleDriver noBraille;
 
+extern int writeBrailleWindow (
+  BrailleDisplay *brl, const BrailleDriver *driver, const wchar_t *text,
+  LatencyMetric latency, const TimeValue *start
+);
+
 extern int cellsHaveChanged (
   unsigned char *cells, const unsigned char *new, unsigned int count,
   unsigned int *from, unsigned int *to, int *force
 );
 
+typedef struct {
+  unsigned int from;
+  unsigned int to;
+} BrailleCellRange;
+
+extern unsigned int getChangedCellRanges (
+  unsigned char *cells, const unsigned char *new, unsigned int count,
+  BrailleCellRange *ranges, unsigned int limit, unsigned int gap, int *force
+);
+
 extern int textHasChanged (
   wchar_t *text, const wchar_t *new, unsigned int count,
   unsigned int *from, unsigned int *to, int *force
 );
 
+extern unsigned int getChangedTextRanges (
+  wchar_t *text, const wchar_t *new, unsigned int count,
+  BrailleCellRange *ranges, unsigned int limit, unsigned int gap, int *force
+);
+
 extern int cursorHasChanged (int *cursor, int new, int *force);
 
 #define TRANSLATION_TABLE_SIZE 0X100
@@ -922,6 +922,42 @@ int BRLAPI_STDCALL brlapi_getDisplaySize(unsigned int *x, unsigned int *y)
   return brlapi__getDisplaySize(&defaultHandle, x, y);
 }
 
+/* Function : brlapi_getMetrics */
+/* Returns the server's latency histograms and counters */
+ssize_t BRLAPI_STDCALL brlapi__getMetrics(brlapi_handle_t *handle, uint32_t *metrics, size_t count)
+{
+  uint32_t packet[BRLAPI_MAXPACKETSIZE/sizeof(uint32_t)];
+  uint32_t first = 0;
+  ssize_t res;
+  size_t i;
+
+  /* The server sends the values a packet at a time, each reply starting
+   * with the total number of values it has. */
+  pthread_mutex_lock(&handle->req_mutex);
+  while (first<count) {
+    uint32_t total;
+    packet[0] = htonl(first);
+    res = brlapi_writePacket(handle->fileDescriptor, BRLAPI_PACKET_GETMETRICS, packet, sizeof(packet[0]));
+    if (res==-1) goto out;
+    res = brlapi__waitForPacket(handle, BRLAPI_PACKET_GETMETRICS, packet, sizeof(packet), 1);
+    if (res==-1) goto out;
+    res /= sizeof(uint32_t);
+    if (res<2) break;
+    total = ntohl(packet[0]);
+    for (i=1; i<res && first<count; i++) metrics[first++] = ntohl(packet[i]);
+    if (first>=total) break;
+  }
+  res = first;
+out:
+  pthread_mutex_unlock(&handle->req_mutex);
+  return res;
+}
+
+ssize_t BRLAPI_STDCALL brlapi_getMetrics(uint32_t *metrics, size_t count)
+{
+  return brlapi__getMetrics(&defaultHandle, metrics, count);
+}
+
 /* Function : getControllingTty */
 /* Returns the number of the caller's controlling terminal */
 /* -1 if error or unknown */
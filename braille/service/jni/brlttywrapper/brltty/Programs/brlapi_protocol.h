@@ -59,6 +59,7 @@ extern "C" {
 #define BRLAPI_PACKET_AUTH            'a'   /**< Authorization               */
 #define BRLAPI_PACKET_GETDRIVERNAME   'n'   /**< Ask which driver is used    */
 #define BRLAPI_PACKET_GETDISPLAYSIZE  's'   /**< Dimensions of brl display   */
+#define BRLAPI_PACKET_GETMETRICS      'M'   /**< Latencies and counters      */
 #define BRLAPI_PACKET_ENTERTTYMODE    't'   /**< Asks for a specified tty    */
 #define BRLAPI_PACKET_SETFOCUS        'F'   /**< Set current tty focus       */
 #define BRLAPI_PACKET_LEAVETTYMODE    'L'   /**< Release the tty             */
@@ -120,6 +121,21 @@ typedef struct {
   char name;
 } brlapi_getDriverSpecificModePacket_t;
 
+/** Structure of metrics packets
+ *
+ * All fields are 32-bit integers: the number of latency histograms, the
+ * number of buckets in each of them, and the number of counters, followed
+ * by each histogram (count, maximum, high and low words of the total, and
+ * then its buckets), followed by each counter. Latencies are in
+ * microseconds.
+ *
+ * They don't all fit in one packet, so the request holds the index of the
+ * first value wanted, and the reply holds the total number of values
+ * followed by as many of them as fit, starting with that one.
+ */
+#define BRLAPI_METRICS_HEADER_SIZE 3
+#define BRLAPI_METRICS_HISTOGRAM_SIZE(buckets) (4 + (buckets))
+
 /** Flags for writing */
 #define BRLAPI_WF_DISPLAYNUMBER 0X01    /**< Display number                 */
 #define BRLAPI_WF_REGION        0X02    /**< Region parameter               */
@@ -72,6 +72,7 @@
 #include "file.h"
 #include "parse.h"
 #include "timing.h"
+#include "metrics.h"
 #include "auth.h"
 #include "io_misc.h"
 #include "scr.h"
@@ -196,6 +197,8 @@ typedef struct Connection {
   unsigned int how; /* how keys must be delivered to clients */
   BrailleWindow brailleWindow;
   BrlBufState brlbufstate;
+  TimeValue writeTime;
+  unsigned writePending:1;
   RepeatState repeatState;
   pthread_mutex_t brlMutex;
   KeyrangeList *acceptedKeys;
@@ -521,6 +524,7 @@ typedef int(*PacketHandler)(Connection *, brlapi_packetType_t, brlapi_packet_t *
 typedef struct { /* packet handlers */
   PacketHandler getDriverName;
   PacketHandler getDisplaySize;
+  PacketHandler getMetrics;
   PacketHandler enterTtyMode;
   PacketHandler setFocus;
   PacketHandler leaveTtyMode;
@@ -590,10 +594,9 @@ void copyBrailleWindow(BrailleWindow *dest, const BrailleWindow *src)
 void getDots(const BrailleWindow *brailleWindow, unsigned char *buf)
 {
   int i;
-  unsigned char c;
+  convertTextToDots(textTable, brailleWindow->text, displaySize, buf);
   for (i=0; i<displaySize; i++) {
-    c = convertCharacterToDots(textTable, brailleWindow->text[i]);
-    buf[i] = (c & brailleWindow->andAttr[i]) | brailleWindow->orAttr[i];
+    buf[i] = (buf[i] & brailleWindow->andAttr[i]) | brailleWindow->orAttr[i];
   }
   if (brailleWindow->cursor) buf[brailleWindow->cursor-1] |= cursorShape;
 }
@@ -621,6 +624,7 @@ static Connection *createConnection(FileDescriptor fd, time_t currentTime)
   c->raw = 0;
   c->suspend = 0;
   c->brlbufstate = EMPTY;
+  c->writePending = 0;
   resetRepeatState(&c->repeatState);
   pthread_mutexattr_init(&mattr);
   pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_RECURSIVE);
@@ -774,6 +778,38 @@ static int handleGetDisplaySize(Connection *c, brlapi_packetType_t type, brlapi_
   return 0;
 }
 
+static int handleGetMetrics(Connection *c, brlapi_packetType_t type, brlapi_packet_t *packet, size_t size)
+{
+  uint32_t values[BRLAPI_METRICS_HEADER_SIZE + (LATENCY_COUNT * BRLAPI_METRICS_HISTOGRAM_SIZE(LATENCY_BUCKET_COUNT)) + COUNTER_COUNT];
+  uint32_t reply[BRLAPI_MAXPACKETSIZE/sizeof(uint32_t)];
+  uint32_t *value = values;
+  unsigned int index, first, count;
+  CHECKERR(size==sizeof(uint32_t),BRLAPI_ERROR_INVALID_PACKET,"wrong size");
+  first = ntohl(packet->uint32);
+  CHECKERR(first<=ARRAY_COUNT(values),BRLAPI_ERROR_INVALID_PARAMETER,"offset out of range");
+  *value++ = htonl(LATENCY_COUNT);
+  *value++ = htonl(LATENCY_BUCKET_COUNT);
+  *value++ = htonl(COUNTER_COUNT);
+  for (index=0; index<LATENCY_COUNT; index++) {
+    LatencyHistogram histogram;
+    unsigned int bucket;
+    getLatencyHistogram(index, &histogram);
+    *value++ = htonl(histogram.count);
+    *value++ = htonl(histogram.maximum);
+    *value++ = htonl(histogram.total >> 32);
+    *value++ = htonl(histogram.total & UINT32_MAX);
+    for (bucket=0; bucket<LATENCY_BUCKET_COUNT; bucket++) *value++ = htonl(histogram.buckets[bucket]);
+  }
+  for (index=0; index<COUNTER_COUNT; index++) *value++ = htonl(getCounterValue(index));
+  /* The whole set doesn't fit in one packet, so each reply carries the total
+   * followed by as many values as fit from the requested one onward. */
+  count = MIN(ARRAY_COUNT(values)-first, ARRAY_COUNT(reply)-1);
+  reply[0] = htonl(ARRAY_COUNT(values));
+  memcpy(&reply[1], &values[first], count*sizeof(values[0]));
+  brlapiserver_writePacket(c->fd,BRLAPI_PACKET_GETMETRICS,reply,(count+1)*sizeof(reply[0]));
+  return 0;
+}
+
 static int handleEnterTtyMode(Connection *c, brlapi_packetType_t type, brlapi_packet_t *packet, size_t size)
 {
   uint32_t * ints = &packet->uint32;
@@ -1061,7 +1097,12 @@ static int handleWrite(Connection *c, brlapi_packetType_t type, brlapi_packet_t
   if (orAttr) memcpy(c->brailleWindow.orAttr+rbeg-1,orAttr,rsiz);
   if (cursor>=0) c->brailleWindow.cursor = cursor;
   c->brlbufstate = TODISPLAY;
+  if (!c->writePending) {
+    getMonotonicTime(&c->writeTime);
+    c->writePending = 1;
+  }
   pthread_mutex_unlock(&c->brlMutex);
+  addToCounter(COUNTER_API_WRITES, 1);
   return 0;
 }
 
@@ -1161,7 +1202,7 @@ static int handleResumeDriver(Connection *c, brlapi_packetType_t type, brlapi_pa
 }
 
 static PacketHandlers packetHandlers = {
-  handleGetDriverName, handleGetDisplaySize,
+  handleGetDriverName, handleGetDisplaySize, handleGetMetrics,
   handleEnterTtyMode, handleSetFocus, handleLeaveTtyMode,
   handleKeyRanges, handleKeyRanges, handleWrite,
   handleEnterRawMode, handleLeaveRawMode, handlePacket, handleSuspendDriver, handleResumeDriver
@@ -1334,6 +1375,7 @@ static int processRequest(Connection *c, PacketHandlers *handlers)
   switch (type) {
     case BRLAPI_PACKET_GETDRIVERNAME: p = handlers->getDriverName; break;
     case BRLAPI_PACKET_GETDISPLAYSIZE: p = handlers->getDisplaySize; break;
+    case BRLAPI_PACKET_GETMETRICS: p = handlers->getMetrics; break;
     case BRLAPI_PACKET_ENTERTTYMODE: p = handlers->enterTtyMode; break;
     case BRLAPI_PACKET_SETFOCUS: p = handlers->setFocus; break;
     case BRLAPI_PACKET_LEAVETTYMODE: p = handlers->leaveTtyMode; break;
@@ -2528,7 +2570,9 @@ int api_flush(BrailleDisplay *brl) {
       disp->buffer = buf;
       getDots(&c->brailleWindow, buf);
       brl->cursor = c->brailleWindow.cursor-1;
-      ok = trueBraille->writeWindow(brl, c->brailleWindow.text);
+      ok = writeBrailleWindow(brl, trueBraille, c->brailleWindow.text,
+                              LATENCY_API_WINDOW, (c->writePending? &c->writeTime: NULL));
+      c->writePending = 0;
       drain = 1;
       disp->buffer = oldbuf;
     }
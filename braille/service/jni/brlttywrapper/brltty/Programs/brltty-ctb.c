@@ -26,6 +26,7 @@
 #include <string.h>
 #include <errno.h>
 
+
 #include "program.h"
 #include "options.h"
 #include "prefs.h"
@@ -37,6 +38,7 @@
 #include "ascii.h"
 #include "ttb.h"
 #include "ctb.h"
+#include "batch.h"
 
 static char *opt_tablesDirectory;
 static char *opt_contractionTable;
@@ -44,6 +46,7 @@ static char *opt_textTable;
 static int opt_reformatText;
 static char *opt_outputWidth;
 static int opt_forceOutput;
+static char *opt_jobCount;
 
 BEGIN_OPTION_TABLE(programOptions)
   { .letter = 'T',
@@ -89,24 +92,77 @@ BEGIN_OPTION_TABLE(programOptions)
     .setting.flag = &opt_forceOutput,
     .description = "Force immediate output."
   },
-END_OPTION_TABLE
 
-static wchar_t *inputBuffer;
-static size_t inputSize;
-static size_t inputLength;
+  { .letter = 'j',
+    .word = "jobs",
+    .argument = "count",
+    .setting.string = &opt_jobCount,
+    .defaultSetting = "",
+    .description = "Contract input files in parallel batches (0 for one job per processor)."
+  },
+END_OPTION_TABLE
 
 static FILE *outputStream;
-static unsigned char *outputBuffer;
 static int outputWidth;
 static int outputExtend;
 
 static ContractionTable *contractionTable;
+static ContractionOptions contractionOptions;
+static unsigned int jobCount;
 static int (*putCell) (unsigned char cell, void *data);
 
+
 typedef struct {
   ProgramExitStatus exitStatus;
+  ContractionTable *contractionTable;
+  ContractionContext *contractionContext;
+  FILE *outputStream;
+
+  struct {
+    wchar_t *buffer;
+    size_t size;
+    size_t length;
+  } input;
+
+  struct {
+    unsigned char *buffer;
+    int width;
+  } output;
 } LineProcessingData;
 
+static int
+initializeLineProcessingData (LineProcessingData *lpd, FILE *stream, ContractionTable *table) {
+  if (!(lpd->contractionContext = newContractionContext(table? table: contractionTable))) return 0;
+
+  lpd->contractionTable = table;
+  lpd->exitStatus = PROG_EXIT_SUCCESS;
+  lpd->outputStream = stream;
+
+  lpd->input.buffer = NULL;
+  lpd->input.size = 0;
+  lpd->input.length = 0;
+
+  lpd->output.buffer = NULL;
+  lpd->output.width = outputWidth;
+  return 1;
+}
+
+static void
+releaseLineProcessingData (LineProcessingData *lpd) {
+  if (lpd->output.buffer) {
+    free(lpd->output.buffer);
+    lpd->output.buffer = NULL;
+  }
+
+  if (lpd->input.buffer) {
+    free(lpd->input.buffer);
+    lpd->input.buffer = NULL;
+  }
+
+  destroyContractionContext(lpd->contractionContext);
+  if (lpd->contractionTable) destroyContractionTable(lpd->contractionTable);
+}
+
 static void
 noMemory (void *data) {
   LineProcessingData *lpd = data;
@@ -119,7 +175,7 @@ static int
 checkOutputStream (void *data) {
   LineProcessingData *lpd = data;
 
-  if (ferror(outputStream)) {
+  if (ferror(lpd->outputStream)) {
     logSystemError("output");
     lpd->exitStatus = PROG_EXIT_FATAL;
     return 0;
@@ -130,61 +186,72 @@ checkOutputStream (void *data) {
 
 static int
 flushOutputStream (void *data) {
-  fflush(outputStream);
+  LineProcessingData *lpd = data;
+
+  fflush(lpd->outputStream);
   return checkOutputStream(data);
 }
 
 static int
 putCharacter (unsigned char character, void *data) {
-  fputc(character, outputStream);
+  LineProcessingData *lpd = data;
+
+  fputc(character, lpd->outputStream);
   return checkOutputStream(data);
 }
 
 static int
 putMappedCharacter (unsigned char cell, void *data) {
-  fputc(convertDotsToCharacter(textTable, cell), outputStream);
+  LineProcessingData *lpd = data;
+
+  fputc(convertDotsToCharacter(textTable, cell), lpd->outputStream);
   return checkOutputStream(data);
 }
 
 static int
 putUnicodeBraille (unsigned char cell, void *data) {
+  LineProcessingData *lpd = data;
   Utf8Buffer utf8;
   size_t utfs = convertWcharToUtf8(cell|UNICODE_BRAILLE_ROW, utf8);
 
-  fprintf(outputStream, "%.*s", (int)utfs, utf8);
+  fprintf(lpd->outputStream, "%.*s", (int)utfs, utf8);
   return checkOutputStream(data);
 }
 
 static int
 writeCharacters (const wchar_t *inputLine, size_t inputLength, void *data) {
+  LineProcessingData *lpd = data;
   const wchar_t *inputBuffer = inputLine;
 
   while (inputLength) {
     int inputCount = inputLength;
-    int outputCount = outputWidth;
+    int outputCount = lpd->output.width;
 
-    if (!outputBuffer) {
-      if (!(outputBuffer = malloc(outputWidth))) {
+    if (!lpd->output.buffer) {
+      if (!(lpd->output.buffer = malloc(lpd->output.width))) {
         noMemory(data);
         return 0;
       }
     }
 
-    contractText(contractionTable,
-                 inputBuffer, &inputCount,
-                 outputBuffer, &outputCount,
-                 NULL, CTB_NO_CURSOR);
-
-    if ((inputCount < inputLength) && outputExtend) {
-      free(outputBuffer);
-      outputBuffer = NULL;
-      outputWidth <<= 1;
+    contractTextWithContext(lpd->contractionContext, &contractionOptions,
+                            inputBuffer, &inputCount,
+                            lpd->output.buffer, &outputCount,
+                            NULL, CTB_NO_CURSOR);
+
+    /* A full buffer may have cut off trailing spaces, and what fits mustn't
+     * depend on how far earlier lines have already extended it.
+     */
+    if (outputExtend && ((inputCount < inputLength) || (outputCount == lpd->output.width))) {
+      free(lpd->output.buffer);
+      lpd->output.buffer = NULL;
+      lpd->output.width <<= 1;
     } else {
       {
         int index;
 
         for (index=0; index<outputCount; index+=1)
-          if (!putCell(outputBuffer[index], data))
+          if (!putCell(lpd->output.buffer[index], data))
             return 0;
       }
 
@@ -202,9 +269,11 @@ writeCharacters (const wchar_t *inputLine, size_t inputLength, void *data) {
 
 static int
 flushCharacters (wchar_t end, void *data) {
-  if (inputLength) {
-    if (!writeCharacters(inputBuffer, inputLength, data)) return 0;
-    inputLength = 0;
+  LineProcessingData *lpd = data;
+
+  if (lpd->input.length) {
+    if (!writeCharacters(lpd->input.buffer, lpd->input.length, data)) return 0;
+    lpd->input.length = 0;
 
     if (end)
       if (!putCharacter(end, data))
@@ -216,16 +285,18 @@ flushCharacters (wchar_t end, void *data) {
 
 static int
 processCharacters (const wchar_t *characters, size_t count, wchar_t end, void *data) {
+  LineProcessingData *lpd = data;
+
   if (opt_reformatText && count) {
     if (iswspace(characters[0]))
       if (!flushCharacters('\n', data))
         return 0;
 
     {
-      unsigned int spaces = !inputLength? 0: 1;
-      size_t newLength = inputLength + spaces + count;
+      unsigned int spaces = !lpd->input.length? 0: 1;
+      size_t newLength = lpd->input.length + spaces + count;
 
-      if (newLength > inputSize) {
+      if (newLength > lpd->input.size) {
         size_t newSize = newLength | 0XFF;
         wchar_t *newBuffer = calloc(newSize, sizeof(*newBuffer));
 
@@ -234,20 +305,20 @@ processCharacters (const wchar_t *characters, size_t count, wchar_t end, void *d
           return 0;
         }
 
-        wmemcpy(newBuffer, inputBuffer, inputLength);
-        free(inputBuffer);
+        wmemcpy(newBuffer, lpd->input.buffer, lpd->input.length);
+        free(lpd->input.buffer);
 
-        inputBuffer = newBuffer;
-        inputSize = newSize;
+        lpd->input.buffer = newBuffer;
+        lpd->input.size = newSize;
       }
 
       while (spaces) {
-        inputBuffer[inputLength++] = WC_C(' ');
+        lpd->input.buffer[lpd->input.length++] = WC_C(' ');
         spaces -= 1;
       }
 
-      wmemcpy(&inputBuffer[inputLength], characters, count);
-      inputLength += count;
+      wmemcpy(&lpd->input.buffer[lpd->input.length], characters, count);
+      lpd->input.length += count;
     }
 
     if (end != '\n') {
@@ -299,15 +370,130 @@ processLine (char *line, void *data) {
 
 static ProgramExitStatus
 processStream (FILE *stream) {
-  LineProcessingData lpd = {
-    .exitStatus = PROG_EXIT_SUCCESS
-  };
-  ProgramExitStatus exitStatus = processLines(stream, processLine, &lpd)? lpd.exitStatus: PROG_EXIT_FATAL;
+  LineProcessingData lpd;
+  ProgramExitStatus exitStatus;
+
+  if (!initializeLineProcessingData(&lpd, outputStream, NULL)) return PROG_EXIT_FATAL;
+  exitStatus = processLines(stream, processLine, &lpd)? lpd.exitStatus: PROG_EXIT_FATAL;
 
   if (exitStatus == PROG_EXIT_SUCCESS)
     if (!(flushCharacters('\n', &lpd) && flushOutputStream(&lpd)))
       exitStatus = lpd.exitStatus;
 
+  releaseLineProcessingData(&lpd);
+  return exitStatus;
+}
+
+static int
+processChunk (const char *bytes, size_t count, int first, FILE *stream, void *worker) {
+  LineProcessingData *lpd = worker;
+  const char *end = bytes + count;
+  char *line = NULL;
+  size_t size = 0;
+  int ok = 1;
+
+  lpd->exitStatus = PROG_EXIT_SUCCESS;
+  lpd->outputStream = stream;
+
+  if (first) {
+    static const char utf8ByteOrderMark[] = {0XEF, 0XBB, 0XBF};
+    static const unsigned int length = sizeof(utf8ByteOrderMark);
+
+    if ((count >= length) && (memcmp(bytes, utf8ByteOrderMark, length) == 0)) bytes += length;
+  }
+
+  while (bytes < end) {
+    const char *next = memchr(bytes, '\n', end-bytes);
+    size_t length = (next? next: end) - bytes;
+
+    if (length >= size) {
+      size_t newSize = length | 0XFF;
+      char *newLine = realloc(line, newSize + 1);
+
+      if (!newLine) {
+        noMemory(lpd);
+        ok = 0;
+        break;
+      }
+
+      line = newLine;
+      size = newSize;
+    }
+
+    memcpy(line, bytes, length);
+    bytes = next? (next + 1): end;
+
+    if (length && (line[length-1] == '\r')) length -= 1;
+    line[length] = 0;
+
+    if (!processLine(line, lpd)) {
+      ok = 0;
+      break;
+    }
+  }
+
+  if (line) free(line);
+  if (ok && !flushCharacters('\n', lpd)) ok = 0;
+  return ok;
+}
+
+static ProgramExitStatus
+processFiles (char **paths, int count, const char *tablePath) {
+  ProgramExitStatus exitStatus = PROG_EXIT_FATAL;
+  LineProcessingData lpds[jobCount];
+  void *workers[jobCount];
+  unsigned int workerCount = 0;
+
+  /* An internal table is shared by the workers, each having its own
+   * context. An external table talks to a single command through one pipe,
+   * so each worker gets its own table (and command).
+   */
+  int external = isExternalContractionTable(contractionTable);
+
+  while (workerCount < jobCount) {
+    ContractionTable *table = NULL;
+
+    if (external) {
+      if (!(table = compileContractionTable(tablePath))) break;
+    }
+
+    if (!initializeLineProcessingData(&lpds[workerCount], outputStream, table)) {
+      if (table) destroyContractionTable(table);
+      break;
+    }
+
+    workers[workerCount] = &lpds[workerCount];
+    workerCount += 1;
+  }
+
+  if (workerCount == jobCount) {
+    const BatchDescriptor descriptor = {
+      .processChunk = processChunk,
+      .workers = workers,
+      .workerCount = workerCount,
+      .splitAtLines = !opt_reformatText
+    };
+
+    exitStatus = PROG_EXIT_SUCCESS;
+
+    while (count) {
+      const char *path = *paths;
+
+      if (strcmp(path, standardStreamArgument) == 0) {
+        exitStatus = processStream(stdin);
+      } else if (!processFileInBatches(&descriptor, path, outputStream)) {
+        exitStatus = PROG_EXIT_FATAL;
+      }
+
+      if (exitStatus != PROG_EXIT_SUCCESS) break;
+      paths += 1, count -= 1;
+    }
+  }
+
+  while (workerCount) {
+    releaseLineProcessingData(&lpds[--workerCount]);
+  }
+
   return exitStatus;
 }
 
@@ -316,7 +502,8 @@ main (int argc, char *argv[]) {
   ProgramExitStatus exitStatus = PROG_EXIT_FATAL;
 
   resetPreferences();
-  prefs.expandCurrentWord = 0;
+  contractionOptions.capitalizationMode = prefs.capitalizationMode;
+  contractionOptions.expandCurrentWord = 0;
 
   {
     static const OptionsDescriptor descriptor = {
@@ -335,12 +522,7 @@ main (int argc, char *argv[]) {
     fixInstallPaths(paths);
   }
 
-  inputBuffer = NULL;
-  inputSize = 0;
-  inputLength = 0;
-
   outputStream = stdout;
-  outputBuffer = NULL;
 
   if ((outputExtend = !*opt_outputWidth)) {
     outputWidth = 0X80;
@@ -353,6 +535,20 @@ main (int argc, char *argv[]) {
     }
   }
 
+  if (*opt_jobCount) {
+    static const int minimum = 0;
+    int count;
+
+    if (!validateInteger(&count, opt_jobCount, &minimum, NULL)) {
+      logMessage(LOG_ERR, "%s: %s", "invalid job count", opt_jobCount);
+      return PROG_EXIT_SYNTAX;
+    }
+
+    jobCount = count? count: getProcessorCount();
+  } else {
+    jobCount = 0;
+  }
+
   {
     char *contractionTablePath;
 
@@ -375,7 +571,9 @@ main (int argc, char *argv[]) {
         }
 
         if (exitStatus == PROG_EXIT_SUCCESS) {
-          if (argc) {
+          if (jobCount && argc) {
+            exitStatus = processFiles(argv, argc, contractionTablePath);
+          } else if (argc) {
             do {
               char *path = *argv;
               if (strcmp(path, standardStreamArgument) == 0) {
@@ -408,7 +606,5 @@ main (int argc, char *argv[]) {
     }
   }
 
-  if (outputBuffer) free(outputBuffer);
-  if (inputBuffer) free(inputBuffer);
   return exitStatus;
 }
@@ -0,0 +1,240 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+#include "prologue.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "program.h"
+#include "options.h"
+#include "log.h"
+#include "timing.h"
+#include "iotrace.h"
+
+static int opt_absoluteTimes;
+
+BEGIN_OPTION_TABLE(programOptions)
+  { .letter = 'a',
+    .word = "absolute-times",
+    .setting.flag = &opt_absoluteTimes,
+    .description = strtext("Show monotonic times rather than times relative to the first record.")
+  },
+END_OPTION_TABLE
+
+static const char *const resourceNames[] = {
+  [IO_TRACE_GENERIC] = "generic",
+  [IO_TRACE_SERIAL] = "serial",
+  [IO_TRACE_USB] = "usb",
+  [IO_TRACE_BLUETOOTH] = "bluetooth"
+};
+
+typedef struct {
+  int swap;
+
+  unsigned haveStart:1;
+  TimeValue start;
+
+  unsigned inTransfer:1;
+  uint32_t endpoint;
+  uint8_t direction;
+  uint16_t size;
+  uint16_t count;
+} TraceData;
+
+static uint16_t
+swap16 (uint16_t value) {
+  return (value << 8) | (value >> 8);
+}
+
+static uint32_t
+swap32 (uint32_t value) {
+  return ((uint32_t)swap16(value) << 16) | swap16(value >> 16);
+}
+
+static void
+fixRecord (IoTraceRecord *record) {
+  record->sequence = swap32(record->sequence);
+  record->seconds = swap32(record->seconds);
+  record->nanoseconds = swap32(record->nanoseconds);
+  record->endpoint = swap32(record->endpoint);
+  record->size = swap16(record->size);
+}
+
+static void
+endTransfer (TraceData *trace) {
+  if (trace->inTransfer) {
+    if (trace->count < trace->size) {
+      printf(" ... (%u of %u bytes)", trace->count, trace->size);
+    }
+
+    printf("\n");
+    trace->inTransfer = 0;
+  }
+}
+
+static void
+beginTransfer (TraceData *trace, const IoTraceRecord *record) {
+  TimeValue time = {
+    .seconds = record->seconds,
+    .nanoseconds = record->nanoseconds
+  };
+
+  if (!trace->haveStart) {
+    trace->start = time;
+    trace->haveStart = 1;
+  }
+
+  if (!opt_absoluteTimes) {
+    time.seconds -= trace->start.seconds;
+    time.nanoseconds -= trace->start.nanoseconds;
+    normalizeTimeValue(&time);
+  }
+
+  {
+    unsigned int resource = IO_TRACE_ENDPOINT_RESOURCE(record->endpoint);
+    const char *name = (resource < ARRAY_COUNT(resourceNames))? resourceNames[resource]: NULL;
+
+    printf("%" PRIsec ".%06" PRInsec " %s.%u %s %u:",
+           time.seconds, time.nanoseconds / NSECS_PER_USEC,
+           (name? name: "unknown"), IO_TRACE_ENDPOINT_NUMBER(record->endpoint),
+           ((record->direction == IO_TRACE_OUTPUT)? "->": "<-"),
+           record->size);
+  }
+
+  trace->inTransfer = 1;
+  trace->endpoint = record->endpoint;
+  trace->direction = record->direction;
+  trace->size = record->size;
+  trace->count = 0;
+}
+
+static void
+processRecord (TraceData *trace, IoTraceRecord *record) {
+  if (trace->swap) fixRecord(record);
+
+  if (!(record->flags & IO_TRACE_FLAG_CONTINUED) ||
+      !trace->inTransfer ||
+      (record->endpoint != trace->endpoint) ||
+      (record->direction != trace->direction)) {
+    endTransfer(trace);
+    beginTransfer(trace, record);
+  }
+
+  {
+    unsigned int count = MIN(record->count, IO_TRACE_RECORD_BYTES);
+    unsigned int index;
+
+    for (index=0; index<count; index+=1) printf(" %02X", record->bytes[index]);
+    trace->count += count;
+  }
+}
+
+static int
+processStream (FILE *stream, const char *name) {
+  TraceData trace;
+  IoTraceHeader header;
+
+  memset(&trace, 0, sizeof(trace));
+
+  if (fread(&header, sizeof(header), 1, stream) != 1) goto inputError;
+
+  if (memcmp(header.magic, IO_TRACE_MAGIC, sizeof(header.magic)) != 0) {
+    logMessage(LOG_ERR, "not an I/O trace: %s", name);
+    return 0;
+  }
+
+  if (header.byteOrder != IO_TRACE_BYTE_ORDER) {
+    if (header.byteOrder != swap32(IO_TRACE_BYTE_ORDER)) {
+      logMessage(LOG_ERR, "unrecognized byte order: %s", name);
+      return 0;
+    }
+
+    trace.swap = 1;
+    header.version = swap32(header.version);
+    header.recordSize = swap32(header.recordSize);
+    header.recordBytes = swap32(header.recordBytes);
+  }
+
+  if ((header.version != IO_TRACE_VERSION) ||
+      (header.recordSize != sizeof(IoTraceRecord)) ||
+      (header.recordBytes != IO_TRACE_RECORD_BYTES)) {
+    logMessage(LOG_ERR, "unsupported I/O trace version: %s: %u", name, header.version);
+    return 0;
+  }
+
+  while (1) {
+    IoTraceRecord record;
+
+    if (fread(&record, sizeof(record), 1, stream) != 1) {
+      if (ferror(stream)) goto inputError;
+      break;
+    }
+
+    processRecord(&trace, &record);
+  }
+
+  endTransfer(&trace);
+  return 1;
+
+inputError:
+  logMessage(LOG_ERR, "input error: %s: %s", name,
+             (ferror(stream)? strerror(errno): "truncated"));
+  return 0;
+}
+
+int
+main (int argc, char *argv[]) {
+  ProgramExitStatus exitStatus = PROG_EXIT_FATAL;
+
+  {
+    static const OptionsDescriptor descriptor = {
+      OPTION_TABLE(programOptions),
+      .applicationName = "brltty-iotrace",
+      .argumentsSummary = "[{trace-file | -} ...]"
+    };
+    PROCESS_OPTIONS(descriptor, argc, argv);
+  }
+
+  if (argc) {
+    do {
+      const char *file = argv[0];
+      FILE *stream;
+
+      if (strcmp(file, standardStreamArgument) == 0) {
+        if (!processStream(stdin, standardInputName)) break;
+      } else if ((stream = fopen(file, "rb"))) {
+        int ok = processStream(stream, file);
+        fclose(stream);
+        if (!ok) break;
+      } else {
+        logMessage(LOG_ERR, "cannot open file: %s: %s", file, strerror(errno));
+        exitStatus = PROG_EXIT_SEMANTIC;
+        break;
+      }
+
+      argv += 1, argc -= 1;
+    } while (argc);
+
+    if (!argc) exitStatus = PROG_EXIT_SUCCESS;
+  } else if (processStream(stdin, standardInputName)) {
+    exitStatus = PROG_EXIT_SUCCESS;
+  }
+
+  return exitStatus;
+}
@@ -26,15 +26,18 @@
 #include "options.h"
 #include "log.h"
 #include "file.h"
+#include "parse.h"
 #include "unicode.h"
 #include "charset.h"
 #include "brldots.h"
 #include "ttb.h"
+#include "batch.h"
 
 static char *opt_tablesDirectory;
 static char *opt_inputTable;
 static char *opt_outputTable;
 static int opt_sixDots;
+static char *opt_jobCount;
 
 static const char tableName_autoselect[] = "auto";
 static const char tableName_unicode[] = "unicode";
@@ -73,8 +76,18 @@ BEGIN_OPTION_TABLE(programOptions)
     .setting.flag = &opt_sixDots,
     .description = strtext("Remove dots seven and eight.")
   },
+
+  { .letter = 'j',
+    .word = "jobs",
+    .argument = strtext("count"),
+    .setting.string = &opt_jobCount,
+    .defaultSetting = "",
+    .description = strtext("Translate input files in parallel batches (0 for one job per processor).")
+  },
 END_OPTION_TABLE
 
+static unsigned int jobCount;
+
 static TextTable *inputTable;
 static TextTable *outputTable;
 
@@ -107,15 +120,52 @@ toCharacter_unicode (unsigned char dots) {
 }
 
 static int
-writeCharacter (const wchar_t *character, mbstate_t *state) {
+writeCharacter (FILE *stream, const wchar_t *character, mbstate_t *state) {
   char bytes[0X1000];
   size_t result = wcrtomb(bytes, (character? *character: WC_C('\0')), state);
 
   if (result == (size_t)-1) return 0;
   if (!character) result -= 1;
 
-  fwrite(bytes, 1, result, outputStream);
-  return !ferror(outputStream);
+  fwrite(bytes, 1, result, stream);
+  return !ferror(stream);
+}
+
+typedef enum {
+  TRANSLATION_DONE,
+  TRANSLATION_INPUT_ERROR,
+  TRANSLATION_OUTPUT_ERROR
+} TranslationResult;
+
+static TranslationResult
+translateBytes (
+  const char *byte, size_t count,
+  mbstate_t *inputState, mbstate_t *outputState, FILE *stream
+) {
+  while (count) {
+    wchar_t character;
+
+    {
+      size_t result = mbrtowc(&character, byte, count, inputState);
+
+      if (result == (size_t)-2) break;
+      if (result == (size_t)-1) return TRANSLATION_INPUT_ERROR;
+      if (!result) result = 1;
+
+      byte += result;
+      count -= result;
+    }
+
+    if (!iswcntrl(character)) {
+      unsigned char dots = toDots(character);
+      if (opt_sixDots) dots &= ~(BRL_DOT7 | BRL_DOT8);
+      character = toCharacter(dots);
+    }
+
+    if (!writeCharacter(stream, &character, outputState)) return TRANSLATION_OUTPUT_ERROR;
+  }
+
+  return TRANSLATION_DONE;
 }
 
 static int
@@ -133,37 +183,60 @@ processStream (FILE *inputStream, const char *inputName) {
     if (ferror(inputStream)) goto inputError;
     if (!inputCount) break;
 
-    {
-      char *byte = inputBuffer;
+    switch (translateBytes(inputBuffer, inputCount, &inputState, &outputState, outputStream)) {
+      case TRANSLATION_INPUT_ERROR:
+        goto inputError;
 
-      while (inputCount) {
-        wchar_t character;
+      case TRANSLATION_OUTPUT_ERROR:
+        goto outputError;
 
-        {
-          size_t result = mbrtowc(&character, byte, inputCount, &inputState);
+      default:
+        break;
+    }
+  }
 
-          if (result == (size_t)-2) break;
-          if (result == (size_t)-1) goto inputError;
-          if (!result) result = 1;
+  if (!writeCharacter(outputStream, NULL, &outputState)) goto outputError;
+  fflush(outputStream);
+  if (ferror(outputStream)) goto outputError;
 
-          byte += result;
-          inputCount -= result;
-        }
+  if (!mbsinit(&inputState)) {
+    errno = EILSEQ;
+    goto inputError;
+  }
 
-        if (!iswcntrl(character)) {
-          unsigned char dots = toDots(character);
-          if (opt_sixDots) dots &= ~(BRL_DOT7 | BRL_DOT8);
-          character = toCharacter(dots);
-        }
+  return 1;
 
-        if (!writeCharacter(&character, &outputState)) goto outputError;
-      }
-    }
+inputError:
+  logMessage(LOG_ERR, "input error: %s: %s", inputName, strerror(errno));
+  return 0;
+
+outputError:
+  logMessage(LOG_ERR, "output error: %s: %s", outputName, strerror(errno));
+  return 0;
+}
+
+static int
+translateChunk (const char *bytes, size_t count, int first, FILE *stream, void *worker) {
+  const char *inputName = worker;
+  mbstate_t inputState;
+  mbstate_t outputState;
+
+  /* chunks end at line boundaries so each one starts in the initial state */
+  memset(&inputState, 0, sizeof(inputState));
+  memset(&outputState, 0, sizeof(outputState));
+
+  switch (translateBytes(bytes, count, &inputState, &outputState, stream)) {
+    case TRANSLATION_INPUT_ERROR:
+      goto inputError;
+
+    case TRANSLATION_OUTPUT_ERROR:
+      goto outputError;
+
+    default:
+      break;
   }
 
-  if (!writeCharacter(NULL, &outputState)) goto outputError;
-  fflush(outputStream);
-  if (ferror(outputStream)) goto outputError;
+  if (!writeCharacter(stream, NULL, &outputState)) goto outputError;
 
   if (!mbsinit(&inputState)) {
     errno = EILSEQ;
@@ -181,6 +254,25 @@ outputError:
   return 0;
 }
 
+static int
+processFile (const char *path, unsigned int jobCount) {
+  /* Each character is translated on its own, so the workers need no
+   * state of their own - just their input file's name for messages.
+   */
+  void *workers[jobCount];
+  unsigned int index;
+
+  const BatchDescriptor descriptor = {
+    .processChunk = translateChunk,
+    .workers = workers,
+    .workerCount = jobCount,
+    .splitAtLines = 1
+  };
+
+  for (index=0; index<jobCount; index+=1) workers[index] = (void *)path;
+  return processFileInBatches(&descriptor, path, outputStream);
+}
+
 static int
 getTable (TextTable **table, const char *directory, const char *name) {
   *table = NULL;
@@ -223,6 +315,18 @@ main (int argc, char *argv[]) {
     PROCESS_OPTIONS(descriptor, argc, argv);
   }
 
+  if (*opt_jobCount) {
+    static const int minimum = 0;
+    int count;
+
+    if (!validateInteger(&count, opt_jobCount, &minimum, NULL)) {
+      logMessage(LOG_ERR, "%s: %s", "invalid job count", opt_jobCount);
+      return PROG_EXIT_SYNTAX;
+    }
+
+    jobCount = count? count: getProcessorCount();
+  }
+
   {
     char **const paths[] = {
       &opt_tablesDirectory,
@@ -239,6 +343,12 @@ main (int argc, char *argv[]) {
       toDots = inputTable? toDots_mapped: toDots_unicode;
       toCharacter = outputTable? toCharacter_mapped: toCharacter_unicode;
 
+      /* Build the table's Latin-1 cache before any workers share it. Its hot
+       * character entries are single self-checking words, so concurrent
+       * lookups may safely refill them.
+       */
+      if (inputTable) convertCharacterToDots(inputTable, WC_C(' '));
+
       if (argc) {
         do {
           const char *file = argv[0];
@@ -246,6 +356,8 @@ main (int argc, char *argv[]) {
 
           if (strcmp(file, standardStreamArgument) == 0) {
             if (!processStream(stdin, standardInputName)) break;
+          } else if (jobCount) {
+            if (!processFile(file, jobCount)) break;
           } else if ((stream = fopen(file, "r"))) {
             int ok = processStream(stream, file);
             fclose(stream);
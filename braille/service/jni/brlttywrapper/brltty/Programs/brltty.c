@@ -49,6 +49,7 @@
 #include "atb.h"
 #include "ctb.h"
 #include "routing.h"
+#include "replay.h"
 #include "clipboard.h"
 #include "touch.h"
 #include "cmd.h"
@@ -169,6 +170,11 @@ handleTerminationRequest (int signalNumber) {
 }
 #endif /* HAVE_SIGNAL_H */
 
+void
+requestTermination (void) {
+  if (!terminationCount) terminationCount = 1;
+}
+
 
 static void
 checkRoutingStatus (RoutingStatus ok, int wait) {
@@ -814,13 +820,12 @@ trackSpeech (int index) {
 }
 
 static void
-sayWideCharacters (const wchar_t *characters, const unsigned char *attributes, size_t count, int immediate) {
+sayWideCharacters (SpeechClass class, const wchar_t *characters, const unsigned char *attributes, size_t count, SpeechMode mode) {
   size_t length;
   char *text = makeUtf8FromWchars(characters, count, &length);
 
   if (text) {
-    if (immediate) speech->mute(&spk);
-    speech->say(&spk, text, length, count, attributes);
+    scheduleSpeech(&spk, class, mode, (unsigned char *)text, length, count, attributes);
     free(text);
   } else {
     logMallocError();
@@ -828,7 +833,7 @@ sayWideCharacters (const wchar_t *characters, const unsigned char *attributes, s
 }
 
 static void
-sayScreenCharacters (const ScreenCharacter *characters, size_t count, int immediate) {
+sayScreenCharacters (SpeechClass class, const ScreenCharacter *characters, size_t count, SpeechMode mode) {
   wchar_t text[count];
   wchar_t *t = text;
 
@@ -845,7 +850,7 @@ sayScreenCharacters (const ScreenCharacter *characters, size_t count, int immedi
     }
   }
 
-  sayWideCharacters(text, attributes, count, immediate);
+  sayWideCharacters(class, text, attributes, count, mode);
 }
 
 static void
@@ -854,7 +859,8 @@ sayScreenRegion (int left, int top, int width, int height, int track, SayMode mo
   ScreenCharacter characters[count];
 
   readScreen(left, top, width, height, characters);
-  sayScreenCharacters(characters, count, mode==sayImmediate);
+  sayScreenCharacters(SPK_CLASS_SCREEN, characters, count,
+                      (mode == sayImmediate)? SPK_MODE_IMMEDIATE: SPK_MODE_APPEND);
 
   speechTracking = track;
   speechScreen = scr.number;
@@ -910,20 +916,20 @@ isAllSpaceCharacters (const ScreenCharacter *characters, int count) {
 
 static void
 speakCharacters (const ScreenCharacter *characters, size_t count, int spell) {
-  int immediate = 1;
+  SpeechMode mode = SPK_MODE_IMMEDIATE;
 
   if (isAllSpaceCharacters(characters, count)) {
     switch (prefs.whitespaceIndicator) {
       default:
       case wsNone:
-        if (immediate) speech->mute(&spk);
+        if (mode == SPK_MODE_IMMEDIATE) muteSpeech(&spk);
         break;
 
       case wsSaySpace: {
         wchar_t buffer[0X100];
         size_t length = convertTextToWchars(buffer, gettext("space"), ARRAY_COUNT(buffer));
 
-        sayWideCharacters(buffer, NULL, length, immediate);
+        sayWideCharacters(SPK_CLASS_CHARACTER, buffer, NULL, length, mode);
         break;
       }
     }
@@ -973,11 +979,16 @@ speakCharacters (const ScreenCharacter *characters, size_t count, int spell) {
       size_t length = convertTextToWchars(buffer, prefix, ARRAY_COUNT(buffer));
       buffer[length++] = WC_C(' ');
       buffer[length++] = character;
-      sayWideCharacters(buffer, NULL, length, immediate);
+      sayWideCharacters(SPK_CLASS_CHARACTER, buffer, NULL, length, mode);
     } else {
-      sayWideCharacters(&character, NULL, 1, immediate);
+      sayWideCharacters(SPK_CLASS_CHARACTER, &character, NULL, 1, mode);
     }
 
+    /* it must be given to the driver, even if it's still speaking,
+     * before the pitch and punctuation are restored
+     */
+    if (restorePitch || restorePunctuation) flushSpeechQueue(&spk);
+
     if (restorePunctuation) speech->setPunctuation(&spk, prefs.speechPunctuation);
     if (restorePitch) speech->setPitch(&spk, prefs.speechPitch);
   } else if (spell) {
@@ -991,9 +1002,9 @@ speakCharacters (const ScreenCharacter *characters, size_t count, int spell) {
     }
 
     string[length] = WC_C('\0');
-    sayWideCharacters(string, NULL, length, immediate);
+    sayWideCharacters(SPK_CLASS_CHARACTER, string, NULL, length, mode);
   } else {
-    sayScreenCharacters(characters, count, immediate);
+    sayScreenCharacters(SPK_CLASS_CHARACTER, characters, count, mode);
   }
 }
 
@@ -1895,7 +1906,11 @@ brlttyCommand (void) {
 
   int command;
 
-  command = restartRequired? BRL_CMD_RESTARTBRL: readBrailleCommand(&brl, getScreenCommandContext());
+  if (restartRequired) {
+    command = BRL_CMD_RESTARTBRL;
+  } else if ((command = readBrailleCommand(&brl, getScreenCommandContext())) != EOF) {
+    recordSessionCommand(command);
+  }
 
   if (brl.highlightWindow) {
     brl.highlightWindow = 0;
@@ -2623,7 +2638,7 @@ doCommand:
         break;
 
       case BRL_CMD_MUTE:
-        speech->mute(&spk);
+        muteSpeech(&spk);
         break;
 
       case BRL_CMD_SAY_LINE:
@@ -3383,6 +3398,7 @@ brlttyUpdate (void) {
 
   if (!isSuspended) {
     int pointerMoved = 0;
+    TimeValue updateTime;
 
 #ifdef ENABLE_API
     int claimed = apiStarted && api_claimDriver(&brl);
@@ -3398,8 +3414,23 @@ brlttyUpdate (void) {
     /* some commands (key insertion, virtual terminal switching, etc)
      * may have moved the cursor
      */
+    getMonotonicTime(&updateTime);
     updateSessionAttributes();
 
+    {
+      static int oldx = -1;
+      static int oldy = -1;
+
+      /* let the routing thread see cursor motion as soon as we do */
+      if ((scr.posx != oldx) || (scr.posy != oldy)) {
+        oldx = scr.posx;
+        oldy = scr.posy;
+        routingScreenUpdated();
+      }
+    }
+
+    recordSessionUpdate(brl.textColumns, brl.textRows);
+
     /*
      * Update blink counters: 
      */
@@ -3412,7 +3443,7 @@ brlttyUpdate (void) {
     /* called continually even if we're not tracking so that the pipe doesn't fill up. */
     speech->doTrack(&spk);
 
-    if (speechTracking && !speech->isSpeaking(&spk)) speechTracking = 0;
+    if (speechTracking && !speech->isSpeaking(&spk) && !getSpeechQueueDepth()) speechTracking = 0;
 #endif /* ENABLE_SPEECH_SUPPORT */
 
     if (ses->trackCursor) {
@@ -3689,6 +3720,7 @@ brlttyUpdate (void) {
 
             int outputLength = textLength;
             unsigned char outputBuffer[outputLength];
+            TimeValue contractionTime;
 
             readScreen(ses->winx, ses->winy, inputLength, 1, inputCharacters);
 
@@ -3699,10 +3731,12 @@ brlttyUpdate (void) {
               }
             }
 
+            getMonotonicTime(&contractionTime);
             contractText(contractionTable,
                          inputText, &inputLength,
                          outputBuffer, &outputLength,
                          contractedOffsets, getContractedCursor());
+            addLatencySince(LATENCY_CONTRACTION, &contractionTime);
 
             {
               int inputEnd = inputLength;
@@ -3845,14 +3879,18 @@ brlttyUpdate (void) {
               int column;
 
               for (column=0; column<textCount; column+=1) {
-                const ScreenCharacter *character = &source[column];
-                unsigned char *dots = &target[column];
+                text[column] = source[column].text;
+              }
+
+              convertTextToDots(textTable, text, textCount, target);
 
-                *dots = convertCharacterToDots(textTable, character->text);
-                if (prefs.textStyle) *dots &= ~(BRL_DOT7 | BRL_DOT8);
-                if (underline) overlayAttributesUnderline(dots, character->attributes);
+              if (prefs.textStyle || underline) {
+                for (column=0; column<textCount; column+=1) {
+                  unsigned char *dots = &target[column];
 
-                text[column] = character->text;
+                  if (prefs.textStyle) *dots &= ~(BRL_DOT7 | BRL_DOT8);
+                  if (underline) overlayAttributesUnderline(dots, source[column].attributes);
+                }
               }
             }
           }
@@ -3888,7 +3926,9 @@ brlttyUpdate (void) {
           fillStatusSeparator(textBuffer, brl.buffer);
         }
 
-        if (!(writeStatusCells() && braille->writeWindow(&brl, textBuffer))) restartRequired = 1;
+        if (!(writeStatusCells() &&
+              writeBrailleWindow(&brl, braille, textBuffer,
+                                 LATENCY_SCREEN_WINDOW, &updateTime))) restartRequired = 1;
       }
     }
 
@@ -3913,9 +3953,11 @@ brlttyUpdate (void) {
 #endif /* ENABLE_API */
 
 #ifdef ENABLE_SPEECH_SUPPORT
+  processSpeechQueue(&spk);
   processSpeechInput(&spk);
 #endif /* ENABLE_SPEECH_SUPPORT */
 
+  addToCounter(COUNTER_UPDATES, 1);
   return 1;
 }
 
@@ -72,6 +72,9 @@ extern KeyTable *keyboardKeyTable;
 
 extern ProgramExitStatus brlttyStart (int argc, char *argv[]);
 
+/* Makes the main loop exit as it would on SIGTERM. Any thread may call it. */
+extern void requestTermination (void);
+
 extern void setPreferences (const Preferences *newPreferences);
 extern int loadPreferences (void);
 extern int savePreferences (void);
@@ -44,6 +44,8 @@
 #include "tunes.h"
 #include "message.h"
 #include "log.h"
+#include "iotrace.h"
+#include "replay.h"
 #include "file.h"
 #include "parse.h"
 #include "system.h"
@@ -90,6 +92,11 @@ static int opt_noDaemon;
 static int opt_standardError;
 static char *opt_logLevel;
 static char *opt_logFile;
+static char *opt_ioTraceFile;
+static char *opt_recordSession;
+static char *opt_replaySession;
+static char *opt_replaySocket;
+static int opt_replayRealTime;
 static int opt_bootParameters = 1;
 static int opt_environmentVariables;
 static char *opt_updateInterval;
@@ -490,6 +497,45 @@ BEGIN_OPTION_TABLE(programOptions)
     .description = strtext("Path to log file.")
   },
 
+  { .letter = 'o',
+    .word = "io-trace-file",
+    .flags = OPT_Hidden | OPT_Config | OPT_Environ,
+    .argument = strtext("file"),
+    .setting.string = &opt_ioTraceFile,
+    .description = strtext("Path to which the I/O trace is written on a crash or on SIGUSR2.")
+  },
+
+  { .letter = 'Z',
+    .word = "record-session",
+    .flags = OPT_Hidden,
+    .argument = strtext("file"),
+    .setting.string = &opt_recordSession,
+    .description = strtext("Path to which screen snapshots and commands are recorded.")
+  },
+
+  { .letter = 'Y',
+    .word = "replay-session",
+    .flags = OPT_Hidden,
+    .argument = strtext("file"),
+    .setting.string = &opt_replaySession,
+    .description = strtext("Path to a recorded session to replay, and then exit.")
+  },
+
+  { .letter = 'y',
+    .word = "replay-socket",
+    .flags = OPT_Hidden,
+    .argument = strtext("path"),
+    .setting.string = &opt_replaySocket,
+    .description = strtext("Path to the local socket of the Virtual braille driver for a replay.")
+  },
+
+  { .letter = 'z',
+    .word = "replay-real-time",
+    .flags = OPT_Hidden,
+    .setting.flag = &opt_replayRealTime,
+    .description = strtext("Replay at the recorded pace rather than at full speed.")
+  },
+
   { .letter = 'e',
     .word = "standard-error",
     .flags = OPT_Hidden,
@@ -1242,14 +1288,36 @@ startBrailleDriver (void) {
 
 static int tryBrailleDriver (void);
 
+/* Set while a braille driver is wanted but couldn't be started, i.e. while
+ * a retry is pending.
+ */
+static int brailleDriverRetrying = 0;
+
 static void
 retryBrailleDriver (void *data UNUSED) {
   if (!brailleDriver) tryBrailleDriver();
 }
 
+static void
+handleUsbHotplug (void *data UNUSED) {
+  /* A newly attached device is tried straight away rather than when the
+   * next retry is due. A new retry is scheduled if this attempt fails.
+   */
+  if (brailleDriverRetrying && !brailleDriver) {
+    logMessage(LOG_DEBUG, "USB device added: retrying braille driver");
+    asyncCancelAlarm(retryBrailleDriver, NULL);
+    tryBrailleDriver();
+  }
+}
+
 static int
 tryBrailleDriver (void) {
-  if (startBrailleDriver()) return 1;
+  if (startBrailleDriver()) {
+    brailleDriverRetrying = 0;
+    return 1;
+  }
+
+  brailleDriverRetrying = 1;
   asyncRelativeAlarm(5000, retryBrailleDriver, NULL);
   initializeBraille();
   ensureBrailleBuffer(&brl, LOG_DEBUG);
@@ -1258,6 +1326,11 @@ tryBrailleDriver (void) {
 
 static void
 stopBrailleDriver (void) {
+  if (brailleDriverRetrying) {
+    brailleDriverRetrying = 0;
+    asyncCancelAlarm(retryBrailleDriver, NULL);
+  }
+
   deactivateBrailleDriver();
   playTune(&tune_braille_off);
 }
@@ -1276,6 +1349,7 @@ exitBrailleDriver (void) {
     message(NULL, gettext("BRLTTY terminated"), MSG_NODELAY|MSG_SILENT);
   }
 
+  usbSetHotplugHandler(NULL, NULL);
   stopBrailleDriver();
 }
 
@@ -1419,7 +1493,7 @@ trySpeechDriver (void) {
 
 static void
 stopSpeechDriver (void) {
-  speech->mute(&spk);
+  muteSpeech(&spk);
   deactivateSpeechDriver();
 }
 
@@ -1830,6 +1904,8 @@ brlttyStart (int argc, char *argv[]) {
     closeSystemLog();
   }
 
+  if (*opt_ioTraceFile) setIoTraceFile(opt_ioTraceFile);
+
   {
     const char *oldPrefix = setLogPrefix(NULL);
     char banner[0X100];
@@ -2020,6 +2096,22 @@ brlttyStart (int argc, char *argv[]) {
   } else {
     tryScreenDriver();
   }
+
+  if (!opt_verify) {
+    if (*opt_recordSession) startSessionRecording(opt_recordSession);
+
+    if (*opt_replaySession) {
+      if (!*opt_replaySocket) {
+        logMessage(LOG_ERR, "replay socket not specified");
+        return PROG_EXIT_SYNTAX;
+      }
+
+      if (!startSessionReplay(opt_replaySession, opt_replaySocket,
+                              opt_replayRealTime? REPLAY_REAL_TIME: REPLAY_FULL_SPEED)) {
+        return PROG_EXIT_FATAL;
+      }
+    }
+  }
   
 #ifdef ENABLE_API
   apiStarted = 0;
@@ -2053,6 +2145,7 @@ brlttyStart (int argc, char *argv[]) {
     if (activateBrailleDriver(1)) deactivateBrailleDriver();
   } else {
     onProgramExit(exitBrailleDriver);
+    usbSetHotplugHandler(handleUsbHotplug, NULL);
     tryBrailleDriver();
   }
 
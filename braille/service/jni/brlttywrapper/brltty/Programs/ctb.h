@@ -26,9 +26,36 @@ extern "C" {
 #endif /* __cplusplus */
 
 typedef struct ContractionTableStruct ContractionTable;
+typedef struct ContractionContextStruct ContractionContext;
+
+typedef struct {
+  unsigned char capitalizationMode;
+  unsigned char expandCurrentWord;
+} ContractionOptions;
 
 extern ContractionTable *compileContractionTable (const char *fileName);
 extern void destroyContractionTable (ContractionTable *table);
+extern int isExternalContractionTable (const ContractionTable *table);
+
+/* A context holds a table's translation caches. Contractions which use
+ * different contexts may run concurrently, even on the same table, as long as
+ * it isn't an external one.
+ */
+extern ContractionContext *newContractionContext (ContractionTable *table);
+extern void destroyContractionContext (ContractionContext *context);
+
+extern void contractTextWithContext (
+  ContractionContext *context,
+  const ContractionOptions *options,
+  const wchar_t *inputBuffer,
+  int *inputLength,
+  unsigned char *outputBuffer,
+  int *outputLength,
+  int *offsetsMap,
+  int cursorOffset
+);
+
+/* Uses the table's own context and the global preferences. */
 extern void contractText (
   ContractionTable *contractionTable, /* Pointer to translation table */
   const wchar_t *inputBuffer, /* What is to be translated */
@@ -174,6 +174,195 @@ saveCharacterTable (ContractionTableData *ctd) {
   return 1;
 }
 
+typedef struct RuleTrieNodeStruct RuleTrieNode;
+
+struct RuleTrieNodeStruct {
+  RuleTrieNode *branches;
+  RuleTrieNode *sibling;
+  wchar_t character;
+  unsigned int branchCount;
+
+  ContractionTableOffset *rules;
+  unsigned int ruleCount;
+  unsigned int ruleSize;
+};
+
+static wchar_t
+foldRuleCharacter (wchar_t character) {
+  /* the same lowercasing which is applied to the text being contracted */
+  return (iswalpha(character) && iswupper(character))? towlower(character): character;
+}
+
+static void
+deallocateRuleTrieNode (RuleTrieNode *node) {
+  while (node->branches) {
+    RuleTrieNode *branch = node->branches;
+    node->branches = branch->sibling;
+
+    deallocateRuleTrieNode(branch);
+    free(branch);
+  }
+
+  if (node->rules) free(node->rules);
+}
+
+static RuleTrieNode *
+getRuleTrieBranch (RuleTrieNode *node, wchar_t character) {
+  RuleTrieNode **branch = &node->branches;
+
+  while (*branch) {
+    if ((*branch)->character == character) return *branch;
+    if ((*branch)->character > character) break;
+    branch = &(*branch)->sibling;
+  }
+
+  {
+    RuleTrieNode *newBranch;
+
+    if (!(newBranch = malloc(sizeof(*newBranch)))) {
+      logMallocError();
+      return NULL;
+    }
+
+    memset(newBranch, 0, sizeof(*newBranch));
+    newBranch->character = character;
+
+    newBranch->sibling = *branch;
+    *branch = newBranch;
+    node->branchCount += 1;
+    return newBranch;
+  }
+}
+
+static int
+addRuleTrieRule (RuleTrieNode *node, ContractionTableOffset offset) {
+  if (node->ruleCount == node->ruleSize) {
+    unsigned int newSize = node->ruleSize? node->ruleSize<<1: 2;
+    ContractionTableOffset *newRules = realloc(node->rules, ARRAY_SIZE(newRules, newSize));
+
+    if (!newRules) {
+      logMallocError();
+      return 0;
+    }
+
+    node->rules = newRules;
+    node->ruleSize = newSize;
+  }
+
+  node->rules[node->ruleCount++] = offset;
+  return 1;
+}
+
+static int
+saveRuleTrieNode (ContractionTableData *ctd, const RuleTrieNode *node, ContractionTableOffset *offset) {
+  ContractionTableTrieNode ttn = {
+    .branchCount = node->branchCount,
+    .ruleCount = node->ruleCount
+  };
+
+  if (node->branchCount) {
+    ContractionTableTrieBranch branches[node->branchCount];
+    ContractionTableTrieBranch *branch = branches;
+    const RuleTrieNode *child = node->branches;
+    DataOffset branchesOffset;
+
+    while (child) {
+      branch->character = child->character;
+      if (!saveRuleTrieNode(ctd, child, &branch->node)) return 0;
+
+      branch += 1;
+      child = child->sibling;
+    }
+
+    if (!saveDataItem(ctd->area, &branchesOffset, branches, sizeof(branches), __alignof__(branches[0]))) return 0;
+    ttn.branches = branchesOffset;
+  }
+
+  if (node->ruleCount) {
+    DataOffset rulesOffset;
+
+    if (!saveDataItem(ctd->area, &rulesOffset, node->rules,
+                      ARRAY_SIZE(node->rules, node->ruleCount),
+                      __alignof__(node->rules[0])))
+      return 0;
+
+    ttn.rules = rulesOffset;
+  }
+
+  {
+    DataOffset nodeOffset;
+
+    if (!saveDataItem(ctd->area, &nodeOffset, &ttn, sizeof(ttn), __alignof__(ttn))) return 0;
+    *offset = nodeOffset;
+  }
+
+  return 1;
+}
+
+static int
+saveRuleTrie (ContractionTableData *ctd) {
+  /* The multi-character rules are indexed by their lowercased text so that
+   * selecting one only needs a single descent per position. Each node lists
+   * the rules which end there in the same order as their hash chain, and
+   * only rules which a lookup of their lowercased text would have reached
+   * through that chain are included.
+   */
+  RuleTrieNode root;
+  int ok = 1;
+  unsigned int hash;
+
+  memset(&root, 0, sizeof(root));
+
+  for (hash=0; hash<HASHNUM; hash+=1) {
+    ContractionTableOffset ruleOffset = getContractionTableHeader(ctd)->rules[hash];
+
+    while (ruleOffset) {
+      const ContractionTableRule *rule = getDataItem(ctd->area, ruleOffset);
+
+      if (rule->findlen > 1) {
+        wchar_t text[rule->findlen];
+        unsigned int index;
+
+        for (index=0; index<rule->findlen; index+=1) {
+          text[index] = foldRuleCharacter(rule->findrep[index]);
+        }
+
+        if (CTH(text) == hash) {
+          RuleTrieNode *node = &root;
+
+          for (index=0; index<rule->findlen; index+=1) {
+            if (!(node = getRuleTrieBranch(node, text[index]))) {
+              ok = 0;
+              goto done;
+            }
+          }
+
+          if (!addRuleTrieRule(node, ruleOffset)) {
+            ok = 0;
+            goto done;
+          }
+        }
+      }
+
+      ruleOffset = rule->next;
+    }
+  }
+
+  {
+    ContractionTableOffset offset;
+
+    if (saveRuleTrieNode(ctd, &root, &offset)) {
+      getContractionTableHeader(ctd)->ruleTrie = offset;
+    } else {
+      ok = 0;
+    }
+  }
+
+done:
+  deallocateRuleTrieNode(&root);
+  return ok;
+}
+
 static ContractionTableRule *
 addRule (
   DataFile *file,
@@ -672,23 +861,43 @@ stopContractionCommand (ContractionTable *table) {
   }
 }
 
-static void
-initializeCommonFields (ContractionTable *table) {
-  table->characters.array = NULL;
-  table->characters.size = 0;
-  table->characters.count = 0;
+void
+initializeContractionContext (ContractionContext *context, ContractionTable *table) {
+  memset(context, 0, sizeof(*context));
+  context->table = table;
+}
+
+void
+releaseContractionContext (ContractionContext *context) {
+  if (context->characters.array) {
+    free(context->characters.array);
+    context->characters.array = NULL;
+  }
+
+  if (context->cache.input.characters) {
+    free(context->cache.input.characters);
+    context->cache.input.characters = NULL;
+  }
 
-  table->cache.input.characters = NULL;
-  table->cache.input.size = 0;
-  table->cache.input.count = 0;
+  if (context->cache.output.cells) {
+    free(context->cache.output.cells);
+    context->cache.output.cells = NULL;
+  }
 
-  table->cache.output.cells = NULL;
-  table->cache.output.size = 0;
-  table->cache.output.count = 0;
+  if (context->cache.offsets.array) {
+    free(context->cache.offsets.array);
+    context->cache.offsets.array = NULL;
+  }
+
+  if (context->response.buffer) {
+    free(context->response.buffer);
+    context->response.buffer = NULL;
+  }
+}
 
-  table->cache.offsets.array = NULL;
-  table->cache.offsets.size = 0;
-  table->cache.offsets.count = 0;
+static void
+initializeCommonFields (ContractionTable *table) {
+  initializeContractionContext(&table->context, table);
 }
 
 ContractionTable *
@@ -720,6 +929,25 @@ compileContractionTable (const char *fileName) {
     return NULL;
   }
 
+  {
+    DataImage *image = loadDataImage(fileName, CONTRACTION_TABLE_IMAGE_TYPE, "");
+
+    if (image) {
+      if ((table = malloc(sizeof(*table)))) {
+        initializeCommonFields(table);
+        table->command = NULL;
+
+        table->data.internal.header.bytes = getDataImageContent(image, &table->data.internal.size);
+        table->data.internal.image = image;
+        return table;
+      } else {
+        logMallocError();
+      }
+
+      destroyDataImage(image);
+    }
+  }
+
   if (setGlobalTableVariables(CONTRACTION_TABLE_EXTENSION, CONTRACTION_SUBTABLE_EXTENSION)) {
     ContractionTableData ctd;
     memset(&ctd, 0, sizeof(ctd));
@@ -741,21 +969,29 @@ compileContractionTable (const char *fileName) {
     if ((ctd.area = newDataArea())) {
       if (allocateDataItem(ctd.area, NULL, sizeof(ContractionTableHeader), __alignof__(ContractionTableHeader))) {
         if (allocateCharacterClasses(&ctd)) {
+          beginDataImageSources();
+
           if (processDataFile(fileName, processContractionTableLine, &ctd)) {
-            if (saveCharacterTable(&ctd)) {
+            if (saveCharacterTable(&ctd) && saveRuleTrie(&ctd)) {
               if ((table = malloc(sizeof(*table)))) {
                 initializeCommonFields(table);
                 table->command = NULL;
 
                 table->data.internal.header.fields = getContractionTableHeader(&ctd);
                 table->data.internal.size = getDataSize(ctd.area);
+                table->data.internal.image = NULL;
                 resetDataArea(ctd.area);
+
+                saveDataImage(fileName, CONTRACTION_TABLE_IMAGE_TYPE, "",
+                              table->data.internal.header.bytes,
+                              table->data.internal.size);
               } else {
                 logMallocError();
               }
             }
           }
 
+          endDataImageSources();
           deallocateCharacterClasses(&ctd);
         }
       }
@@ -769,27 +1005,14 @@ compileContractionTable (const char *fileName) {
   return table;
 }
 
+int
+isExternalContractionTable (const ContractionTable *table) {
+  return table->command != NULL;
+}
+
 void
 destroyContractionTable (ContractionTable *table) {
-  if (table->characters.array) {
-    free(table->characters.array);
-    table->characters.array = NULL;
-  }
-
-  if (table->cache.input.characters) {
-    free(table->cache.input.characters);
-    table->cache.input.characters = NULL;
-  }
-
-  if (table->cache.output.cells) {
-    free(table->cache.output.cells);
-    table->cache.output.cells = NULL;
-  }
-
-  if (table->cache.offsets.array) {
-    free(table->cache.offsets.array);
-    table->cache.offsets.array = NULL;
-  }
+  releaseContractionContext(&table->context);
 
   if (table->command) {
     stopContractionCommand(table);
@@ -797,7 +1020,12 @@ destroyContractionTable (ContractionTable *table) {
     free(table);
   } else {
     if (table->data.internal.size) {
-      free(table->data.internal.header.fields);
+      if (table->data.internal.image) {
+        destroyDataImage(table->data.internal.image);
+      } else {
+        free(table->data.internal.header.fields);
+      }
+
       free(table);
     }
   }
@@ -21,12 +21,17 @@
 
 #include <stdio.h>
 
+#include "dataimage.h"
+#include "bitmask.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
 #define BYTE unsigned char
 
+#define CONTRACTION_LATIN1_CHARACTER_COUNT 0X100
+
 #define HASHNUM 1087
 #define CTH(x) (((x[0]<<8)+x[1])%HASHNUM)
 
@@ -110,8 +115,21 @@ typedef struct {
   ContractionTableOffset characters;
   uint32_t characterCount;
   ContractionTableOffset rules[HASHNUM]; /*locations of multi-character rules in table*/
+  ContractionTableOffset ruleTrie; /*multi-character rules indexed by their lowercased text*/
 } ContractionTableHeader;
 
+typedef struct {
+  wchar_t character;
+  ContractionTableOffset node;
+} ContractionTableTrieBranch;
+
+typedef struct {
+  ContractionTableOffset branches; /*sorted by character*/
+  ContractionTableOffset rules; /*the rules which end here, in priority order*/
+  uint32_t branchCount;
+  uint32_t ruleCount;
+} ContractionTableTrieNode;
+
 typedef struct {
   wchar_t value;
   wchar_t uppercase;
@@ -119,11 +137,16 @@ typedef struct {
   ContractionTableCharacterAttributes attributes;
 } CharacterEntry;
 
-struct ContractionTableStruct {
+struct ContractionContextStruct {
+  ContractionTable *table;
+
   struct {
     CharacterEntry *array;
     int size;
     int count;
+
+    CharacterEntry latin1[CONTRACTION_LATIN1_CHARACTER_COUNT];
+    BITMASK(latin1Defined, CONTRACTION_LATIN1_CHARACTER_COUNT, char);
   } characters;
 
   struct {
@@ -152,6 +175,14 @@ struct ContractionTableStruct {
     unsigned char capitalizationMode;
   } cache;
 
+  struct {
+    char *buffer;
+    size_t size;
+  } response;
+};
+
+struct ContractionTableStruct {
+  ContractionContext context;
   char *command;
 
   union {
@@ -162,6 +193,7 @@ struct ContractionTableStruct {
       } header;
 
       size_t size;
+      DataImage *image;
     } internal;
 
     struct {
@@ -172,6 +204,11 @@ struct ContractionTableStruct {
   } data;
 };
 
+#define CONTRACTION_TABLE_IMAGE_TYPE "ctb-2"
+
+extern void initializeContractionContext (ContractionContext *context, ContractionTable *table);
+extern void releaseContractionContext (ContractionContext *context);
+
 extern int startContractionCommand (ContractionTable *table);
 extern void stopContractionCommand (ContractionTable *table);
 
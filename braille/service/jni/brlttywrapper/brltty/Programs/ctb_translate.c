@@ -37,47 +37,52 @@
 #include "file.h"
 #include "parse.h"
 
-static ContractionTable *table;
-static const wchar_t *src, *srcmin, *srcmax, *cursor;
-static BYTE *dest, *destmin, *destmax;
-static int *offsets;
+typedef struct {
+  ContractionContext *context;
+  ContractionTable *table;
+  const ContractionOptions *options;
+
+  const wchar_t *src, *srcmin, *srcmax, *cursor;
+  BYTE *dest, *destmin, *destmax;
+  int *offsets;
 
-static wchar_t before, after;	/*the characters before and after a string */
-static int currentFindLength;		/*length of current find string */
-static ContractionTableOpcode currentOpcode;
-static ContractionTableOpcode previousOpcode;
-static const ContractionTableRule *currentRule;	/*pointer to current rule in table */
+  wchar_t before, after;	/*the characters before and after a string */
+  int currentFindLength;		/*length of current find string */
+  ContractionTableOpcode currentOpcode;
+  ContractionTableOpcode previousOpcode;
+  const ContractionTableRule *currentRule;	/*pointer to current rule in table */
+} BrailleContractionData;
 
 static inline void
-assignOffset (size_t value) {
-  if (offsets) offsets[src - srcmin] = value;
+assignOffset (BrailleContractionData *bcd, size_t value) {
+  if (bcd->offsets) bcd->offsets[bcd->src - bcd->srcmin] = value;
 }
 
 static inline void
-setOffset (void) {
-  assignOffset(dest - destmin);
+setOffset (BrailleContractionData *bcd) {
+  assignOffset(bcd, bcd->dest - bcd->destmin);
 }
 
 static inline void
-clearOffset (void) {
-  assignOffset(CTB_NO_OFFSET);
+clearOffset (BrailleContractionData *bcd) {
+  assignOffset(bcd, CTB_NO_OFFSET);
 }
 
 static inline ContractionTableHeader *
-getContractionTableHeader (void) {
-  return table->data.internal.header.fields;
+getContractionTableHeader (BrailleContractionData *bcd) {
+  return bcd->table->data.internal.header.fields;
 }
 
 static inline const void *
-getContractionTableItem (ContractionTableOffset offset) {
-  return &table->data.internal.header.bytes[offset];
+getContractionTableItem (BrailleContractionData *bcd, ContractionTableOffset offset) {
+  return &bcd->table->data.internal.header.bytes[offset];
 }
 
 static const ContractionTableCharacter *
-getContractionTableCharacter (wchar_t character) {
-  const ContractionTableCharacter *characters = getContractionTableItem(getContractionTableHeader()->characters);
+getContractionTableCharacter (BrailleContractionData *bcd, wchar_t character) {
+  const ContractionTableCharacter *characters = getContractionTableItem(bcd, getContractionTableHeader(bcd)->characters);
   int first = 0;
-  int last = getContractionTableHeader()->characterCount - 1;
+  int last = getContractionTableHeader(bcd)->characterCount - 1;
 
   while (first <= last) {
     int current = (first + last) / 2;
@@ -95,14 +100,58 @@ getContractionTableCharacter (wchar_t character) {
   return NULL;
 }
 
+static void
+initializeCharacterEntry (BrailleContractionData *bcd, CharacterEntry *entry, wchar_t character) {
+  memset(entry, 0, sizeof(*entry));
+  entry->value = entry->uppercase = entry->lowercase = character;
+
+  if (iswspace(character)) {
+    entry->attributes |= CTC_Space;
+  } else if (iswalpha(character)) {
+    entry->attributes |= CTC_Letter;
+
+    if (iswupper(character)) {
+      entry->attributes |= CTC_UpperCase;
+      entry->lowercase = towlower(character);
+    }
+
+    if (iswlower(character)) {
+      entry->attributes |= CTC_LowerCase;
+      entry->uppercase = towupper(character);
+    }
+  } else if (iswdigit(character)) {
+    entry->attributes |= CTC_Digit;
+  } else if (iswpunct(character)) {
+    entry->attributes |= CTC_Punctuation;
+  }
+
+  if (!bcd->table->command) {
+    const ContractionTableCharacter *ctc = getContractionTableCharacter(bcd, character);
+    if (ctc) entry->attributes |= ctc->attributes;
+  }
+}
+
 static CharacterEntry *
-getCharacterEntry (wchar_t character) {
+getCharacterEntry (BrailleContractionData *bcd, wchar_t character) {
   int first = 0;
-  int last = table->characters.count - 1;
+  int last;
+
+  if ((character >= 0) && (character < CONTRACTION_LATIN1_CHARACTER_COUNT)) {
+    CharacterEntry *entry = &bcd->context->characters.latin1[character];
+
+    if (!BITMASK_TEST(bcd->context->characters.latin1Defined, character)) {
+      initializeCharacterEntry(bcd, entry, character);
+      BITMASK_SET(bcd->context->characters.latin1Defined, character);
+    }
+
+    return entry;
+  }
+
+  last = bcd->context->characters.count - 1;
 
   while (first <= last) {
     int current = (first + last) / 2;
-    CharacterEntry *entry = &table->characters.array[current];
+    CharacterEntry *entry = &bcd->context->characters.array[current];
 
     if (entry->value < character) {
       first = current + 1;
@@ -113,103 +162,76 @@ getCharacterEntry (wchar_t character) {
     }
   }
 
-  if (table->characters.count == table->characters.size) {
-    int newSize = table->characters.size;
+  if (bcd->context->characters.count == bcd->context->characters.size) {
+    int newSize = bcd->context->characters.size;
     newSize = newSize? newSize<<1: 0X80;
 
     {
-      CharacterEntry *newArray = realloc(table->characters.array, (newSize * sizeof(*newArray)));
+      CharacterEntry *newArray = realloc(bcd->context->characters.array, (newSize * sizeof(*newArray)));
 
       if (!newArray) {
         logMallocError();
         return NULL;
       }
 
-      table->characters.array = newArray;
-      table->characters.size = newSize;
+      bcd->context->characters.array = newArray;
+      bcd->context->characters.size = newSize;
     }
   }
 
-  memmove(&table->characters.array[first+1],
-          &table->characters.array[first],
-          (table->characters.count - first) * sizeof(*table->characters.array));
-  table->characters.count += 1;
+  memmove(&bcd->context->characters.array[first+1],
+          &bcd->context->characters.array[first],
+          (bcd->context->characters.count - first) * sizeof(*bcd->context->characters.array));
+  bcd->context->characters.count += 1;
 
   {
-    CharacterEntry *entry = &table->characters.array[first];
-    memset(entry, 0, sizeof(*entry));
-    entry->value = entry->uppercase = entry->lowercase = character;
-
-    if (iswspace(character)) {
-      entry->attributes |= CTC_Space;
-    } else if (iswalpha(character)) {
-      entry->attributes |= CTC_Letter;
-
-      if (iswupper(character)) {
-        entry->attributes |= CTC_UpperCase;
-        entry->lowercase = towlower(character);
-      }
-
-      if (iswlower(character)) {
-        entry->attributes |= CTC_LowerCase;
-        entry->uppercase = towupper(character);
-      }
-    } else if (iswdigit(character)) {
-      entry->attributes |= CTC_Digit;
-    } else if (iswpunct(character)) {
-      entry->attributes |= CTC_Punctuation;
-    }
-
-    if (!table->command) {
-      const ContractionTableCharacter *ctc = getContractionTableCharacter(character);
-      if (ctc) entry->attributes |= ctc->attributes;
-    }
-
+    CharacterEntry *entry = &bcd->context->characters.array[first];
+    initializeCharacterEntry(bcd, entry, character);
     return entry;
   }
 }
 
 static int
-testCharacter (wchar_t character, ContractionTableCharacterAttributes attributes) {
-  const CharacterEntry *entry = getCharacterEntry(character);
+testCharacter (BrailleContractionData *bcd, wchar_t character, ContractionTableCharacterAttributes attributes) {
+  const CharacterEntry *entry = getCharacterEntry(bcd, character);
   return entry && (attributes & entry->attributes);
 }
 
 static wchar_t
-toLowerCase (wchar_t character) {
-  const CharacterEntry *entry = getCharacterEntry(character);
+toLowerCase (BrailleContractionData *bcd, wchar_t character) {
+  const CharacterEntry *entry = getCharacterEntry(bcd, character);
   return entry? entry->lowercase: character;
 }
 
 static int
-checkCurrentRule (const wchar_t *source) {
-  const wchar_t *character = currentRule->findrep;
-  int count = currentFindLength;
+checkCurrentRule (BrailleContractionData *bcd, const wchar_t *source) {
+  const wchar_t *character = bcd->currentRule->findrep;
+  int count = bcd->currentFindLength;
 
   while (count) {
-    if (toLowerCase(*source) != toLowerCase(*character)) return 0;
+    if (toLowerCase(bcd, *source) != toLowerCase(bcd, *character)) return 0;
     --count, ++source, ++character;
   }
   return 1;
 }
 
 static void
-setBefore (void) {
-  before = (src == srcmin)? WC_C(' '): src[-1];
+setBefore (BrailleContractionData *bcd) {
+  bcd->before = (bcd->src == bcd->srcmin)? WC_C(' '): bcd->src[-1];
 }
 
 static void
-setAfter (int length) {
-  after = (src + length < srcmax)? src[length]: WC_C(' ');
+setAfter (BrailleContractionData *bcd, int length) {
+  bcd->after = (bcd->src + length < bcd->srcmax)? bcd->src[length]: WC_C(' ');
 }
 
 static int
-isBeginning (void) {
-  const wchar_t *ptr = src;
+isBeginning (BrailleContractionData *bcd) {
+  const wchar_t *ptr = bcd->src;
 
-  while (ptr > srcmin) {
-    if (!testCharacter(*--ptr, CTC_Punctuation)) {
-      if (!testCharacter(*ptr, CTC_Space)) return 0;
+  while (ptr > bcd->srcmin) {
+    if (!testCharacter(bcd, *--ptr, CTC_Punctuation)) {
+      if (!testCharacter(bcd, *ptr, CTC_Space)) return 0;
       break;
     }
   }
@@ -218,12 +240,12 @@ isBeginning (void) {
 }
 
 static int
-isEnding (void) {
-  const wchar_t *ptr = src + currentFindLength;
+isEnding (BrailleContractionData *bcd) {
+  const wchar_t *ptr = bcd->src + bcd->currentFindLength;
 
-  while (ptr < srcmax) {
-    if (!testCharacter(*ptr, CTC_Punctuation)) {
-      if (!testCharacter(*ptr, CTC_Space)) return 0;
+  while (ptr < bcd->srcmax) {
+    if (!testCharacter(bcd, *ptr, CTC_Punctuation)) {
+      if (!testCharacter(bcd, *ptr, CTC_Space)) return 0;
       break;
     }
 
@@ -234,234 +256,280 @@ isEnding (void) {
 }
 
 static int
-selectRule (int length) {
-  int ruleOffset;
-  int maximumLength;
+testRule (BrailleContractionData *bcd, const ContractionTableRule *rule, int *maximumLength) {
+  bcd->currentRule = rule;
+  bcd->currentOpcode = bcd->currentRule->opcode;
+  bcd->currentFindLength = bcd->currentRule->findlen;
 
-  if (length < 1) return 0;
-  if (length == 1) {
-    const ContractionTableCharacter *ctc = getContractionTableCharacter(toLowerCase(*src));
-    if (!ctc) return 0;
-    ruleOffset = ctc->rules;
-    maximumLength = 1;
-  } else {
-    wchar_t characters[2];
-    characters[0] = toLowerCase(src[0]);
-    characters[1] = toLowerCase(src[1]);
-    ruleOffset = getContractionTableHeader()->rules[CTH(characters)];
-    maximumLength = 0;
-  }
+  setAfter(bcd, bcd->currentFindLength);
 
-  while (ruleOffset) {
-    currentRule = getContractionTableItem(ruleOffset);
-    currentOpcode = currentRule->opcode;
-    currentFindLength = currentRule->findlen;
+  if (!*maximumLength) {
+    *maximumLength = bcd->currentFindLength;
 
-    if ((length == 1) ||
-        ((currentFindLength <= length) &&
-         checkCurrentRule(src))) {
-      setAfter(currentFindLength);
+    if (bcd->options->capitalizationMode != CTB_CAP_NONE) {
+      typedef enum {CS_Any, CS_Lower, CS_UpperSingle, CS_UpperMultiple} CapitalizationState;
+#define STATE(c) (testCharacter(bcd, (c), CTC_UpperCase)? CS_UpperSingle: testCharacter(bcd, (c), CTC_LowerCase)? CS_Lower: CS_Any)
 
-      if (!maximumLength) {
-        maximumLength = currentFindLength;
+      CapitalizationState current = STATE(bcd->before);
+      int i;
 
-        if (prefs.capitalizationMode != CTB_CAP_NONE) {
-          typedef enum {CS_Any, CS_Lower, CS_UpperSingle, CS_UpperMultiple} CapitalizationState;
-#define STATE(c) (testCharacter((c), CTC_UpperCase)? CS_UpperSingle: testCharacter((c), CTC_LowerCase)? CS_Lower: CS_Any)
+      for (i=0; i<bcd->currentFindLength; i+=1) {
+        wchar_t character = bcd->src[i];
+        CapitalizationState next = STATE(character);
 
-          CapitalizationState current = STATE(before);
-          int i;
+        if (i > 0) {
+          if (((current == CS_Lower) && (next == CS_UpperSingle)) ||
+              ((current == CS_UpperMultiple) && (next == CS_Lower))) {
+            *maximumLength = i;
+            break;
+          }
 
-          for (i=0; i<currentFindLength; i+=1) {
-            wchar_t character = src[i];
-            CapitalizationState next = STATE(character);
+          if ((bcd->options->capitalizationMode != CTB_CAP_SIGN) &&
+              (next == CS_UpperSingle)) {
+            *maximumLength = i;
+            break;
+          }
+        }
 
-            if (i > 0) {
-              if (((current == CS_Lower) && (next == CS_UpperSingle)) ||
-                  ((current == CS_UpperMultiple) && (next == CS_Lower))) {
-                maximumLength = i;
-                break;
-              }
+        if ((bcd->options->capitalizationMode == CTB_CAP_SIGN) && (current > CS_Lower) && (next == CS_UpperSingle)) {
+          current = CS_UpperMultiple;
+        } else if (next != CS_Any) {
+          current = next;
+        } else if (current == CS_Any) {
+          current = CS_Lower;
+        }
+      }
 
-              if ((prefs.capitalizationMode != CTB_CAP_SIGN) &&
-                  (next == CS_UpperSingle)) {
-                maximumLength = i;
-                break;
-              }
-            }
+#undef STATE
+    }
+  }
 
-            if ((prefs.capitalizationMode == CTB_CAP_SIGN) && (current > CS_Lower) && (next == CS_UpperSingle)) {
-              current = CS_UpperMultiple;
-            } else if (next != CS_Any) {
-              current = next;
-            } else if (current == CS_Any) {
-              current = CS_Lower;
+  if ((bcd->currentFindLength <= *maximumLength) &&
+      (!bcd->currentRule->after || testCharacter(bcd, bcd->before, bcd->currentRule->after)) &&
+      (!bcd->currentRule->before || testCharacter(bcd, bcd->after, bcd->currentRule->before))) {
+    switch (bcd->currentOpcode) {
+      case CTO_Always:
+      case CTO_Repeatable:
+      case CTO_Literal:
+        return 1;
+
+      case CTO_LargeSign:
+      case CTO_LastLargeSign:
+        if (!isBeginning(bcd) || !isEnding(bcd)) bcd->currentOpcode = CTO_Always;
+        return 1;
+
+      case CTO_WholeWord:
+      case CTO_Contraction:
+        if (testCharacter(bcd, bcd->before, CTC_Space|CTC_Punctuation) &&
+            testCharacter(bcd, bcd->after, CTC_Space|CTC_Punctuation))
+          return 1;
+        break;
+
+      case CTO_LowWord:
+        if (testCharacter(bcd, bcd->before, CTC_Space) && testCharacter(bcd, bcd->after, CTC_Space) &&
+            (bcd->previousOpcode != CTO_JoinedWord) &&
+            ((bcd->dest == bcd->destmin) || !bcd->dest[-1]))
+          return 1;
+        break;
+
+      case CTO_JoinedWord:
+        if (testCharacter(bcd, bcd->before, CTC_Space|CTC_Punctuation) &&
+            (bcd->before != '-') &&
+            (bcd->dest + bcd->currentRule->replen < bcd->destmax)) {
+          const wchar_t *end = bcd->src + bcd->currentFindLength;
+          const wchar_t *ptr = end;
+
+          while (ptr < bcd->srcmax) {
+            if (!testCharacter(bcd, *ptr, CTC_Space)) {
+              if (!testCharacter(bcd, *ptr, CTC_Letter)) break;
+              if (ptr == end) break;
+              return 1;
             }
-          }
 
-#undef STATE
+            if (ptr++ == bcd->cursor) break;
+          }
         }
-      }
+        break;
 
-      if ((currentFindLength <= maximumLength) &&
-          (!currentRule->after || testCharacter(before, currentRule->after)) &&
-          (!currentRule->before || testCharacter(after, currentRule->before))) {
-        switch (currentOpcode) {
-          case CTO_Always:
-          case CTO_Repeatable:
-          case CTO_Literal:
-            return 1;
-
-          case CTO_LargeSign:
-          case CTO_LastLargeSign:
-            if (!isBeginning() || !isEnding()) currentOpcode = CTO_Always;
-            return 1;
-
-          case CTO_WholeWord:
-          case CTO_Contraction:
-            if (testCharacter(before, CTC_Space|CTC_Punctuation) &&
-                testCharacter(after, CTC_Space|CTC_Punctuation))
-              return 1;
-            break;
+      case CTO_SuffixableWord:
+        if (testCharacter(bcd, bcd->before, CTC_Space|CTC_Punctuation) &&
+            testCharacter(bcd, bcd->after, CTC_Space|CTC_Letter|CTC_Punctuation))
+          return 1;
+        break;
 
-          case CTO_LowWord:
-            if (testCharacter(before, CTC_Space) && testCharacter(after, CTC_Space) &&
-                (previousOpcode != CTO_JoinedWord) &&
-                ((dest == destmin) || !dest[-1]))
-              return 1;
-            break;
+      case CTO_PrefixableWord:
+        if (testCharacter(bcd, bcd->before, CTC_Space|CTC_Letter|CTC_Punctuation) &&
+            testCharacter(bcd, bcd->after, CTC_Space|CTC_Punctuation))
+          return 1;
+        break;
 
-          case CTO_JoinedWord:
-            if (testCharacter(before, CTC_Space|CTC_Punctuation) &&
-                (before != '-') &&
-                (dest + currentRule->replen < destmax)) {
-              const wchar_t *end = src + currentFindLength;
-              const wchar_t *ptr = end;
-
-              while (ptr < srcmax) {
-                if (!testCharacter(*ptr, CTC_Space)) {
-                  if (!testCharacter(*ptr, CTC_Letter)) break;
-                  if (ptr == end) break;
-                  return 1;
-                }
-
-                if (ptr++ == cursor) break;
-              }
-            }
-            break;
+      case CTO_BegWord:
+        if (testCharacter(bcd, bcd->before, CTC_Space|CTC_Punctuation) &&
+            testCharacter(bcd, bcd->after, CTC_Letter))
+          return 1;
+        break;
 
-          case CTO_SuffixableWord:
-            if (testCharacter(before, CTC_Space|CTC_Punctuation) &&
-                testCharacter(after, CTC_Space|CTC_Letter|CTC_Punctuation))
-              return 1;
-            break;
+      case CTO_BegMidWord:
+        if (testCharacter(bcd, bcd->before, CTC_Letter|CTC_Space|CTC_Punctuation) &&
+            testCharacter(bcd, bcd->after, CTC_Letter))
+          return 1;
+        break;
 
-          case CTO_PrefixableWord:
-            if (testCharacter(before, CTC_Space|CTC_Letter|CTC_Punctuation) &&
-                testCharacter(after, CTC_Space|CTC_Punctuation))
-              return 1;
-            break;
+      case CTO_MidWord:
+        if (testCharacter(bcd, bcd->before, CTC_Letter) && testCharacter(bcd, bcd->after, CTC_Letter))
+          return 1;
+        break;
 
-          case CTO_BegWord:
-            if (testCharacter(before, CTC_Space|CTC_Punctuation) &&
-                testCharacter(after, CTC_Letter))
-              return 1;
-            break;
+      case CTO_MidEndWord:
+        if (testCharacter(bcd, bcd->before, CTC_Letter) &&
+            testCharacter(bcd, bcd->after, CTC_Letter|CTC_Space|CTC_Punctuation))
+          return 1;
+        break;
 
-          case CTO_BegMidWord:
-            if (testCharacter(before, CTC_Letter|CTC_Space|CTC_Punctuation) &&
-                testCharacter(after, CTC_Letter))
-              return 1;
-            break;
+      case CTO_EndWord:
+        if (testCharacter(bcd, bcd->before, CTC_Letter) &&
+            testCharacter(bcd, bcd->after, CTC_Space|CTC_Punctuation))
+          return 1;
+        break;
 
-          case CTO_MidWord:
-            if (testCharacter(before, CTC_Letter) && testCharacter(after, CTC_Letter))
-              return 1;
-            break;
+      case CTO_BegNum:
+        if (testCharacter(bcd, bcd->before, CTC_Space|CTC_Punctuation) &&
+            testCharacter(bcd, bcd->after, CTC_Digit))
+          return 1;
+        break;
 
-          case CTO_MidEndWord:
-            if (testCharacter(before, CTC_Letter) &&
-                testCharacter(after, CTC_Letter|CTC_Space|CTC_Punctuation))
-              return 1;
-            break;
+      case CTO_MidNum:
+        if (testCharacter(bcd, bcd->before, CTC_Digit) && testCharacter(bcd, bcd->after, CTC_Digit))
+          return 1;
+        break;
 
-          case CTO_EndWord:
-            if (testCharacter(before, CTC_Letter) &&
-                testCharacter(after, CTC_Space|CTC_Punctuation))
-              return 1;
-            break;
+      case CTO_EndNum:
+        if (testCharacter(bcd, bcd->before, CTC_Digit) &&
+            testCharacter(bcd, bcd->after, CTC_Space|CTC_Punctuation))
+          return 1;
+        break;
 
-          case CTO_BegNum:
-            if (testCharacter(before, CTC_Space|CTC_Punctuation) &&
-                testCharacter(after, CTC_Digit))
-              return 1;
-            break;
+      case CTO_PrePunc:
+        if (testCharacter(bcd, *bcd->src, CTC_Punctuation) && isBeginning(bcd) && !isEnding(bcd)) return 1;
+        break;
 
-          case CTO_MidNum:
-            if (testCharacter(before, CTC_Digit) && testCharacter(after, CTC_Digit))
-              return 1;
-            break;
+      case CTO_PostPunc:
+        if (testCharacter(bcd, *bcd->src, CTC_Punctuation) && !isBeginning(bcd) && isEnding(bcd)) return 1;
+        break;
 
-          case CTO_EndNum:
-            if (testCharacter(before, CTC_Digit) &&
-                testCharacter(after, CTC_Space|CTC_Punctuation))
-              return 1;
-            break;
+      default:
+        break;
+    }
+  }
 
-          case CTO_PrePunc:
-            if (testCharacter(*src, CTC_Punctuation) && isBeginning() && !isEnding()) return 1;
-            break;
+  return 0;
+}
 
-          case CTO_PostPunc:
-            if (testCharacter(*src, CTC_Punctuation) && !isBeginning() && isEnding()) return 1;
-            break;
+static int
+selectRule (BrailleContractionData *bcd, int length) {
+  int maximumLength;
 
-          default:
+  if (length < 1) return 0;
+  if (length == 1) {
+    const ContractionTableCharacter *ctc = getContractionTableCharacter(bcd, toLowerCase(bcd, *bcd->src));
+    ContractionTableOffset ruleOffset;
+
+    if (!ctc) return 0;
+    ruleOffset = ctc->rules;
+    maximumLength = 1;
+
+    while (ruleOffset) {
+      const ContractionTableRule *rule = getContractionTableItem(bcd, ruleOffset);
+      if (testRule(bcd, rule, &maximumLength)) return 1;
+      ruleOffset = rule->next;
+    }
+  } else {
+    const ContractionTableTrieNode *nodes[0X100];
+    int depth = 0;
+
+    {
+      const ContractionTableTrieNode *node = getContractionTableItem(bcd, getContractionTableHeader(bcd)->ruleTrie);
+
+      if (length > ARRAY_COUNT(nodes)) length = ARRAY_COUNT(nodes);
+
+      while (depth < length) {
+        const ContractionTableTrieBranch *branches = getContractionTableItem(bcd, node->branches);
+        wchar_t character = toLowerCase(bcd, bcd->src[depth]);
+        int first = 0;
+        int last = node->branchCount - 1;
+
+        node = NULL;
+
+        while (first <= last) {
+          int current = (first + last) / 2;
+          const ContractionTableTrieBranch *branch = &branches[current];
+
+          if (branch->character < character) {
+            first = current + 1;
+          } else if (branch->character > character) {
+            last = current - 1;
+          } else {
+            node = getContractionTableItem(bcd, branch->node);
             break;
+          }
         }
+
+        if (!node) break;
+        nodes[depth++] = node;
       }
     }
 
-    ruleOffset = currentRule->next;
+    /* the longest matching rules have the highest priority */
+    maximumLength = 0;
+
+    while (depth > 1) {
+      const ContractionTableTrieNode *node = nodes[--depth];
+      const ContractionTableOffset *rules = getContractionTableItem(bcd, node->rules);
+      uint32_t index;
+
+      for (index=0; index<node->ruleCount; index+=1) {
+        if (testRule(bcd, getContractionTableItem(bcd, rules[index]), &maximumLength)) return 1;
+      }
+    }
   }
 
   return 0;
 }
 
 static int
-putCells (const BYTE *cells, int count) {
-  if (dest + count > destmax) return 0;
-  memcpy(dest, cells, count);
-  dest += count;
+putCells (BrailleContractionData *bcd, const BYTE *cells, int count) {
+  if (bcd->dest + count > bcd->destmax) return 0;
+  memcpy(bcd->dest, cells, count);
+  bcd->dest += count;
   return 1;
 }
 
 static int
-putCell (BYTE byte) {
-  return putCells(&byte, 1);
+putCell (BrailleContractionData *bcd, BYTE byte) {
+  return putCells(bcd, &byte, 1);
 }
 
 static int
-putReplace (const ContractionTableRule *rule, wchar_t character) {
+putReplace (BrailleContractionData *bcd, const ContractionTableRule *rule, wchar_t character) {
   const BYTE *cells = (BYTE *)&rule->findrep[rule->findlen];
   int count = rule->replen;
 
-  if ((prefs.capitalizationMode == CTB_CAP_DOT7) &&
-      testCharacter(character, CTC_UpperCase)) {
-    if (!putCell(*cells++ | BRL_DOT7)) return 0;
+  if ((bcd->options->capitalizationMode == CTB_CAP_DOT7) &&
+      testCharacter(bcd, character, CTC_UpperCase)) {
+    if (!putCell(bcd, *cells++ | BRL_DOT7)) return 0;
     if (!(count -= 1)) return 1;
   }
 
-  return putCells(cells, count);
+  return putCells(bcd, cells, count);
 }
 
 static const ContractionTableRule *
-getAlwaysRule (wchar_t character) {
-  const ContractionTableCharacter *ctc = getContractionTableCharacter(character);
+getAlwaysRule (BrailleContractionData *bcd, wchar_t character) {
+  const ContractionTableCharacter *ctc = getContractionTableCharacter(bcd, character);
   if (ctc) {
     ContractionTableOffset offset = ctc->always;
     if (offset) {
-      const ContractionTableRule *rule = getContractionTableItem(offset);
+      const ContractionTableRule *rule = getContractionTableItem(bcd, offset);
       if (rule->replen) return rule;
     }
   }
@@ -469,15 +537,16 @@ getAlwaysRule (wchar_t character) {
 }
 
 typedef struct {
+  BrailleContractionData *bcd;
   const ContractionTableRule *rule;
 } SetCharacterRuleData;
 
 static int
 setCharacterRule (wchar_t character, void *data) {
-  const ContractionTableRule *rule = getAlwaysRule(character);
+  SetCharacterRuleData *scr = data;
+  const ContractionTableRule *rule = getAlwaysRule(scr->bcd, character);
 
   if (rule) {
-    SetCharacterRuleData *scr = data;
     scr->rule = rule;
     return 1;
   }
@@ -486,14 +555,15 @@ setCharacterRule (wchar_t character, void *data) {
 }
 
 static int
-putCharacter (wchar_t character) {
+putCharacter (BrailleContractionData *bcd, wchar_t character) {
   {
     SetCharacterRuleData scr = {
+      .bcd = bcd,
       .rule = NULL
     };
 
     if (handleBestCharacter(character, setCharacterRule, &scr)) {
-      return putReplace(scr.rule, character);
+      return putReplace(bcd, scr.rule, character);
     }
   }
 
@@ -506,18 +576,18 @@ putCharacter (wchar_t character) {
 #endif /* HAVE_WCHAR_H */
 
     if (replacementCharacter != character) {
-      const ContractionTableRule *rule = getAlwaysRule(replacementCharacter);
-      if (rule) return putReplace(rule, character);
+      const ContractionTableRule *rule = getAlwaysRule(bcd, replacementCharacter);
+      if (rule) return putReplace(bcd, rule, character);
     }
   }
 
-  return putCell(BRL_DOT1 | BRL_DOT2 | BRL_DOT3 | BRL_DOT4 | BRL_DOT5 | BRL_DOT6 | BRL_DOT7 | BRL_DOT8);
+  return putCell(bcd, BRL_DOT1 | BRL_DOT2 | BRL_DOT3 | BRL_DOT4 | BRL_DOT5 | BRL_DOT6 | BRL_DOT7 | BRL_DOT8);
 }
 
 static int
-putSequence (ContractionTableOffset offset) {
-  const BYTE *sequence = getContractionTableItem(offset);
-  return putCells(sequence+1, *sequence);
+putSequence (BrailleContractionData *bcd, ContractionTableOffset offset) {
+  const BYTE *sequence = getContractionTableItem(bcd, offset);
+  return putCells(bcd, sequence+1, *sequence);
 }
 
 #ifdef HAVE_ICU
@@ -540,6 +610,7 @@ prepareLineBreakOpportunitiesState (LineBreakOpportunitiesState *lbo) {
 
 static void
 findLineBreakOpportunities (
+  BrailleContractionData *bcd,
   LineBreakOpportunitiesState *lbo,
   unsigned char *opportunities,
   const wchar_t *characters, unsigned int limit
@@ -939,12 +1010,13 @@ prepareLineBreakOpportunitiesState (LineBreakOpportunitiesState *lbo) {
 
 static void
 findLineBreakOpportunities (
+  BrailleContractionData *bcd,
   LineBreakOpportunitiesState *lbo,
   unsigned char *opportunities,
   const wchar_t *characters, unsigned int limit
 ) {
   while (lbo->index <= limit) {
-    int isSpace = testCharacter(characters[lbo->index], CTC_Space);
+    int isSpace = testCharacter(bcd, characters[lbo->index], CTC_Space);
     opportunities[lbo->index] = lbo->wasSpace && !isSpace;
 
     lbo->wasSpace = isSpace;
@@ -954,7 +1026,7 @@ findLineBreakOpportunities (
 #endif /* HAVE_ICU */
 
 static int
-contractTextInternally (void) {
+contractTextInternally (BrailleContractionData *bcd) {
   const wchar_t *srcword = NULL;
   BYTE *destword = NULL;
 
@@ -964,91 +1036,91 @@ contractTextInternally (void) {
   BYTE *destlast = NULL;
   const wchar_t *literal = NULL;
 
-  unsigned char lineBreakOpportunities[srcmax - srcmin];
+  unsigned char lineBreakOpportunities[bcd->srcmax - bcd->srcmin];
   LineBreakOpportunitiesState lbo;
 
   prepareLineBreakOpportunitiesState(&lbo);
-  previousOpcode = CTO_None;
+  bcd->previousOpcode = CTO_None;
 
-  while (src < srcmax) {
-    int wasLiteral = src == literal;
+  while (bcd->src < bcd->srcmax) {
+    int wasLiteral = bcd->src == literal;
 
-    destlast = dest;
-    setOffset();
-    setBefore();
+    destlast = bcd->dest;
+    setOffset(bcd);
+    setBefore(bcd);
 
     if (literal)
-      if (src >= literal)
-        if (testCharacter(*src, CTC_Space) || testCharacter(src[-1], CTC_Space))
+      if (bcd->src >= literal)
+        if (testCharacter(bcd, *bcd->src, CTC_Space) || testCharacter(bcd, bcd->src[-1], CTC_Space))
           literal = NULL;
 
-    if ((!literal && selectRule(srcmax-src)) || selectRule(1)) {
+    if ((!literal && selectRule(bcd, bcd->srcmax-bcd->src)) || selectRule(bcd, 1)) {
       if (!literal &&
-          ((currentOpcode == CTO_Literal) ||
-           (prefs.expandCurrentWord && (cursor >= src) && (cursor < (src + currentFindLength))))) {
-        literal = src + currentFindLength;
+          ((bcd->currentOpcode == CTO_Literal) ||
+           (bcd->options->expandCurrentWord && (bcd->cursor >= bcd->src) && (bcd->cursor < (bcd->src + bcd->currentFindLength))))) {
+        literal = bcd->src + bcd->currentFindLength;
 
-        if (!testCharacter(*src, CTC_Space)) {
+        if (!testCharacter(bcd, *bcd->src, CTC_Space)) {
           if (destjoin) {
-            src = srcjoin;
-            dest = destjoin;
+            bcd->src = srcjoin;
+            bcd->dest = destjoin;
           } else {
-            src = srcmin;
-            dest = destmin;
+            bcd->src = bcd->srcmin;
+            bcd->dest = bcd->destmin;
           }
         }
 
         continue;
       }
 
-      if (getContractionTableHeader()->numberSign && (previousOpcode != CTO_MidNum) &&
-          !testCharacter(before, CTC_Digit) && testCharacter(*src, CTC_Digit)) {
-        if (!putSequence(getContractionTableHeader()->numberSign)) break;
-      } else if (getContractionTableHeader()->englishLetterSign && testCharacter(*src, CTC_Letter)) {
-        if ((currentOpcode == CTO_Contraction) ||
-            ((currentOpcode != CTO_EndNum) && testCharacter(before, CTC_Digit)) ||
-            (testCharacter(*src, CTC_Letter) &&
-             (currentOpcode == CTO_Always) &&
-             (currentFindLength == 1) &&
-             testCharacter(before, CTC_Space) &&
-             (((src + 1) == srcmax) ||
-              testCharacter(src[1], CTC_Space) ||
-              (testCharacter(src[1], CTC_Punctuation) && (src[1] != '.') && (src[1] != '\''))))) {
-          if (!putSequence(getContractionTableHeader()->englishLetterSign)) break;
+      if (getContractionTableHeader(bcd)->numberSign && (bcd->previousOpcode != CTO_MidNum) &&
+          !testCharacter(bcd, bcd->before, CTC_Digit) && testCharacter(bcd, *bcd->src, CTC_Digit)) {
+        if (!putSequence(bcd, getContractionTableHeader(bcd)->numberSign)) break;
+      } else if (getContractionTableHeader(bcd)->englishLetterSign && testCharacter(bcd, *bcd->src, CTC_Letter)) {
+        if ((bcd->currentOpcode == CTO_Contraction) ||
+            ((bcd->currentOpcode != CTO_EndNum) && testCharacter(bcd, bcd->before, CTC_Digit)) ||
+            (testCharacter(bcd, *bcd->src, CTC_Letter) &&
+             (bcd->currentOpcode == CTO_Always) &&
+             (bcd->currentFindLength == 1) &&
+             testCharacter(bcd, bcd->before, CTC_Space) &&
+             (((bcd->src + 1) == bcd->srcmax) ||
+              testCharacter(bcd, bcd->src[1], CTC_Space) ||
+              (testCharacter(bcd, bcd->src[1], CTC_Punctuation) && (bcd->src[1] != '.') && (bcd->src[1] != '\''))))) {
+          if (!putSequence(bcd, getContractionTableHeader(bcd)->englishLetterSign)) break;
         }
       }
 
-      if (prefs.capitalizationMode == CTB_CAP_SIGN) {
-        if (testCharacter(*src, CTC_UpperCase)) {
-          if (!testCharacter(before, CTC_UpperCase)) {
-            if (getContractionTableHeader()->beginCapitalSign &&
-                (src + 1 < srcmax) && testCharacter(src[1], CTC_UpperCase)) {
-              if (!putSequence(getContractionTableHeader()->beginCapitalSign)) break;
-            } else if (getContractionTableHeader()->capitalSign) {
-              if (!putSequence(getContractionTableHeader()->capitalSign)) break;
+      if (bcd->options->capitalizationMode == CTB_CAP_SIGN) {
+        if (testCharacter(bcd, *bcd->src, CTC_UpperCase)) {
+          if (!testCharacter(bcd, bcd->before, CTC_UpperCase)) {
+            if (getContractionTableHeader(bcd)->beginCapitalSign &&
+                (bcd->src + 1 < bcd->srcmax) && testCharacter(bcd, bcd->src[1], CTC_UpperCase)) {
+              if (!putSequence(bcd, getContractionTableHeader(bcd)->beginCapitalSign)) break;
+            } else if (getContractionTableHeader(bcd)->capitalSign) {
+              if (!putSequence(bcd, getContractionTableHeader(bcd)->capitalSign)) break;
             }
           }
-        } else if (testCharacter(*src, CTC_LowerCase)) {
-          if (getContractionTableHeader()->endCapitalSign && (src - 2 >= srcmin) &&
-              testCharacter(src[-1], CTC_UpperCase) && testCharacter(src[-2], CTC_UpperCase)) {
-            if (!putSequence(getContractionTableHeader()->endCapitalSign)) break;
+        } else if (testCharacter(bcd, *bcd->src, CTC_LowerCase)) {
+          if (getContractionTableHeader(bcd)->endCapitalSign && (bcd->src - 2 >= bcd->srcmin) &&
+              testCharacter(bcd, bcd->src[-1], CTC_UpperCase) && testCharacter(bcd, bcd->src[-2], CTC_UpperCase)) {
+            if (!putSequence(bcd, getContractionTableHeader(bcd)->endCapitalSign)) break;
           }
         }
       }
 
-      switch (currentOpcode) {
+      switch (bcd->currentOpcode) {
         case CTO_LargeSign:
         case CTO_LastLargeSign:
-          if ((previousOpcode == CTO_LargeSign) && !wasLiteral) {
-            while ((dest > destmin) && !dest[-1]) dest -= 1;
-            setOffset();
+          if ((bcd->previousOpcode == CTO_LargeSign) && !wasLiteral) {
+            while ((bcd->dest > bcd->destmin) && !bcd->dest[-1]) bcd->dest -= 1;
+            setOffset(bcd);
 
             {
               BYTE **destptrs[] = {&destword, &destjoin, &destlast, NULL};
               BYTE ***destptr = destptrs;
 
               while (*destptr) {
-                if (**destptr && (**destptr > dest)) **destptr = dest;
+                if (**destptr && (**destptr > bcd->dest)) **destptr = bcd->dest;
                 destptr += 1;
               }
             }
@@ -1059,50 +1131,50 @@ contractTextInternally (void) {
           break;
       }
 
-      if (currentRule->replen &&
-          !((currentOpcode == CTO_Always) && (currentFindLength == 1))) {
-        const wchar_t *srcnxt = src + currentFindLength;
-        if (!putReplace(currentRule, *src)) goto done;
-        while (++src != srcnxt) clearOffset();
+      if (bcd->currentRule->replen &&
+          !((bcd->currentOpcode == CTO_Always) && (bcd->currentFindLength == 1))) {
+        const wchar_t *srcnxt = bcd->src + bcd->currentFindLength;
+        if (!putReplace(bcd, bcd->currentRule, *bcd->src)) goto done;
+        while (++bcd->src != srcnxt) clearOffset(bcd);
       } else {
-        const wchar_t *srclim = src + currentFindLength;
+        const wchar_t *srclim = bcd->src + bcd->currentFindLength;
         while (1) {
-          if (!putCharacter(*src)) goto done;
-          if (++src == srclim) break;
-          setOffset();
+          if (!putCharacter(bcd, *bcd->src)) goto done;
+          if (++bcd->src == srclim) break;
+          setOffset(bcd);
         }
       }
 
       {
-        const wchar_t *srcorig = src;
+        const wchar_t *srcorig = bcd->src;
         const wchar_t *srcbeg = NULL;
         BYTE *destbeg = NULL;
 
-        switch (currentOpcode) {
+        switch (bcd->currentOpcode) {
           case CTO_Repeatable: {
-            const wchar_t *srclim = srcmax - currentFindLength;
+            const wchar_t *srclim = bcd->srcmax - bcd->currentFindLength;
 
-            srcbeg = src - currentFindLength;
+            srcbeg = bcd->src - bcd->currentFindLength;
             destbeg = destlast;
 
-            while ((src <= srclim) && checkCurrentRule(src)) {
-              const wchar_t *srcnxt = src + currentFindLength;
+            while ((bcd->src <= srclim) && checkCurrentRule(bcd, bcd->src)) {
+              const wchar_t *srcnxt = bcd->src + bcd->currentFindLength;
 
               do {
-                clearOffset();
-              } while (++src != srcnxt);
+                clearOffset(bcd);
+              } while (++bcd->src != srcnxt);
             }
 
             break;
           }
 
           case CTO_JoinedWord:
-            srcbeg = src;
-            destbeg = dest;
+            srcbeg = bcd->src;
+            destbeg = bcd->dest;
 
-            while ((src < srcmax) && testCharacter(*src, CTC_Space)) {
-              clearOffset();
-              src += 1;
+            while ((bcd->src < bcd->srcmax) && testCharacter(bcd, *bcd->src, CTC_Space)) {
+              clearOffset(bcd);
+              bcd->src += 1;
             }
             break;
 
@@ -1110,50 +1182,54 @@ contractTextInternally (void) {
             break;
         }
 
-        if (srcbeg && (cursor >= srcbeg) && (cursor < src)) {
+        if (srcbeg && (bcd->cursor >= srcbeg) && (bcd->cursor < bcd->src)) {
           int repeat = !literal;
-          literal = src;
+          literal = bcd->src;
 
           if (repeat) {
-            src = srcbeg;
-            dest = destbeg;
+            bcd->src = srcbeg;
+            bcd->dest = destbeg;
             continue;
           }
 
-          src = srcorig;
+          bcd->src = srcorig;
         }
       }
     } else {
-      currentOpcode = CTO_Always;
-      if (!putCharacter(*src)) break;
-      src += 1;
+      bcd->currentOpcode = CTO_Always;
+      if (!putCharacter(bcd, *bcd->src)) break;
+      bcd->src += 1;
     }
 
-    findLineBreakOpportunities(&lbo, lineBreakOpportunities, srcmin, src-srcmin);
-    if (lineBreakOpportunities[src-srcmin]) {
-      srcjoin = src;
-      destjoin = dest;
+    /* there's nothing to join or rewind to once all of the input has been consumed */
+    if (bcd->src < bcd->srcmax) {
+      findLineBreakOpportunities(bcd, &lbo, lineBreakOpportunities, bcd->srcmin, bcd->src-bcd->srcmin);
+
+      if (lineBreakOpportunities[bcd->src-bcd->srcmin]) {
+        srcjoin = bcd->src;
+        destjoin = bcd->dest;
 
-      if (currentOpcode != CTO_JoinedWord) {
-        srcword = src;
-        destword = dest;
+        if (bcd->currentOpcode != CTO_JoinedWord) {
+          srcword = bcd->src;
+          destword = bcd->dest;
+        }
       }
     }
 
-    if ((dest == destmin) || dest[-1]) {
-      previousOpcode = currentOpcode;
+    if ((bcd->dest == bcd->destmin) || bcd->dest[-1]) {
+      bcd->previousOpcode = bcd->currentOpcode;
     }
   }
 
 done:
-  if (src < srcmax) {
-    if (destword && (destword > destmin) &&
-        (!(testCharacter(src[-1], CTC_Space) || testCharacter(*src, CTC_Space)) ||
-         (previousOpcode == CTO_JoinedWord))) {
-      src = srcword;
-      dest = destword;
+  if (bcd->src < bcd->srcmax) {
+    if (destword && (destword > bcd->destmin) &&
+        (!(testCharacter(bcd, bcd->src[-1], CTC_Space) || testCharacter(bcd, *bcd->src, CTC_Space)) ||
+         (bcd->previousOpcode == CTO_JoinedWord))) {
+      bcd->src = srcword;
+      bcd->dest = destword;
     } else if (destlast) {
-      dest = destlast;
+      bcd->dest = destlast;
     }
   }
 
@@ -1161,7 +1237,7 @@ done:
 }
 
 static int
-putExternalRequests (void) {
+putExternalRequests (BrailleContractionData *bcd) {
   typedef enum {
     REQ_TEXT,
     REQ_NUMBER
@@ -1184,36 +1260,36 @@ putExternalRequests (void) {
   const ExternalRequestEntry externalRequestTable[] = {
     { .name = "cursor-position",
       .type = REQ_NUMBER,
-      .value.number = cursor? cursor-srcmin+1: 0
+      .value.number = bcd->cursor? bcd->cursor-bcd->srcmin+1: 0
     },
 
     { .name = "expand-current-word",
       .type = REQ_NUMBER,
-      .value.number = prefs.expandCurrentWord
+      .value.number = bcd->options->expandCurrentWord
     },
 
     { .name = "capitalization-mode",
       .type = REQ_NUMBER,
-      .value.number = prefs.capitalizationMode
+      .value.number = bcd->options->capitalizationMode
     },
 
     { .name = "maximum-length",
       .type = REQ_NUMBER,
-      .value.number = destmax - destmin
+      .value.number = bcd->destmax - bcd->destmin
     },
 
     { .name = "text",
       .type = REQ_TEXT,
       .value.text = {
-        .start = srcmin,
-        .count = srcmax - srcmin
+        .start = bcd->srcmin,
+        .count = bcd->srcmax - bcd->srcmin
       }
     },
 
     { .name = NULL }
   };
 
-  FILE *stream = table->data.external.standardInput;
+  FILE *stream = bcd->table->data.external.standardInput;
   const ExternalRequestEntry *req = externalRequestTable;
 
   while (req->name) {
@@ -1241,7 +1317,7 @@ putExternalRequests (void) {
         break;
 
       default:
-        logMessage(LOG_WARNING, "unimplemented external contraction request property type: %s: %u (%s)", table->command, req->type, req->name);
+        logMessage(LOG_WARNING, "unimplemented external contraction request property type: %s: %u (%s)", bcd->table->command, req->type, req->name);
         return 0;
     }
 
@@ -1253,7 +1329,7 @@ putExternalRequests (void) {
   return 1;
 
 outputError:
-  logMessage(LOG_WARNING, "external contraction output error: %s: %s", table->command, strerror(errno));
+  logMessage(LOG_WARNING, "external contraction output error: %s: %s", bcd->table->command, strerror(errno));
   return 0;
 }
 
@@ -1325,10 +1401,10 @@ static const unsigned char brfTable[0X40] = {
 };
 
 static int
-handleExternalResponse_brf (const char *value) {
-  int useDot7 = prefs.capitalizationMode == CTB_CAP_DOT7;
+handleExternalResponse_brf (BrailleContractionData *bcd, const char *value) {
+  int useDot7 = bcd->options->capitalizationMode == CTB_CAP_DOT7;
 
-  while (*value && (dest < destmax)) {
+  while (*value && (bcd->dest < bcd->destmax)) {
     unsigned char brf = *value++ & 0XFF;
     unsigned char dots = 0;
     unsigned char superimpose = 0;
@@ -1340,29 +1416,29 @@ handleExternalResponse_brf (const char *value) {
     }
 
     if ((brf >= 0X20) && (brf <= 0X5F)) dots = brfTable[brf - 0X20] | superimpose;
-    *dest++ = dots;
+    *bcd->dest++ = dots;
   }
 
   return 1;
 }
 
 static int
-handleExternalResponse_consumedLength (const char *value) {
+handleExternalResponse_consumedLength (BrailleContractionData *bcd, const char *value) {
   int length;
 
   if (!isInteger(&length, value)) return 0;
   if (length < 1) return 0;
-  if (length > (srcmax - srcmin)) return 0;
+  if (length > (bcd->srcmax - bcd->srcmin)) return 0;
 
-  src = srcmin + length;
+  bcd->src = bcd->srcmin + length;
   return 1;
 }
 
 static int
-handleExternalResponse_outputOffsets (const char *value) {
-  if (offsets) {
+handleExternalResponse_outputOffsets (BrailleContractionData *bcd, const char *value) {
+  if (bcd->offsets) {
     int previous = CTB_NO_OFFSET;
-    unsigned int count = srcmax - srcmin;
+    unsigned int count = bcd->srcmax - bcd->srcmin;
     unsigned int index = 0;
 
     while (*value && (index < count)) {
@@ -1391,9 +1467,9 @@ handleExternalResponse_outputOffsets (const char *value) {
       }
 
       if (offset < ((index == 0)? 0: previous)) return 0;
-      if (offset >= (destmax - destmin)) return 0;
+      if (offset >= (bcd->destmax - bcd->destmin)) return 0;
 
-      offsets[index++] = (offset == previous)? CTB_NO_OFFSET: offset;
+      bcd->offsets[index++] = (offset == previous)? CTB_NO_OFFSET: offset;
       previous = offset;
     }
   }
@@ -1403,7 +1479,7 @@ handleExternalResponse_outputOffsets (const char *value) {
 
 typedef struct {
   const char *name;
-  int (*handler) (const char *value);
+  int (*handler) (BrailleContractionData *bcd, const char *value);
   unsigned stop:1;
 } ExternalResponseEntry;
 
@@ -1425,16 +1501,17 @@ static const ExternalResponseEntry externalResponseTable[] = {
 };
 
 static int
-getExternalResponses (void) {
-  static char *buffer = NULL;
-  static size_t size = 0;
+getExternalResponses (BrailleContractionData *bcd) {
+  char **buffer = &bcd->context->response.buffer;
+  size_t *size = &bcd->context->response.size;
 
-  FILE *stream = table->data.external.standardOutput;
+  FILE *stream = bcd->table->data.external.standardOutput;
 
-  while (readLine(stream, &buffer, &size)) {
+  while (readLine(stream, buffer, size)) {
+    char *line = *buffer;
     int ok = 0;
     int stop = 0;
-    char *delimiter = strchr(buffer, '=');
+    char *delimiter = strchr(line, '=');
 
     if (delimiter) {
       const char *value = delimiter + 1;
@@ -1444,8 +1521,8 @@ getExternalResponses (void) {
       *delimiter = 0;
 
       while (rsp->name) {
-        if (strcmp(buffer, rsp->name) == 0) {
-          if (rsp->handler(value)) ok = 1;
+        if (strcmp(line, rsp->name) == 0) {
+          if (rsp->handler(bcd, value)) ok = 1;
           if (rsp->stop) stop = 1;
           break;
         }
@@ -1456,203 +1533,251 @@ getExternalResponses (void) {
       *delimiter = oldDelimiter;
     }
 
-    if (!ok) logMessage(LOG_WARNING, "unexpected external contraction response: %s: %s", table->command, buffer);
+    if (!ok) logMessage(LOG_WARNING, "unexpected external contraction response: %s: %s", bcd->table->command, line);
     if (stop) return 1;
   }
 
-  logMessage(LOG_WARNING, "incomplete external contraction response: %s", table->command);
+  logMessage(LOG_WARNING, "incomplete external contraction response: %s", bcd->table->command);
   return 0;
 }
 
 static int
-contractTextExternally (void) {
-  setOffset();
-  while (++src < srcmax) clearOffset();
+contractTextExternally (BrailleContractionData *bcd) {
+  setOffset(bcd);
+  while (++bcd->src < bcd->srcmax) clearOffset(bcd);
 
-  if (startContractionCommand(table)) {
-    if (putExternalRequests()) {
-      if (getExternalResponses()) {
+  if (startContractionCommand(bcd->table)) {
+    if (putExternalRequests(bcd)) {
+      if (getExternalResponses(bcd)) {
         return 1;
       }
     }
   }
 
-  stopContractionCommand(table);
+  stopContractionCommand(bcd->table);
   return 0;
 }
 
 static inline unsigned int
-makeCachedInputCount (void) {
-  return srcmax - srcmin;
+makeCachedInputCount (BrailleContractionData *bcd) {
+  return bcd->srcmax - bcd->srcmin;
 }
 
 static inline unsigned int
-makeCachedOutputMaximum (void) {
-  return destmax - destmin;
+makeCachedOutputMaximum (BrailleContractionData *bcd) {
+  return bcd->destmax - bcd->destmin;
 }
 
 static inline int
-makeCachedCursorOffset (void) {
-  return cursor? (cursor - srcmin): CTB_NO_CURSOR;
+makeCachedCursorOffset (BrailleContractionData *bcd) {
+  return bcd->cursor? (bcd->cursor - bcd->srcmin): CTB_NO_CURSOR;
 }
 
 static int
-checkCache (void) {
-  if (!table->cache.input.characters) return 0;
-  if (!table->cache.output.cells) return 0;
-  if (offsets && !table->cache.offsets.count) return 0;
-  if (table->cache.output.maximum != makeCachedOutputMaximum()) return 0;
-  if (table->cache.cursorOffset != makeCachedCursorOffset()) return 0;
-  if (table->cache.expandCurrentWord != prefs.expandCurrentWord) return 0;
-  if (table->cache.capitalizationMode != prefs.capitalizationMode) return 0;
+checkCache (BrailleContractionData *bcd) {
+  if (!bcd->context->cache.input.characters) return 0;
+  if (!bcd->context->cache.output.cells) return 0;
+  if (bcd->offsets && !bcd->context->cache.offsets.count) return 0;
+  if (bcd->context->cache.output.maximum != makeCachedOutputMaximum(bcd)) return 0;
+  if (bcd->context->cache.cursorOffset != makeCachedCursorOffset(bcd)) return 0;
+  if (bcd->context->cache.expandCurrentWord != bcd->options->expandCurrentWord) return 0;
+  if (bcd->context->cache.capitalizationMode != bcd->options->capitalizationMode) return 0;
 
   {
-    unsigned int count = makeCachedInputCount();
-    if (table->cache.input.count != count) return 0;
-    if (wmemcmp(srcmin, table->cache.input.characters, count) != 0) return 0;
+    unsigned int count = makeCachedInputCount(bcd);
+    if (bcd->context->cache.input.count != count) return 0;
+    if (wmemcmp(bcd->srcmin, bcd->context->cache.input.characters, count) != 0) return 0;
   }
 
   return 1;
 }
 
 static void
-updateCache (void) {
+updateCache (BrailleContractionData *bcd) {
   {
-    unsigned int count = makeCachedInputCount();
+    unsigned int count = makeCachedInputCount(bcd);
 
-    if (count > table->cache.input.size) {
+    if (count > bcd->context->cache.input.size) {
       unsigned int newSize = count | 0X7F;
       wchar_t *newCharacters = malloc(ARRAY_SIZE(newCharacters, newSize));
 
       if (!newCharacters) {
         logMallocError();
-        table->cache.input.count = 0;
+        bcd->context->cache.input.count = 0;
         goto inputDone;
       }
 
-      if (table->cache.input.characters) free(table->cache.input.characters);
-      table->cache.input.characters = newCharacters;
-      table->cache.input.size = newSize;
+      if (bcd->context->cache.input.characters) free(bcd->context->cache.input.characters);
+      bcd->context->cache.input.characters = newCharacters;
+      bcd->context->cache.input.size = newSize;
     }
 
-    wmemcpy(table->cache.input.characters, srcmin, count);
-    table->cache.input.count = count;
-    table->cache.input.consumed = src - srcmin;
+    wmemcpy(bcd->context->cache.input.characters, bcd->srcmin, count);
+    bcd->context->cache.input.count = count;
+    bcd->context->cache.input.consumed = bcd->src - bcd->srcmin;
   }
 inputDone:
 
   {
-    unsigned int count = dest - destmin;
+    unsigned int count = bcd->dest - bcd->destmin;
 
-    if (count > table->cache.output.size) {
+    if (count > bcd->context->cache.output.size) {
       unsigned int newSize = count | 0X7F;
       unsigned char *newCells = malloc(ARRAY_SIZE(newCells, newSize));
 
       if (!newCells) {
         logMallocError();
-        table->cache.output.count = 0;
+        bcd->context->cache.output.count = 0;
         goto outputDone;
       }
 
-      if (table->cache.output.cells) free(table->cache.output.cells);
-      table->cache.output.cells = newCells;
-      table->cache.output.size = newSize;
+      if (bcd->context->cache.output.cells) free(bcd->context->cache.output.cells);
+      bcd->context->cache.output.cells = newCells;
+      bcd->context->cache.output.size = newSize;
     }
 
-    memcpy(table->cache.output.cells, destmin, count);
-    table->cache.output.count = count;
-    table->cache.output.maximum = makeCachedOutputMaximum();
+    memcpy(bcd->context->cache.output.cells, bcd->destmin, count);
+    bcd->context->cache.output.count = count;
+    bcd->context->cache.output.maximum = makeCachedOutputMaximum(bcd);
   }
 outputDone:
 
-  if (offsets) {
-    unsigned int count = makeCachedInputCount();
+  if (bcd->offsets) {
+    unsigned int count = makeCachedInputCount(bcd);
 
-    if (count > table->cache.offsets.size) {
+    if (count > bcd->context->cache.offsets.size) {
       unsigned int newSize = count | 0X7F;
       int *newArray = malloc(ARRAY_SIZE(newArray, newSize));
 
       if (!newArray) {
         logMallocError();
-        table->cache.offsets.count = 0;
+        bcd->context->cache.offsets.count = 0;
         goto offsetsDone;
       }
 
-      if (table->cache.offsets.array) free(table->cache.offsets.array);
-      table->cache.offsets.array = newArray;
-      table->cache.offsets.size = newSize;
+      if (bcd->context->cache.offsets.array) free(bcd->context->cache.offsets.array);
+      bcd->context->cache.offsets.array = newArray;
+      bcd->context->cache.offsets.size = newSize;
     }
 
-    memcpy(table->cache.offsets.array, offsets, ARRAY_SIZE(offsets, count));
-    table->cache.offsets.count = count;
+    memcpy(bcd->context->cache.offsets.array, bcd->offsets, ARRAY_SIZE(bcd->offsets, count));
+    bcd->context->cache.offsets.count = count;
   } else {
-    table->cache.offsets.count = 0;
+    bcd->context->cache.offsets.count = 0;
   }
 offsetsDone:
 
-  table->cache.cursorOffset = makeCachedCursorOffset();
-  table->cache.expandCurrentWord = prefs.expandCurrentWord;
-  table->cache.capitalizationMode = prefs.capitalizationMode;
+  bcd->context->cache.cursorOffset = makeCachedCursorOffset(bcd);
+  bcd->context->cache.expandCurrentWord = bcd->options->expandCurrentWord;
+  bcd->context->cache.capitalizationMode = bcd->options->capitalizationMode;
+}
+
+ContractionContext *
+newContractionContext (ContractionTable *table) {
+  ContractionContext *context;
+
+  if ((context = malloc(sizeof(*context)))) {
+    initializeContractionContext(context, table);
+    return context;
+  } else {
+    logMallocError();
+  }
+
+  return NULL;
 }
 
 void
-contractText (
-  ContractionTable *contractionTable,
+destroyContractionContext (ContractionContext *context) {
+  releaseContractionContext(context);
+  free(context);
+}
+
+void
+contractTextWithContext (
+  ContractionContext *context, const ContractionOptions *options,
   const wchar_t *inputBuffer, int *inputLength,
   BYTE *outputBuffer, int *outputLength,
   int *offsetsMap, const int cursorOffset
 ) {
-  table = contractionTable;
-  srcmax = (srcmin = src = inputBuffer) + *inputLength;
-  destmax = (destmin = dest = outputBuffer) + *outputLength;
-  offsets = offsetsMap;
-  cursor = (cursorOffset == CTB_NO_CURSOR)? NULL: &src[cursorOffset];
-
-  if (checkCache()) {
-    src = srcmin + table->cache.input.consumed;
-    if (offsets)
-      memcpy(offsets, table->cache.offsets.array,
-             ARRAY_SIZE(offsets, table->cache.offsets.count));
-
-    dest = destmin + table->cache.output.count;
-    memcpy(destmin, table->cache.output.cells,
-           ARRAY_SIZE(destmin, table->cache.output.count));
+  BrailleContractionData bcd = {
+    .context = context,
+    .table = context->table,
+    .options = options,
+
+    .src = inputBuffer,
+    .srcmin = inputBuffer,
+    .srcmax = inputBuffer + *inputLength,
+    .cursor = (cursorOffset == CTB_NO_CURSOR)? NULL: &inputBuffer[cursorOffset],
+
+    .dest = outputBuffer,
+    .destmin = outputBuffer,
+    .destmax = outputBuffer + *outputLength,
+    .offsets = offsetsMap
+  };
+
+  if (checkCache(&bcd)) {
+    bcd.src = bcd.srcmin + context->cache.input.consumed;
+    if (bcd.offsets)
+      memcpy(bcd.offsets, context->cache.offsets.array,
+             ARRAY_SIZE(bcd.offsets, context->cache.offsets.count));
+
+    bcd.dest = bcd.destmin + context->cache.output.count;
+    memcpy(bcd.destmin, context->cache.output.cells,
+           ARRAY_SIZE(bcd.destmin, context->cache.output.count));
   } else {
-    if (!(table->command? contractTextExternally(): contractTextInternally())) {
-      src = srcmin;
-      dest = destmin;
+    if (!(bcd.table->command? contractTextExternally(&bcd): contractTextInternally(&bcd))) {
+      bcd.src = bcd.srcmin;
+      bcd.dest = bcd.destmin;
 
-      while ((src < srcmax) && (dest < destmax)) {
-        setOffset();
-        *dest++ = convertCharacterToDots(textTable, *src++);
+      while ((bcd.src < bcd.srcmax) && (bcd.dest < bcd.destmax)) {
+        setOffset(&bcd);
+        *bcd.dest++ = convertCharacterToDots(textTable, *bcd.src++);
       }
     }
 
-    if (src < srcmax) {
-      const wchar_t *srcorig = src;
+    if (bcd.src < bcd.srcmax) {
+      const wchar_t *srcorig = bcd.src;
       int done = 1;
 
-      setOffset();
+      setOffset(&bcd);
       while (1) {
-        if (done && !testCharacter(*src, CTC_Space)) {
+        if (done && !testCharacter(&bcd, *bcd.src, CTC_Space)) {
           done = 0;
 
-          if (!cursor || (cursor < srcorig) || (cursor >= src)) {
-            setOffset();
-            srcorig = src;
+          if (!bcd.cursor || (bcd.cursor < srcorig) || (bcd.cursor >= bcd.src)) {
+            setOffset(&bcd);
+            srcorig = bcd.src;
           }
         }
 
-        if (++src == srcmax) break;
-        clearOffset();
+        if (++bcd.src == bcd.srcmax) break;
+        clearOffset(&bcd);
       }
 
-      if (!done) src = srcorig;
+      if (!done) bcd.src = srcorig;
     }
 
-    updateCache();
+    updateCache(&bcd);
   }
 
-  *inputLength = src - srcmin;
-  *outputLength = dest - destmin;
+  *inputLength = bcd.src - bcd.srcmin;
+  *outputLength = bcd.dest - bcd.destmin;
+}
+
+void
+contractText (
+  ContractionTable *contractionTable,
+  const wchar_t *inputBuffer, int *inputLength,
+  BYTE *outputBuffer, int *outputLength,
+  int *offsetsMap, const int cursorOffset
+) {
+  const ContractionOptions options = {
+    .capitalizationMode = prefs.capitalizationMode,
+    .expandCurrentWord = prefs.expandCurrentWord
+  };
+
+  contractTextWithContext(&contractionTable->context, &options,
+                          inputBuffer, inputLength,
+                          outputBuffer, outputLength,
+                          offsetsMap, cursorOffset);
 }
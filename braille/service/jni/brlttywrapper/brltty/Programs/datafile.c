@@ -31,6 +31,7 @@
 #include "file.h"
 #include "queue.h"
 #include "datafile.h"
+#include "dataimage.h"
 #include "charset.h"
 #include "unicode.h"
 #include "brldots.h"
@@ -776,6 +777,8 @@ processDataStream (
       return 0;
 
   logMessage(LOG_DEBUG, "including data file: %s", file.name);
+  addDataImageSource(file.name);
+
   if ((file.variables = newDataVariableQueue(variables))) {
     if (processLines(stream, processUtf8Line, &file)) ok = 1;
     deallocateQueue(file.variables);
@@ -0,0 +1,576 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+
+#include "prologue.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_POSIX_THREADS
+#include <pthread.h>
+#endif /* HAVE_POSIX_THREADS */
+
+#include "log.h"
+#include "file.h"
+#include "dataimage.h"
+
+/* A data image is the compiled form of a table, together with enough
+ * information to tell whether it still matches the source files it was
+ * compiled from. It is laid out as:
+ *
+ *   header
+ *   variant (length + characters)
+ *   source count
+ *   for each source: modification time, size, path (length + characters)
+ *   padding up to DATA_IMAGE_ALIGNMENT
+ *   content
+ *
+ * The checksum covers everything after the header.
+ */
+
+#define DATA_IMAGE_MAGIC "BRLTTYDI"
+#define DATA_IMAGE_VERSION 1
+#define DATA_IMAGE_BYTE_ORDER 0X01020304
+#define DATA_IMAGE_ALIGNMENT 16
+
+typedef struct {
+  char magic[8];
+  char type[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t wcharSize;
+  uint32_t checksum;
+  uint32_t contentOffset;
+  uint32_t contentSize;
+  uint32_t reserved[2];
+} DataImageHeader;
+
+struct DataImageStruct {
+  FileContents file;
+
+  const unsigned char *content;
+  size_t contentSize;
+};
+
+static int dataImagesEnabled = 1;
+
+typedef struct {
+  char **paths;
+  unsigned int size;
+  unsigned int count;
+  unsigned active:1;
+} DataImageSources;
+
+static void
+clearDataImageSources (DataImageSources *sources) {
+  while (sources->count) free(sources->paths[--sources->count]);
+  sources->active = 0;
+}
+
+/* Tables may be compiled on several threads at once, so each thread
+ * collects its own source list.
+ */
+#ifdef HAVE_POSIX_THREADS
+static pthread_once_t dataImageSourcesOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t dataImageSourcesKey;
+
+static void
+destroyDataImageSources (void *data) {
+  DataImageSources *sources = data;
+
+  clearDataImageSources(sources);
+  if (sources->paths) free(sources->paths);
+  free(sources);
+}
+
+static void
+createDataImageSourcesKey (void) {
+  pthread_key_create(&dataImageSourcesKey, destroyDataImageSources);
+}
+
+static DataImageSources *
+getDataImageSources (int create) {
+  DataImageSources *sources;
+
+  pthread_once(&dataImageSourcesOnce, createDataImageSourcesKey);
+
+  if (!(sources = pthread_getspecific(dataImageSourcesKey)) && create) {
+    if ((sources = malloc(sizeof(*sources)))) {
+      memset(sources, 0, sizeof(*sources));
+
+      if (pthread_setspecific(dataImageSourcesKey, sources) != 0) {
+        free(sources);
+        sources = NULL;
+      }
+    } else {
+      logMallocError();
+    }
+  }
+
+  return sources;
+}
+#else /* HAVE_POSIX_THREADS */
+static DataImageSources *
+getDataImageSources (int create) {
+  static DataImageSources sources;
+  return &sources;
+}
+#endif /* HAVE_POSIX_THREADS */
+
+void
+setDataImagesEnabled (int enabled) {
+  dataImagesEnabled = enabled;
+}
+
+uint32_t
+makeDataImageChecksum (uint32_t checksum, const void *bytes, size_t count) {
+  const unsigned char *byte = bytes;
+
+  if (!checksum) checksum = 0X811C9DC5;
+
+  while (count) {
+    checksum ^= *byte++;
+    checksum *= 0X01000193;
+    count -= 1;
+  }
+
+  return checksum;
+}
+
+static char *
+makeDataImagePath (const char *source) {
+  size_t length = strlen(source);
+  char *path = malloc(length + sizeof(DATA_IMAGE_EXTENSION));
+
+  if (path) {
+    memcpy(path, source, length);
+    memcpy(&path[length], DATA_IMAGE_EXTENSION, sizeof(DATA_IMAGE_EXTENSION));
+  } else {
+    logMallocError();
+  }
+
+  return path;
+}
+
+static int
+setDataImageType (char *field, const char *type) {
+  size_t length = strlen(type);
+
+  if (length >= sizeof(((DataImageHeader *)NULL)->type)) {
+    logMessage(LOG_ERR, "data image type too long: %s", type);
+    return 0;
+  }
+
+  memset(field, 0, sizeof(((DataImageHeader *)NULL)->type));
+  memcpy(field, type, length);
+  return 1;
+}
+
+typedef struct {
+  const unsigned char *next;
+  const unsigned char *end;
+} DataImageReader;
+
+static int
+readDataImageBytes (DataImageReader *reader, void *bytes, size_t count) {
+  if ((size_t)(reader->end - reader->next) < count) return 0;
+  memcpy(bytes, reader->next, count);
+  reader->next += count;
+  return 1;
+}
+
+static int
+readDataImageString (DataImageReader *reader, const char **string, uint32_t *length) {
+  if (!readDataImageBytes(reader, length, sizeof(*length))) return 0;
+  if ((size_t)(reader->end - reader->next) < *length) return 0;
+
+  *string = (const char *)reader->next;
+  reader->next += *length;
+  return 1;
+}
+
+static int
+isSameString (const char *string, const char *characters, uint32_t length) {
+  return (strlen(string) == length) && (memcmp(string, characters, length) == 0);
+}
+
+static const char *
+verifyDataImage (DataImage *image, const char *source, const char *type, const char *variant) {
+  DataImageHeader header;
+
+  if (image->file.size < sizeof(header)) return "too small";
+  memcpy(&header, image->file.bytes, sizeof(header));
+
+  if (memcmp(header.magic, DATA_IMAGE_MAGIC, sizeof(header.magic)) != 0) return "not a data image";
+  if (header.version != DATA_IMAGE_VERSION) return "version mismatch";
+  if (header.byteOrder != DATA_IMAGE_BYTE_ORDER) return "byte order mismatch";
+  if (header.wcharSize != sizeof(wchar_t)) return "character size mismatch";
+
+  {
+    char expectedType[sizeof(header.type)];
+
+    if (!setDataImageType(expectedType, type)) return "invalid type";
+    if (memcmp(header.type, expectedType, sizeof(header.type)) != 0) return "type mismatch";
+  }
+
+  if (header.contentOffset < sizeof(header)) return "invalid content offset";
+  if (header.contentOffset % DATA_IMAGE_ALIGNMENT) return "misaligned content";
+  if (header.contentOffset > image->file.size) return "truncated";
+  if (header.contentSize != (image->file.size - header.contentOffset)) return "truncated";
+
+  if (makeDataImageChecksum(0, &image->file.bytes[sizeof(header)], image->file.size - sizeof(header)) != header.checksum) {
+    return "checksum mismatch";
+  }
+
+  {
+    DataImageReader reader = {
+      .next = &image->file.bytes[sizeof(header)],
+      .end = &image->file.bytes[header.contentOffset]
+    };
+
+    const char *characters;
+    uint32_t length;
+    uint32_t count;
+    int first = 1;
+
+    if (!readDataImageString(&reader, &characters, &length)) return "missing variant";
+    if (!isSameString(variant, characters, length)) return "variant mismatch";
+
+    if (!readDataImageBytes(&reader, &count, sizeof(count))) return "missing source count";
+    if (!count) return "no sources";
+
+    while (count) {
+      int64_t modified;
+      uint64_t size;
+      struct stat status;
+
+      if (!readDataImageBytes(&reader, &modified, sizeof(modified))) return "missing source time";
+      if (!readDataImageBytes(&reader, &size, sizeof(size))) return "missing source size";
+      if (!readDataImageString(&reader, &characters, &length)) return "missing source path";
+
+      if (first) {
+        if (!isSameString(source, characters, length)) return "source mismatch";
+        first = 0;
+      }
+
+      {
+        char path[length + 1];
+
+        memcpy(path, characters, length);
+        path[length] = 0;
+
+        if (stat(path, &status) == -1) return "source not found";
+      }
+
+      if ((int64_t)status.st_mtime != modified) return "source modified";
+      if ((uint64_t)status.st_size != size) return "source resized";
+
+      count -= 1;
+    }
+  }
+
+  image->content = &image->file.bytes[header.contentOffset];
+  image->contentSize = header.contentSize;
+  return NULL;
+}
+
+DataImage *
+loadDataImage (const char *source, const char *type, const char *variant) {
+  DataImage *image = NULL;
+  char *path;
+
+  if (!dataImagesEnabled) return NULL;
+
+  if ((path = makeDataImagePath(source))) {
+    int file;
+
+    if ((file = open(path, O_RDONLY)) != -1) {
+      if ((image = malloc(sizeof(*image)))) {
+        memset(image, 0, sizeof(*image));
+
+        if (mapFileContents(&image->file, file)) {
+          const char *problem = verifyDataImage(image, source, type, variant);
+
+          if (!problem) {
+            logMessage(LOG_DEBUG, "data image loaded: %s", path);
+          } else {
+            logMessage(LOG_DEBUG, "data image not usable: %s: %s", path, problem);
+            destroyDataImage(image);
+            image = NULL;
+          }
+        } else {
+          free(image);
+          image = NULL;
+        }
+      } else {
+        logMallocError();
+      }
+
+      close(file);
+    } else if (errno != ENOENT) {
+      logMessage(LOG_DEBUG, "cannot open data image: %s: %s", path, strerror(errno));
+    }
+
+    free(path);
+  }
+
+  return image;
+}
+
+const void *
+getDataImageContent (const DataImage *image, size_t *size) {
+  if (size) *size = image->contentSize;
+  return image->content;
+}
+
+void
+destroyDataImage (DataImage *image) {
+  unmapFileContents(&image->file);
+  free(image);
+}
+
+void
+beginDataImageSources (void) {
+  DataImageSources *sources = getDataImageSources(1);
+
+  if (sources) {
+    clearDataImageSources(sources);
+    sources->active = 1;
+  }
+}
+
+void
+endDataImageSources (void) {
+  DataImageSources *sources = getDataImageSources(0);
+
+  if (sources) clearDataImageSources(sources);
+}
+
+void
+addDataImageSource (const char *path) {
+  DataImageSources *sources = getDataImageSources(0);
+
+  if (sources && sources->active) {
+    unsigned int index;
+
+    for (index=0; index<sources->count; index+=1) {
+      if (strcmp(sources->paths[index], path) == 0) return;
+    }
+
+    if (sources->count == sources->size) {
+      unsigned int newSize = sources->size? sources->size<<1: 0X10;
+      char **newPaths = realloc(sources->paths, ARRAY_SIZE(newPaths, newSize));
+
+      if (!newPaths) {
+        logMallocError();
+        goto failed;
+      }
+
+      sources->paths = newPaths;
+      sources->size = newSize;
+    }
+
+    if ((sources->paths[sources->count] = strdup(path))) {
+      sources->count += 1;
+      return;
+    }
+
+    logMallocError();
+
+  failed:
+    /* An incomplete source list must never be saved. */
+    clearDataImageSources(sources);
+  }
+}
+
+typedef struct {
+  unsigned char *bytes;
+  size_t size;
+  size_t count;
+} DataImageWriter;
+
+static int
+writeDataImageBytes (DataImageWriter *writer, const void *bytes, size_t count) {
+  if ((writer->count + count) > writer->size) {
+    size_t newSize = (writer->count + count) | 0XFFF;
+    unsigned char *newBytes = realloc(writer->bytes, newSize);
+
+    if (!newBytes) {
+      logMallocError();
+      return 0;
+    }
+
+    writer->bytes = newBytes;
+    writer->size = newSize;
+  }
+
+  if (bytes) {
+    memcpy(&writer->bytes[writer->count], bytes, count);
+  } else {
+    memset(&writer->bytes[writer->count], 0, count);
+  }
+
+  writer->count += count;
+  return 1;
+}
+
+static int
+writeDataImageString (DataImageWriter *writer, const char *string) {
+  uint32_t length = strlen(string);
+
+  if (!writeDataImageBytes(writer, &length, sizeof(length))) return 0;
+  return writeDataImageBytes(writer, string, length);
+}
+
+static int
+writeDataImageSources (DataImageWriter *writer, const char *variant, const DataImageSources *sources) {
+  uint32_t count = sources->count;
+  unsigned int index;
+
+  if (!writeDataImageString(writer, variant)) return 0;
+  if (!writeDataImageBytes(writer, &count, sizeof(count))) return 0;
+
+  for (index=0; index<sources->count; index+=1) {
+    const char *path = sources->paths[index];
+    struct stat status;
+    int64_t modified;
+    uint64_t size;
+
+    if (stat(path, &status) == -1) {
+      logMessage(LOG_DEBUG, "cannot stat data image source: %s: %s", path, strerror(errno));
+      return 0;
+    }
+
+    modified = status.st_mtime;
+    size = status.st_size;
+
+    if (!writeDataImageBytes(writer, &modified, sizeof(modified))) return 0;
+    if (!writeDataImageBytes(writer, &size, sizeof(size))) return 0;
+    if (!writeDataImageString(writer, path)) return 0;
+  }
+
+  return 1;
+}
+
+/* The image is written to a uniquely named file beside it, and then renamed,
+ * so that concurrent writers never see each other's partial images.
+ */
+static int
+writeDataImageFile (const char *path, const void *bytes, size_t count) {
+  char temporary[strlen(path) + 8];
+  int file;
+
+  snprintf(temporary, sizeof(temporary), "%s.XXXXXX", path);
+
+#ifdef HAVE_MKSTEMP
+  if ((file = mkstemp(temporary)) != -1) {
+#ifdef HAVE_FCHMOD
+    fchmod(file, (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+#endif /* HAVE_FCHMOD */
+  }
+#else /* HAVE_MKSTEMP */
+  file = open(mktemp(temporary), (O_WRONLY | O_CREAT | O_EXCL), (S_IRUSR | S_IWUSR));
+#endif /* HAVE_MKSTEMP */
+
+  if (file != -1) {
+    FILE *stream;
+
+    if ((stream = fdopen(file, "wb"))) {
+      int written = fwrite(bytes, 1, count, stream) == count;
+
+      if (fclose(stream) == EOF) written = 0;
+
+      if (written && (rename(temporary, path) != -1)) return 1;
+      logMessage(LOG_DEBUG, "cannot save data image: %s: %s", path, strerror(errno));
+    } else {
+      logSystemError("fdopen");
+      close(file);
+    }
+
+    unlink(temporary);
+  } else {
+    logMessage(LOG_DEBUG, "cannot create data image: %s: %s", temporary, strerror(errno));
+  }
+
+  return 0;
+}
+
+int
+saveDataImage (
+  const char *source, const char *type, const char *variant,
+  const void *content, size_t size
+) {
+  int ok = 0;
+  const DataImageSources *sources;
+
+  if (!dataImagesEnabled) return 0;
+  if (!(sources = getDataImageSources(0))) return 0;
+  if (!sources->active || !sources->count) return 0;
+  if (strcmp(sources->paths[0], source) != 0) return 0;
+
+  {
+    DataImageHeader header;
+    DataImageWriter writer = {
+      .bytes = NULL,
+      .size = 0,
+      .count = 0
+    };
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DATA_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = DATA_IMAGE_VERSION;
+    header.byteOrder = DATA_IMAGE_BYTE_ORDER;
+    header.wcharSize = sizeof(wchar_t);
+
+    if (setDataImageType(header.type, type)) {
+      if (writeDataImageBytes(&writer, &header, sizeof(header))) {
+        if (writeDataImageSources(&writer, variant, sources)) {
+          size_t padding = (DATA_IMAGE_ALIGNMENT - (writer.count % DATA_IMAGE_ALIGNMENT)) % DATA_IMAGE_ALIGNMENT;
+
+          if (writeDataImageBytes(&writer, NULL, padding)) {
+            header.contentOffset = writer.count;
+            header.contentSize = size;
+
+            if (writeDataImageBytes(&writer, content, size)) {
+              char *path;
+
+              header.checksum = makeDataImageChecksum(0, &writer.bytes[sizeof(header)], writer.count - sizeof(header));
+              memcpy(writer.bytes, &header, sizeof(header));
+
+              if ((path = makeDataImagePath(source))) {
+                if (writeDataImageFile(path, writer.bytes, writer.count)) {
+                  logMessage(LOG_DEBUG, "data image saved: %s", path);
+                  ok = 1;
+                }
+
+                free(path);
+              }
+            }
+          }
+        }
+      }
+    }
+
+    if (writer.bytes) free(writer.bytes);
+  }
+
+  return ok;
+}
@@ -0,0 +1,51 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+
+#ifndef BRLTTY_INCLUDED_DATAIMAGE
+#define BRLTTY_INCLUDED_DATAIMAGE
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define DATA_IMAGE_EXTENSION ".img"
+
+extern void setDataImagesEnabled (int enabled);
+
+typedef struct DataImageStruct DataImage;
+
+extern DataImage *loadDataImage (const char *source, const char *type, const char *variant);
+extern const void *getDataImageContent (const DataImage *image, size_t *size);
+extern void destroyDataImage (DataImage *image);
+
+extern void beginDataImageSources (void);
+extern void endDataImageSources (void);
+extern void addDataImageSource (const char *path);
+
+extern int saveDataImage (
+  const char *source, const char *type, const char *variant,
+  const void *content, size_t size
+);
+
+extern uint32_t makeDataImageChecksum (uint32_t checksum, const void *bytes, size_t count);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* BRLTTY_INCLUDED_DATAIMAGE */
@@ -19,6 +19,7 @@
 #include "prologue.h"
 
 #include "log.h"
+#include "metrics.h"
 #include "driver.h"
 
 void
@@ -38,6 +39,7 @@ logOutputPacket (const void *packet, size_t size) {
 
 void
 logInputPacket (const void *packet, size_t size) {
+  beginLatency(LATENCY_KEY_COMMAND);
   if (LOG_CATEGORY_FLAG(INPUT_PACKETS)) logPacket("Input Packet", packet, size);
 }
 
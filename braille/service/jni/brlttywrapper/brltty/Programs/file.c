@@ -30,6 +30,10 @@
 #include <sys/file.h>
 #endif /* HAVE_SYS_FILE_H */
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
 #include "file.h"
 #include "log.h"
 #include "parse.h"
@@ -655,6 +659,85 @@ releaseFileLock (int file) {
 }
 #endif /* file locking */
 
+/* The whole file is mapped when possible, and read into memory otherwise. */
+int
+mapFileContents (FileContents *contents, int file) {
+  struct stat status;
+
+  contents->bytes = NULL;
+  contents->size = 0;
+  contents->mapped = 0;
+
+  if (fstat(file, &status) == -1) {
+    logSystemError("fstat");
+    return 0;
+  }
+
+  if (!(contents->size = status.st_size)) return 1;
+
+#ifdef HAVE_SYS_MMAN_H
+  {
+    void *address = mmap(NULL, contents->size, PROT_READ, MAP_PRIVATE, file, 0);
+
+    if (address != MAP_FAILED) {
+      contents->bytes = address;
+      contents->mapped = 1;
+      return 1;
+    }
+
+    logSystemError("mmap");
+  }
+#endif /* HAVE_SYS_MMAN_H */
+
+  {
+    unsigned char *buffer;
+
+    if ((buffer = malloc(contents->size))) {
+      size_t count = 0;
+
+      while (count < contents->size) {
+        ssize_t result = read(file, &buffer[count], contents->size - count);
+
+        if (result == -1) {
+          if (errno == EINTR) continue;
+          logSystemError("read");
+          break;
+        }
+
+        if (!result) break;
+        count += result;
+      }
+
+      if (count == contents->size) {
+        contents->bytes = buffer;
+        return 1;
+      }
+
+      free(buffer);
+    } else {
+      logMallocError();
+    }
+  }
+
+  return 0;
+}
+
+void
+unmapFileContents (FileContents *contents) {
+  if (contents->bytes) {
+#ifdef HAVE_SYS_MMAN_H
+    if (contents->mapped) {
+      munmap((void *)contents->bytes, contents->size);
+    } else
+#endif /* HAVE_SYS_MMAN_H */
+    {
+      free((void *)contents->bytes);
+    }
+
+    contents->bytes = NULL;
+  }
+}
+
 int
 readLine (FILE *file, char **buffer, size_t *size) {
   char *line;
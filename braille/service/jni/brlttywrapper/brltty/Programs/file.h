@@ -62,6 +62,15 @@ extern int acquireFileLock (int file, int exclusive);
 extern int attemptFileLock (int file, int exclusive);
 extern int releaseFileLock (int file);
 
+typedef struct {
+  const unsigned char *bytes;
+  size_t size;
+  unsigned mapped:1;
+} FileContents;
+
+extern int mapFileContents (FileContents *contents, int file);
+extern void unmapFileContents (FileContents *contents);
+
 typedef int LineHandler (char *line, void *data);
 extern int processLines (FILE *file, LineHandler handleLine, void *data);
 extern int readLine (FILE *file, char **buffer, size_t *size);
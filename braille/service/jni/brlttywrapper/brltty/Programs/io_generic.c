@@ -23,6 +23,10 @@
 
 #include "log.h"
 #include "timing.h"
+#include "iotrace.h"
+#include "metrics.h"
+#include "async.h"
+#include "driver.h"
 #include "io_generic.h"
 #include "io_serial.h"
 #include "io_usb.h"
@@ -124,6 +128,7 @@ struct GioEndpointStruct {
   GioOptions options;
   unsigned int bytesPerSecond;
   HidReportItemsData hidReportItems;
+  uint32_t traceEndpoint;
 
   struct {
     int error;
@@ -131,8 +136,30 @@ struct GioEndpointStruct {
     unsigned int to;
     unsigned char buffer[0X40];
   } input;
+
+  struct {
+    struct GioOutputPacketStruct *first;
+    struct GioOutputPacketStruct *last;
+    unsigned int depth;
+    unsigned int maximumDepth;
+    TimeValue readyTime;
+    unsigned enabled:1;
+    unsigned alarmSet:1;
+  } output;
 };
 
+/* A queued packet which hasn't been written yet. A newer packet of the
+ * same (nonzero) class takes its place rather than being queued after it.
+ */
+typedef struct GioOutputPacketStruct {
+  struct GioOutputPacketStruct *next;
+  unsigned int class;
+  size_t size;
+  unsigned char bytes[];
+} GioOutputPacket;
+
+static void handleOutputAlarm (void *data);
+
 static void
 initializeOptions (GioOptions *options) {
   options->applicationData = NULL;
@@ -437,11 +464,19 @@ gioConnectResource (
     endpoint->hidReportItems.address = NULL;
     endpoint->hidReportItems.size = 0;
 
+    endpoint->output.first = NULL;
+    endpoint->output.last = NULL;
+    endpoint->output.depth = 0;
+    endpoint->output.maximumDepth = 0;
+    endpoint->output.enabled = 0;
+    endpoint->output.alarmSet = 0;
+
     if (descriptor->serial.parameters) {
       if (isSerialDevice(&identifier)) {
         if ((endpoint->handle.serial.device = serialOpenDevice(identifier))) {
           if (serialSetParameters(endpoint->handle.serial.device, descriptor->serial.parameters)) {
             endpoint->methods = &serialMethods;
+            endpoint->traceEndpoint = newIoTraceEndpoint(IO_TRACE_SERIAL);
             endpoint->options = descriptor->serial.options;
             setBytesPerSecond(endpoint, descriptor->serial.parameters);
             goto connectSucceeded;
@@ -458,6 +493,7 @@ gioConnectResource (
       if (isUsbDevice(&identifier)) {
         if ((endpoint->handle.usb.channel = usbFindChannel(descriptor->usb.channelDefinitions, identifier))) {
           endpoint->methods = &usbMethods;
+          endpoint->traceEndpoint = newIoTraceEndpoint(IO_TRACE_USB);
           endpoint->options = descriptor->usb.options;
 
           if (!endpoint->options.applicationData) {
@@ -481,6 +517,7 @@ gioConnectResource (
       if (isBluetoothDevice(&identifier)) {
         if ((endpoint->handle.bluetooth.connection = bthOpenConnection(identifier, descriptor->bluetooth.channelNumber, 0))) {
           endpoint->methods = &bluetoothMethods;
+          endpoint->traceEndpoint = newIoTraceEndpoint(IO_TRACE_BLUETOOTH);
           endpoint->options = descriptor->bluetooth.options;
           goto connectSucceeded;
         }
@@ -521,6 +558,15 @@ gioDisconnectResource (GioEndpoint *endpoint) {
   int ok = 0;
   DisconnectResourceMethod *method = endpoint->methods->disconnectResource;
 
+  gioFlushOutput(endpoint);
+  while (endpoint->output.first) {
+    GioOutputPacket *packet = endpoint->output.first;
+    endpoint->output.first = packet->next;
+    free(packet);
+  }
+
+  if (endpoint->output.alarmSet) asyncCancelAlarm(handleOutputAlarm, endpoint);
+
   if (!method) {
     logUnsupportedOperation("disconnectResource");
   } else if (method(&endpoint->handle)) {
@@ -537,12 +583,195 @@ gioGetApplicationData (GioEndpoint *endpoint) {
   return endpoint->options.applicationData;
 }
 
-ssize_t
-gioWriteData (GioEndpoint *endpoint, const void *data, size_t size) {
+static ssize_t
+writeEndpointData (GioEndpoint *endpoint, const void *data, size_t size) {
   WriteDataMethod *method = endpoint->methods->writeData;
   if (!method) return logUnsupportedOperation("writeData");
-  return method(&endpoint->handle, data, size,
-                endpoint->options.outputTimeout);
+  traceIo(endpoint->traceEndpoint, IO_TRACE_OUTPUT, data, size);
+
+  {
+    TimeValue start;
+    ssize_t result;
+
+    getMonotonicTime(&start);
+    result = method(&endpoint->handle, data, size,
+                    endpoint->options.outputTimeout);
+    addLatencySince(LATENCY_GENERIC_WRITE, &start);
+
+    if (result > 0) {
+      addToCounter(COUNTER_GENERIC_OUTPUT_BYTES, result);
+
+      if (endpoint->output.enabled) {
+        TimeValue now;
+
+        /* the link is busy until everything written so far has gone out */
+        getMonotonicTime(&now);
+        if (compareTimeValues(&now, &endpoint->output.readyTime) > 0) endpoint->output.readyTime = now;
+        adjustTimeValue(&endpoint->output.readyTime, gioGetMillisecondsToTransfer(endpoint, result));
+      }
+    }
+
+    return result;
+  }
+}
+
+static ssize_t
+writeOutputPacket (GioEndpoint *endpoint, const void *packet, size_t size) {
+  /* logged here rather than when queued since it may yet be superseded */
+  logOutputPacket(packet, size);
+  return writeEndpointData(endpoint, packet, size);
+}
+
+/* Queued output mustn't wait for the driver to next read or write - the
+ * last update before the display goes idle would otherwise never be sent.
+ */
+static void
+scheduleOutputAlarm (GioEndpoint *endpoint) {
+  if (endpoint->output.first && !endpoint->output.alarmSet) {
+    TimeValue now;
+    long int delay;
+
+    getMonotonicTime(&now);
+    delay = millisecondsBetween(&now, &endpoint->output.readyTime);
+    if (delay < 0) delay = 0;
+
+    if (asyncRelativeAlarm(delay, handleOutputAlarm, endpoint)) {
+      endpoint->output.alarmSet = 1;
+    }
+  }
+}
+
+static int
+writeOutputPackets (GioEndpoint *endpoint, int all) {
+  while (endpoint->output.first) {
+    GioOutputPacket *packet = endpoint->output.first;
+
+    if (!all) {
+      TimeValue now;
+
+      getMonotonicTime(&now);
+      if (compareTimeValues(&now, &endpoint->output.readyTime) < 0) break;
+    }
+
+    if (!(endpoint->output.first = packet->next)) endpoint->output.last = NULL;
+    endpoint->output.depth -= 1;
+
+    {
+      ssize_t result = writeOutputPacket(endpoint, packet->bytes, packet->size);
+
+      free(packet);
+      if (result == -1) return 0;
+    }
+  }
+
+  scheduleOutputAlarm(endpoint);
+  return 1;
+}
+
+static void
+handleOutputAlarm (void *data) {
+  GioEndpoint *endpoint = data;
+
+  endpoint->output.alarmSet = 0;
+  writeOutputPackets(endpoint, 0);
+}
+
+int
+gioEnableOutputQueue (GioEndpoint *endpoint) {
+  if (!endpoint->output.enabled) {
+    getMonotonicTime(&endpoint->output.readyTime);
+    endpoint->output.enabled = 1;
+  }
+
+  return 1;
+}
+
+ssize_t
+gioQueueData (GioEndpoint *endpoint, unsigned int class, const void *data, size_t size) {
+  /* without a queue there's nothing to flush first, but it's still logged */
+  if (!endpoint->output.enabled) return writeOutputPacket(endpoint, data, size);
+  if (!writeOutputPackets(endpoint, 0)) return -1;
+
+  if (!endpoint->output.first) {
+    TimeValue now;
+
+    getMonotonicTime(&now);
+    if (compareTimeValues(&now, &endpoint->output.readyTime) >= 0) {
+      return writeOutputPacket(endpoint, data, size);
+    }
+  }
+
+  {
+    GioOutputPacket *packet;
+
+    if (!(packet = malloc(sizeof(*packet) + size))) {
+      logMallocError();
+      return -1;
+    }
+
+    packet->next = NULL;
+    packet->class = class;
+    packet->size = size;
+    memcpy(packet->bytes, data, size);
+
+    if (class) {
+      GioOutputPacket **previous = &endpoint->output.first;
+
+      while (*previous) {
+        GioOutputPacket *superseded = *previous;
+
+        if (superseded->class == class) {
+          packet->next = superseded->next;
+          *previous = packet;
+          if (endpoint->output.last == superseded) endpoint->output.last = packet;
+
+          free(superseded);
+          addToCounter(COUNTER_GENERIC_OUTPUT_SUPERSEDED, 1);
+          return size;
+        }
+
+        previous = &superseded->next;
+      }
+    }
+
+    if (endpoint->output.last) {
+      endpoint->output.last->next = packet;
+    } else {
+      endpoint->output.first = packet;
+    }
+
+    endpoint->output.last = packet;
+
+    if ((endpoint->output.depth += 1) > endpoint->output.maximumDepth) {
+      endpoint->output.maximumDepth = endpoint->output.depth;
+      logMessage(LOG_DEBUG, "generic output queue depth: %u", endpoint->output.maximumDepth);
+    }
+
+    scheduleOutputAlarm(endpoint);
+    return size;
+  }
+}
+
+int
+gioFlushOutput (GioEndpoint *endpoint) {
+  return writeOutputPackets(endpoint, 1);
+}
+
+int
+gioServiceOutput (GioEndpoint *endpoint) {
+  return writeOutputPackets(endpoint, 0);
+}
+
+unsigned int
+gioGetOutputQueueDepth (GioEndpoint *endpoint) {
+  return endpoint->output.depth;
+}
+
+ssize_t
+gioWriteData (GioEndpoint *endpoint, const void *data, size_t size) {
+  /* whatever's been queued must go first */
+  if (!gioFlushOutput(endpoint)) return -1;
+  return writeEndpointData(endpoint, data, size);
 }
 
 int
@@ -550,6 +779,7 @@ gioAwaitInput (GioEndpoint *endpoint, int timeout) {
   AwaitInputMethod *method = endpoint->methods->awaitInput;
   if (!method) return logUnsupportedOperation("awaitInput");
   if (endpoint->input.to - endpoint->input.from) return 1;
+  gioServiceOutput(endpoint);
   return method(&endpoint->handle, timeout);
 }
 
@@ -558,6 +788,9 @@ gioReadData (GioEndpoint *endpoint, void *buffer, size_t size, int wait) {
   ReadDataMethod *method = endpoint->methods->readData;
   if (!method) return logUnsupportedOperation("readData");
 
+  /* drivers read input every cycle, which is when queued output goes out */
+  gioServiceOutput(endpoint);
+
   {
     unsigned char *start = buffer;
     unsigned char *next = start;
@@ -593,6 +826,10 @@ gioReadData (GioEndpoint *endpoint, void *buffer, size_t size, int wait) {
                                 (wait? endpoint->options.inputTimeout: 0), 0);
 
         if (result > 0) {
+          traceIo(endpoint->traceEndpoint, IO_TRACE_INPUT,
+                  &endpoint->input.buffer[endpoint->input.to], result);
+          addToCounter(COUNTER_GENERIC_INPUT_BYTES, result);
+
           if (LOG_CATEGORY_FLAG(GENERIC_INPUT)) {
             logBytes(categoryLogLevel, "generic input", &endpoint->input.buffer[endpoint->input.to], result);
           }
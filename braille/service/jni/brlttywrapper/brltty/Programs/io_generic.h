@@ -63,6 +63,18 @@ extern int gioDisconnectResource (GioEndpoint *endpoint);
 extern const void *gioGetApplicationData (GioEndpoint *endpoint);
 
 extern ssize_t gioWriteData (GioEndpoint *endpoint, const void *data, size_t size);
+
+/* An endpoint with an output queue paces queued packets to the speed of
+ * its link. Packets of the same nonzero class supersede one another
+ * while they're still queued. Data written with gioWriteData() is
+ * written after everything which has already been queued.
+ */
+extern int gioEnableOutputQueue (GioEndpoint *endpoint);
+extern ssize_t gioQueueData (GioEndpoint *endpoint, unsigned int class, const void *data, size_t size);
+extern int gioServiceOutput (GioEndpoint *endpoint);
+extern int gioFlushOutput (GioEndpoint *endpoint);
+extern unsigned int gioGetOutputQueueDepth (GioEndpoint *endpoint);
+
 extern int gioAwaitInput (GioEndpoint *endpoint, int timeout);
 extern ssize_t gioReadData (GioEndpoint *endpoint, void *buffer, size_t size, int wait);
 extern int gioReadByte (GioEndpoint *endpoint, unsigned char *byte, int wait);
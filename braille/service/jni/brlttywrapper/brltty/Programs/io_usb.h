@@ -28,6 +28,9 @@ extern "C" {
 
 extern void usbForgetDevices (void);
 
+typedef void (*UsbHotplugHandler) (void *data);
+extern void usbSetHotplugHandler (UsbHotplugHandler handler, void *data);
+
 typedef struct UsbDeviceStruct UsbDevice;
 typedef int (*UsbDeviceChooser) (UsbDevice *device, void *data);
 extern UsbDevice *usbFindDevice (UsbDeviceChooser chooser, void *data);
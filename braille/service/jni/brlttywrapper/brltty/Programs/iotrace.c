@@ -0,0 +1,299 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+#include "prologue.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif /* HAVE_SIGNAL_H */
+
+#include "log.h"
+#include "timing.h"
+#include "iotrace.h"
+
+/*
+ * Tracing is always on, so recording a transfer must be cheap: reserve
+ * consecutive slots with one atomic increment, then fill them in without
+ * any formatting. A slot's sequence is zero while it's being written,
+ * which lets a reader (possibly a signal handler) skip torn records.
+ */
+#define IO_TRACE_RECORD_COUNT 0X400 /* must be a power of two */
+#define IO_TRACE_TRANSFER_LIMIT 8 /* most records for one transfer */
+
+static IoTraceRecord ioTraceRecords[IO_TRACE_RECORD_COUNT];
+static uint32_t ioTraceNext = 0;
+static uint32_t ioTraceEndpointCount = 0;
+
+#if defined(__GNUC__)
+#define IO_TRACE_RESERVE(variable,count) __sync_fetch_and_add(&(variable), (count))
+#define IO_TRACE_BARRIER() __sync_synchronize()
+#else /* atomic operations */
+#define IO_TRACE_RESERVE(variable,count) (((variable) += (count)) - (count))
+#define IO_TRACE_BARRIER()
+#endif /* atomic operations */
+
+static inline uint32_t
+getRecordSequence (const IoTraceRecord *record) {
+  return *(const volatile uint32_t *)&record->sequence;
+}
+
+static inline void
+setRecordSequence (IoTraceRecord *record, uint32_t sequence) {
+  *(volatile uint32_t *)&record->sequence = sequence;
+}
+
+uint32_t
+newIoTraceEndpoint (IoTraceResource resource) {
+  uint32_t number = IO_TRACE_RESERVE(ioTraceEndpointCount, 1);
+  return IO_TRACE_ENDPOINT(resource, number);
+}
+
+void
+traceIo (uint32_t endpoint, IoTraceDirection direction, const void *data, size_t size) {
+  const unsigned char *bytes = data;
+  uint16_t total = MIN(size, UINT16_MAX);
+  unsigned int count = (size + IO_TRACE_RECORD_BYTES - 1) / IO_TRACE_RECORD_BYTES;
+  uint32_t sequence;
+  TimeValue now;
+
+  if (!count) return;
+  if (count > IO_TRACE_TRANSFER_LIMIT) count = IO_TRACE_TRANSFER_LIMIT;
+
+  getMonotonicTime(&now);
+  sequence = IO_TRACE_RESERVE(ioTraceNext, count);
+
+  while (count) {
+    IoTraceRecord *record = &ioTraceRecords[sequence & (IO_TRACE_RECORD_COUNT - 1)];
+    size_t length = MIN(size, IO_TRACE_RECORD_BYTES);
+
+    setRecordSequence(record, 0);
+    IO_TRACE_BARRIER();
+
+    record->seconds = now.seconds;
+    record->nanoseconds = now.nanoseconds;
+    record->endpoint = endpoint;
+    record->direction = direction;
+    record->flags = (bytes == data)? 0: IO_TRACE_FLAG_CONTINUED;
+    record->size = total;
+    record->count = length;
+    record->reserved = 0;
+    memcpy(record->bytes, bytes, length);
+
+    IO_TRACE_BARRIER();
+    setRecordSequence(record, sequence+1);
+
+    bytes += length;
+    size -= length;
+    sequence += 1;
+    count -= 1;
+  }
+}
+
+static int
+writeIoTraceBytes (int fileDescriptor, const void *data, size_t size) {
+  const unsigned char *bytes = data;
+
+  while (size) {
+    ssize_t result = write(fileDescriptor, bytes, size);
+
+    if (result == -1) {
+      if (errno == EINTR) continue;
+      return 0;
+    }
+
+    bytes += result;
+    size -= result;
+  }
+
+  return 1;
+}
+
+int
+writeIoTrace (int fileDescriptor) {
+  /* Only async-signal-safe calls may be made here. */
+  uint32_t end = ioTraceNext;
+  uint32_t sequence = (end > IO_TRACE_RECORD_COUNT)? (end - IO_TRACE_RECORD_COUNT): 0;
+
+  {
+    IoTraceHeader header;
+
+    memcpy(header.magic, IO_TRACE_MAGIC, sizeof(header.magic));
+    header.version = IO_TRACE_VERSION;
+    header.byteOrder = IO_TRACE_BYTE_ORDER;
+    header.recordSize = sizeof(IoTraceRecord);
+    header.recordBytes = IO_TRACE_RECORD_BYTES;
+
+    if (!writeIoTraceBytes(fileDescriptor, &header, sizeof(header))) return 0;
+  }
+
+  while (sequence != end) {
+    const IoTraceRecord *slot = &ioTraceRecords[sequence & (IO_TRACE_RECORD_COUNT - 1)];
+
+    if (getRecordSequence(slot) == (sequence + 1)) {
+      IoTraceRecord record;
+
+      IO_TRACE_BARRIER();
+      record = *slot;
+      IO_TRACE_BARRIER();
+
+      if (getRecordSequence(slot) == (sequence + 1)) {
+        record.sequence = sequence;
+        if (!writeIoTraceBytes(fileDescriptor, &record, sizeof(record))) return 0;
+      }
+    }
+
+    sequence += 1;
+  }
+
+  return 1;
+}
+
+static int
+openIoTraceFile (const char *path) {
+  return open(path, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+}
+
+int
+saveIoTrace (const char *path) {
+  int fileDescriptor = openIoTraceFile(path);
+
+  if (fileDescriptor != -1) {
+    int ok = writeIoTrace(fileDescriptor);
+
+    if (!ok) logSystemError("write");
+    close(fileDescriptor);
+    if (ok) return 1;
+  } else {
+    logMessage(LOG_WARNING, "cannot create I/O trace file: %s: %s",
+               path, strerror(errno));
+  }
+
+  return 0;
+}
+
+#ifdef HAVE_SIGACTION
+static char *ioTraceFile = NULL;
+
+static void
+dumpIoTrace (void) {
+  int originalErrno = errno;
+  int fileDescriptor = openIoTraceFile(ioTraceFile);
+
+  if (fileDescriptor != -1) {
+    writeIoTrace(fileDescriptor);
+    close(fileDescriptor);
+  }
+
+  errno = originalErrno;
+}
+
+static void
+handleDumpRequest (int signalNumber) {
+  dumpIoTrace();
+}
+
+typedef struct {
+  int signalNumber;
+  struct sigaction oldAction;
+} CrashSignalEntry;
+
+static CrashSignalEntry crashSignalTable[] = {
+  { .signalNumber = SIGSEGV },
+  { .signalNumber = SIGBUS },
+  { .signalNumber = SIGILL },
+  { .signalNumber = SIGFPE },
+  { .signalNumber = SIGABRT }
+};
+
+static void
+handleCrash (int signalNumber) {
+  CrashSignalEntry *crash = crashSignalTable;
+  const CrashSignalEntry *end = crash + ARRAY_COUNT(crashSignalTable);
+
+  dumpIoTrace();
+
+  /* Put back whatever was there before. A fault recurs when we return,
+   * and abort() raises its signal again, so that handler still runs.
+   */
+  while (crash < end) {
+    if (crash->signalNumber == signalNumber) {
+      sigaction(signalNumber, &crash->oldAction, NULL);
+      break;
+    }
+
+    crash += 1;
+  }
+}
+
+static int
+handleIoTraceSignal (int signalNumber, void (*handler) (int), struct sigaction *oldAction) {
+  struct sigaction action;
+
+  memset(&action, 0, sizeof(action));
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = handler;
+
+  if (sigaction(signalNumber, &action, oldAction) != -1) return 1;
+  logSystemError("sigaction");
+  return 0;
+}
+
+int
+setIoTraceFile (const char *path) {
+  char *file;
+
+  if (ioTraceFile) {
+    logMessage(LOG_WARNING, "I/O trace file already set: %s", ioTraceFile);
+    return 0;
+  }
+
+  if (!(file = strdup(path))) {
+    logMallocError();
+    return 0;
+  }
+
+  ioTraceFile = file;
+
+  {
+    CrashSignalEntry *crash = crashSignalTable;
+    const CrashSignalEntry *end = crash + ARRAY_COUNT(crashSignalTable);
+
+    while (crash < end) {
+      handleIoTraceSignal(crash->signalNumber, handleCrash, &crash->oldAction);
+      crash += 1;
+    }
+  }
+
+#ifdef SIGUSR2
+  handleIoTraceSignal(SIGUSR2, handleDumpRequest, NULL);
+#endif /* SIGUSR2 */
+
+  logMessage(LOG_DEBUG, "I/O trace file: %s", ioTraceFile);
+  return 1;
+}
+#else /* HAVE_SIGACTION */
+int
+setIoTraceFile (const char *path) {
+  logMessage(LOG_WARNING, "I/O trace dumping not supported");
+  return 0;
+}
+#endif /* HAVE_SIGACTION */
@@ -0,0 +1,93 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+#ifndef BRLTTY_INCLUDED_IOTRACE
+#define BRLTTY_INCLUDED_IOTRACE
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef enum {
+  IO_TRACE_GENERIC,
+  IO_TRACE_SERIAL,
+  IO_TRACE_USB,
+  IO_TRACE_BLUETOOTH
+} IoTraceResource;
+
+typedef enum {
+  IO_TRACE_INPUT,
+  IO_TRACE_OUTPUT
+} IoTraceDirection;
+
+/* The endpoint of a record is its resource type in the high byte and a
+ * per-connection number in the low three bytes.
+ */
+#define IO_TRACE_ENDPOINT_NUMBER_MASK 0XFFFFFF
+#define IO_TRACE_ENDPOINT(resource,number) (((uint32_t)(resource) << 24) | ((number) & IO_TRACE_ENDPOINT_NUMBER_MASK))
+#define IO_TRACE_ENDPOINT_RESOURCE(endpoint) ((endpoint) >> 24)
+#define IO_TRACE_ENDPOINT_NUMBER(endpoint) ((endpoint) & IO_TRACE_ENDPOINT_NUMBER_MASK)
+
+extern uint32_t newIoTraceEndpoint (IoTraceResource resource);
+extern void traceIo (uint32_t endpoint, IoTraceDirection direction, const void *data, size_t size);
+
+extern int writeIoTrace (int fileDescriptor);
+extern int saveIoTrace (const char *path);
+extern int setIoTraceFile (const char *path);
+
+/* The layout of a saved trace.
+ * Every field is in the byte order of the writer (see byteOrder).
+ */
+#define IO_TRACE_MAGIC "BRLTTYIO"
+#define IO_TRACE_VERSION 2
+#define IO_TRACE_BYTE_ORDER 0X01020304
+#define IO_TRACE_RECORD_BYTES 42
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t recordSize;
+  uint32_t recordBytes;
+} IoTraceHeader;
+
+/* The header is followed by records, oldest first, until end of file.
+ * A transfer which doesn't fit into one record continues into the next
+ * ones, each of which has IO_TRACE_FLAG_CONTINUED set, and size is always
+ * that of the whole transfer.
+ */
+
+#define IO_TRACE_FLAG_CONTINUED 0X01
+
+typedef struct {
+  uint32_t sequence;
+  int32_t seconds;
+  int32_t nanoseconds;
+  uint32_t endpoint;
+  uint16_t size;
+  uint8_t direction;
+  uint8_t flags;
+  uint8_t count;
+  uint8_t reserved;
+  unsigned char bytes[IO_TRACE_RECORD_BYTES];
+} IoTraceRecord;
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* BRLTTY_INCLUDED_IOTRACE */
@@ -40,6 +40,13 @@
 
 #include "bitmask.h"
 #include "async.h"
+#include "timing.h"
+#include "metrics.h"
+
+/* Fast typing and autorepeat deliver events faster than the main loop
+ * wakes up, so as many as this are read and handled at a time.
+ */
+#define KEYBOARD_EVENT_BATCH_SIZE 64
 
 typedef struct {
   KeyEventHandler *handleKeyEvent;
@@ -77,9 +84,18 @@ handleKeyboardEvent (const AsyncInputResult *result) {
     logMessage(LOG_DEBUG, "keyboard end-of-file: fd=%d", kpd->fileDescriptor);
     closeKeyboard(kpd);
   } else {
+    /* All of the events which arrived together are handled in order, so
+     * the groups ending with each SYN_REPORT are still forwarded intact.
+     */
     const struct input_event *event = result->buffer;
+    size_t count = result->length / sizeof(*event);
+    const struct input_event *end = event + count;
+    TimeValue start;
+
+    if (!count) return 0;
+    getMonotonicTime(&start);
 
-    if (result->length >= sizeof(*event)) {
+    for (; event < end; event += 1) {
       if (event->type == EV_KEY) {
         int release = event->value == 0;
         int press   = event->value == 1;
@@ -605,9 +621,12 @@ handleKeyboardEvent (const AsyncInputResult *result) {
       } else {
         writeInputEvent(event->type, event->code, event->value);
       }
-
-      return sizeof(*event);
     }
+
+    addToCounter(COUNTER_KEYBOARD_READS, 1);
+    addToCounter(COUNTER_KEYBOARD_EVENTS, count);
+    addLatencySince(LATENCY_KEYBOARD_DISPATCH, &start);
+    return count * sizeof(*event);
   }
 
   return 0;
@@ -667,7 +686,7 @@ monitorKeyboard (int device, KeyboardCommonData *kcd) {
         if (kpd->actualProperties.type) {
           if (checkKeyboardProperties(&kpd->actualProperties, &kcd->requiredProperties)) {
             if (hasInputEvent(device, EV_KEY, KEY_ENTER, KEY_MAX)) {
-              if (asyncRead(device, sizeof(struct input_event), handleKeyboardEvent, kpd)) {
+              if (asyncRead(device, KEYBOARD_EVENT_BATCH_SIZE * sizeof(struct input_event), handleKeyboardEvent, kpd)) {
 #ifdef EVIOCGRAB
                 ioctl(device, EVIOCGRAB, 1);
 #endif /* EVIOCGRAB */
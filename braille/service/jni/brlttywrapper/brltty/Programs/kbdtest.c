@@ -0,0 +1,331 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+
+/* kbdtest.c - Test program for the keyboard monitor
+ *
+ * A virtual keyboard is created via uinput and the keyboard monitor is
+ * started on it. Key presses are then typed on it in bursts, as a fast
+ * typist or autorepeat would, and the program checks that every key event
+ * reaches the key event handler in order. It reports how many events the
+ * monitor handled per read, and what dispatching each one cost.
+ */
+
+#include "prologue.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef HAVE_LINUX_UINPUT_H
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#endif /* HAVE_LINUX_UINPUT_H */
+
+#include "program.h"
+#include "options.h"
+#include "log.h"
+#include "parse.h"
+#include "timing.h"
+#include "async.h"
+#include "metrics.h"
+#include "kbd.h"
+#include "ktb_keyboard.h"
+
+static char *opt_pressCount;
+static char *opt_burstSize;
+
+BEGIN_OPTION_TABLE(programOptions)
+  { .letter = 'c',
+    .word = "count",
+    .argument = "presses",
+    .setting.string = &opt_pressCount,
+    .defaultSetting = "1000",
+    .description = "Number of key presses to type."
+  },
+
+  { .letter = 'b',
+    .word = "burst",
+    .argument = "presses",
+    .setting.string = &opt_burstSize,
+    .defaultSetting = "8",
+    .description = "Number of key presses to type at a time."
+  },
+END_OPTION_TABLE
+
+#ifdef HAVE_LINUX_UINPUT_H
+#define TEST_KEYBOARD_NAME "brltty keyboard test"
+#define TEST_KEYBOARD_VENDOR 0XFFFF
+#define TEST_KEYBOARD_PRODUCT 0XB7E5
+
+#define TEST_TIMEOUT 2000
+
+typedef struct {
+  uint16_t code;
+  unsigned char key;
+} TestKey;
+
+static const TestKey testKeys[] = {
+  {.code=KEY_A, .key=KBD_KEY_LETTER_A},
+  {.code=KEY_S, .key=KBD_KEY_LETTER_S},
+  {.code=KEY_D, .key=KBD_KEY_LETTER_D},
+  {.code=KEY_F, .key=KBD_KEY_LETTER_F},
+  {.code=KEY_J, .key=KBD_KEY_LETTER_J},
+  {.code=KEY_K, .key=KBD_KEY_LETTER_K},
+  {.code=KEY_L, .key=KBD_KEY_LETTER_L},
+  {.code=KEY_ENTER, .key=KBD_KEY_FUNCTION_Enter}
+};
+
+static unsigned int expectedEvents;
+static unsigned int receivedEvents;
+static unsigned int misorderedEvents;
+
+/* Events i*2 and i*2+1 are the press and release of key i. */
+static KeyTableState
+handleKeyEvent (unsigned char set, unsigned char key, int press) {
+  const TestKey *expected = &testKeys[(receivedEvents / 2) % ARRAY_COUNT(testKeys)];
+  int expectedPress = !(receivedEvents % 2);
+
+  if ((set != 0) || (key != expected->key) || (press != expectedPress)) {
+    if (!misorderedEvents++) {
+      logMessage(LOG_WARNING, "unexpected key event: #%u: set=%u key=%u press=%d",
+                 receivedEvents, set, key, press);
+    }
+  }
+
+  receivedEvents += 1;
+  return KTS_HOTKEY;
+}
+
+static void
+setInputEvent (struct input_event *event, uint16_t type, uint16_t code, int32_t value) {
+  memset(event, 0, sizeof(*event));
+  event->type = type;
+  event->code = code;
+  event->value = value;
+}
+
+/* Each press is written as its own SYN_REPORT group, followed by the group
+ * for its release.
+ */
+static int
+typeKeys (int device, unsigned int first, unsigned int count) {
+  struct input_event events[count * 4];
+  struct input_event *event = events;
+
+  while (count) {
+    uint16_t code = testKeys[first % ARRAY_COUNT(testKeys)].code;
+
+    setInputEvent(event++, EV_KEY, code, 1);
+    setInputEvent(event++, EV_SYN, SYN_REPORT, 0);
+    setInputEvent(event++, EV_KEY, code, 0);
+    setInputEvent(event++, EV_SYN, SYN_REPORT, 0);
+
+    first += 1;
+    count -= 1;
+  }
+
+  expectedEvents += (event - events) / 2;
+
+  if (write(device, events, (event - events) * sizeof(*event)) == -1) {
+    logSystemError("write(struct input_event)");
+    return 0;
+  }
+
+  return 1;
+}
+
+static int
+awaitKeyEvents (void) {
+  TimePeriod period;
+  startTimePeriod(&period, TEST_TIMEOUT);
+
+  while (receivedEvents < expectedEvents) {
+    if (afterTimePeriod(&period, NULL)) return 0;
+    asyncWait(1);
+  }
+
+  return 1;
+}
+
+static int
+createTestKeyboard (void) {
+  int device = open("/dev/uinput", O_WRONLY);
+
+  if (device != -1) {
+    struct uinput_user_dev description;
+
+    memset(&description, 0, sizeof(description));
+    strcpy(description.name, TEST_KEYBOARD_NAME);
+    description.id.bustype = BUS_USB;
+    description.id.vendor = TEST_KEYBOARD_VENDOR;
+    description.id.product = TEST_KEYBOARD_PRODUCT;
+
+    if (ioctl(device, UI_SET_EVBIT, EV_KEY) != -1) {
+      unsigned int index;
+
+      for (index=0; index<ARRAY_COUNT(testKeys); index+=1) {
+        if (ioctl(device, UI_SET_KEYBIT, testKeys[index].code) == -1) {
+          logSystemError("ioctl[UI_SET_KEYBIT]");
+          goto error;
+        }
+      }
+
+      if (write(device, &description, sizeof(description)) != -1) {
+        if (ioctl(device, UI_DEV_CREATE) != -1) return device;
+        logSystemError("ioctl[UI_DEV_CREATE]");
+      } else {
+        logSystemError("write(struct uinput_user_dev)");
+      }
+    } else {
+      logSystemError("ioctl[UI_SET_EVBIT]");
+    }
+
+  error:
+    close(device);
+  } else {
+    logMessage(LOG_ERR, "cannot open uinput: %s", strerror(errno));
+  }
+
+  return -1;
+}
+
+static void
+destroyTestKeyboard (int device) {
+  ioctl(device, UI_DEV_DESTROY);
+  close(device);
+}
+
+static ProgramExitStatus
+testKeyboardMonitor (int device, unsigned int pressCount, unsigned int burstSize) {
+  static const KeyboardProperties properties = {
+    .type = KBD_TYPE_USB,
+    .vendor = TEST_KEYBOARD_VENDOR,
+    .product = TEST_KEYBOARD_PRODUCT
+  };
+
+  /* give udev time to create the event device */
+  approximateDelay(1000);
+
+  if (!startKeyboardMonitor(&properties, handleKeyEvent)) {
+    logMessage(LOG_ERR, "keyboard monitor not started");
+    return PROG_EXIT_FATAL;
+  }
+
+  if (!typeKeys(device, 0, 1)) return PROG_EXIT_FATAL;
+
+  if (!awaitKeyEvents()) {
+    logMessage(LOG_ERR, "test keyboard not being monitored");
+    return PROG_EXIT_FATAL;
+  }
+
+  expectedEvents = receivedEvents = 0;
+  resetMetrics();
+
+  {
+    unsigned int typed = 0;
+
+    while (typed < pressCount) {
+      unsigned int count = MIN(burstSize, pressCount-typed);
+
+      if (!typeKeys(device, typed, count)) return PROG_EXIT_FATAL;
+      typed += count;
+
+      /* let the monitor catch up before the kernel's buffer fills */
+      asyncWait(1);
+    }
+  }
+
+  awaitKeyEvents();
+
+  {
+    uint32_t reads = getCounterValue(COUNTER_KEYBOARD_READS);
+    uint32_t events = getCounterValue(COUNTER_KEYBOARD_EVENTS);
+    LatencyHistogram histogram;
+    char buffer[0X200];
+
+    getLatencyHistogram(LATENCY_KEYBOARD_DISPATCH, &histogram);
+
+    printf("key events: %u of %u (%u out of order)\n",
+           receivedEvents, expectedEvents, misorderedEvents);
+    printf("input events: %" PRIu32 " in %" PRIu32 " reads (%.1f per read)\n",
+           events, reads, (reads? ((double)events / reads): 0.0));
+    printf("dispatch: %.2fus per event\n",
+           (events? ((double)histogram.total / events): 0.0));
+
+    formatLatencyHistogram(buffer, sizeof(buffer), getLatencyName(LATENCY_KEYBOARD_DISPATCH), &histogram);
+    printf("%s\n", buffer);
+  }
+
+  if (misorderedEvents || (receivedEvents != expectedEvents)) return PROG_EXIT_SEMANTIC;
+  return PROG_EXIT_SUCCESS;
+}
+#endif /* HAVE_LINUX_UINPUT_H */
+
+int
+main (int argc, char *argv[]) {
+  ProgramExitStatus exitStatus;
+  int pressCount;
+  int burstSize;
+
+  {
+    static const OptionsDescriptor descriptor = {
+      OPTION_TABLE(programOptions),
+      .applicationName = "kbdtest"
+    };
+    PROCESS_OPTIONS(descriptor, argc, argv);
+  }
+
+  {
+    static const int minimum = 1;
+
+    if (!validateInteger(&pressCount, opt_pressCount, &minimum, NULL)) {
+      logMessage(LOG_ERR, "invalid press count: %s", opt_pressCount);
+      return PROG_EXIT_SYNTAX;
+    }
+
+    if (!validateInteger(&burstSize, opt_burstSize, &minimum, NULL)) {
+      logMessage(LOG_ERR, "invalid burst size: %s", opt_burstSize);
+      return PROG_EXIT_SYNTAX;
+    }
+  }
+
+  if (argc) {
+    logMessage(LOG_ERR, "too many parameters");
+    return PROG_EXIT_SYNTAX;
+  }
+
+#ifdef HAVE_LINUX_UINPUT_H
+  {
+    int device = createTestKeyboard();
+
+    if (device != -1) {
+      exitStatus = testKeyboardMonitor(device, pressCount, burstSize);
+      destroyTestKeyboard(device);
+    } else {
+      exitStatus = PROG_EXIT_FATAL;
+    }
+  }
+#else /* HAVE_LINUX_UINPUT_H */
+  logMessage(LOG_ERR, "uinput not supported");
+  exitStatus = PROG_EXIT_FATAL;
+#endif /* HAVE_LINUX_UINPUT_H */
+
+  return exitStatus;
+}
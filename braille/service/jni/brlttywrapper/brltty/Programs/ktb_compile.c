@@ -24,6 +24,8 @@
 #include "log.h"
 #include "file.h"
 #include "datafile.h"
+#include "dataarea.h"
+#include "dataimage.h"
 #include "cmd.h"
 #include "brldefs.h"
 #include "ktb.h"
@@ -1229,6 +1231,8 @@ done:
   return ok;
 }
 
+static int sortKeyBindingEntries (KeyContext *ctx);
+
 static int
 prepareKeyBindings (KeyContext *ctx) {
   if (!addIncompleteBindings(ctx)) return 0;
@@ -1251,6 +1255,11 @@ prepareKeyBindings (KeyContext *ctx) {
     ctx->keyBindings.size = ctx->keyBindings.count;
   }
 
+  return sortKeyBindingEntries(ctx);
+}
+
+static int
+sortKeyBindingEntries (KeyContext *ctx) {
   if (ctx->keyBindings.count) {
     if (!(ctx->keyBindings.sorted = malloc(ARRAY_SIZE(ctx->keyBindings.sorted, ctx->keyBindings.count)))) {
       logMallocError();
@@ -1360,48 +1369,424 @@ finishKeyTable (KeyTableData *ktd) {
   return 1;
 }
 
-KeyTable *
-compileKeyTable (const char *name, KEY_NAME_TABLES_REFERENCE keys) {
+/* Key tables hold pointers, so their image is a flattened, offset-based copy
+ * which is expanded back into an ordinary key table when it's loaded. Key
+ * values and command codes are stored as numbers, which is why the image
+ * variant identifies the key names, commands, and keyboard functions that
+ * they were resolved against.
+ */
+
+#define KEY_TABLE_IMAGE_TYPE "ktb-1"
+
+typedef uint32_t KeyTableImageOffset;
+
+typedef struct {
+  KeyTableImageOffset title;
+  KeyTableImageOffset notes;
+  uint32_t noteCount;
+  KeyTableImageOffset contexts;
+  uint32_t contextCount;
+} KeyTableImageHeader;
+
+typedef struct {
+  KeyValue keyValue;
+  int32_t keyboardFunction;
+} KeyTableImageMappedKey;
+
+typedef struct {
+  KeyTableImageOffset title;
+  KeyTableImageOffset keyBindings;
+  uint32_t keyBindingCount;
+  KeyTableImageOffset hotkeys;
+  uint32_t hotkeyCount;
+  KeyTableImageOffset mappedKeys;
+  uint32_t mappedKeyCount;
+  uint32_t superimpose;
+} KeyTableImageContext;
+
+static void
+makeKeyTableImageVariant (char *variant, size_t size, KEY_NAME_TABLES_REFERENCE keys) {
+  uint32_t checksum = 0;
+
+  {
+    const KeyNameEntry *const *knt = keys;
+
+    while (*knt) {
+      const KeyNameEntry *kne = *knt++;
+
+      while (kne->name) {
+        checksum = makeDataImageChecksum(checksum, kne->name, strlen(kne->name) + 1);
+        checksum = makeDataImageChecksum(checksum, &kne->value, sizeof(kne->value));
+        kne += 1;
+      }
+    }
+  }
+
+  {
+    const CommandEntry *command = commandTable;
+
+    while (command->name) {
+      checksum = makeDataImageChecksum(checksum, command->name, strlen(command->name) + 1);
+      checksum = makeDataImageChecksum(checksum, &command->code, sizeof(command->code));
+      command += 1;
+    }
+  }
+
+  checksum = makeDataImageChecksum(checksum, &keyboardFunctionCount, sizeof(keyboardFunctionCount));
+  snprintf(variant, size, "%08" PRIX32, checksum);
+}
+
+static int
+saveKeyTableImageString (DataArea *area, KeyTableImageOffset *offset, const wchar_t *string) {
+  DataOffset item;
+
+  if (!string) {
+    *offset = 0;
+    return 1;
+  }
+
+  if (!saveDataItem(area, &item, string, (wcslen(string) + 1) * sizeof(*string), __alignof__(wchar_t))) return 0;
+  *offset = item;
+  return 1;
+}
+
+static int
+saveKeyTableImageArray (DataArea *area, KeyTableImageOffset *offset, const void *array, size_t size, unsigned int alignment) {
+  DataOffset item;
+
+  if (!size) {
+    *offset = 0;
+    return 1;
+  }
+
+  if (!saveDataItem(area, &item, array, size, alignment)) return 0;
+  *offset = item;
+  return 1;
+}
+
+static int
+saveKeyTableImageContext (DataArea *area, KeyTableImageOffset offset, const KeyContext *ctx) {
+  KeyTableImageContext context;
+  memset(&context, 0, sizeof(context));
+
+  if (!saveKeyTableImageString(area, &context.title, ctx->title)) return 0;
+
+  context.keyBindingCount = ctx->keyBindings.count;
+  if (!saveKeyTableImageArray(area, &context.keyBindings, ctx->keyBindings.table,
+                              ARRAY_SIZE(ctx->keyBindings.table, ctx->keyBindings.count),
+                              __alignof__(KeyBinding))) return 0;
+
+  context.hotkeyCount = ctx->hotkeys.count;
+  if (!saveKeyTableImageArray(area, &context.hotkeys, ctx->hotkeys.table,
+                              ARRAY_SIZE(ctx->hotkeys.table, ctx->hotkeys.count),
+                              __alignof__(HotkeyEntry))) return 0;
+
+  context.mappedKeyCount = ctx->mappedKeys.count;
+  context.superimpose = ctx->mappedKeys.superimpose;
+
+  if (ctx->mappedKeys.count) {
+    KeyTableImageMappedKey mappedKeys[ctx->mappedKeys.count];
+    unsigned int index;
+
+    for (index=0; index<ctx->mappedKeys.count; index+=1) {
+      const MappedKeyEntry *map = &ctx->mappedKeys.table[index];
+      KeyTableImageMappedKey *mappedKey = &mappedKeys[index];
+
+      mappedKey->keyValue = map->keyValue;
+      mappedKey->keyboardFunction = map->keyboardFunction? (map->keyboardFunction - keyboardFunctionTable): -1;
+    }
+
+    if (!saveKeyTableImageArray(area, &context.mappedKeys, mappedKeys, sizeof(mappedKeys),
+                                __alignof__(KeyTableImageMappedKey))) return 0;
+  }
+
+  memcpy(getDataItem(area, offset), &context, sizeof(context));
+  return 1;
+}
+
+static void
+saveKeyTableImage (const char *name, KEY_NAME_TABLES_REFERENCE keys, const KeyTable *table) {
+  DataArea *area;
+
+  if ((area = newDataArea())) {
+    KeyTableImageHeader header;
+    memset(&header, 0, sizeof(header));
+
+    if (allocateDataItem(area, NULL, sizeof(header), __alignof__(KeyTableImageHeader))) {
+      if (saveKeyTableImageString(area, &header.title, table->title)) {
+        unsigned int index;
+        DataOffset offset;
+
+        header.noteCount = table->noteCount;
+        if (!allocateDataItem(area, &offset, ARRAY_SIZE((KeyTableImageOffset *)NULL, table->noteCount) + 1,
+                              __alignof__(KeyTableImageOffset))) goto done;
+        header.notes = offset;
+
+        for (index=0; index<table->noteCount; index+=1) {
+          KeyTableImageOffset note;
+
+          if (!saveKeyTableImageString(area, &note, table->noteTable[index])) goto done;
+          memcpy((KeyTableImageOffset *)getDataItem(area, header.notes) + index, &note, sizeof(note));
+        }
+
+        header.contextCount = table->keyContextCount;
+        if (!allocateDataItem(area, &offset, ARRAY_SIZE((KeyTableImageContext *)NULL, table->keyContextCount) + 1,
+                              __alignof__(KeyTableImageContext))) goto done;
+        header.contexts = offset;
+
+        for (index=0; index<table->keyContextCount; index+=1) {
+          if (!saveKeyTableImageContext(area, header.contexts + (index * sizeof(KeyTableImageContext)),
+                                        &table->keyContextTable[index])) goto done;
+        }
+
+        memcpy(getDataItem(area, 0), &header, sizeof(header));
+
+        {
+          char variant[0X10];
+
+          makeKeyTableImageVariant(variant, sizeof(variant), keys);
+          saveDataImage(name, KEY_TABLE_IMAGE_TYPE, variant, getDataItem(area, 0), getDataSize(area));
+        }
+      }
+    }
+
+  done:
+    destroyDataArea(area);
+  }
+}
+
+static const void *
+getKeyTableImageItem (const unsigned char *bytes, size_t size, KeyTableImageOffset offset, size_t length) {
+  if (offset > size) return NULL;
+  if (length > (size - offset)) return NULL;
+  return &bytes[offset];
+}
+
+static int
+loadKeyTableImageString (const unsigned char *bytes, size_t size, KeyTableImageOffset offset, wchar_t **string) {
+  const wchar_t *characters;
+  size_t length = 0;
+
+  *string = NULL;
+  if (!offset) return 1;
+
+  while (1) {
+    wchar_t character;
+
+    if (!(characters = getKeyTableImageItem(bytes, size, offset, (length + 1) * sizeof(*characters)))) return 0;
+    memcpy(&character, &characters[length], sizeof(character));
+    if (!character) break;
+    length += 1;
+  }
+
+  if (!(*string = malloc(ARRAY_SIZE(*string, length+1)))) {
+    logMallocError();
+    return 0;
+  }
+
+  memcpy(*string, characters, (length + 1) * sizeof(*characters));
+  return 1;
+}
+
+static int
+loadKeyTableImageArray (const unsigned char *bytes, size_t size, KeyTableImageOffset offset, size_t length, void **array) {
+  const void *source;
+
+  *array = NULL;
+  if (!length) return 1;
+  if (!(source = getKeyTableImageItem(bytes, size, offset, length))) return 0;
+
+  if (!(*array = malloc(length))) {
+    logMallocError();
+    return 0;
+  }
+
+  memcpy(*array, source, length);
+  return 1;
+}
+
+static int
+loadKeyTableImageContext (const unsigned char *bytes, size_t size, const KeyTableImageContext *context, KeyContext *ctx) {
+  void *array;
+
+  if (!loadKeyTableImageString(bytes, size, context->title, &ctx->title)) return 0;
+
+  if (!loadKeyTableImageArray(bytes, size, context->keyBindings,
+                              ARRAY_SIZE(ctx->keyBindings.table, context->keyBindingCount), &array)) return 0;
+  ctx->keyBindings.table = array;
+  ctx->keyBindings.size = ctx->keyBindings.count = context->keyBindingCount;
+
+  if (!loadKeyTableImageArray(bytes, size, context->hotkeys,
+                              ARRAY_SIZE(ctx->hotkeys.table, context->hotkeyCount), &array)) return 0;
+  ctx->hotkeys.table = array;
+  ctx->hotkeys.count = context->hotkeyCount;
+
+  ctx->mappedKeys.superimpose = context->superimpose;
+
+  if (context->mappedKeyCount) {
+    const KeyTableImageMappedKey *mappedKeys;
+    unsigned int index;
+
+    if (!(mappedKeys = getKeyTableImageItem(bytes, size, context->mappedKeys,
+                                            ARRAY_SIZE(mappedKeys, context->mappedKeyCount)))) return 0;
+
+    if (!(ctx->mappedKeys.table = malloc(ARRAY_SIZE(ctx->mappedKeys.table, context->mappedKeyCount)))) {
+      logMallocError();
+      return 0;
+    }
+    ctx->mappedKeys.count = context->mappedKeyCount;
+
+    for (index=0; index<context->mappedKeyCount; index+=1) {
+      const KeyTableImageMappedKey *mappedKey = &mappedKeys[index];
+      MappedKeyEntry *map = &ctx->mappedKeys.table[index];
+      int function = mappedKey->keyboardFunction;
+
+      if (function >= keyboardFunctionCount) return 0;
+      map->keyValue = mappedKey->keyValue;
+      map->keyboardFunction = (function < 0)? NULL: &keyboardFunctionTable[function];
+    }
+  }
+
+  if (!sortKeyBindingEntries(ctx)) return 0;
+  if (!prepareHotkeyEntries(ctx)) return 0;
+  if (!prepareMappedKeyEntries(ctx)) return 0;
+  return 1;
+}
+
+static int
+loadKeyTableImageContent (KeyTableData *ktd, const unsigned char *bytes, size_t size) {
+  KeyTable *table = ktd->table;
+  const KeyTableImageHeader *header;
+
+  if (!(header = getKeyTableImageItem(bytes, size, 0, sizeof(*header)))) return 0;
+  if (!loadKeyTableImageString(bytes, size, header->title, &table->title)) return 0;
+
+  if (header->noteCount) {
+    const KeyTableImageOffset *notes;
+
+    if (!(notes = getKeyTableImageItem(bytes, size, header->notes, ARRAY_SIZE(notes, header->noteCount)))) return 0;
+
+    if (!(table->noteTable = malloc(ARRAY_SIZE(table->noteTable, header->noteCount)))) {
+      logMallocError();
+      return 0;
+    }
+
+    while (table->noteCount < header->noteCount) {
+      if (!loadKeyTableImageString(bytes, size, notes[table->noteCount], &table->noteTable[table->noteCount])) return 0;
+      table->noteCount += 1;
+    }
+  }
+
+  if (header->contextCount) {
+    const KeyTableImageContext *contexts;
+    unsigned int index;
+
+    if (!(contexts = getKeyTableImageItem(bytes, size, header->contexts, ARRAY_SIZE(contexts, header->contextCount)))) return 0;
+    if (!getKeyContext(ktd, header->contextCount-1)) return 0;
+
+    for (index=0; index<header->contextCount; index+=1) {
+      if (!loadKeyTableImageContext(bytes, size, &contexts[index], &table->keyContextTable[index])) return 0;
+    }
+  }
+
+  qsort(table->keyNameTable, table->keyNameCount, sizeof(*table->keyNameTable), sortKeyValues);
+  resetKeyTable(table);
+  return 1;
+}
+
+static KeyTable *
+newKeyTable (void) {
+  KeyTable *table;
+
+  if ((table = malloc(sizeof(*table)))) {
+    memset(table, 0, sizeof(*table));
+
+    table->title = NULL;
+
+    table->noteTable = NULL;
+    table->noteCount = 0;
+
+    table->keyNameTable = NULL;
+    table->keyNameCount = 0;
+
+    table->keyContextTable = NULL;
+    table->keyContextCount = 0;
+
+    table->pressedKeys = NULL;
+    table->pressedSize = 0;
+    table->pressedCount = 0;
+  } else {
+    logMallocError();
+  }
+
+  return table;
+}
+
+static KeyTable *
+loadKeyTableImage (const char *name, KEY_NAME_TABLES_REFERENCE keys) {
   KeyTable *table = NULL;
+  DataImage *image;
+  char variant[0X10];
 
-  if (setGlobalTableVariables(KEY_TABLE_EXTENSION, KEY_SUBTABLE_EXTENSION)) {
+  makeKeyTableImageVariant(variant, sizeof(variant), keys);
+
+  if ((image = loadDataImage(name, KEY_TABLE_IMAGE_TYPE, variant))) {
     KeyTableData ktd;
     memset(&ktd, 0, sizeof(ktd));
 
-    ktd.context = KTB_CTX_DEFAULT;
+    if ((ktd.table = newKeyTable())) {
+      if (allocateKeyNameTable(&ktd, keys)) {
+        size_t size;
+        const unsigned char *bytes = getDataImageContent(image, &size);
+
+        if (loadKeyTableImageContent(&ktd, bytes, size)) {
+          table = ktd.table;
+          ktd.table = NULL;
+        } else {
+          logMessage(LOG_WARNING, "invalid key table image: %s", name);
+        }
+      }
 
-    if ((ktd.table = malloc(sizeof(*ktd.table)))) {
-      ktd.table->title = NULL;
+      if (ktd.table) destroyKeyTable(ktd.table);
+    }
 
-      ktd.table->noteTable = NULL;
-      ktd.table->noteCount = 0;
+    destroyDataImage(image);
+  }
 
-      ktd.table->keyNameTable = NULL;
-      ktd.table->keyNameCount = 0;
+  return table;
+}
 
-      ktd.table->keyContextTable = NULL;
-      ktd.table->keyContextCount = 0;
+KeyTable *
+compileKeyTable (const char *name, KEY_NAME_TABLES_REFERENCE keys) {
+  KeyTable *table = NULL;
+
+  if ((table = loadKeyTableImage(name, keys))) return table;
 
-      ktd.table->pressedKeys = NULL;
-      ktd.table->pressedSize = 0;
-      ktd.table->pressedCount = 0;
+  if (setGlobalTableVariables(KEY_TABLE_EXTENSION, KEY_SUBTABLE_EXTENSION)) {
+    KeyTableData ktd;
+    memset(&ktd, 0, sizeof(ktd));
 
+    ktd.context = KTB_CTX_DEFAULT;
+
+    if ((ktd.table = newKeyTable())) {
       if (allocateKeyNameTable(&ktd, keys)) {
         if (allocateCommandTable(&ktd)) {
+          beginDataImageSources();
+
           if (processDataFile(name, processKeyTableLine, &ktd)) {
             if (finishKeyTable(&ktd)) {
               table = ktd.table;
               ktd.table = NULL;
+              saveKeyTableImage(name, keys, table);
             }
           }
 
+          endDataImageSources();
           if (ktd.commandTable) free(ktd.commandTable);
         }
       }
 
       if (ktd.table) destroyKeyTable(ktd.table);
-    } else {
-      logMallocError();
     }
   }
 
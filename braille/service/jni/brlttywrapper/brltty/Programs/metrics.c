@@ -0,0 +1,283 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+#include "prologue.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_POSIX_THREADS
+#include <pthread.h>
+#endif /* HAVE_POSIX_THREADS */
+
+#include "log.h"
+#include "metrics.h"
+
+/*
+ * These are updated from the core as well as from the BrlAPI server's
+ * threads, so every update is a single atomic operation. A snapshot may
+ * therefore be slightly inconsistent, which is fine for statistics.
+ */
+#if defined(__GNUC__)
+#define METRIC_ADD(variable,amount) __sync_fetch_and_add(&(variable), (amount))
+#define METRIC_RAISE(variable,value) { \
+  uint32_t old; \
+  while ((value) > (old = (variable))) \
+    if (__sync_bool_compare_and_swap(&(variable), old, (value))) break; \
+}
+#else /* atomic operations */
+#define METRIC_ADD(variable,amount) ((variable) += (amount))
+#define METRIC_RAISE(variable,value) if ((value) > (variable)) (variable) = (value)
+#endif /* atomic operations */
+
+/* Not every target (e.g. ARMv5) has 64-bit atomic operations, so latency
+ * totals fall back to a mutex there.
+ */
+#if defined(__GNUC__) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+#define METRIC_ADD_WIDE(variable,amount) METRIC_ADD((variable), (amount))
+#define METRIC_LOCK()
+#define METRIC_UNLOCK()
+#elif defined(HAVE_POSIX_THREADS)
+static pthread_mutex_t metricMutex = PTHREAD_MUTEX_INITIALIZER;
+#define METRIC_LOCK() pthread_mutex_lock(&metricMutex)
+#define METRIC_UNLOCK() pthread_mutex_unlock(&metricMutex)
+#define METRIC_ADD_WIDE(variable,amount) { \
+  METRIC_LOCK(); \
+  (variable) += (amount); \
+  METRIC_UNLOCK(); \
+}
+#else /* 64-bit atomic operations */
+#define METRIC_ADD_WIDE(variable,amount) ((variable) += (amount))
+#define METRIC_LOCK()
+#define METRIC_UNLOCK()
+#endif /* 64-bit atomic operations */
+
+static const char *const latencyNames[] = {
+  [LATENCY_KEY_COMMAND] = "key to command",
+  [LATENCY_SCREEN_WINDOW] = "screen to display",
+  [LATENCY_API_WINDOW] = "BrlAPI to display",
+  [LATENCY_WINDOW_WRITE] = "window write",
+  [LATENCY_GENERIC_WRITE] = "device write",
+  [LATENCY_CONTRACTION] = "contraction",
+  [LATENCY_SPEECH_QUEUE] = "speech queue",
+  [LATENCY_KEYBOARD_DISPATCH] = "keyboard dispatch"
+};
+
+static const char *const counterNames[] = {
+  [COUNTER_COMMANDS] = "commands",
+  [COUNTER_CELLS_CHANGED] = "cell writes",
+  [COUNTER_CELLS_UNCHANGED] = "cell writes suppressed",
+  [COUNTER_API_WRITES] = "BrlAPI writes",
+  [COUNTER_GENERIC_INPUT_BYTES] = "device input bytes",
+  [COUNTER_GENERIC_OUTPUT_BYTES] = "device output bytes",
+  [COUNTER_UPDATES] = "updates",
+  [COUNTER_KEYBOARD_READS] = "keyboard reads",
+  [COUNTER_KEYBOARD_EVENTS] = "keyboard events",
+  [COUNTER_GENERIC_OUTPUT_SUPERSEDED] = "device output packets superseded",
+  [COUNTER_SPEECH_REQUESTS] = "speech requests",
+  [COUNTER_SPEECH_SUPERSEDED] = "speech requests superseded",
+  [COUNTER_SPEECH_QUEUE_DEPTH] = "speech queue depth",
+  [COUNTER_SPEECH_QUEUE_MAXIMUM] = "speech queue maximum depth"
+};
+
+static LatencyHistogram latencyHistograms[LATENCY_COUNT];
+static uint32_t counterValues[COUNTER_COUNT];
+
+static struct {
+  TimeValue start;
+  unsigned started:1;
+} latencyStarts[LATENCY_COUNT];
+
+const char *
+getLatencyName (LatencyMetric metric) {
+  return latencyNames[metric];
+}
+
+const char *
+getCounterName (CounterMetric metric) {
+  return counterNames[metric];
+}
+
+static unsigned int
+getLatencyBucket (unsigned long int microseconds) {
+  unsigned int bucket = 0;
+
+  microseconds >>= LATENCY_BUCKET_SHIFT;
+  while (microseconds && (bucket < (LATENCY_BUCKET_COUNT - 1))) {
+    microseconds >>= 1;
+    bucket += 1;
+  }
+
+  return bucket;
+}
+
+static unsigned long int
+getLatencyBucketLimit (unsigned int bucket) {
+  return 1UL << (LATENCY_BUCKET_SHIFT + bucket);
+}
+
+void
+addLatency (LatencyMetric metric, unsigned long int microseconds) {
+  LatencyHistogram *histogram = &latencyHistograms[metric];
+  uint32_t value = MIN(microseconds, UINT32_MAX);
+
+  METRIC_ADD(histogram->count, 1);
+  METRIC_ADD_WIDE(histogram->total, value);
+  METRIC_ADD(histogram->buckets[getLatencyBucket(value)], 1);
+  METRIC_RAISE(histogram->maximum, value);
+}
+
+void
+addLatencySince (LatencyMetric metric, const TimeValue *start) {
+  TimeValue now;
+  long int microseconds;
+
+  getMonotonicTime(&now);
+  microseconds = ((now.seconds - start->seconds) * USECS_PER_SEC)
+               + ((now.nanoseconds - start->nanoseconds) / NSECS_PER_USEC);
+
+  addLatency(metric, MAX(microseconds, 0));
+}
+
+void
+addToCounter (CounterMetric metric, unsigned int amount) {
+  METRIC_ADD(counterValues[metric], amount);
+}
+
+void
+setCounter (CounterMetric metric, unsigned int value) {
+  counterValues[metric] = value;
+}
+
+void
+raiseCounter (CounterMetric metric, unsigned int value) {
+  METRIC_RAISE(counterValues[metric], value);
+}
+
+void
+beginLatency (LatencyMetric metric) {
+  if (!latencyStarts[metric].started) {
+    getMonotonicTime(&latencyStarts[metric].start);
+    latencyStarts[metric].started = 1;
+  }
+}
+
+void
+endLatency (LatencyMetric metric, int extraMilliseconds) {
+  if (latencyStarts[metric].started) {
+    TimeValue start = latencyStarts[metric].start;
+
+    adjustTimeValue(&start, -extraMilliseconds);
+    addLatencySince(metric, &start);
+    latencyStarts[metric].started = 0;
+  }
+}
+
+void
+cancelLatency (LatencyMetric metric) {
+  latencyStarts[metric].started = 0;
+}
+
+void
+getLatencyHistogram (LatencyMetric metric, LatencyHistogram *histogram) {
+  METRIC_LOCK();
+  *histogram = latencyHistograms[metric];
+  METRIC_UNLOCK();
+}
+
+uint32_t
+getCounterValue (CounterMetric metric) {
+  return counterValues[metric];
+}
+
+void
+resetMetrics (void) {
+  METRIC_LOCK();
+  memset(latencyHistograms, 0, sizeof(latencyHistograms));
+  memset(counterValues, 0, sizeof(counterValues));
+  METRIC_UNLOCK();
+}
+
+static unsigned long int
+getLatencyPercentile (const LatencyHistogram *histogram, unsigned int percent) {
+  uint64_t target = ((uint64_t)histogram->count * percent + 99) / 100;
+  uint64_t sum = 0;
+  unsigned int bucket;
+
+  for (bucket=0; bucket<LATENCY_BUCKET_COUNT; bucket+=1) {
+    if ((sum += histogram->buckets[bucket]) >= target) {
+      if (bucket == (LATENCY_BUCKET_COUNT - 1)) break;
+      return getLatencyBucketLimit(bucket);
+    }
+  }
+
+  return histogram->maximum;
+}
+
+size_t
+formatLatencyHistogram (char *buffer, size_t size, const char *name, const LatencyHistogram *histogram) {
+  size_t length;
+
+  STR_BEGIN(buffer, size);
+  STR_PRINTF("%s: %" PRIu32, name, histogram->count);
+
+  if (histogram->count) {
+    unsigned int bucket;
+
+    STR_PRINTF(" avg=%" PRIu64 "us max=%" PRIu32 "us",
+               histogram->total / histogram->count, histogram->maximum);
+
+    STR_PRINTF(" p50<%luus p90<%luus p99<%luus",
+               getLatencyPercentile(histogram, 50),
+               getLatencyPercentile(histogram, 90),
+               getLatencyPercentile(histogram, 99));
+
+    for (bucket=0; bucket<LATENCY_BUCKET_COUNT; bucket+=1) {
+      uint32_t count = histogram->buckets[bucket];
+
+      if (count) {
+        if (bucket < (LATENCY_BUCKET_COUNT - 1)) {
+          STR_PRINTF(" <%lu:%" PRIu32, getLatencyBucketLimit(bucket), count);
+        } else {
+          STR_PRINTF(" >=%lu:%" PRIu32, getLatencyBucketLimit(bucket-1), count);
+        }
+      }
+    }
+  }
+
+  length = STR_LENGTH;
+  STR_END;
+  return length;
+}
+
+void
+logMetrics (int level) {
+  unsigned int index;
+
+  for (index=0; index<LATENCY_COUNT; index+=1) {
+    LatencyHistogram histogram;
+    char buffer[0X200];
+
+    getLatencyHistogram(index, &histogram);
+    formatLatencyHistogram(buffer, sizeof(buffer), getLatencyName(index), &histogram);
+    logMessage(level, "latency: %s", buffer);
+  }
+
+  for (index=0; index<COUNTER_COUNT; index+=1) {
+    logMessage(level, "counter: %s: %" PRIu32, getCounterName(index), getCounterValue(index));
+  }
+}
@@ -0,0 +1,99 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+#ifndef BRLTTY_INCLUDED_METRICS
+#define BRLTTY_INCLUDED_METRICS
+
+#include "timing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef enum {
+  LATENCY_KEY_COMMAND,
+  LATENCY_SCREEN_WINDOW,
+  LATENCY_API_WINDOW,
+  LATENCY_WINDOW_WRITE,
+  LATENCY_GENERIC_WRITE,
+  LATENCY_CONTRACTION,
+  LATENCY_SPEECH_QUEUE,
+  LATENCY_KEYBOARD_DISPATCH,
+
+  LATENCY_COUNT /* must be last */
+} LatencyMetric;
+
+typedef enum {
+  COUNTER_COMMANDS,
+  COUNTER_CELLS_CHANGED,
+  COUNTER_CELLS_UNCHANGED,
+  COUNTER_API_WRITES,
+  COUNTER_GENERIC_INPUT_BYTES,
+  COUNTER_GENERIC_OUTPUT_BYTES,
+  COUNTER_UPDATES,
+  COUNTER_KEYBOARD_READS,
+  COUNTER_KEYBOARD_EVENTS,
+  COUNTER_GENERIC_OUTPUT_SUPERSEDED,
+  COUNTER_SPEECH_REQUESTS,
+  COUNTER_SPEECH_SUPERSEDED,
+  COUNTER_SPEECH_QUEUE_DEPTH,
+  COUNTER_SPEECH_QUEUE_MAXIMUM,
+
+  COUNTER_COUNT /* must be last */
+} CounterMetric;
+
+/* Bucket 0 is for latencies under 128 microseconds, each subsequent bucket
+ * covers twice the range of the previous one, and the last one is open.
+ */
+#define LATENCY_BUCKET_COUNT 16
+#define LATENCY_BUCKET_SHIFT 7
+
+typedef struct {
+  uint32_t count;
+  uint32_t maximum;
+  uint64_t total;
+  uint32_t buckets[LATENCY_BUCKET_COUNT];
+} LatencyHistogram;
+
+extern const char *getLatencyName (LatencyMetric metric);
+extern const char *getCounterName (CounterMetric metric);
+
+extern void addLatency (LatencyMetric metric, unsigned long int microseconds);
+extern void addLatencySince (LatencyMetric metric, const TimeValue *start);
+extern void addToCounter (CounterMetric metric, unsigned int amount);
+
+/* For counters which are levels rather than totals. */
+extern void setCounter (CounterMetric metric, unsigned int value);
+extern void raiseCounter (CounterMetric metric, unsigned int value);
+
+/* For latencies which start in one place and end in another. */
+extern void beginLatency (LatencyMetric metric);
+extern void endLatency (LatencyMetric metric, int extraMilliseconds);
+extern void cancelLatency (LatencyMetric metric);
+
+extern void getLatencyHistogram (LatencyMetric metric, LatencyHistogram *histogram);
+extern uint32_t getCounterValue (CounterMetric metric);
+extern void resetMetrics (void);
+
+extern size_t formatLatencyHistogram (char *buffer, size_t size, const char *name, const LatencyHistogram *histogram);
+extern void logMetrics (int level);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* BRLTTY_INCLUDED_METRICS */
@@ -27,6 +27,24 @@
 #include "system.h"
 #include "notes.h"
 
+/* Rendered notes are kept so that frequently played tunes (alerts on
+ * every wrap, bounce, etc) go straight from the cache to the device.
+ */
+#define PCM_WAVEFORM_CACHE_ENTRIES 16
+#define PCM_WAVEFORM_CACHE_BYTES 0X40000
+#define PCM_WAVEFORM_MAXIMUM_BYTES (PCM_WAVEFORM_CACHE_BYTES / 4)
+
+typedef size_t PcmSampleMaker (unsigned char *sample, int amplitude);
+
+typedef struct {
+  unsigned char *bytes;
+  size_t size;
+  unsigned long int lastUsed;
+  unsigned int duration;
+  unsigned char note;
+  unsigned char volume;
+} PcmWaveform;
+
 struct NoteDeviceStruct {
   PcmDevice *pcm;
   int blockSize;
@@ -35,13 +53,127 @@ struct NoteDeviceStruct {
   PcmAmplitudeFormat amplitudeFormat;
   unsigned char *blockAddress;
   size_t blockUsed;
+
+  PcmSampleMaker *makeSample;
+  size_t frameSize;
+
+  PcmWaveform waveforms[PCM_WAVEFORM_CACHE_ENTRIES];
+  size_t waveformBytes;
+  unsigned long int waveformUses;
 };
 
+static size_t
+makeSample_S8 (unsigned char *sample, int amplitude) {
+  sample[0] = amplitude >> 8;
+  return 1;
+}
+
+static size_t
+makeSample_U8 (unsigned char *sample, int amplitude) {
+  return makeSample_S8(sample, amplitude+0X8000);
+}
+
+static size_t
+makeSample_S16B (unsigned char *sample, int amplitude) {
+  sample[0] = amplitude >> 8;
+  sample[1] = amplitude;
+  return 2;
+}
+
+static size_t
+makeSample_U16B (unsigned char *sample, int amplitude) {
+  return makeSample_S16B(sample, amplitude+0X8000);
+}
+
+static size_t
+makeSample_S16L (unsigned char *sample, int amplitude) {
+  sample[0] = amplitude;
+  sample[1] = amplitude >> 8;
+  return 2;
+}
+
+static size_t
+makeSample_U16L (unsigned char *sample, int amplitude) {
+  return makeSample_S16L(sample, amplitude+0X8000);
+}
+
+static size_t
+makeSample_ULAW (unsigned char *sample, int amplitude) {
+  int negative = amplitude < 0;
+  int exponent = 0X7;
+  unsigned char value;
+  const unsigned int bias = 0X84;
+  const unsigned int clip = 0X7FFF - bias;
+
+  if (negative) amplitude = -amplitude;
+  if (amplitude > clip) amplitude = clip;
+  amplitude += bias;
+
+  while ((exponent > 0) && !(amplitude & 0X4000)) {
+    amplitude <<= 1;
+    --exponent;
+  }
+
+  value = (exponent << 4) | ((amplitude >> 10) & 0X0F);
+  if (negative) value |= 0X80;
+  sample[0] = ~value;
+  return 1;
+}
+
+static size_t
+makeSample_ALAW (unsigned char *sample, int amplitude) {
+  int negative = amplitude < 0;
+  int exponent = 0X7;
+  unsigned char value;
+
+  if (negative) amplitude = -amplitude;
+
+  while ((exponent > 0) && !(amplitude & 0X4000)) {
+    amplitude <<= 1;
+    --exponent;
+  }
+
+  if (!exponent) amplitude >>= 1;
+  value = (exponent << 4) | ((amplitude >> 10) & 0X0F);
+  if (negative) value |= 0X80;
+  sample[0] = value ^ 0X55;
+  return 1;
+}
+
+static size_t
+makeSample_UNKNOWN (unsigned char *sample, int amplitude) {
+  return 0;
+}
+
+static PcmSampleMaker *const sampleMakers[] = {
+  [PCM_FMT_U8] = makeSample_U8,
+  [PCM_FMT_S8] = makeSample_S8,
+  [PCM_FMT_U16B] = makeSample_U16B,
+  [PCM_FMT_S16B] = makeSample_S16B,
+  [PCM_FMT_U16L] = makeSample_U16L,
+  [PCM_FMT_S16L] = makeSample_S16L,
+  [PCM_FMT_ULAW] = makeSample_ULAW,
+  [PCM_FMT_ALAW] = makeSample_ALAW,
+  [PCM_FMT_UNKNOWN] = makeSample_UNKNOWN
+};
+
+static void
+makeFrame (NoteDevice *device, unsigned char *frame, int amplitude) {
+  size_t size = device->makeSample(frame, amplitude);
+  int channel;
+
+  for (channel=1; channel<device->channelCount; ++channel) {
+    memcpy(&frame[channel * size], frame, size);
+  }
+}
+
 static NoteDevice *
 pcmConstruct (int errorLevel) {
   NoteDevice *device;
 
   if ((device = malloc(sizeof(*device)))) {
+    memset(device, 0, sizeof(*device));
+
     if ((device->pcm = openPcmDevice(errorLevel, opt_pcmDevice))) {
       device->blockSize = getPcmBlockSize(device->pcm);
       device->sampleRate = getPcmSampleRate(device->pcm);
@@ -49,6 +181,14 @@ pcmConstruct (int errorLevel) {
       device->amplitudeFormat = getPcmAmplitudeFormat(device->pcm);
       device->blockUsed = 0;
 
+      if (device->amplitudeFormat >= ARRAY_COUNT(sampleMakers)) device->amplitudeFormat = PCM_FMT_UNKNOWN;
+      device->makeSample = sampleMakers[device->amplitudeFormat];
+
+      {
+        unsigned char sample[4];
+        device->frameSize = device->makeSample(sample, 0) * device->channelCount;
+      }
+
       if ((device->blockAddress = malloc(device->blockSize))) {
         logMessage(LOG_DEBUG, "PCM enabled: blk=%d rate=%d chan=%d fmt=%d",
                    device->blockSize, device->sampleRate, device->channelCount, device->amplitudeFormat);
@@ -79,7 +219,18 @@ flushBytes (NoteDevice *device) {
 static int
 writeBytes (NoteDevice *device, const unsigned char *address, size_t length) {
   while (length > 0) {
-    size_t count = device->blockSize - device->blockUsed;
+    size_t count;
+
+    if (!device->blockUsed && (length >= device->blockSize)) {
+      /* whole blocks can go straight to the device */
+      count = length - (length % device->blockSize);
+      if (!writePcmData(device->pcm, address, count)) return 0;
+      address += count;
+      length -= count;
+      continue;
+    }
+
+    count = device->blockSize - device->blockUsed;
     if (length < count) count = length;
     memcpy(&device->blockAddress[device->blockUsed], address, count);
     address += count;
@@ -93,96 +244,14 @@ writeBytes (NoteDevice *device, const unsigned char *address, size_t length) {
   return 1;
 }
 
-static int
-writeSample (NoteDevice *device, int amplitude) {
-  unsigned char sample[4];
-  size_t length;
-
-  switch (device->amplitudeFormat) {
-    default:
-      length = 0;
-      break;
-
-    case PCM_FMT_U8:
-      amplitude += 0X8000;
-    case PCM_FMT_S8:
-      sample[0] = amplitude >> 8;
-      length = 1;
-      break;
-
-    case PCM_FMT_U16B:
-      amplitude += 0X8000;
-    case PCM_FMT_S16B:
-      sample[0] = amplitude >> 8;
-      sample[1] = amplitude;
-      length = 2;
-      break;
-
-    case PCM_FMT_U16L:
-      amplitude += 0X8000;
-    case PCM_FMT_S16L:
-      sample[0] = amplitude;
-      sample[1] = amplitude >> 8;
-      length = 2;
-      break;
-
-    case PCM_FMT_ULAW: {
-      int negative = amplitude < 0;
-      int exponent = 0X7;
-      unsigned char value;
-      const unsigned int bias = 0X84;
-      const unsigned int clip = 0X7FFF - bias;
-
-      if (negative) amplitude = -amplitude;
-      if (amplitude > clip) amplitude = clip;
-      amplitude += bias;
-
-      while ((exponent > 0) && !(amplitude & 0X4000)) {
-        amplitude <<= 1;
-        --exponent;
-      }
-
-      value = (exponent << 4) | ((amplitude >> 10) & 0X0F);
-      if (negative) value |= 0X80;
-      sample[0] = ~value;
-      length = 1;
-      break;
-    }
-
-    case PCM_FMT_ALAW: {
-      int negative = amplitude < 0;
-      int exponent = 0X7;
-      unsigned char value;
-
-      if (negative) amplitude = -amplitude;
-
-      while ((exponent > 0) && !(amplitude & 0X4000)) {
-        amplitude <<= 1;
-        --exponent;
-      }
-
-      if (!exponent) amplitude >>= 1;
-      value = (exponent << 4) | ((amplitude >> 10) & 0X0F);
-      if (negative) value |= 0X80;
-      sample[0] = value ^ 0X55;
-      length = 1;
-      break;
-    }
-  }
-
-  {
-    int channel;
-    for (channel=0; channel<device->channelCount; ++channel) {
-      if (!writeBytes(device, sample, length)) return 0;
-    }
-  }
-
-  return 1;
-}
-
-static int
-pcmPlay (NoteDevice *device, unsigned char note, unsigned int duration) {
+static unsigned char *
+renderWaveform (NoteDevice *device, unsigned char note, unsigned int duration, size_t *size) {
   long int sampleCount = device->sampleRate * duration / 1000;
+  unsigned char *bytes;
+  unsigned char *frame;
+
+  logMessage(LOG_DEBUG, "tone: msec=%d smct=%lu note=%d",
+             duration, sampleCount, note);
 
   if (note) {
     /* A triangle waveform sounds nice, is lightweight, and avoids
@@ -205,28 +274,31 @@ pcmPlay (NoteDevice *device, unsigned char note, unsigned int duration) {
                             * GET_NOTE_FREQUENCY(note);
 
     int32_t maximumAmplitude = INT16_MAX * prefs.pcmVolume / 100;
-    int32_t amplitudeGranularity = positiveShiftsPerQuarterWave / maximumAmplitude;
+    int32_t amplitudeGranularity;
 
-    logMessage(LOG_DEBUG, "tone: msec=%d smct=%lu note=%d",
-               duration, sampleCount, note);
+    if (maximumAmplitude < 1) maximumAmplitude = 1;
+    amplitudeGranularity = positiveShiftsPerQuarterWave / maximumAmplitude;
 
+    /* the last wave is always finished */
+    if (!(bytes = malloc((sampleCount + (positiveShiftsPerFullWave / shiftsPerSample) + 1) * device->frameSize))) {
+      logMallocError();
+      return NULL;
+    }
+
+    frame = bytes;
     while (sampleCount > 0) {
       do {
-        {
-          int32_t normalizedAmplitude = positiveShiftsPerHalfWave - currentShift;
-
-          if (normalizedAmplitude > positiveShiftsPerQuarterWave) {
-            normalizedAmplitude = positiveShiftsPerHalfWave - normalizedAmplitude;
-          } else if (normalizedAmplitude < negativeShiftsPerQuarterWave) {
-            normalizedAmplitude = negativeSiftsPerHalfWave - normalizedAmplitude;
-          }
-
-          {
-            int32_t actualAmplitude = normalizedAmplitude / amplitudeGranularity;
-            if (!writeSample(device, actualAmplitude)) return 0;
-            sampleCount -= 1;
-          }
+        int32_t normalizedAmplitude = positiveShiftsPerHalfWave - currentShift;
+
+        if (normalizedAmplitude > positiveShiftsPerQuarterWave) {
+          normalizedAmplitude = positiveShiftsPerHalfWave - normalizedAmplitude;
+        } else if (normalizedAmplitude < negativeShiftsPerQuarterWave) {
+          normalizedAmplitude = negativeSiftsPerHalfWave - normalizedAmplitude;
         }
+
+        makeFrame(device, frame, normalizedAmplitude/amplitudeGranularity);
+        frame += device->frameSize;
+        sampleCount -= 1;
       } while ((currentShift += shiftsPerSample) < positiveShiftsPerFullWave);
 
       do {
@@ -234,23 +306,131 @@ pcmPlay (NoteDevice *device, unsigned char note, unsigned int duration) {
       } while (currentShift >= positiveShiftsPerFullWave);
     }
   } else {
-    logMessage(LOG_DEBUG, "tone: msec=%d smct=%lu note=%d",
-               duration, sampleCount, note);
+    if (!(bytes = malloc(sampleCount * device->frameSize + 1))) {
+      logMallocError();
+      return NULL;
+    }
 
-    while (sampleCount > 0) {
-      if (!writeSample(device, 0)) return 0;
-      --sampleCount;
+    frame = bytes;
+    if (sampleCount > 0) {
+      makeFrame(device, frame, 0);
+      frame += device->frameSize;
+
+      while (--sampleCount > 0) {
+        memcpy(frame, bytes, device->frameSize);
+        frame += device->frameSize;
+      }
     }
   }
 
-  return 1;
+  *size = frame - bytes;
+  return bytes;
+}
+
+static void
+discardWaveform (NoteDevice *device, PcmWaveform *waveform) {
+  if (waveform->bytes) {
+    device->waveformBytes -= waveform->size;
+    free(waveform->bytes);
+    waveform->bytes = NULL;
+  }
+}
+
+static const PcmWaveform *
+findWaveform (NoteDevice *device, unsigned char note, unsigned int duration) {
+  PcmWaveform *waveform = device->waveforms;
+  const PcmWaveform *end = waveform + PCM_WAVEFORM_CACHE_ENTRIES;
+
+  while (waveform < end) {
+    if (waveform->bytes &&
+        (waveform->note == note) &&
+        (waveform->duration == duration) &&
+        (waveform->volume == prefs.pcmVolume)) {
+      waveform->lastUsed = ++device->waveformUses;
+      return waveform;
+    }
+
+    waveform += 1;
+  }
+
+  return NULL;
+}
+
+static PcmWaveform *
+getLeastRecentlyUsedWaveform (NoteDevice *device, int includeUnused) {
+  PcmWaveform *waveform = device->waveforms;
+  const PcmWaveform *end = waveform + PCM_WAVEFORM_CACHE_ENTRIES;
+  PcmWaveform *oldest = NULL;
+
+  while (waveform < end) {
+    if (!waveform->bytes) {
+      if (includeUnused) return waveform;
+    } else if (!oldest || (waveform->lastUsed < oldest->lastUsed)) {
+      oldest = waveform;
+    }
+
+    waveform += 1;
+  }
+
+  return oldest;
+}
+
+static void
+cacheWaveform (NoteDevice *device, unsigned char note, unsigned int duration, unsigned char *bytes, size_t size) {
+  PcmWaveform *waveform = getLeastRecentlyUsedWaveform(device, 1);
+
+  discardWaveform(device, waveform);
+
+  while ((device->waveformBytes + size) > PCM_WAVEFORM_CACHE_BYTES) {
+    discardWaveform(device, getLeastRecentlyUsedWaveform(device, 0));
+  }
+
+  waveform->bytes = bytes;
+  waveform->size = size;
+  waveform->note = note;
+  waveform->duration = duration;
+  waveform->volume = prefs.pcmVolume;
+  waveform->lastUsed = ++device->waveformUses;
+  device->waveformBytes += size;
+}
+
+static int
+pcmPlay (NoteDevice *device, unsigned char note, unsigned int duration) {
+  const PcmWaveform *waveform = findWaveform(device, note, duration);
+
+  if (waveform) {
+    return writeBytes(device, waveform->bytes, waveform->size);
+  } else {
+    size_t size;
+    unsigned char *bytes = renderWaveform(device, note, duration, &size);
+    int ok;
+
+    if (!bytes) return 0;
+    ok = writeBytes(device, bytes, size);
+
+    if (size <= PCM_WAVEFORM_MAXIMUM_BYTES) {
+      cacheWaveform(device, note, duration, bytes, size);
+    } else {
+      free(bytes);
+    }
+
+    return ok;
+  }
 }
 
 static int
 flushBlock (NoteDevice *device) {
-  while (device->blockUsed)
-    if (!writeSample(device, 0))
-      return 0;
+  if (device->blockUsed) {
+    unsigned char frame[device->frameSize];
+
+    makeFrame(device, frame, 0);
+
+    while (device->blockUsed) {
+      size_t count = device->blockSize - device->blockUsed;
+      if (count > device->frameSize) count = device->frameSize;
+      if (!writeBytes(device, frame, count)) return 0;
+    }
+  }
 
   return 1;
 }
@@ -262,6 +442,14 @@ pcmFlush (NoteDevice *device) {
 
 static void
 pcmDestruct (NoteDevice *device) {
+  {
+    int index;
+
+    for (index=0; index<PCM_WAVEFORM_CACHE_ENTRIES; index+=1) {
+      discardWaveform(device, &device->waveforms[index]);
+    }
+  }
+
   flushBlock(device);
   free(device->blockAddress);
   closePcmDevice(device->pcm);
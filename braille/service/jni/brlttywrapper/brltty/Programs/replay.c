@@ -0,0 +1,932 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+
+
+#include "prologue.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef __MINGW32__
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+#endif /* __MINGW32__ */
+
+#ifdef HAVE_POSIX_THREADS
+#include <pthread.h>
+#endif /* HAVE_POSIX_THREADS */
+
+#include "log.h"
+#include "file.h"
+#include "parse.h"
+#include "charset.h"
+#include "timing.h"
+#include "metrics.h"
+#include "cmd.h"
+#include "brldefs.h"
+#include "scr.h"
+#include "program.h"
+#include "brltty.h"
+#include "replay.h"
+
+static FILE *recordingFile = NULL;
+static TimeValue recordingStart;
+static unsigned int recordedColumns;
+static unsigned int recordedRows;
+static ScreenDescription recordedScreen;
+static ScreenCharacter *recordedCharacters = NULL;
+static ScreenCharacter *currentCharacters = NULL;
+static size_t recordedSize = 0;
+
+static void
+exitSessionRecording (void) {
+  if (recordingFile) {
+    fclose(recordingFile);
+    recordingFile = NULL;
+  }
+
+  if (recordedCharacters) {
+    free(recordedCharacters);
+    recordedCharacters = NULL;
+  }
+
+  if (currentCharacters) {
+    free(currentCharacters);
+    currentCharacters = NULL;
+  }
+
+  recordedSize = 0;
+}
+
+int
+startSessionRecording (const char *path) {
+  if (recordingFile) return 1;
+
+  if ((recordingFile = openFile(path, "w", 0))) {
+    getMonotonicTime(&recordingStart);
+    recordedColumns = 0;
+    recordedRows = 0;
+    memset(&recordedScreen, 0, sizeof(recordedScreen));
+
+    onProgramExit(exitSessionRecording);
+    logMessage(LOG_INFO, "recording session: %s", path);
+    return 1;
+  }
+
+  return 0;
+}
+
+static void
+writeSessionText (const ScreenCharacter *characters, int count) {
+  while (count > 0) {
+    wchar_t character = characters++->text;
+    count -= 1;
+
+    if ((character == WC_C('"')) || (character == WC_C('\\'))) {
+      fprintf(recordingFile, "\\%c", (char)character);
+    } else if (character < WC_C(' ')) {
+      fprintf(recordingFile, "\\x%02X", (unsigned int)character);
+    } else {
+      Utf8Buffer utf8;
+      size_t length = convertWcharToUtf8(character, utf8);
+      fwrite(utf8, 1, length, recordingFile);
+    }
+  }
+}
+
+static int
+isSameRow (const ScreenCharacter *row1, const ScreenCharacter *row2, int columns) {
+  while (columns-- > 0) {
+    if ((row1++)->text != (row2++)->text) return 0;
+  }
+
+  return 1;
+}
+
+void
+recordSessionUpdate (unsigned int columns, unsigned int rows) {
+  if (recordingFile) {
+    long int time = getMonotonicElapsed(&recordingStart);
+    ScreenDescription description;
+
+    if ((columns != recordedColumns) || (rows != recordedRows)) {
+      fprintf(recordingFile, "display %ld %u %u\n", time, columns, rows);
+      recordedColumns = columns;
+      recordedRows = rows;
+    }
+
+    describeScreen(&description);
+
+    if (!description.unreadable) {
+      size_t count = description.rows * description.cols;
+      int resized = (description.rows != recordedScreen.rows) ||
+                    (description.cols != recordedScreen.cols);
+
+      if (count > recordedSize) {
+        ScreenCharacter *previous = realloc(recordedCharacters, ARRAY_SIZE(previous, count));
+        ScreenCharacter *current;
+
+        if (previous) recordedCharacters = previous;
+        if (!previous || !(current = realloc(currentCharacters, ARRAY_SIZE(current, count)))) {
+          logMallocError();
+          return;
+        }
+
+        currentCharacters = current;
+        recordedSize = count;
+      }
+
+      if (readScreen(0, 0, description.cols, description.rows, currentCharacters)) {
+        int written = 0;
+        int row;
+
+        for (row=0; row<description.rows; row+=1) {
+          const ScreenCharacter *characters = &currentCharacters[row * description.cols];
+
+          if (resized || !isSameRow(characters, &recordedCharacters[row * description.cols], description.cols)) {
+            if (!written) {
+              fprintf(recordingFile, "screen %ld %d %d %d %d %d\n", time,
+                      description.cols, description.rows,
+                      description.posx, description.posy, description.number);
+              written = 1;
+            }
+
+            fprintf(recordingFile, "row %d \"", row);
+            writeSessionText(characters, description.cols);
+            fprintf(recordingFile, "\"\n");
+          }
+        }
+
+        if (!written) {
+          if ((description.posx != recordedScreen.posx) ||
+              (description.posy != recordedScreen.posy) ||
+              (description.number != recordedScreen.number)) {
+            fprintf(recordingFile, "screen %ld %d %d %d %d %d\n", time,
+                    description.cols, description.rows,
+                    description.posx, description.posy, description.number);
+          }
+        }
+
+        {
+          ScreenCharacter *characters = recordedCharacters;
+          recordedCharacters = currentCharacters;
+          currentCharacters = characters;
+        }
+
+        recordedScreen = description;
+      }
+    }
+  }
+}
+
+void
+recordSessionCommand (int command) {
+  if (recordingFile) {
+    const CommandEntry *entry = getCommandEntry(command);
+
+    if (entry) {
+      int block = command & BRL_MSK_BLK;
+      int number = 0;
+
+      if (block && (getCommandEntry(block | BRL_MSK_ARG) == entry)) {
+        /* The Virtual driver only accepts a number for the last entry of a
+         * block, and adds it (it must be positive) to that entry's code.
+         */
+        if (!(number = (command & BRL_MSK_ARG) - (entry->code & BRL_MSK_ARG))) {
+          logMessage(LOG_DEBUG, "command can't be recorded: %s", entry->name);
+          return;
+        }
+      }
+
+      fprintf(recordingFile, "command %ld %s",
+              getMonotonicElapsed(&recordingStart), entry->name);
+
+      if (block) {
+        if (number) fprintf(recordingFile, " %d", number);
+      } else {
+        if (command & BRL_FLG_TOGGLE_ON) {
+          fprintf(recordingFile, " on");
+        } else if (command & BRL_FLG_TOGGLE_OFF) {
+          fprintf(recordingFile, " off");
+        }
+      }
+
+      fprintf(recordingFile, "\n");
+    }
+  }
+}
+
+#if defined(HAVE_POSIX_THREADS) && defined(AF_LOCAL)
+typedef enum {
+  EVENT_DISPLAY,
+  EVENT_SCREEN,
+  EVENT_COMMAND
+} ReplayEventType;
+
+typedef struct {
+  int index;
+  wchar_t *characters;
+  int count;
+} ReplayRow;
+
+typedef struct {
+  ReplayEventType type;
+  long int time;
+
+  union {
+    struct {
+      unsigned int columns;
+      unsigned int rows;
+    } display;
+
+    struct {
+      ScreenDescription description;
+      ReplayRow *rows;
+      unsigned int count;
+    } screen;
+
+    char *command;
+  } value;
+} ReplayEvent;
+
+typedef struct {
+  const char *path;
+  unsigned int line;
+
+  ReplayEvent *events;
+  unsigned int eventCount;
+  unsigned int eventSize;
+
+  char *socket;
+  ReplaySpeed speed;
+  pthread_t thread;
+  volatile int stopping;
+
+  ScreenDescription description;
+  ScreenCharacter *characters;
+  size_t size;
+
+  char output[0X200];
+  size_t outputLength;
+  unsigned outputOverflow:1;
+  unsigned int windowsRendered;
+} ReplaySession;
+
+static ReplaySession replaySession;
+
+static void
+logReplayError (ReplaySession *session, const char *problem) {
+  logMessage(LOG_ERR, "%s[%u]: %s", session->path, session->line, problem);
+}
+
+static ReplayEvent *
+addReplayEvent (ReplaySession *session, ReplayEventType type, const char *time) {
+  ReplayEvent *event;
+  int milliseconds;
+
+  if (!time || !isInteger(&milliseconds, time) || (milliseconds < 0)) {
+    logReplayError(session, "invalid time");
+    return NULL;
+  }
+
+  if (session->eventCount == session->eventSize) {
+    unsigned int newSize = session->eventSize? session->eventSize<<1: 0X100;
+    ReplayEvent *newEvents = realloc(session->events, ARRAY_SIZE(newEvents, newSize));
+
+    if (!newEvents) {
+      logMallocError();
+      return NULL;
+    }
+
+    session->events = newEvents;
+    session->eventSize = newSize;
+  }
+
+  event = &session->events[session->eventCount++];
+  memset(event, 0, sizeof(*event));
+  event->type = type;
+  event->time = milliseconds;
+  return event;
+}
+
+static int
+getReplayNumbers (ReplaySession *session, int *numbers, unsigned int count) {
+  while (count > 0) {
+    const char *word = strtok(NULL, " ");
+
+    if (!word || !isInteger(numbers, word)) {
+      logReplayError(session, "invalid number");
+      return 0;
+    }
+
+    numbers += 1;
+    count -= 1;
+  }
+
+  return 1;
+}
+
+static int
+addReplayRow (ReplaySession *session, int index, const char *text) {
+  ReplayEvent *event;
+  ReplayRow *row;
+  size_t size = strlen(text) + 1;
+  wchar_t characters[size];
+  int count = 0;
+
+  if (!session->eventCount) goto noScreen;
+  event = &session->events[session->eventCount - 1];
+  if (event->type != EVENT_SCREEN) goto noScreen;
+
+  if ((index < 0) || (index >= event->value.screen.description.rows)) {
+    logReplayError(session, "row out of range");
+    return 0;
+  }
+
+  if (*text++ != '"') goto badText;
+
+  while (*text != '"') {
+    if (!*text) goto badText;
+
+    if (*text == '\\') {
+      text += 1;
+
+      if ((*text == 'x') || (*text == 'X')) {
+        unsigned int value;
+        int length;
+
+        if (sscanf(text+1, "%2x%n", &value, &length) != 1) goto badText;
+        characters[count++] = value;
+        text += 1 + length;
+        continue;
+      }
+
+      if (!*text) goto badText;
+      characters[count++] = *text++ & 0XFF;
+    } else {
+      size_t length = strlen(text);
+      wint_t character = convertUtf8ToWchar(&text, &length);
+
+      if (character == WEOF) goto badText;
+      characters[count++] = character;
+    }
+  }
+
+  {
+    unsigned int newCount = event->value.screen.count + 1;
+    ReplayRow *newRows = realloc(event->value.screen.rows, ARRAY_SIZE(newRows, newCount));
+
+    if (!newRows) {
+      logMallocError();
+      return 0;
+    }
+
+    event->value.screen.rows = newRows;
+    row = &newRows[event->value.screen.count];
+  }
+
+  if (!(row->characters = malloc(ARRAY_SIZE(row->characters, count+1)))) {
+    logMallocError();
+    return 0;
+  }
+
+  wmemcpy(row->characters, characters, count);
+  row->index = index;
+  row->count = count;
+  event->value.screen.count += 1;
+  return 1;
+
+noScreen:
+  logReplayError(session, "row not within a screen");
+  return 0;
+
+badText:
+  logReplayError(session, "invalid row text");
+  return 0;
+}
+
+static int
+handleReplayLine (char *line, void *data) {
+  ReplaySession *session = data;
+  const char *word;
+
+  session->line += 1;
+  if (!(word = strtok(line, " "))) return 1;
+  if (*word == '#') return 1;
+
+  if (strcmp(word, "display") == 0) {
+    ReplayEvent *event = addReplayEvent(session, EVENT_DISPLAY, strtok(NULL, " "));
+    int numbers[2];
+
+    if (!event) return 0;
+    if (!getReplayNumbers(session, numbers, ARRAY_COUNT(numbers))) return 0;
+    event->value.display.columns = numbers[0];
+    event->value.display.rows = numbers[1];
+    return 1;
+  }
+
+  if (strcmp(word, "screen") == 0) {
+    ReplayEvent *event = addReplayEvent(session, EVENT_SCREEN, strtok(NULL, " "));
+    ScreenDescription *description;
+    int numbers[5];
+
+    if (!event) return 0;
+    if (!getReplayNumbers(session, numbers, ARRAY_COUNT(numbers))) return 0;
+
+    if ((numbers[0] < 1) || (numbers[1] < 1)) {
+      logReplayError(session, "invalid screen size");
+      return 0;
+    }
+
+    description = &event->value.screen.description;
+    description->cols = numbers[0];
+    description->rows = numbers[1];
+    description->posx = numbers[2];
+    description->posy = numbers[3];
+    description->number = numbers[4];
+    description->cursor = 1;
+    return 1;
+  }
+
+  if (strcmp(word, "row") == 0) {
+    int index;
+
+    if (!(word = strtok(NULL, " ")) || !isInteger(&index, word)) {
+      logReplayError(session, "invalid row number");
+      return 0;
+    }
+
+    /* the text may contain spaces so take the rest of the line */
+    return addReplayRow(session, index, word+strlen(word)+1);
+  }
+
+  if (strcmp(word, "command") == 0) {
+    ReplayEvent *event = addReplayEvent(session, EVENT_COMMAND, strtok(NULL, " "));
+    const char *command = strtok(NULL, "");
+
+    if (!event) return 0;
+    if (!command) {
+      logReplayError(session, "missing command");
+      return 0;
+    }
+
+    if (!(event->value.command = strdup(command))) {
+      logMallocError();
+      return 0;
+    }
+
+    return 1;
+  }
+
+  logReplayError(session, "unknown event");
+  return 0;
+}
+
+static void
+deallocateReplaySession (ReplaySession *session) {
+  while (session->eventCount > 0) {
+    ReplayEvent *event = &session->events[--session->eventCount];
+
+    switch (event->type) {
+      case EVENT_SCREEN:
+        while (event->value.screen.count > 0) {
+          free(event->value.screen.rows[--event->value.screen.count].characters);
+        }
+
+        if (event->value.screen.rows) free(event->value.screen.rows);
+        break;
+
+      case EVENT_COMMAND:
+        free(event->value.command);
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  if (session->events) {
+    free(session->events);
+    session->events = NULL;
+  }
+
+  if (session->characters) {
+    free(session->characters);
+    session->characters = NULL;
+  }
+
+  if (session->socket) {
+    free(session->socket);
+    session->socket = NULL;
+  }
+}
+
+static int
+applyReplayScreen (ReplaySession *session, const ReplayEvent *event) {
+  const ScreenDescription *description = &event->value.screen.description;
+  size_t count = description->rows * description->cols;
+  unsigned int index;
+
+  if ((description->rows != session->description.rows) ||
+      (description->cols != session->description.cols)) {
+    if (count > session->size) {
+      ScreenCharacter *characters = realloc(session->characters, ARRAY_SIZE(characters, count));
+
+      if (!characters) {
+        logMallocError();
+        return 0;
+      }
+
+      session->characters = characters;
+      session->size = count;
+    }
+
+    clearScreenCharacters(session->characters, count);
+  }
+
+  session->description = *description;
+
+  for (index=0; index<event->value.screen.count; index+=1) {
+    const ReplayRow *row = &event->value.screen.rows[index];
+    ScreenCharacter *characters = &session->characters[row->index * description->cols];
+    int length = MIN(row->count, description->cols);
+    int column;
+
+    clearScreenCharacters(characters, description->cols);
+    for (column=0; column<length; column+=1) characters[column].text = row->characters[column];
+  }
+
+  return updateReplayScreen(&session->description, session->characters);
+}
+
+static int
+connectReplaySocket (ReplaySession *session) {
+  struct sockaddr_un address;
+  int attempts = 100;
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_LOCAL;
+
+  if (strlen(session->socket) >= sizeof(address.sun_path)) {
+    logMessage(LOG_ERR, "replay socket path too long: %s", session->socket);
+    return -1;
+  }
+
+  strcpy(address.sun_path, session->socket);
+
+  /* the Virtual driver creates its socket when it's started */
+  while (!session->stopping && (attempts-- > 0)) {
+    int descriptor = socket(PF_LOCAL, SOCK_STREAM, 0);
+
+    if (descriptor == -1) {
+      logSystemError("socket");
+      return -1;
+    }
+
+    if (connect(descriptor, (struct sockaddr *)&address, sizeof(address)) != -1) return descriptor;
+    close(descriptor);
+
+    if ((errno != ENOENT) && (errno != ECONNREFUSED)) {
+      logSystemError("connect");
+      return -1;
+    }
+
+    approximateDelay(100);
+  }
+
+  logMessage(LOG_ERR, "replay socket not available: %s", session->socket);
+  return -1;
+}
+
+static int
+sendReplayLine (int descriptor, const char *line) {
+  size_t length = strlen(line);
+  char buffer[length + 1];
+
+  memcpy(buffer, line, length);
+  buffer[length++] = '\n';
+
+  {
+    const char *byte = buffer;
+
+    while (length > 0) {
+      ssize_t count = send(descriptor, byte, length, 0);
+
+      if (count == -1) {
+        if (errno == EINTR) continue;
+        logSystemError("send");
+        return 0;
+      }
+
+      byte += count;
+      length -= count;
+    }
+  }
+
+  return 1;
+}
+
+static int
+readReplayOutput (ReplaySession *session, int descriptor, int milliseconds) {
+  fd_set set;
+  struct timeval timeout;
+
+  FD_ZERO(&set);
+  FD_SET(descriptor, &set);
+  timeout.tv_sec = milliseconds / MSECS_PER_SEC;
+  timeout.tv_usec = (milliseconds % MSECS_PER_SEC) * USECS_PER_MSEC;
+
+  switch (select(descriptor+1, &set, NULL, NULL, &timeout)) {
+    case -1:
+      if (errno == EINTR) return 1;
+      logSystemError("select");
+      return 0;
+
+    case 0:
+      return 1;
+
+    default:
+      break;
+  }
+
+  {
+    char *buffer = &session->output[session->outputLength];
+    ssize_t count = recv(descriptor, buffer, sizeof(session->output) - session->outputLength, 0);
+
+    if (count == -1) {
+      if (errno == EINTR) return 1;
+      logSystemError("recv");
+      return 0;
+    }
+
+    if (count == 0) {
+      logMessage(LOG_WARNING, "replay socket closed by driver");
+      return 0;
+    }
+
+    session->outputLength += count;
+  }
+
+  {
+    char *line = session->output;
+    char *end = line + session->outputLength;
+    char *newline;
+
+    while ((newline = memchr(line, '\n', end-line))) {
+      if (!session->outputOverflow) {
+        static const char prefix[] = "Braille ";
+        const size_t length = sizeof(prefix) - 1;
+
+        if (((newline - line) >= length) && (strncasecmp(line, prefix, length) == 0)) {
+          session->windowsRendered += 1;
+        }
+      }
+
+      session->outputOverflow = 0;
+      line = newline + 1;
+    }
+
+    if (line == session->output) {
+      if (session->outputLength == sizeof(session->output)) {
+        /* only the start of a line matters - discard the rest of it */
+        session->outputLength = 0;
+        session->outputOverflow = 1;
+      }
+    } else {
+      session->outputLength = end - line;
+      memmove(session->output, line, session->outputLength);
+    }
+  }
+
+  return 1;
+}
+
+static int
+awaitReplayUpdates (ReplaySession *session, int descriptor) {
+  /* the second update starts after the first has finished with the event */
+  uint32_t target = getCounterValue(COUNTER_UPDATES) + 2;
+  TimeValue start;
+
+  getMonotonicTime(&start);
+
+  while (!session->stopping && (getCounterValue(COUNTER_UPDATES) < target)) {
+    if (getMonotonicElapsed(&start) > MSECS_PER_SEC) break;
+    if (!readReplayOutput(session, descriptor, 10)) return 0;
+  }
+
+  return 1;
+}
+
+static unsigned long int
+getCpuTime (void) {
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) == -1) {
+    logSystemError("getrusage");
+    return 0;
+  }
+
+  return ((usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * USECS_PER_SEC) +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void
+logReplayLatency (LatencyMetric metric) {
+  LatencyHistogram histogram;
+  char buffer[0X200];
+
+  getLatencyHistogram(metric, &histogram);
+  formatLatencyHistogram(buffer, sizeof(buffer), getLatencyName(metric), &histogram);
+  logMessage(LOG_NOTICE, "session replay: %s", buffer);
+}
+
+static void *
+runReplayThread (void *argument) {
+  ReplaySession *session = argument;
+  int descriptor = connectReplaySocket(session);
+
+  if (descriptor != -1) {
+    const ReplayEvent *event = session->events;
+    const ReplayEvent *end = event + session->eventCount;
+    long int base = event->time;
+    unsigned int commands = 0;
+    unsigned int columns = 40;
+    unsigned int rows = 1;
+    unsigned long int cpuTime;
+    TimeValue start;
+    char line[0X40];
+
+    /* the driver won't finish starting until it knows its size */
+    while ((event < end) && (event->type != EVENT_DISPLAY)) event += 1;
+    if (event < end) {
+      columns = event->value.display.columns;
+      rows = event->value.display.rows;
+    }
+
+    snprintf(line, sizeof(line), "cells %u %u", columns, rows);
+    if (!sendReplayLine(descriptor, line)) goto done;
+    if (!awaitReplayUpdates(session, descriptor)) goto done;
+
+    resetMetrics();
+    session->windowsRendered = 0;
+    cpuTime = getCpuTime();
+    getMonotonicTime(&start);
+
+    for (event=session->events; event<end; event+=1) {
+      if (session->stopping) goto done;
+
+      if (session->speed == REPLAY_REAL_TIME) {
+        long int delay;
+
+        while ((delay = (event->time - base) - getMonotonicElapsed(&start)) > 0) {
+          if (session->stopping) goto done;
+          if (!readReplayOutput(session, descriptor, MIN(delay, 100))) goto done;
+        }
+      }
+
+      switch (event->type) {
+        case EVENT_DISPLAY:
+          if ((event->value.display.columns == columns) &&
+              (event->value.display.rows == rows)) {
+            break;
+          }
+
+          columns = event->value.display.columns;
+          rows = event->value.display.rows;
+          snprintf(line, sizeof(line), "cells %u %u",
+                   event->value.display.columns, event->value.display.rows);
+          if (!sendReplayLine(descriptor, line)) goto done;
+          break;
+
+        case EVENT_SCREEN:
+          if (!applyReplayScreen(session, event)) goto done;
+          break;
+
+        case EVENT_COMMAND:
+          if (!sendReplayLine(descriptor, event->value.command)) goto done;
+          commands += 1;
+          break;
+      }
+
+      if (session->speed == REPLAY_FULL_SPEED) {
+        if (!awaitReplayUpdates(session, descriptor)) goto done;
+      }
+    }
+
+    if (!awaitReplayUpdates(session, descriptor)) goto done;
+
+    {
+      long int elapsed = MAX(getMonotonicElapsed(&start), 1);
+      uint32_t updates = MAX(getCounterValue(COUNTER_UPDATES), 1);
+
+      cpuTime = getCpuTime() - cpuTime;
+
+      logMessage(LOG_NOTICE, "session replay: %u events (%u commands) in %ld ms",
+                 session->eventCount, commands, elapsed);
+      logMessage(LOG_NOTICE, "session replay: %u windows rendered (%lu per second)",
+                 session->windowsRendered,
+                 (session->windowsRendered * MSECS_PER_SEC) / elapsed);
+      logMessage(LOG_NOTICE, "session replay: %" PRIu32 " updates (%lu us of CPU per update)",
+                 updates, cpuTime / updates);
+      logReplayLatency(LATENCY_CONTRACTION);
+      logReplayLatency(LATENCY_KEY_COMMAND);
+      logReplayLatency(LATENCY_SCREEN_WINDOW);
+    }
+
+  done:
+    close(descriptor);
+  }
+
+  /* a replay is a benchmark run - it's over when the session is */
+  if (!session->stopping) requestTermination();
+  return NULL;
+}
+
+static void
+exitSessionReplay (void) {
+  ReplaySession *session = &replaySession;
+
+  session->stopping = 1;
+  pthread_join(session->thread, NULL);
+  deactivateReplayScreen();
+  deallocateReplaySession(session);
+}
+
+int
+startSessionReplay (const char *path, const char *socket, ReplaySpeed speed) {
+  ReplaySession *session = &replaySession;
+  FILE *file;
+
+  memset(session, 0, sizeof(*session));
+  session->path = path;
+  session->speed = speed;
+
+  if (!(session->socket = strdup(socket))) {
+    logMallocError();
+    return 0;
+  }
+
+  if ((file = openFile(path, "r", 0))) {
+    int ok = processLines(file, handleReplayLine, session);
+
+    fclose(file);
+
+    if (ok && !session->eventCount) {
+      logMessage(LOG_ERR, "empty session: %s", path);
+      ok = 0;
+    }
+
+    if (ok) {
+      const ReplayEvent *event = session->events;
+      const ReplayEvent *end = event + session->eventCount;
+
+      /* show the first snapshot before the driver starts */
+      while ((event < end) && (event->type != EVENT_SCREEN)) event += 1;
+
+      if (event == end) {
+        logMessage(LOG_ERR, "no screen in session: %s", path);
+      } else if (applyReplayScreen(session, event) && activateReplayScreen()) {
+        int error = pthread_create(&session->thread, NULL, runReplayThread, session);
+
+        if (!error) {
+          onProgramExit(exitSessionReplay);
+          logMessage(LOG_INFO, "replaying session: %s", path);
+          return 1;
+        }
+
+        errno = error;
+        logSystemError("pthread_create");
+        deactivateReplayScreen();
+      }
+    }
+  }
+
+  deallocateReplaySession(session);
+  return 0;
+}
+#else /* replay support */
+int
+startSessionReplay (const char *path, const char *socket, ReplaySpeed speed) {
+  logMessage(LOG_ERR, "session replay not supported");
+  return 0;
+}
+#endif /* replay support */
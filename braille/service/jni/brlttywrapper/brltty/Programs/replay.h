@@ -0,0 +1,56 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+
+
+#ifndef BRLTTY_INCLUDED_REPLAY
+#define BRLTTY_INCLUDED_REPLAY
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* A session file is plain text, one event per line, each (except for rows)
+ * beginning with the number of milliseconds since the recording started:
+ *
+ *   display time columns rows
+ *   screen time columns rows column row number
+ *   row index "text"
+ *   command time name [on|off|number]
+ *
+ * A screen line is followed by a row line for each row which has changed
+ * since the previous one. Commands are written the way the Virtual braille
+ * driver expects a display to send them so that a replay can drive the core
+ * through that driver.
+ */
+
+extern int startSessionRecording (const char *path);
+extern void recordSessionUpdate (unsigned int columns, unsigned int rows);
+extern void recordSessionCommand (int command);
+
+typedef enum {
+  REPLAY_FULL_SPEED,
+  REPLAY_REAL_TIME
+} ReplaySpeed;
+
+extern int startSessionReplay (const char *path, const char *socket, ReplaySpeed speed);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* BRLTTY_INCLUDED_REPLAY */
@@ -23,13 +23,9 @@
 #include <string.h>
 #include <errno.h>
 
-#ifdef HAVE_SIGNAL_H
-#include <signal.h>
-#endif /* HAVE_SIGNAL_H */
-
-#ifdef SIGUSR1
-#include <sys/wait.h>
-#endif /* SIGUSR1 */
+#ifdef HAVE_POSIX_THREADS
+#include <pthread.h>
+#endif /* HAVE_POSIX_THREADS */
 
 #include "log.h"
 #include "program.h"
@@ -43,9 +39,10 @@
  * further details.
  * NOTE: if you try to route the cursor to an invalid place, BRLTTY won't
  * give up until the timeout has elapsed!
+ * The core wakes the routing thread as soon as it sees the cursor move, so
+ * the interval only bounds how long it waits before checking anyway.
  */
-#define ROUTING_NICENESS	10	/* niceness of cursor routing subprocess */
-#define ROUTING_INTERVAL	1	/* how often to check for response */
+#define ROUTING_INTERVAL	100	/* longest wait for a cursor motion report */
 #define ROUTING_TIMEOUT	2000	/* max wait for response to key press */
 
 typedef enum {
@@ -55,10 +52,6 @@ typedef enum {
 } RoutingResult;
 
 typedef struct {
-#ifdef HAVE_SIGNAL_H
-  sigset_t signalMask;
-#endif /* HAVE_SIGNAL_H */
-
   int screenNumber;
   int screenRows;
   int screenColumns;
@@ -139,13 +132,13 @@ logRouting (const char *format, ...) {
 static int
 readScreenRow (RoutingData *routing, ScreenCharacter *buffer, int row) {
   if (!buffer) buffer = routing->rowBuffer;
-  return readScreen(0, row, routing->screenColumns, 1, buffer);
+  return readRoutingScreen(0, row, routing->screenColumns, 1, buffer);
 }
 
 static int
 getCurrentPosition (RoutingData *routing) {
   ScreenDescription description;
-  describeScreen(&description);
+  describeRoutingScreen(&description);
 
   if (description.number != routing->screenNumber) {
     logRouting("screen changed: num=%d", description.number);
@@ -184,19 +177,67 @@ error:
   return 0;
 }
 
+#ifdef HAVE_POSIX_THREADS
+typedef struct {
+  int column;
+  int row;
+  int screen;
+} RoutingRequest;
+
+static pthread_mutex_t routingMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t routingCondition = PTHREAD_COND_INITIALIZER;
+
+static struct {
+  pthread_t thread;
+  RoutingRequest request;
+  RoutingStatus status;
+
+  unsigned started:1;
+  unsigned stopping:1;
+  unsigned pending:1;
+  unsigned active:1;
+  unsigned cancelled:1;
+  unsigned updated:1;
+} routingThread;
+
+static int
+awaitRoutingEvent (int milliseconds) {
+  int ok;
+
+  pthread_mutex_lock(&routingMutex);
+
+  if (!routingThread.updated && !routingThread.cancelled) {
+    TimeValue time;
+    struct timespec timeout;
+
+    getCurrentTime(&time);
+    adjustTimeValue(&time, milliseconds);
+    timeout.tv_sec = time.seconds;
+    timeout.tv_nsec = time.nanoseconds;
+
+    while (!routingThread.updated && !routingThread.cancelled) {
+      if (pthread_cond_timedwait(&routingCondition, &routingMutex, &timeout) == ETIMEDOUT) break;
+    }
+  }
+
+  routingThread.updated = 0;
+  ok = !routingThread.cancelled;
+  pthread_mutex_unlock(&routingMutex);
+  return ok;
+}
+#else /* HAVE_POSIX_THREADS */
+static int
+awaitRoutingEvent (int milliseconds) {
+  /* routing runs on the core's own thread so nothing can report motion */
+  approximateDelay(1);
+  return 1;
+}
+#endif /* HAVE_POSIX_THREADS */
+
 static void
 moveCursor (RoutingData *routing, const CursorDirectionEntry *direction) {
-#ifdef SIGUSR1
-  sigset_t oldMask;
-  sigprocmask(SIG_BLOCK, &routing->signalMask, &oldMask);
-#endif /* SIGUSR1 */
-
   logRouting("move: %s", direction->name);
-  insertScreenKey(direction->key);
-
-#ifdef SIGUSR1
-  sigprocmask(SIG_SETMASK, &oldMask, NULL);
-#endif /* SIGUSR1 */
+  insertRoutingScreenKey(direction->key);
 }
 
 static int
@@ -221,7 +262,11 @@ awaitCursorMotion (RoutingData *routing, int direction, const CursorAxisEntry *a
     int oldy;
     int oldx;
 
-    approximateDelay(ROUTING_INTERVAL);
+    if (!awaitRoutingEvent(ROUTING_INTERVAL)) {
+      logRouting("cancelled");
+      return 0;
+    }
+
     getMonotonicTime(&now);
     time = millisecondsBetween(&start, &now) + 1;
 
@@ -370,13 +415,6 @@ static RoutingStatus
 doRouting (int column, int row, int screen) {
   RoutingData routing;
 
-#ifdef SIGUSR1
-  /* Set up the signal mask. */
-  sigemptyset(&routing.signalMask);
-  sigaddset(&routing.signalMask, SIGUSR1);
-  sigprocmask(SIG_UNBLOCK, &routing.signalMask, NULL);
-#endif /* SIGUSR1 */
-
   /* initialize the routing data structure */
   routing.screenNumber = screen;
   routing.rowBuffer = NULL;
@@ -405,61 +443,143 @@ doRouting (int column, int row, int screen) {
   return ROUTING_DONE;
 }
 
-#ifdef SIGUSR1
-#define NOT_ROUTING 0
+#ifdef HAVE_POSIX_THREADS
+static void *
+runRoutingThread (void *argument) {
+  pthread_mutex_lock(&routingMutex);
+
+  while (!routingThread.stopping) {
+    if (routingThread.pending) {
+      RoutingRequest request = routingThread.request;
+      RoutingStatus status;
+
+      routingThread.pending = 0;
+      routingThread.active = 1;
+      routingThread.cancelled = 0;
+      routingThread.updated = 0;
+      pthread_mutex_unlock(&routingMutex);
+
+      status = doRouting(request.column, request.row, request.screen);
+
+      pthread_mutex_lock(&routingMutex);
+      routingThread.active = 0;
+      if (!routingThread.cancelled) routingThread.status = status;
+      pthread_cond_broadcast(&routingCondition);
+    } else {
+      pthread_cond_wait(&routingCondition, &routingMutex);
+    }
+  }
+
+  pthread_mutex_unlock(&routingMutex);
+  return NULL;
+}
+
+static void
+exitRouting (void) {
+  pthread_mutex_lock(&routingMutex);
+  routingThread.stopping = 1;
+  routingThread.pending = 0;
+  routingThread.cancelled = 1;
+  pthread_cond_broadcast(&routingCondition);
+  pthread_mutex_unlock(&routingMutex);
+
+  pthread_join(routingThread.thread, NULL);
+  routingThread.started = 0;
+  routingThread.stopping = 0;
+}
 
-static pid_t routingProcess = NOT_ROUTING;
+static int
+startRoutingThread (void) {
+  if (!routingThread.started) {
+    int error = pthread_create(&routingThread.thread, NULL, runRoutingThread, NULL);
+
+    if (error) {
+      errno = error;
+      logSystemError("pthread_create");
+      return 0;
+    }
+
+    routingThread.started = 1;
+
+    {
+      static int first = 1;
+      if (first) {
+        first = 0;
+        onProgramExit(exitRouting);
+      }
+    }
+  }
+
+  return 1;
+}
 
 int
 isRouting (void) {
-  return routingProcess != NOT_ROUTING;
+  int routing;
+
+  pthread_mutex_lock(&routingMutex);
+  routing = routingThread.pending || routingThread.active;
+  pthread_mutex_unlock(&routingMutex);
+
+  return routing;
 }
 
 RoutingStatus
 getRoutingStatus (int wait) {
-  if (isRouting()) {
-    int options = 0;
-    if (!wait) options |= WNOHANG;
+  RoutingStatus status;
 
-  doWait:
-    {
-      int status;
-      pid_t process = waitpid(routingProcess, &status, options);
+  pthread_mutex_lock(&routingMutex);
 
-      if (process == routingProcess) {
-        routingProcess = NOT_ROUTING;
-        return WIFEXITED(status)? WEXITSTATUS(status): ROUTING_ERROR;
-      }
+  if (wait) {
+    while (routingThread.pending || routingThread.active) {
+      pthread_cond_wait(&routingCondition, &routingMutex);
+    }
+  }
 
-      if (process == -1) {
-        if (errno == EINTR) goto doWait;
+  status = routingThread.status;
+  routingThread.status = ROUTING_NONE;
+  pthread_mutex_unlock(&routingMutex);
 
-        if (errno == ECHILD) {
-          routingProcess = NOT_ROUTING;
-          return ROUTING_ERROR;
-        }
+  return status;
+}
 
-        logSystemError("waitpid");
-      }
-    }
+void
+routingScreenUpdated (void) {
+  pthread_mutex_lock(&routingMutex);
+
+  if (routingThread.active) {
+    routingThread.updated = 1;
+    pthread_cond_broadcast(&routingCondition);
   }
 
-  return ROUTING_NONE;
+  pthread_mutex_unlock(&routingMutex);
 }
 
-static void
-stopRouting (void) {
-  if (isRouting()) {
-    kill(routingProcess, SIGUSR1);
-    getRoutingStatus(1);
+int
+startRouting (int column, int row, int screen) {
+  int started = 0;
+
+  pthread_mutex_lock(&routingMutex);
+
+  if (startRoutingThread()) {
+    /* A newer request supersedes the one in progress as well as any
+     * result which hasn't been collected yet.
+     */
+    routingThread.request.column = column;
+    routingThread.request.row = row;
+    routingThread.request.screen = screen;
+    routingThread.status = ROUTING_NONE;
+    routingThread.pending = 1;
+    if (routingThread.active) routingThread.cancelled = 1;
+
+    pthread_cond_broadcast(&routingCondition);
+    started = 1;
   }
-}
 
-static void
-exitRouting (void) {
-  stopRouting();
+  pthread_mutex_unlock(&routingMutex);
+  return started;
 }
-#else /* SIGUSR1 */
+#else /* HAVE_POSIX_THREADS */
 static RoutingStatus routingStatus = ROUTING_NONE;
 
 RoutingStatus
@@ -473,56 +593,14 @@ int
 isRouting (void) {
   return 0;
 }
-#endif /* SIGUSR1 */
+
+void
+routingScreenUpdated (void) {
+}
 
 int
 startRouting (int column, int row, int screen) {
-#ifdef SIGUSR1
-  int started = 0;
-
-  stopRouting();
-
-  switch (routingProcess = fork()) {
-    case 0: { /* child: cursor routing subprocess */
-      int result = ROUTING_ERROR;
-
-      if (!ROUTING_INTERVAL) {
-        int niceness = nice(ROUTING_NICENESS);
-
-        if (niceness == -1) {
-          logSystemError("nice");
-        }
-      }
-
-      if (constructRoutingScreen()) {
-        result = doRouting(column, row, screen);		/* terminate child process */
-        destructRoutingScreen();		/* close second thread of screen reading */
-      }
-
-      _exit(result);		/* terminate child process */
-    }
-
-    case -1: /* error: fork() failed */
-      logSystemError("fork");
-      routingProcess = NOT_ROUTING;
-      break;
-
-    default: /* parent: continue while cursor is being routed */
-      {
-        static int first = 1;
-        if (first) {
-          first = 0;
-          onProgramExit(exitRouting);
-        }
-      }
-
-      started = 1;
-      break;
-  }
-
-  return started;
-#else /* SIGUSR1 */
   routingStatus = doRouting(column, row, screen);
   return 1;
-#endif /* SIGUSR1 */
 }
+#endif /* HAVE_POSIX_THREADS */
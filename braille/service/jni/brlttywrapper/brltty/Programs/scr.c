@@ -29,6 +29,10 @@
 
 #include <string.h>
 
+#ifdef HAVE_POSIX_THREADS
+#include <pthread.h>
+#endif /* HAVE_POSIX_THREADS */
+
 #include "log.h"
 #include "message.h"
 #include "system.h"
@@ -38,12 +42,14 @@
 #include "scr_help.h"
 #include "scr_menu.h"
 #include "scr_frozen.h"
+#include "scr_replay.h"
 #include "scr_real.h"
 #include "scr.auto.h"
 
 static HelpScreen helpScreen;
 static MenuScreen menuScreen;
 static FrozenScreen frozenScreen;                
+static ReplayScreen replayScreen;
 static MainScreen mainScreen;
 static BaseScreen *currentScreen = &mainScreen.base;
 
@@ -90,6 +96,45 @@ loadScreenDriver (const char *code, void **driverObject, const char *driverDirec
                     &noScreen, &noScreen.definition);
 }
 
+/* The cursor routing thread uses the main screen at the same time as the
+ * core, and screen drivers aren't reentrant, so every call into a screen is
+ * serialized. The lock is recursive because some screens call back into
+ * this file (the help and menu screens ask for a user virtual terminal).
+ */
+#ifdef HAVE_POSIX_THREADS
+static pthread_once_t screenLockOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t screenLock;
+
+static void
+initializeScreenLock (void) {
+  pthread_mutexattr_t attributes;
+
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&screenLock, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+}
+
+static void
+lockScreen (void) {
+  pthread_once(&screenLockOnce, initializeScreenLock);
+  pthread_mutex_lock(&screenLock);
+}
+
+static void
+unlockScreen (void) {
+  pthread_mutex_unlock(&screenLock);
+}
+#else /* HAVE_POSIX_THREADS */
+static void
+lockScreen (void) {
+}
+
+static void
+unlockScreen (void) {
+}
+#endif /* HAVE_POSIX_THREADS */
+
 void
 initializeScreen (void) {
   screen->initialize(&mainScreen);
@@ -97,22 +142,29 @@ initializeScreen (void) {
 
 int
 constructScreenDriver (char **parameters) {
+  int constructed = 0;
+
+  lockScreen();
   initializeScreen();
+
   if (mainScreen.processParameters(parameters)) {
     if (mainScreen.construct()) {
-      return 1;
+      constructed = 1;
     } else {
       logMessage(LOG_DEBUG, "screen driver initialization failed: %s",
                  screen->definition.code);
     }
   }
 
-  return 0;
+  unlockScreen();
+  return constructed;
 }
 
 void
 destructScreenDriver (void) {
+  lockScreen();
   mainScreen.destruct();
+  unlockScreen();
 }
 
 void
@@ -134,6 +186,7 @@ constructSpecialScreens (void) {
   initializeHelpScreen(&helpScreen);
   initializeMenuScreen(&menuScreen);
   initializeFrozenScreen(&frozenScreen);
+  initializeReplayScreen(&replayScreen);
 }
 
 void
@@ -141,16 +194,21 @@ destructSpecialScreens (void) {
   helpScreen.destruct();
   menuScreen.destruct();
   frozenScreen.destruct();
+  replayScreen.destruct();
 }
 
 
 typedef enum {
   SCR_HELP   = 0X01,
   SCR_MENU   = 0X02,
-  SCR_FROZEN = 0X04
+  SCR_FROZEN = 0X04,
+  SCR_REPLAY = 0X08
 } ActiveScreen;
 static ActiveScreen activeScreens = 0;
 
+/* The routing thread picks its screen from the active set, so the set and
+ * the current screen only change while the screen lock is held.
+ */
 static void
 setScreen (ActiveScreen which) {
   typedef struct {
@@ -162,6 +220,7 @@ setScreen (ActiveScreen which) {
     {SCR_HELP  , &helpScreen.base},
     {SCR_MENU  , &menuScreen.base},
     {SCR_FROZEN, &frozenScreen.base},
+    {SCR_REPLAY, &replayScreen.base},
     {0         , &mainScreen.base}
   };
   const ScreenEntry *entry = screenEntries;
@@ -171,17 +230,13 @@ setScreen (ActiveScreen which) {
     entry += 1;
   }
   currentScreen = entry->screen;
-
-  {
-    char buffer[0X80];
-    size_t length = formatScreenTitle(buffer, sizeof(buffer));
-    if (length) message(NULL, buffer, 0);
-  }
 }
 
 static void
-selectScreen (void) {
-  setScreen(activeScreens);
+announceScreen (void) {
+  char buffer[0X80];
+  size_t length = formatScreenTitle(buffer, sizeof(buffer));
+  if (length) message(NULL, buffer, 0);
 }
 
 int
@@ -191,19 +246,41 @@ haveScreen (ActiveScreen which) {
 
 static void
 activateScreen (ActiveScreen which) {
+  lockScreen();
   activeScreens |= which;
   setScreen(which);
+  unlockScreen();
+
+  announceScreen();
 }
 
 static void
 deactivateScreen (ActiveScreen which) {
+  lockScreen();
   activeScreens &= ~which;
-  selectScreen();
+  setScreen(activeScreens);
+  unlockScreen();
+
+  announceScreen();
+}
+
+/* While a recorded session is being replayed its screen stands in for the
+ * main screen underneath the help, menu, and frozen screens. The caller must
+ * hold the screen lock.
+ */
+static BaseScreen *
+getLiveScreen (void) {
+  return haveScreen(SCR_REPLAY)? &replayScreen.base: &mainScreen.base;
 }
 
 int
 isLiveScreen (void) {
-  return currentScreen == &mainScreen.base;
+  int live;
+
+  lockScreen();
+  live = currentScreen == getLiveScreen();
+  unlockScreen();
+  return live;
 }
 
 
@@ -270,22 +347,54 @@ setScreenMessage (const ScreenBox *box, ScreenCharacter *buffer, const char *mes
 
 size_t
 formatScreenTitle (char *buffer, size_t size) {
-  return currentScreen->formatTitle(buffer, size);
+  size_t length;
+
+  lockScreen();
+  length = currentScreen->formatTitle(buffer, size);
+  unlockScreen();
+  return length;
 }
 
-void
-describeScreen (ScreenDescription *description) {
-  describeBaseScreen(currentScreen, description);
+static void
+describeSpecificScreen (BaseScreen *screen, ScreenDescription *description) {
+  lockScreen();
+  describeBaseScreen(screen, description);
+  unlockScreen();
 }
 
-int
-readScreen (short left, short top, short width, short height, ScreenCharacter *buffer) {
+static int
+readSpecificScreen (BaseScreen *screen, short left, short top, short width, short height, ScreenCharacter *buffer) {
+  int ok;
   ScreenBox box;
   box.left = left;
   box.top = top;
   box.width = width;
   box.height = height;
-  return currentScreen->readCharacters(&box, buffer);
+
+  lockScreen();
+  ok = screen->readCharacters(&box, buffer);
+  unlockScreen();
+  return ok;
+}
+
+static int
+insertSpecificScreenKey (BaseScreen *screen, ScreenKey key) {
+  int ok;
+
+  lockScreen();
+  ok = screen->insertKey(key);
+  unlockScreen();
+  return ok;
+}
+
+void
+describeScreen (ScreenDescription *description) {
+  describeSpecificScreen(currentScreen, description);
+}
+
+int
+readScreen (short left, short top, short width, short height, ScreenCharacter *buffer) {
+  return readSpecificScreen(currentScreen, left, top, width, height, buffer);
 }
 
 int
@@ -304,73 +413,135 @@ readScreenText (short left, short top, short width, short height, wchar_t *buffe
 
 int
 insertScreenKey (ScreenKey key) {
-  return currentScreen->insertKey(key);
+  return insertSpecificScreenKey(currentScreen, key);
 }
 
 int
 routeCursor (int column, int row, int screen) {
-  return currentScreen->routeCursor(column, row, screen);
+  int ok;
+
+  lockScreen();
+  ok = currentScreen->routeCursor(column, row, screen);
+  unlockScreen();
+  return ok;
 }
 
 int
 highlightScreenRegion (int left, int right, int top, int bottom) {
-  return currentScreen->highlightRegion(left, right, top, bottom);
+  int ok;
+
+  lockScreen();
+  ok = currentScreen->highlightRegion(left, right, top, bottom);
+  unlockScreen();
+  return ok;
 }
 
 int
 unhighlightScreenRegion (void) {
-  return currentScreen->unhighlightRegion();
+  int ok;
+
+  lockScreen();
+  ok = currentScreen->unhighlightRegion();
+  unlockScreen();
+  return ok;
 }
 
 int
 getScreenPointer (int *column, int *row) {
-  return currentScreen->getPointer(column, row);
+  int ok;
+
+  lockScreen();
+  ok = currentScreen->getPointer(column, row);
+  unlockScreen();
+  return ok;
 }
 
 int
 selectScreenVirtualTerminal (int vt) {
-  return currentScreen->selectVirtualTerminal(vt);
+  int ok;
+
+  lockScreen();
+  ok = currentScreen->selectVirtualTerminal(vt);
+  unlockScreen();
+  return ok;
 }
 
 int
 switchScreenVirtualTerminal (int vt) {
-  return currentScreen->switchVirtualTerminal(vt);
+  int ok;
+
+  lockScreen();
+  ok = currentScreen->switchVirtualTerminal(vt);
+  unlockScreen();
+  return ok;
 }
 
 int
 currentVirtualTerminal (void) {
-  return currentScreen->currentVirtualTerminal();
+  int vt;
+
+  lockScreen();
+  vt = currentScreen->currentVirtualTerminal();
+  unlockScreen();
+  return vt;
 }
 
 int
 userVirtualTerminal (int number) {
-  return mainScreen.userVirtualTerminal(number);
+  int vt;
+
+  lockScreen();
+  vt = mainScreen.userVirtualTerminal(number);
+  unlockScreen();
+  return vt;
 }
 
 int
 executeScreenCommand (int *command) {
-  return currentScreen->executeCommand(command);
+  int ok;
+
+  lockScreen();
+  ok = currentScreen->executeCommand(command);
+  unlockScreen();
+  return ok;
 }
 
 KeyTableCommandContext
 getScreenCommandContext (void) {
-  return currentScreen->getCommandContext();
+  KeyTableCommandContext context;
+
+  lockScreen();
+  context = currentScreen->getCommandContext();
+  unlockScreen();
+  return context;
 }
 
 
+void
+describeRoutingScreen (ScreenDescription *description) {
+  lockScreen();
+  describeSpecificScreen(getLiveScreen(), description);
+  unlockScreen();
+}
+
 int
-constructRoutingScreen (void) {
-  /* This function should be used in a forked process. Though we want to
-   * have a separate file descriptor for the main screen from the one used
-   * in the main thread.  So we close and reopen the device.
-   */
-  mainScreen.destruct();
-  return mainScreen.construct();
+readRoutingScreen (short left, short top, short width, short height, ScreenCharacter *buffer) {
+  int ok;
+
+  lockScreen();
+  ok = readSpecificScreen(getLiveScreen(), left, top, width, height, buffer);
+  unlockScreen();
+  return ok;
 }
 
-void
-destructRoutingScreen (void) {
-  mainScreen.destruct();
+int
+insertRoutingScreenKey (ScreenKey key) {
+  int ok;
+
+  lockScreen();
+  ok = insertSpecificScreenKey(getLiveScreen(), key);
+  unlockScreen();
+  return ok;
 }
 
 
@@ -496,7 +667,15 @@ haveFrozenScreen (void) {
 
 int
 activateFrozenScreen (void) {
-  if (haveFrozenScreen() || !frozenScreen.construct(&mainScreen.base)) return 0;
+  int constructed;
+
+  if (haveFrozenScreen()) return 0;
+
+  lockScreen();
+  constructed = frozenScreen.construct(getLiveScreen());
+  unlockScreen();
+
+  if (!constructed) return 0;
   activateScreen(SCR_FROZEN);
   return 1;
 }
@@ -508,3 +687,34 @@ deactivateFrozenScreen (void) {
     deactivateScreen(SCR_FROZEN);
   }
 }
+
+
+int
+haveReplayScreen (void) {
+  return haveScreen(SCR_REPLAY);
+}
+
+int
+activateReplayScreen (void) {
+  if (haveReplayScreen()) return 0;
+  activateScreen(SCR_REPLAY);
+  return 1;
+}
+
+void
+deactivateReplayScreen (void) {
+  if (haveReplayScreen()) {
+    deactivateScreen(SCR_REPLAY);
+    replayScreen.destruct();
+  }
+}
+
+int
+updateReplayScreen (const ScreenDescription *description, const ScreenCharacter *characters) {
+  int ok;
+
+  lockScreen();
+  ok = replayScreen.update(description, characters);
+  unlockScreen();
+  return ok;
+}
@@ -161,6 +161,12 @@ extern int haveFrozenScreen (void);
 extern int activateFrozenScreen (void);
 extern void deactivateFrozenScreen (void);
 
+/* Routines which apply to the replay screen. */
+extern int haveReplayScreen (void);
+extern int activateReplayScreen (void);
+extern void deactivateReplayScreen (void);
+extern int updateReplayScreen (const ScreenDescription *description, const ScreenCharacter *characters);
+
 /* Routines which apply to the current screen. */
 extern size_t formatScreenTitle (char *buffer, size_t size);
 extern void describeScreen (ScreenDescription *);		/* get screen status */
@@ -179,12 +185,12 @@ extern int executeScreenCommand (int *);
 extern KeyTableCommandContext getScreenCommandContext (void);
 
 /* Routines which apply to the routing screen.
- * An extra `thread' for the cursor routing subprocess.
- * This is needed because the forked subprocess shares its parent's
- * file descriptors.  A readScreen equivalent is not needed.
+ * The cursor routing thread always works on the main (or replay) screen,
+ * whichever screen is current, and may use these concurrently with the core.
  */
-extern int constructRoutingScreen (void);
-extern void destructRoutingScreen (void);
+extern void describeRoutingScreen (ScreenDescription *description);
+extern int readRoutingScreen (short left, short top, short width, short height, ScreenCharacter *buffer);
+extern int insertRoutingScreenKey (ScreenKey key);
 
 /* Routines which apply to the help screen. */
 extern int constructHelpScreen (void);
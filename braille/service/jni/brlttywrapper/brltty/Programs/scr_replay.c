@@ -0,0 +1,101 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2013 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU General Public License, as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-GPL for details.
+ *
+ * Web Page: http://mielke.cc/brltty/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+
+
+#include "prologue.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+#include "scr.h"
+#include "scr_replay.h"
+
+static ScreenDescription screenDescription;
+static ScreenCharacter *screenCharacters;
+static size_t screenSize;
+
+static int
+update_ReplayScreen (const ScreenDescription *description, const ScreenCharacter *characters) {
+  size_t count = description->rows * description->cols;
+
+  if (count > screenSize) {
+    ScreenCharacter *buffer = realloc(screenCharacters, ARRAY_SIZE(buffer, count));
+
+    if (!buffer) {
+      logMallocError();
+      return 0;
+    }
+
+    screenCharacters = buffer;
+    screenSize = count;
+  }
+
+  screenDescription = *description;
+  memcpy(screenCharacters, characters, ARRAY_SIZE(screenCharacters, count));
+  return 1;
+}
+
+static void
+destruct_ReplayScreen (void) {
+  if (screenCharacters) {
+    free(screenCharacters);
+    screenCharacters = NULL;
+  }
+
+  screenSize = 0;
+  memset(&screenDescription, 0, sizeof(screenDescription));
+}
+
+static void
+describe_ReplayScreen (ScreenDescription *description) {
+  *description = screenDescription;
+  if (!screenCharacters) description->unreadable = "no session snapshot";
+}
+
+static int
+readCharacters_ReplayScreen (const ScreenBox *box, ScreenCharacter *buffer) {
+  if (validateScreenBox(box, screenDescription.cols, screenDescription.rows)) {
+    int row;
+    for (row=0; row<box->height; row++) {
+      memcpy(&buffer[row * box->width],
+             &screenCharacters[((box->top + row) * screenDescription.cols) + box->left],
+             box->width * sizeof(*screenCharacters));
+    }
+    return 1;
+  }
+  return 0;
+}
+
+static int
+currentVirtualTerminal_ReplayScreen (void) {
+  return screenDescription.number;
+}
+
+void
+initializeReplayScreen (ReplayScreen *replay) {
+  initializeBaseScreen(&replay->base);
+  replay->base.describe = describe_ReplayScreen;
+  replay->base.readCharacters = readCharacters_ReplayScreen;
+  replay->base.currentVirtualTerminal = currentVirtualTerminal_ReplayScreen;
+  replay->update = update_ReplayScreen;
+  replay->destruct = destruct_ReplayScreen;
+  screenCharacters = NULL;
+  screenSize = 0;
+  memset(&screenDescription, 0, sizeof(screenDescription));
+}
@@ -25,6 +25,9 @@
 #include <sys/stat.h>
 
 #include "log.h"
+#include "timing.h"
+#include "metrics.h"
+#include "queue.h"
 #include "program.h"
 #include "file.h"
 #include "parse.h"
@@ -121,8 +124,10 @@ sayCharacters (SpeechSynthesizer *spk, const char *characters, size_t count, int
       *b = 0;
     }
 
-    if (mute) speech->mute(spk);
-    speech->say(spk, bytes, b-bytes, count, NULL);
+    /* messages aren't held back - they're spoken as soon as they're said */
+    scheduleSpeech(spk, SPK_CLASS_MESSAGE, (mute? SPK_MODE_IMMEDIATE: SPK_MODE_APPEND),
+                   bytes, b-bytes, count, NULL);
+    flushSpeechQueue(spk);
   }
 }
 
@@ -131,6 +136,158 @@ sayString (SpeechSynthesizer *spk, const char *string, int mute) {
   sayCharacters(spk, string, strlen(string), mute);
 }
 
+typedef struct {
+  SpeechClass class;
+  unsigned immediate:1;
+  unsigned append:1;
+  TimeValue time;
+
+  size_t length;
+  size_t count;
+  unsigned char *attributes;
+  unsigned char text[];
+} SpeechRequest;
+
+static Queue *speechQueue = NULL;
+
+static void
+deallocateSpeechRequest (void *item, void *data) {
+  SpeechRequest *request = item;
+  free(request);
+}
+
+static int
+getSpeechQueue (void) {
+  if (!speechQueue) {
+    if (!(speechQueue = newQueue(deallocateSpeechRequest, NULL))) return 0;
+  }
+
+  return 1;
+}
+
+static int
+testSupersededSpeechRequest (const void *item, const void *data) {
+  const SpeechRequest *request = item;
+  const SpeechRequest *newer = data;
+
+  if (newer->immediate) return 1;
+  if (request->append) return 0;
+  return request->class >= newer->class;
+}
+
+int
+scheduleSpeech (
+  SpeechSynthesizer *spk, SpeechClass class, SpeechMode mode,
+  const unsigned char *text, size_t length, size_t count,
+  const unsigned char *attributes
+) {
+  SpeechRequest *request;
+  size_t size = sizeof(*request) + length;
+
+  if (attributes) size += count;
+  if (!getSpeechQueue()) return 0;
+
+  if (!(request = malloc(size))) {
+    logMallocError();
+    return 0;
+  }
+
+  request->class = class;
+  request->immediate = mode == SPK_MODE_IMMEDIATE;
+  request->append = mode == SPK_MODE_APPEND;
+  getMonotonicTime(&request->time);
+
+  request->length = length;
+  request->count = count;
+  memcpy(request->text, text, length);
+
+  if (attributes) {
+    request->attributes = &request->text[length];
+    memcpy(request->attributes, attributes, count);
+  } else {
+    request->attributes = NULL;
+  }
+
+  addToCounter(COUNTER_SPEECH_REQUESTS, 1);
+
+  if (!request->append) {
+    Element *element;
+
+    while ((element = findElement(speechQueue, testSupersededSpeechRequest, request))) {
+      const SpeechRequest *superseded = getElementItem(element);
+
+      /* what it would have interrupted is still to be interrupted */
+      if (superseded->immediate) request->immediate = 1;
+
+      deleteElement(element);
+      addToCounter(COUNTER_SPEECH_SUPERSEDED, 1);
+    }
+  }
+
+  if (!enqueueItem(speechQueue, request)) {
+    free(request);
+    return 0;
+  }
+
+  {
+    unsigned int depth = getSpeechQueueDepth();
+
+    setCounter(COUNTER_SPEECH_QUEUE_DEPTH, depth);
+    raiseCounter(COUNTER_SPEECH_QUEUE_MAXIMUM, depth);
+  }
+
+  return 1;
+}
+
+static void
+deliverSpeechRequests (SpeechSynthesizer *spk, int all) {
+  if (speechQueue) {
+    Element *element;
+
+    while ((element = getQueueHead(speechQueue))) {
+      SpeechRequest *request = getElementItem(element);
+
+      /* Queued requests are only given to the driver once it's idle so
+       * that, until then, newer ones can still supersede them.
+       */
+      if (!all && !request->immediate && speech->isSpeaking(spk)) break;
+
+      if (request->immediate) speech->mute(spk);
+      speech->say(spk, request->text, request->length, request->count, request->attributes);
+      addLatencySince(LATENCY_SPEECH_QUEUE, &request->time);
+
+      deleteElement(element);
+    }
+
+    setCounter(COUNTER_SPEECH_QUEUE_DEPTH, getSpeechQueueDepth());
+  }
+}
+
+void
+processSpeechQueue (SpeechSynthesizer *spk) {
+  deliverSpeechRequests(spk, 0);
+}
+
+void
+flushSpeechQueue (SpeechSynthesizer *spk) {
+  deliverSpeechRequests(spk, 1);
+}
+
+void
+muteSpeech (SpeechSynthesizer *spk) {
+  if (speechQueue) {
+    deleteElements(speechQueue);
+    setCounter(COUNTER_SPEECH_QUEUE_DEPTH, 0);
+  }
+
+  speech->mute(spk);
+}
+
+unsigned int
+getSpeechQueueDepth (void) {
+  return speechQueue? getQueueSize(speechQueue): 0;
+}
+
 static void
 sayStringSetting (SpeechSynthesizer *spk, const char *name, const char *string) {
   char statement[0X40];
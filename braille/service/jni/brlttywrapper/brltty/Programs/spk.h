@@ -37,6 +37,37 @@ extern void initializeSpeechSynthesizer (SpeechSynthesizer *spk);
 extern void sayCharacters (SpeechSynthesizer *spk, const char *characters, size_t count, int mute);
 extern void sayString (SpeechSynthesizer *spk, const char *string, int mute);
 
+/* Requests are queued in priority order - a new one supersedes any
+ * queued ones of its own or a lower priority class. Messages (see
+ * sayString) are delivered as soon as they're scheduled.
+ */
+typedef enum {
+  SPK_CLASS_MESSAGE,
+  SPK_CLASS_SCREEN,
+  SPK_CLASS_CHARACTER
+} SpeechClass;
+
+/* An immediate request supersedes everything that's queued and interrupts
+ * what's being spoken. An appended one neither supersedes nor is superseded
+ * by anything but an immediate request.
+ */
+typedef enum {
+  SPK_MODE_QUEUE,
+  SPK_MODE_IMMEDIATE,
+  SPK_MODE_APPEND
+} SpeechMode;
+
+extern int scheduleSpeech (
+  SpeechSynthesizer *spk, SpeechClass class, SpeechMode mode,
+  const unsigned char *text, size_t length, size_t count,
+  const unsigned char *attributes
+);
+
+extern void processSpeechQueue (SpeechSynthesizer *spk);
+extern void flushSpeechQueue (SpeechSynthesizer *spk);
+extern void muteSpeech (SpeechSynthesizer *spk);
+extern unsigned int getSpeechQueueDepth (void);
+
 extern int setSpeechVolume (SpeechSynthesizer *spk, int setting, int say);
 extern unsigned int getIntegerSpeechVolume (unsigned char setting, unsigned int normal);
 #ifndef NO_FLOAT
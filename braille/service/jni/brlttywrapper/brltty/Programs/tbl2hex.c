@@ -26,6 +26,7 @@
 #include "log.h"
 #include "file.h"
 
+#include "dataimage.h"
 #include "ttb.h"
 #include "ttb_internal.h"
 
@@ -221,6 +222,9 @@ main (int argc, char *argv[]) {
   }
   path = *argv++, argc--;
 
+  /* The table is being embedded, so don't leave an image beside it. */
+  setDataImagesEnabled(0);
+
   {
     const char *extension = locatePathExtension(path);
 
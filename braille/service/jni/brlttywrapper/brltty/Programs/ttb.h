@@ -35,6 +35,7 @@ extern char *makeTextTablePath (const char *directory, const char *name);
 extern char *selectTextTable (const char *directory);
 
 extern unsigned char convertCharacterToDots (TextTable *table, wchar_t character);
+extern void convertTextToDots (TextTable *table, const wchar_t *text, size_t count, unsigned char *dots);
 extern wchar_t convertDotsToCharacter (TextTable *table, unsigned char dots);
 
 extern int replaceTextTable (const char *directory, const char *name);
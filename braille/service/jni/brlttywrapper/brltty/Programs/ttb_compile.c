@@ -258,16 +258,58 @@ makeTextTable (TextTableData *ttd) {
   if (table) {
     table->header.fields = getTextTableHeader(ttd);
     table->size = getDataSize(ttd->area);
+    table->image = NULL;
+    memset(&table->cache, 0, sizeof(table->cache));
     resetDataArea(ttd->area);
   }
 
   return table;
 }
 
+static const char *
+getTextTableImageVariant (void) {
+  /* byte directives are interpreted according to the current character set */
+  const char *charset = getCharset();
+  return charset? charset: "";
+}
+
+TextTable *
+loadTextTableImage (const char *name) {
+  DataImage *image = loadDataImage(name, TEXT_TABLE_IMAGE_TYPE, getTextTableImageVariant());
+
+  if (image) {
+    TextTable *table = malloc(sizeof(*table));
+
+    if (table) {
+      table->header.bytes = getDataImageContent(image, &table->size);
+      table->image = image;
+      memset(&table->cache, 0, sizeof(table->cache));
+      return table;
+    } else {
+      logMallocError();
+    }
+
+    destroyDataImage(image);
+  }
+
+  return NULL;
+}
+
+int
+saveTextTableImage (const char *name, const TextTable *table) {
+  return saveDataImage(name, TEXT_TABLE_IMAGE_TYPE, getTextTableImageVariant(),
+                       table->header.bytes, table->size);
+}
+
 void
 destroyTextTable (TextTable *table) {
   if (table->size) {
-    free(table->header.fields);
+    if (table->image) {
+      destroyDataImage(table->image);
+    } else {
+      free(table->header.fields);
+    }
+
     free(table);
   }
 }
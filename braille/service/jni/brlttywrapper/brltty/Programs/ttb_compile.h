@@ -34,6 +34,10 @@ extern void destroyTextTableData (TextTableData *ttd);
 extern TextTableData *processTextTableLines (FILE *stream, const char *name, DataProcessor processor);
 extern TextTable *makeTextTable (TextTableData *ttd);
 
+#define TEXT_TABLE_IMAGE_TYPE "ttb-1"
+extern TextTable *loadTextTableImage (const char *name);
+extern int saveTextTableImage (const char *name, const TextTable *table);
+
 typedef TextTableData *TextTableProcessor (FILE *stream, const char *name);
 extern TextTableProcessor processTextTableStream;
 extern TextTableProcessor processGnomeBrailleStream;
@@ -25,6 +25,7 @@ extern "C" {
 
 #include "bitmask.h"
 #include "unicode.h"
+#include "dataimage.h"
 
 typedef uint32_t TextTableOffset;
 
@@ -51,6 +52,28 @@ typedef struct {
   BITMASK(dotsCharacterDefined, 0X100, char);
 } TextTableHeader;
 
+#define TEXT_TABLE_HOT_CHARACTER_BITS 8
+#define TEXT_TABLE_HOT_CHARACTER_COUNT (1 << TEXT_TABLE_HOT_CHARACTER_BITS)
+#define TEXT_TABLE_HOT_CHARACTER_MASK (TEXT_TABLE_HOT_CHARACTER_COUNT - 1)
+
+/* A hot character entry holds the character in the upper bits and its dots
+ * in the lower eight so that it can be updated with a single store.
+ */
+typedef uint32_t TextTableHotCharacter;
+
+typedef struct {
+  unsigned char latin1Dots[UNICODE_CELLS_PER_ROW];
+
+  /* The table may be shared between threads. The thread which claims the
+   * Latin-1 array fills it and only then publishes it, after a barrier, so
+   * that any thread which sees the pointer also sees the dots.
+   */
+  const unsigned char *volatile latin1;
+  int latin1Claimed;
+
+  TextTableHotCharacter hotCharacters[TEXT_TABLE_HOT_CHARACTER_COUNT];
+} TextTableCache;
+
 struct TextTableStruct {
   union {
     TextTableHeader *fields;
@@ -58,6 +81,8 @@ struct TextTableStruct {
   } header;
 
   size_t size;
+  DataImage *image;
+  TextTableCache cache;
 };
 
 #ifdef __cplusplus
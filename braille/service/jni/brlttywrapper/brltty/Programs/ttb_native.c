@@ -194,14 +194,17 @@ processTextTableStream (FILE *stream, const char *name) {
 
 TextTable *
 compileTextTable (const char *name) {
-  TextTable *table = NULL;
+  TextTable *table;
   FILE *stream;
 
+  if ((table = loadTextTableImage(name))) return table;
+  beginDataImageSources();
+
   if ((stream = openDataFile(name, "r", 0))) {
     TextTableData *ttd;
 
     if ((ttd = processTextTableStream(stream, name))) {
-      table = makeTextTable(ttd);
+      if ((table = makeTextTable(ttd))) saveTextTableImage(name, table);
 
       destroyTextTableData(ttd);
     }
@@ -209,5 +212,6 @@ compileTextTable (const char *name) {
     fclose(stream);
   }
 
+  endDataImageSources();
   return table;
 }
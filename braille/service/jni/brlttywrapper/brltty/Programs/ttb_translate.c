@@ -104,8 +104,8 @@ setBrailleRepresentation (wchar_t character, void *data) {
   return 0;
 }
 
-unsigned char
-convertCharacterToDots (TextTable *table, wchar_t character) {
+static unsigned char
+translateCharacterToDots (TextTable *table, wchar_t character) {
   switch (character & ~UNICODE_CELL_MASK) {
     case UNICODE_BRAILLE_ROW:
       return character & UNICODE_CELL_MASK;
@@ -141,6 +141,97 @@ convertCharacterToDots (TextTable *table, wchar_t character) {
   }
 }
 
+static const unsigned char *
+getLatin1Dots (TextTable *table) {
+  TextTableCache *cache = &table->cache;
+  const unsigned char *latin1 = cache->latin1;
+
+  if (!latin1) {
+    unsigned int character;
+
+    /* Another thread is filling the array - don't use it until it's been
+     * published.
+     */
+    if (!__sync_bool_compare_and_swap(&cache->latin1Claimed, 0, 1)) return NULL;
+
+    for (character=0; character<UNICODE_CELLS_PER_ROW; character+=1) {
+      cache->latin1Dots[character] = translateCharacterToDots(table, character);
+    }
+
+    __sync_synchronize();
+    cache->latin1 = latin1 = cache->latin1Dots;
+  }
+
+  return latin1;
+}
+
+static unsigned char
+getHotCharacterDots (TextTable *table, uint32_t character) {
+  if (character > (UINT32_MAX >> 8)) return translateCharacterToDots(table, character);
+
+  {
+    TextTableHotCharacter *entry = &table->cache.hotCharacters[character & TEXT_TABLE_HOT_CHARACTER_MASK];
+    TextTableHotCharacter hot = *entry;
+    unsigned char dots;
+
+    if ((hot >> 8) == character) return hot & 0XFF;
+    dots = translateCharacterToDots(table, character);
+    *entry = (character << 8) | dots;
+    return dots;
+  }
+}
+
+unsigned char
+convertCharacterToDots (TextTable *table, wchar_t character) {
+  uint32_t value = character;
+
+  if (value < UNICODE_CELLS_PER_ROW) {
+    const unsigned char *latin1 = getLatin1Dots(table);
+    if (latin1) return latin1[value];
+    return translateCharacterToDots(table, value);
+  }
+
+  if ((value & ~UNICODE_CELL_MASK) == UNICODE_BRAILLE_ROW) return value & UNICODE_CELL_MASK;
+  return getHotCharacterDots(table, value);
+}
+
+void
+convertTextToDots (TextTable *table, const wchar_t *text, size_t count, unsigned char *dots) {
+  const unsigned char *latin1 = getLatin1Dots(table);
+  const wchar_t *end = text + count;
+
+  if (!latin1) {
+    while (text < end) *dots++ = convertCharacterToDots(table, *text++);
+    return;
+  }
+
+  while (text < end) {
+    /* Screen text is nearly always Latin-1, so test four characters at a
+     * time and, when none of them is above U+00FF, translate them with
+     * nothing more than flat table lookups.
+     */
+    while ((end - text) >= 4) {
+      uint32_t c0 = text[0];
+      uint32_t c1 = text[1];
+      uint32_t c2 = text[2];
+      uint32_t c3 = text[3];
+
+      if ((c0 | c1 | c2 | c3) & ~UNICODE_CELL_MASK) break;
+
+      dots[0] = latin1[c0];
+      dots[1] = latin1[c1];
+      dots[2] = latin1[c2];
+      dots[3] = latin1[c3];
+
+      text += 4;
+      dots += 4;
+    }
+
+    if (text == end) break;
+    *dots++ = convertCharacterToDots(table, *text++);
+  }
+}
+
 wchar_t
 convertDotsToCharacter (TextTable *table, unsigned char dots) {
   const TextTableHeader *header = table->header.fields;
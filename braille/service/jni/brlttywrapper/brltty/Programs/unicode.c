@@ -25,6 +25,10 @@
 
 #ifdef HAVE_ICONV_H
 #include <iconv.h>
+
+#ifdef HAVE_POSIX_THREADS
+#include <pthread.h>
+#endif /* HAVE_POSIX_THREADS */
 #endif /* HAVE_ICONV_H */
 
 #include "unicode.h"
@@ -103,10 +107,29 @@ getBaseCharacter (wchar_t character) {
   return 0;
 }
 
+#ifdef HAVE_ICONV_H
+/* An iconv descriptor holds conversion state, and contraction may run on
+ * several threads at once, so the shared descriptor is only used (and lazily
+ * opened) while holding this lock.
+ */
+#ifdef HAVE_POSIX_THREADS
+static pthread_mutex_t transliterationMutex = PTHREAD_MUTEX_INITIALIZER;
+#define TRANSLITERATION_LOCK() pthread_mutex_lock(&transliterationMutex)
+#define TRANSLITERATION_UNLOCK() pthread_mutex_unlock(&transliterationMutex)
+#else /* HAVE_POSIX_THREADS */
+#define TRANSLITERATION_LOCK()
+#define TRANSLITERATION_UNLOCK()
+#endif /* HAVE_POSIX_THREADS */
+#endif /* HAVE_ICONV_H */
+
 wchar_t
 getTransliteratedCharacter (wchar_t character) {
+  wchar_t result = 0;
+
 #ifdef HAVE_ICONV_H
   static iconv_t handle = NULL;
+
+  TRANSLITERATION_LOCK();
   if (!handle) handle = iconv_open("ASCII//TRANSLIT", "WCHAR_T");
 
   if (handle != (iconv_t)-1) {
@@ -116,13 +139,17 @@ getTransliteratedCharacter (wchar_t character) {
     char outputBuffer[outputSize];
     char *outputAddress = outputBuffer;
 
-    if (iconv(handle, &inputAddress, &inputSize, &outputAddress, &outputSize) != (size_t)-1)
-      if ((outputAddress - outputBuffer) == 1)
-        return outputBuffer[0] & 0XFF;
+    if (iconv(handle, &inputAddress, &inputSize, &outputAddress, &outputSize) != (size_t)-1) {
+      if ((outputAddress - outputBuffer) == 1) result = outputBuffer[0] & 0XFF;
+    } else {
+      /* don't let a failed conversion affect the next one */
+      iconv(handle, NULL, NULL, NULL, NULL);
+    }
   }
+  TRANSLITERATION_UNLOCK();
 #endif /* HAVE_ICONV_H */
 
-  return 0;
+  return result;
 }
 
 int
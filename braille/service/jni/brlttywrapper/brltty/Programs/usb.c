@@ -961,6 +961,20 @@ usbChooseChannel (UsbDevice *device, void *data) {
   return 0;
 }
 
+static UsbHotplugHandler usbHotplugHandler = NULL;
+static void *usbHotplugData = NULL;
+
+void
+usbSetHotplugHandler (UsbHotplugHandler handler, void *data) {
+  usbHotplugHandler = handler;
+  usbHotplugData = data;
+}
+
+void
+usbNotifyHotplug (void) {
+  if (usbHotplugHandler) usbHotplugHandler(usbHotplugData);
+}
+
 UsbChannel *
 usbFindChannel (const UsbChannelDefinition *definitions, const char *serialNumber) {
   UsbChooseChannelData choose = {
@@ -65,6 +65,8 @@ struct UsbDeviceStruct {
   uint16_t language;
 };
 
+extern void usbNotifyHotplug (void);
+
 extern UsbDevice *usbTestDevice (
   UsbDeviceExtension *extension,
   UsbDeviceChooser chooser,
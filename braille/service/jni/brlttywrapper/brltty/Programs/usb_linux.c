@@ -27,6 +27,8 @@
 #include <sys/stat.h>
 #include <sys/vfs.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
 #include <linux/usbdevice_fs.h>
 
 #ifndef USBDEVFS_DISCONNECT
@@ -42,6 +44,7 @@
 #include "parse.h"
 #include "timing.h"
 #include "mount.h"
+#include "async.h"
 #include "io_usb.h"
 #include "usb_internal.h"
 
@@ -49,12 +52,22 @@ typedef struct {
   char *sysfsPath;
   char *usbfsPath;
   UsbDeviceDescriptor usbDescriptor;
+  unsigned int references;
 } UsbHostDevice;
 
+/* While hotplug events are being monitored, the host device index is kept
+ * current and so needn't be rebuilt each time devices are looked for.
+ */
 static Queue *usbHostDevices = NULL;
+static char *usbHostRoot = NULL;
+static int usbHotplugSocket = -1;
+static int usbHotplugRestart = 0;
+
+/* Give udev time to set the new device node's permissions. */
+#define USB_HOTPLUG_SETTLE_TIME 500
 
 struct UsbDeviceExtensionStruct {
-  const UsbHostDevice *host;
+  UsbHostDevice *host;
   int usbfsFile;
 };
 
@@ -751,19 +764,26 @@ usbDeallocateEndpointExtension (UsbEndpointExtension *eptx) {
   free(eptx);
 }
 
+static void
+usbReleaseHostDevice (UsbHostDevice *host) {
+  if (!--host->references) {
+    if (host->sysfsPath) free(host->sysfsPath);
+    if (host->usbfsPath) free(host->usbfsPath);
+    free(host);
+  }
+}
+
 void
 usbDeallocateDeviceExtension (UsbDeviceExtension *devx) {
   usbCloseUsbfsFile(devx);
+  usbReleaseHostDevice(devx->host);
   free(devx);
 }
 
 static void
 usbDeallocateHostDevice (void *item, void *data) {
   UsbHostDevice *host = item;
-
-  if (host->sysfsPath) free(host->sysfsPath);
-  if (host->usbfsPath) free(host->usbfsPath);
-  free(host);
+  usbReleaseHostDevice(host);
 }
 
 typedef struct {
@@ -774,7 +794,7 @@ typedef struct {
 
 static int
 usbTestHostDevice (void *item, void *data) {
-  const UsbHostDevice *host = item;
+  UsbHostDevice *host = item;
   UsbTestHostDeviceData *test = data;
   UsbDeviceExtension *devx;
 
@@ -783,6 +803,9 @@ usbTestHostDevice (void *item, void *data) {
     devx->host = host;
     devx->usbfsFile = -1;
 
+    /* an open device keeps its host entry even if the index drops it */
+    host->references += 1;
+
     if ((test->device = usbTestDevice(devx, test->chooser, test->data))) return 1;
 
     usbDeallocateDeviceExtension(devx);
@@ -898,6 +921,8 @@ usbAddHostDevice (const char *path) {
   UsbHostDevice *host;
 
   if ((host = malloc(sizeof(*host)))) {
+    host->references = 1;
+
     if ((host->usbfsPath = strdup(path))) {
       host->sysfsPath = usbMakeSysfsPath(host->usbfsPath);
 
@@ -1048,6 +1073,142 @@ usbGetUsbfs (void) {
   return usbGetFileSystem("usbfs", usbfsCandidates, usbTestUsbfs, usbVerifyUsbfs);
 }
 
+static int
+usbTestHostPath (const void *item, const void *data) {
+  const UsbHostDevice *host = item;
+  const char *path = data;
+  return strcmp(host->usbfsPath, path) == 0;
+}
+
+static void
+usbRemoveHostDevice (const char *path) {
+  Element *element = findElement(usbHostDevices, usbTestHostPath, path);
+  if (element) deleteElement(element);
+}
+
+static void
+usbNotifyHostDeviceAdded (void *data UNUSED) {
+  usbNotifyHotplug();
+}
+
+static void
+usbHandleHotplugEvent (const char *action, const char *name) {
+  /* The device name is relative to /dev, e.g. bus/usb/001/005, and the
+   * usbfs root (whichever one is in use) holds the same bus/device tail.
+   */
+  static const char prefix[] = "bus/usb/";
+  const size_t prefixLength = sizeof(prefix) - 1;
+
+  if (!usbHostDevices) return;
+
+  if (strncmp(name, prefix, prefixLength) == 0) {
+    const char *tail = name + prefixLength;
+    char path[strlen(usbHostRoot) + 1 + strlen(tail) + 1];
+
+    snprintf(path, sizeof(path), "%s/%s", usbHostRoot, tail);
+    logMessage(LOG_DEBUG, "USB hotplug: %s %s", action, path);
+    usbRemoveHostDevice(path);
+
+    if (strcmp(action, "add") == 0) {
+      if (usbAddHostDevice(path)) {
+        asyncRelativeAlarm(USB_HOTPLUG_SETTLE_TIME, usbNotifyHostDeviceAdded, NULL);
+      }
+    }
+  }
+}
+
+static void
+usbStopHotplugMonitor (void) {
+  /* Events may have been lost (e.g. ENOBUFS), so the index can't be trusted
+   * any more. The next search rescans usbfs and restarts the monitor.
+   */
+  close(usbHotplugSocket);
+  usbHotplugSocket = -1;
+  usbHotplugRestart = 1;
+  usbForgetDevices();
+}
+
+static size_t
+usbHandleHotplugInput (const AsyncInputResult *result) {
+  if (result->error) {
+    logMessage(LOG_DEBUG, "USB hotplug read error: %s", strerror(result->error));
+    usbStopHotplugMonitor();
+  } else if (result->end) {
+    logMessage(LOG_DEBUG, "USB hotplug end-of-file");
+    usbStopHotplugMonitor();
+  } else {
+    /* Each datagram is a header (action@devpath) followed by
+     * NUL-terminated key=value properties.
+     */
+    const char *buffer = result->buffer;
+    const char *end = buffer + result->length;
+    const char *property = memchr(buffer, 0, result->length);
+
+    if (property) {
+      const char *action = NULL;
+      const char *subsystem = NULL;
+      const char *type = NULL;
+      const char *name = NULL;
+
+      while (++property < end) {
+        const char *next = memchr(property, 0, end-property);
+        if (!next) break;
+
+        if (strncmp(property, "ACTION=", 7) == 0) {
+          action = property + 7;
+        } else if (strncmp(property, "SUBSYSTEM=", 10) == 0) {
+          subsystem = property + 10;
+        } else if (strncmp(property, "DEVTYPE=", 8) == 0) {
+          type = property + 8;
+        } else if (strncmp(property, "DEVNAME=", 8) == 0) {
+          name = property + 8;
+        }
+
+        property = next;
+      }
+
+      if (action && subsystem && type && name) {
+        if ((strcmp(subsystem, "usb") == 0) && (strcmp(type, "usb_device") == 0)) {
+          usbHandleHotplugEvent(action, name);
+        }
+      }
+    }
+
+    return result->length;
+  }
+
+  return 0;
+}
+
+static int
+usbMonitorHotplug (void) {
+#ifdef NETLINK_KOBJECT_UEVENT
+  const struct sockaddr_nl socketAddress = {
+    .nl_family = AF_NETLINK,
+    .nl_pid = 0,
+    .nl_groups = 1
+  };
+
+  if ((usbHotplugSocket = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT)) != -1) {
+    if (bind(usbHotplugSocket, (const struct sockaddr *)&socketAddress, sizeof(socketAddress)) != -1) {
+      if (asyncRead(usbHotplugSocket, 0X1000, usbHandleHotplugInput, NULL)) {
+        logMessage(LOG_DEBUG, "USB hotplug monitor started");
+        return 1;
+      }
+    } else {
+      logSystemError("bind");
+    }
+
+    close(usbHotplugSocket);
+    usbHotplugSocket = -1;
+  } else {
+    logSystemError("socket");
+  }
+#endif /* NETLINK_KOBJECT_UEVENT */
+
+  return 0;
+}
+
 UsbDevice *
 usbFindDevice (UsbDeviceChooser chooser, void *data) {
   if (!usbHostDevices) {
@@ -1058,6 +1219,21 @@ usbFindDevice (UsbDeviceChooser chooser, void *data) {
 
       if ((root = usbGetUsbfs())) {
         logMessage(LOG_DEBUG, "USBFS Root: %s", root);
+
+        if (!usbHostRoot) {
+          /* The monitor is started before the scan so that no device
+           * which is added during it is missed.
+           */
+          if ((usbHostRoot = strdup(root))) {
+            usbMonitorHotplug();
+          } else {
+            logSystemError("strdup");
+          }
+        } else if (usbHotplugRestart) {
+          usbHotplugRestart = 0;
+          usbMonitorHotplug();
+        }
+
         if (usbAddHostDevices(root)) ok = 1;
 
         free(root);
@@ -1087,7 +1263,7 @@ usbFindDevice (UsbDeviceChooser chooser, void *data) {
 
 void
 usbForgetDevices (void) {
-  if (usbHostDevices) {
+  if (usbHostDevices && (usbHotplugSocket == -1)) {
     deallocateQueue(usbHostDevices);
     usbHostDevices = NULL;
   }
@@ -94,6 +94,9 @@ extern "C" {
 /* Define this if the header file sys/file.h exists. */
 #define HAVE_SYS_FILE_H 1
 
+/* Define this if the header file sys/mman.h exists. */
+#define HAVE_SYS_MMAN_H 1
+
 /* Define this if the function time exists. */
 #define HAVE_TIME 1
 
@@ -166,6 +169,9 @@ extern "C" {
 /* Define this if the function fchmod exists. */
 #define HAVE_FCHMOD 1
 
+/* Define this if the function mkstemp exists. */
+#define HAVE_MKSTEMP 1
+
 /* Define this if the function getaddrinfo exists. */
 #define HAVE_GETADDRINFO 1
 
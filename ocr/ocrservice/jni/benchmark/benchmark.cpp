@@ -0,0 +1,462 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs the OCR native code over a sequence of frames on a host and reports
+// how long each stage takes, so that changes to it can be measured without a
+// device. See the Makefile in this directory for how to build it.
+//
+// Results are tab separated, one record per line, for diffing and scripting:
+//
+//   stage  <benchmark>  <stage>  <count>  <mean>  <p50>  <p90>  <p99>  <max>
+//   fps    <benchmark>  <frames per second>
+//
+// Times are in ms. The "frame" stage of each benchmark is the end to end time
+// per frame, and the other stages are the parts of it timed by the native
+// code itself. Lines starting with # are comments.
+//
+// With --check, text detection is also run with and without threads, and the
+// exit status is nonzero unless every frame gives the same text areas.
+
+#include <ctype.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PNG
+#include <png.h>
+#endif
+
+#include "types.h"
+#include "stage_timer.h"
+#include "time_log.h"
+#include "optical_flow_utils.h"
+#include "image.h"
+#include "optical_flow.h"
+#include "blur.h"
+#include "similar.h"
+#include "benchmark.h"
+
+extern const int32 kFrameStage = getStageId("frame");
+
+static const int32 kNextFrameStage = getStageId("nextFrame");
+static const int32 kComputeFeaturesStage = getStageId("computeFeatures");
+static const int32 kComputeFlowStage = getStageId("computeFlow");
+static const int32 kComputeSignatureStage = getStageId("ComputeSignature");
+static const int32 kDiffStage = getStageId("Diff");
+
+// Same as the app's OpticalFlowProcessor.
+static const int32 kDefaultDownsampleFactor = 4;
+
+// Timestamps given to consecutive frames, as from a 30fps camera.
+static const int32 kFrameIntervalMs = 33;
+
+static int32 downsample_factor = kDefaultDownsampleFactor;
+
+typedef void (*BenchmarkPass)(const Frame* const frames,
+                              const int32 num_frames);
+
+struct Benchmark {
+  const char* name;
+  BenchmarkPass run_pass;
+
+  // Whether every frame must be the same size.
+  bool fixed_size;
+};
+
+
+static void runOpticalFlowPass(const Frame* const frames,
+                               const int32 num_frames) {
+  flow::OpticalFlow optical_flow(frames[0].width, frames[0].height,
+                                 downsample_factor);
+
+  for (int32 i = 0; i < num_frames; ++i) {
+    ScopedTimer frame_timer(kFrameStage);
+    int64 start_us = currentTimeMicros();
+
+    // Starts the laps of the timeLog statements inside, as the JNI does.
+    resetTimeLog();
+
+    optical_flow.nextFrame(frames[i].luminance, frames[i].width,
+                           i * kFrameIntervalMs);
+    start_us += recordStageTime(kNextFrameStage, start_us);
+
+    optical_flow.computeFeatures(true);
+    start_us += recordStageTime(kComputeFeaturesStage, start_us);
+
+    optical_flow.computeFlow();
+    recordStageTime(kComputeFlowStage, start_us);
+  }
+}
+
+
+static void runBlurPass(const Frame* const frames, const int32 num_frames) {
+  for (int32 i = 0; i < num_frames; ++i) {
+    const Frame& frame = frames[i];
+    float blur = 0;
+    float extent = 0;
+
+    ScopedTimer frame_timer(kFrameStage);
+    IsBlurred(frame.luminance, frame.width, frame.height, frame.width,
+              &blur, &extent);
+  }
+}
+
+
+static void runSignaturePass(const Frame* const frames,
+                             const int32 num_frames) {
+  uint32 signatures[2][SIGNATURE_SIZE];
+
+  for (int32 i = 0; i < num_frames; ++i) {
+    const Frame& frame = frames[i];
+    uint32* const signature = signatures[i & 1];
+    const uint32* const previous = signatures[(i + 1) & 1];
+
+    ScopedTimer frame_timer(kFrameStage);
+    int64 start_us = currentTimeMicros();
+
+    ComputeSignature(frame.luminance, frame.width, frame.height, frame.width,
+                     signature);
+    start_us += recordStageTime(kComputeSignatureStage, start_us);
+
+    // Like the app, compare each frame with the one before it.
+    if (i > 0) {
+      Diff(reinterpret_cast<const int32*>(previous),
+           reinterpret_cast<const int32*>(signature), SIGNATURE_SIZE);
+      recordStageTime(kDiffStage, start_us);
+    }
+  }
+}
+
+
+static const Benchmark kBenchmarks[] = {
+  { "flow", runOpticalFlowPass, true },
+  { "blur", runBlurPass, false },
+  { "signature", runSignaturePass, false },
+#ifdef HAVE_HYDROGEN
+  { "hydrogen", runTextDetectionPass, false },
+  { "clusters", runClusteringPass, false },
+#endif
+};
+
+static const int32 kNumBenchmarks = sizeof(kBenchmarks) / sizeof(kBenchmarks[0]);
+
+
+// Reads the next number from the header of a PGM file, skipping whitespace
+// and comments.
+static bool readPgmHeaderValue(FILE* const file, int32* const value) {
+  int c = fgetc(file);
+  while (c != EOF && (isspace(c) || c == '#')) {
+    if (c == '#') {
+      while (c != EOF && c != '\n') {
+        c = fgetc(file);
+      }
+    }
+    c = fgetc(file);
+  }
+
+  if (c == EOF || !isdigit(c)) {
+    return false;
+  }
+
+  *value = 0;
+  while (c != EOF && isdigit(c)) {
+    *value = *value * 10 + (c - '0');
+    c = fgetc(file);
+  }
+
+  // Exactly one whitespace character separates the header from the pixels.
+  return c != EOF && isspace(c);
+}
+
+
+// Loads an 8 bit binary (P5) PGM.
+static bool loadPgm(FILE* const file, Frame* const frame) {
+  int32 max_value = 0;
+  if (fgetc(file) != 'P' || fgetc(file) != '5' ||
+      !readPgmHeaderValue(file, &frame->width) ||
+      !readPgmHeaderValue(file, &frame->height) ||
+      !readPgmHeaderValue(file, &max_value)) {
+    fprintf(stderr, "%s: not a binary PGM\n", frame->path);
+    return false;
+  }
+
+  if (frame->width <= 0 || frame->height <= 0 ||
+      max_value <= 0 || max_value > 255) {
+    fprintf(stderr, "%s: only 8 bit PGMs are supported\n", frame->path);
+    return false;
+  }
+
+  const size_t size = static_cast<size_t>(frame->width) * frame->height;
+  frame->luminance = new uint8[size];
+  if (fread(frame->luminance, 1, size, file) != size) {
+    fprintf(stderr, "%s: truncated\n", frame->path);
+    return false;
+  }
+
+  return true;
+}
+
+
+#ifdef HAVE_PNG
+// Loads a PNG of any format, converting it to luminance.
+static bool loadPng(FILE* const file, Frame* const frame) {
+  png_image image;
+  memset(&image, 0, sizeof(image));
+  image.version = PNG_IMAGE_VERSION;
+
+  if (!png_image_begin_read_from_stdio(&image, file)) {
+    fprintf(stderr, "%s: %s\n", frame->path, image.message);
+    return false;
+  }
+
+  image.format = PNG_FORMAT_GRAY;
+  frame->width = image.width;
+  frame->height = image.height;
+  frame->luminance = new uint8[PNG_IMAGE_SIZE(image)];
+
+  if (!png_image_finish_read(&image, NULL, frame->luminance, 0, NULL)) {
+    fprintf(stderr, "%s: %s\n", frame->path, image.message);
+    return false;
+  }
+
+  return true;
+}
+#endif
+
+
+static bool loadFrame(const char* const path, Frame* const frame) {
+  frame->path = path;
+  frame->luminance = NULL;
+
+  FILE* const file = fopen(path, "rb");
+  if (file == NULL) {
+    perror(path);
+    return false;
+  }
+
+  const int c = fgetc(file);
+  ungetc(c, file);
+
+  bool loaded;
+  if (c == 'P') {
+    loaded = loadPgm(file, frame);
+#ifdef HAVE_PNG
+  } else if (c == 0x89) {
+    loaded = loadPng(file, frame);
+#endif
+  } else {
+    fprintf(stderr, "%s: unsupported format\n", path);
+    loaded = false;
+  }
+
+  fclose(file);
+  return loaded;
+}
+
+
+static void printResults(const char* const benchmark) {
+  StageTimes* const stages = new StageTimes[MAX_STAGES];
+  const int32 num_stages = getStageTimes(stages);
+
+  for (int32 i = 0; i < num_stages; ++i) {
+    const StageTimes& stage = stages[i];
+    if (stage.count == 0) {
+      continue;
+    }
+
+    printf("stage\t%s\t%s\t%lld\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\n",
+           benchmark, stage.name, stage.count,
+           stage.total_us / 1000.0 / stage.count,
+           getStagePercentile(stage, 0.5f),
+           getStagePercentile(stage, 0.9f),
+           getStagePercentile(stage, 0.99f),
+           stage.max_us / 1000.0);
+  }
+
+  const StageTimes& frame = stages[kFrameStage];
+  printf("fps\t%s\t%.2f\n", benchmark,
+         frame.total_us > 0 ? frame.count * 1000000.0 / frame.total_us : 0.0);
+
+  delete[] stages;
+}
+
+
+static bool isSelected(const char* const benchmark, const char* const list) {
+  if (list == NULL) {
+    return true;
+  }
+
+  const size_t length = strlen(benchmark);
+  for (const char* name = list; name != NULL; name = strchr(name, ',')) {
+    if (*name == ',') {
+      ++name;
+    }
+    if (strncmp(name, benchmark, length) == 0 &&
+        (name[length] == ',' || name[length] == '\0')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+static void printUsage(const char* const program) {
+  fprintf(stderr,
+          "Usage: %s [options] FRAME...\n"
+          "\n"
+          "Times the OCR native code over a sequence of frames, given as 8 bit\n"
+          "binary PGM%s files.\n"
+          "\n"
+          "  -b, --benchmarks=LIST   comma separated benchmarks to run, from:\n"
+          "                          ",
+          program,
+#ifdef HAVE_PNG
+          " or PNG"
+#else
+          ""
+#endif
+          );
+  for (int32 i = 0; i < kNumBenchmarks; ++i) {
+    fprintf(stderr, "%s%s", i > 0 ? "," : "", kBenchmarks[i].name);
+  }
+  fprintf(stderr,
+          " (default all)\n"
+          "  -r, --repeat=N          timed passes over the frames (default 5)\n"
+          "  -w, --warmup=N          untimed passes first (default 1)\n"
+          "  -d, --downsample=N      optical flow downsampling (default %d)\n",
+          kDefaultDownsampleFactor);
+#ifdef HAVE_HYDROGEN
+  fprintf(stderr,
+          "  -c, --check             check that text detection finds the same\n"
+          "                          text with threads as without\n");
+#endif
+}
+
+
+int main(int argc, char** argv) {
+  const char* benchmark_list = NULL;
+  int32 num_passes = 5;
+  int32 num_warmup_passes = 1;
+#ifdef HAVE_HYDROGEN
+  bool check = false;
+#endif
+
+  static const struct option kOptions[] = {
+    { "benchmarks", required_argument, NULL, 'b' },
+    { "repeat", required_argument, NULL, 'r' },
+    { "warmup", required_argument, NULL, 'w' },
+    { "downsample", required_argument, NULL, 'd' },
+#ifdef HAVE_HYDROGEN
+    { "check", no_argument, NULL, 'c' },
+#endif
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+  };
+
+#ifdef HAVE_HYDROGEN
+  static const char kShortOptions[] = "b:r:w:d:ch";
+#else
+  static const char kShortOptions[] = "b:r:w:d:h";
+#endif
+
+  int option;
+  while ((option = getopt_long(argc, argv, kShortOptions, kOptions, NULL)) != -1) {
+    switch (option) {
+      case 'b':
+        benchmark_list = optarg;
+        break;
+      case 'r':
+        num_passes = atoi(optarg);
+        break;
+      case 'w':
+        num_warmup_passes = atoi(optarg);
+        break;
+      case 'd':
+        downsample_factor = atoi(optarg);
+        break;
+#ifdef HAVE_HYDROGEN
+      case 'c':
+        check = true;
+        break;
+#endif
+      default:
+        printUsage(argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+
+  const int32 num_frames = argc - optind;
+  if (num_frames <= 0 || num_passes <= 0 || num_warmup_passes < 0 ||
+      downsample_factor <= 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  Frame* const frames = new Frame[num_frames];
+  bool same_size = true;
+  for (int32 i = 0; i < num_frames; ++i) {
+    if (!loadFrame(argv[optind + i], frames + i)) {
+      return 1;
+    }
+    same_size = same_size && frames[i].width == frames[0].width &&
+        frames[i].height == frames[0].height;
+  }
+
+  printf("# %d frames, first %dx%d; %d warmup and %d timed passes\n",
+         num_frames, frames[0].width, frames[0].height,
+         num_warmup_passes, num_passes);
+  printf("# record\tbenchmark\tstage\tcount\tmean_ms\tp50_ms\tp90_ms\tp99_ms"
+         "\tmax_ms\n");
+
+  for (int32 i = 0; i < kNumBenchmarks; ++i) {
+    const Benchmark& benchmark = kBenchmarks[i];
+    if (!isSelected(benchmark.name, benchmark_list)) {
+      continue;
+    }
+
+    if (benchmark.fixed_size && !same_size) {
+      printf("# %s skipped: frames differ in size\n", benchmark.name);
+      continue;
+    }
+
+    for (int32 pass = 0; pass < num_warmup_passes; ++pass) {
+      benchmark.run_pass(frames, num_frames);
+    }
+
+    resetStageTimes();
+    for (int32 pass = 0; pass < num_passes; ++pass) {
+      benchmark.run_pass(frames, num_frames);
+    }
+
+    printResults(benchmark.name);
+    fflush(stdout);
+  }
+
+  bool passed = true;
+#ifdef HAVE_HYDROGEN
+  if (check) {
+    passed = checkTextDetection(frames, num_frames);
+  }
+#endif
+
+  for (int32 i = 0; i < num_frames; ++i) {
+    delete[] frames[i].luminance;
+  }
+  delete[] frames;
+
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Pieces of the host benchmark runner shared between its source files.
+
+#ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_BENCHMARK_BENCHMARK_H_
+#define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_BENCHMARK_BENCHMARK_H_
+
+#include "types.h"
+
+// A luminance frame loaded from disk, with packed rows.
+struct Frame {
+  const char* path;
+  int32 width;
+  int32 height;
+  uint8* luminance;
+};
+
+// Stage that every benchmark times each frame under, from handing the frame
+// over to having the results.
+extern const int32 kFrameStage;
+
+#ifdef HAVE_HYDROGEN
+// Times the pair and cluster searches of text detection on a page of
+// synthetic components the size of each frame. Larger frames give more
+// components: about 900 for 640x480, and 24000 for 3200x2400.
+void runClusteringPass(const Frame* const frames, const int32 num_frames);
+
+// Runs text detection over each frame once.
+void runTextDetectionPass(const Frame* const frames, const int32 num_frames);
+
+// Runs text detection over each frame on the worker pool and on the calling
+// thread alone, and returns whether the results were the same for all.
+bool checkTextDetection(const Frame* const frames, const int32 num_frames);
+#endif
+
+#endif  // JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_BENCHMARK_BENCHMARK_H_
@@ -0,0 +1,36 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Stand-in for the Android logging API so that the native code can be built
+// on a host. Messages go to stderr.
+
+#ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_BENCHMARK_HOST_ANDROID_LOG_H_
+#define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_BENCHMARK_HOST_ANDROID_LOG_H_
+
+#include <stdio.h>
+
+#define ANDROID_LOG_VERBOSE 2
+#define ANDROID_LOG_DEBUG 3
+#define ANDROID_LOG_INFO 4
+#define ANDROID_LOG_WARN 5
+#define ANDROID_LOG_ERROR 6
+
+#define __android_log_print(priority, tag, ...) \
+    (fprintf(stderr, "%s: ", tag), \
+     fprintf(stderr, __VA_ARGS__), \
+     fputc('\n', stderr))
+
+#endif  // JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_BENCHMARK_HOST_ANDROID_LOG_H_
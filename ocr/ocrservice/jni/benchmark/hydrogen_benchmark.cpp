@@ -0,0 +1,262 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Text detection benchmark. This is kept apart from the others because it
+// needs leptonica, whose headers don't mix with the rest of the native code.
+
+#include <stdlib.h>
+
+#include "leptonica.h"
+#include "clusterer.h"
+#include "hydrogentextdetector.h"
+#include "stage_timer.h"
+#include "worker_pool.h"
+#include "benchmark.h"
+
+static const int32 kRemoveInvalidPairsStage = getStageId("RemoveInvalidPairs()");
+static const int32 kClusterValidComponentsStage = getStageId("ClusterValidComponents()");
+
+// Spacing of the synthetic text lines laid out by createComponents().
+static const l_int32 kLineSpacing = 30;
+
+// Copies a frame into an 8 bit PIX.
+static PIX *createPix(const Frame &frame) {
+  PIX *pix = pixCreate(frame.width, frame.height, 8);
+  if (pix == NULL) {
+    return NULL;
+  }
+
+  l_uint32 *data = pixGetData(pix);
+  l_int32 wpl = pixGetWpl(pix);
+  for (l_int32 y = 0; y < frame.height; y++) {
+    l_uint32 *line = data + y * wpl;
+    const uint8 *src = frame.luminance + y * frame.width;
+
+    for (l_int32 x = 0; x < frame.width; x++) {
+      SET_DATA_BYTE(line, x, src[x]);
+    }
+  }
+
+  return pix;
+}
+
+// A small deterministic generator, so that every pass clusters the same
+// components.
+static l_int32 nextRandom(l_uint32 *seed, l_int32 n) {
+  *seed = *seed * 1103515245 + 12345;
+  return ((*seed >> 16) & 0x7FFF) % n;
+}
+
+// Adds a solid component with the given box to pixa.
+static void addComponent(PIXA *pixa, l_int32 x, l_int32 y, l_int32 w, l_int32 h) {
+  PIX *pix = pixCreate(w, h, 1);
+  pixSetAll(pix);
+  pixaAddPix(pixa, pix, L_INSERT);
+  pixaAddBox(pixa, boxCreate(x, y, w, h), L_INSERT);
+}
+
+// Lays out glyph sized components in lines of text filling a page of the
+// given size, with a speck of noise for every two glyphs, and sorts them left
+// to right as ConnCompValidPixa() does.
+static PIXA *createComponents(l_int32 width, l_int32 height, l_uint32 seed) {
+  PIXA *glyphs = pixaCreate(0);
+  l_int32 num_glyphs = 0;
+
+  for (l_int32 line_y = 0; line_y + kLineSpacing <= height; line_y += kLineSpacing) {
+    l_int32 x = nextRandom(&seed, 10);
+
+    while (true) {
+      l_int32 h = 14 + nextRandom(&seed, 8);
+      l_int32 w = 6 + nextRandom(&seed, 10);
+      if (x + w > width) {
+        break;
+      }
+
+      addComponent(glyphs, x, line_y + 5 + nextRandom(&seed, 4) + 20 - h, w, h);
+      num_glyphs++;
+
+      // Occasionally leave a word gap.
+      x += w + 2 + nextRandom(&seed, 5) + (nextRandom(&seed, 9) == 0 ? 15 : 0);
+    }
+  }
+
+  for (l_int32 i = 0; i < num_glyphs / 2; i++) {
+    l_int32 w = 1 + nextRandom(&seed, L_MIN(40, width));
+    l_int32 h = 1 + nextRandom(&seed, L_MIN(40, height));
+    addComponent(glyphs, nextRandom(&seed, width - w + 1), nextRandom(&seed, height - h + 1), w, h);
+  }
+
+  PIXA *components = pixaSort(glyphs, L_SORT_BY_X, L_SORT_INCREASING, NULL, L_CLONE);
+  pixaDestroy(&glyphs);
+  return components;
+}
+
+void runClusteringPass(const Frame *const frames, const int32 num_frames) {
+  HydrogenTextDetector::TextDetectorParameters params;
+
+  for (int32 i = 0; i < num_frames; i++) {
+    PIX *pix8 = createPix(frames[i]);
+    PIXA *components = createComponents(frames[i].width, frames[i].height, i + 1);
+    if (pix8 == NULL || components == NULL) {
+      fprintf(stderr, "%s: couldn't create components\n", frames[i].path);
+      pixDestroy(&pix8);
+      pixaDestroy(&components);
+      continue;
+    }
+
+    l_int32 count = pixaGetCount(components);
+    NUMA *confs = numaMakeConstant(1.0, count);
+    l_uint8 *remove = (l_uint8 *) calloc(L_MAX(1, count), sizeof(l_uint8));
+    PIXA *clusters = NULL;
+    NUMA *cluster_confs = NULL;
+
+    {
+      ScopedTimer frame_timer(kFrameStage);
+      int64 start_us = currentTimeMicros();
+
+      RemoveInvalidPairs(pix8, components, confs, remove, params);
+      start_us += recordStageTime(kRemoveInvalidPairsStage, start_us);
+
+      ClusterValidComponents(pix8, components, confs, remove, &clusters, &cluster_confs, params);
+      recordStageTime(kClusterValidComponentsStage, start_us);
+    }
+
+    pixaDestroy(&clusters);
+    numaDestroy(&cluster_confs);
+    free(remove);
+    numaDestroy(&confs);
+    pixaDestroy(&components);
+    pixDestroy(&pix8);
+  }
+}
+
+void runTextDetectionPass(const Frame *const frames, const int32 num_frames) {
+  HydrogenTextDetector detector;
+
+  for (int32 i = 0; i < num_frames; i++) {
+    PIX *pix = createPix(frames[i]);
+    if (pix == NULL) {
+      fprintf(stderr, "%s: couldn't create PIX\n", frames[i].path);
+      continue;
+    }
+
+    {
+      ScopedTimer frame_timer(kFrameStage);
+      detector.SetSourceImage(pix);
+      detector.DetectText();
+    }
+
+    detector.Clear();
+    pixDestroy(&pix);
+  }
+}
+
+// Runs text detection on a frame and returns its text areas and their
+// confidences, or false if it couldn't be run.
+static bool detectText(HydrogenTextDetector *detector, const Frame &frame, PIXA **ptext_areas,
+                       NUMA **ptext_confs) {
+  PIX *pix = createPix(frame);
+  if (pix == NULL) {
+    fprintf(stderr, "%s: couldn't create PIX\n", frame.path);
+    return false;
+  }
+
+  detector->SetSourceImage(pix);
+  detector->DetectText();
+  *ptext_areas = detector->GetTextAreas();
+  *ptext_confs = detector->GetTextConfs();
+
+  detector->Clear();
+  pixDestroy(&pix);
+  return true;
+}
+
+// Whether two detections found the same text areas, in the same order and
+// with the same confidences.
+static bool sameTextAreas(PIXA *areas1, NUMA *confs1, PIXA *areas2, NUMA *confs2) {
+  l_int32 count = pixaGetCount(areas1);
+  if (pixaGetCount(areas2) != count || numaGetCount(confs1) != count ||
+      numaGetCount(confs2) != count) {
+    return false;
+  }
+
+  for (l_int32 i = 0; i < count; i++) {
+    l_int32 x1, y1, w1, h1, x2, y2, w2, h2;
+    l_float32 conf1, conf2;
+    pixaGetBoxGeometry(areas1, i, &x1, &y1, &w1, &h1);
+    pixaGetBoxGeometry(areas2, i, &x2, &y2, &w2, &h2);
+    numaGetFValue(confs1, i, &conf1);
+    numaGetFValue(confs2, i, &conf2);
+
+    if (x1 != x2 || y1 != y2 || w1 != w2 || h1 != h2 || conf1 != conf2) {
+      return false;
+    }
+
+    PIX *pix1 = pixaGetPix(areas1, i, L_CLONE);
+    PIX *pix2 = pixaGetPix(areas2, i, L_CLONE);
+    l_int32 same = 0;
+    pixEqual(pix1, pix2, &same);
+    pixDestroy(&pix1);
+    pixDestroy(&pix2);
+
+    if (!same) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool checkTextDetection(const Frame *const frames, const int32 num_frames) {
+  HydrogenTextDetector parallel_detector;
+  HydrogenTextDetector serial_detector;
+  WorkerPool serial_pool(0);
+  serial_detector.SetWorkerPool(&serial_pool);
+
+  int32 num_different = 0;
+
+  for (int32 i = 0; i < num_frames; i++) {
+    PIXA *parallel_areas, *serial_areas;
+    NUMA *parallel_confs, *serial_confs;
+
+    if (!detectText(&parallel_detector, frames[i], &parallel_areas, &parallel_confs)) {
+      num_different++;
+      continue;
+    }
+
+    if (!detectText(&serial_detector, frames[i], &serial_areas, &serial_confs)) {
+      pixaDestroy(&parallel_areas);
+      numaDestroy(&parallel_confs);
+      num_different++;
+      continue;
+    }
+
+    if (!sameTextAreas(parallel_areas, parallel_confs, serial_areas, serial_confs)) {
+      printf("# hydrogen: %s: %d text areas in parallel, %d serially\n", frames[i].path,
+             pixaGetCount(parallel_areas), pixaGetCount(serial_areas));
+      num_different++;
+    }
+
+    pixaDestroy(&parallel_areas);
+    pixaDestroy(&serial_areas);
+    numaDestroy(&parallel_confs);
+    numaDestroy(&serial_confs);
+  }
+
+  printf("# hydrogen: %d of %d frames detected the same in parallel as serially\n",
+         num_frames - num_different, num_frames);
+  return num_different == 0;
+}
@@ -0,0 +1,607 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks the x86 vector kernels in image.h and the FAST circle test in
+// feature_detector.cpp against the scalar code, and times the image.h kernels.
+// See the Makefile in this directory for how to build it.
+//
+// Without options, every kernel the CPU supports is run over rows of many odd
+// widths, from buffers at every alignment and with padded strides, and its
+// output must be bit-exact with the scalar code. Writes past the pixels a
+// kernel claims to have handled are caught with guard bytes. The Image
+// operations which use the kernels are checked the same way, edges included,
+// and so is every lane of the FAST circle test at every pixel it can reach.
+// The exit status is nonzero if anything differs.
+//
+// With -b, each kernel is timed instead. Results are tab separated:
+//
+//   kernel  <kernel>  <variant>  <ns per pixel>  <speedup over scalar>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "stage_timer.h"
+#include "optical_flow_utils.h"
+#include "image.h"
+#include "feature_detector.h"
+
+using namespace flow;
+
+// Widths around every vector size, plus some typical downsampled frame widths.
+static const int32 kWidths[] = {
+  1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 18, 23, 31, 32, 33, 34, 35,
+  47, 63, 64, 65, 66, 67, 97, 127, 129, 161, 257, 321, 641
+};
+static const int32 kNumWidths = sizeof(kWidths) / sizeof(kWidths[0]);
+
+// Enough for any AVX2 load to be misaligned by every possible amount.
+static const int32 kMaxMisalignment = 32;
+
+// Bytes after the output which no kernel may touch.
+static const int32 kGuardSize = 64;
+static const uint8 kGuard = 0xA5;
+
+enum Pattern {
+  PATTERN_RANDOM,
+  PATTERN_WHITE,
+  PATTERN_STRIPES,
+  NUM_PATTERNS
+};
+
+static const char* const kPatternNames[NUM_PATTERNS] = {
+  "random", "255", "0/255"
+};
+
+static int32 num_failures = 0;
+
+
+static void fillPixels(uint8* const pixels, const int32 count,
+                       const Pattern pattern) {
+  for (int32 i = 0; i < count; ++i) {
+    switch (pattern) {
+      case PATTERN_RANDOM:
+        pixels[i] = rand() & 0xFF;
+        break;
+      case PATTERN_WHITE:
+        pixels[i] = 255;
+        break;
+      default:
+        pixels[i] = ((i + (i / 3)) & 1) ? 255 : 0;
+        break;
+    }
+  }
+}
+
+
+static void reportFailure(const char* const kernel, const char* const detail,
+                          const int32 width, const int32 misalignment,
+                          const Pattern pattern, const int32 x,
+                          const int32 expected, const int32 actual) {
+  if (num_failures++ < 20) {
+    fprintf(stderr,
+            "FAIL %s (%s): width %d, misalignment %d, %s pixels: "
+            "at %d expected %d, got %d\n",
+            kernel, detail, width, misalignment, kPatternNames[pattern],
+            x, expected, actual);
+  }
+}
+
+
+// The scalar code's value for an unclipped pixel of downsampleSmoothed3x3().
+static uint8 downsamplePixel(const uint8* const row_min,
+                             const uint8* const row_center,
+                             const uint8* const row_max, const int32 x) {
+  const int32 orig_x = 2 * x;
+  const int32 sum = row_center[orig_x] * 4 +
+      (row_center[orig_x - 1] + row_center[orig_x + 1] +
+       row_min[orig_x] + row_max[orig_x]) * 2 +
+      row_min[orig_x - 1] + row_min[orig_x + 1] +
+      row_max[orig_x - 1] + row_max[orig_x + 1];
+  return sum >> 4;
+}
+
+static int32 downsampleRowScalar(const uint8* const row_min,
+                                 const uint8* const row_center,
+                                 const uint8* const row_max,
+                                 uint8* const dest,
+                                 int32 x, const int32 end_x) {
+  for (; x < end_x; ++x) {
+    dest[x] = downsamplePixel(row_min, row_center, row_max, x);
+  }
+  return x;
+}
+
+// The scalar code's value for a pixel of derivativeX() and derivativeY().
+static int32 halfDiffPixel(const int32 first, const int32 second) {
+  return (second - first) / 2;
+}
+
+static int32 halfDiffRowScalar(const uint8* const first,
+                               const uint8* const second,
+                               int32* const dest,
+                               int32 i, const int32 count) {
+  for (; i < count; ++i) {
+    dest[i] = halfDiffPixel(first[i], second[i]);
+  }
+  return i;
+}
+
+
+typedef int32 (*DownsampleKernel)(const uint8* const row_min,
+                                  const uint8* const row_center,
+                                  const uint8* const row_max,
+                                  uint8* const dest,
+                                  int32 x, const int32 end_x);
+
+typedef int32 (*HalfDiffKernel)(const uint8* const first,
+                                const uint8* const second,
+                                int32* const dest,
+                                int32 i, const int32 count);
+
+struct KernelVariant {
+  const char* name;
+  int32 vector_size;
+  bool (*supported)();
+  DownsampleKernel downsample;
+  HalfDiffKernel half_diff;
+};
+
+static bool alwaysSupported() {
+  return true;
+}
+
+static const KernelVariant kVariants[] = {
+  { "scalar", 1, alwaysSupported, downsampleRowScalar, halfDiffRowScalar },
+#ifdef HAVE_X86
+  { "sse4.1", 8, supportsSse41, downsampleSmoothed3x3Sse41, halfDiffRowSse41 },
+  { "avx2", 16, supportsAvx2, downsampleSmoothed3x3Avx2, halfDiffRowAvx2 },
+#endif
+};
+static const int32 kNumVariants = sizeof(kVariants) / sizeof(kVariants[0]);
+
+
+// Runs a downsampling kernel over one destination row of the given width,
+// reading three source rows which are stride bytes apart, and checks what it
+// wrote.
+static void checkDownsampleRow(const KernelVariant& variant,
+                               const int32 width, const int32 misalignment,
+                               const Pattern pattern) {
+  const int32 src_width = 2 * width + 1;
+  const int32 stride = src_width + 7;
+  uint8* const src_buffer = new uint8[kMaxMisalignment + 3 * stride];
+  uint8* const dest_buffer = new uint8[kMaxMisalignment + width + kGuardSize];
+
+  uint8* const src = src_buffer + misalignment;
+  uint8* const dest = dest_buffer + misalignment;
+  fillPixels(src, 3 * stride, pattern);
+  memset(dest_buffer, kGuard, kMaxMisalignment + width + kGuardSize);
+
+  // As Image::downsampleSmoothed3x3() calls it.
+  const int32 end_x = min(width, src_width / 2);
+  const int32 done = variant.downsample(src, src + stride, src + 2 * stride,
+                                        dest, 1, end_x);
+
+  if (done < 1 || done > end_x || end_x - done >= variant.vector_size) {
+    reportFailure("downsampleSmoothed3x3", variant.name, width, misalignment,
+                  pattern, -1, end_x, done);
+  }
+
+  for (int32 x = 1; x < done; ++x) {
+    const uint8 expected =
+        downsamplePixel(src, src + stride, src + 2 * stride, x);
+    if (dest[x] != expected) {
+      reportFailure("downsampleSmoothed3x3", variant.name, width, misalignment,
+                    pattern, x, expected, dest[x]);
+    }
+  }
+
+  for (int32 x = -misalignment; x < width + kGuardSize; ++x) {
+    if ((x < 1 || x >= done) && dest[x] != kGuard) {
+      reportFailure("downsampleSmoothed3x3", "guard", width, misalignment,
+                    pattern, x, kGuard, dest[x]);
+    }
+  }
+
+  delete[] src_buffer;
+  delete[] dest_buffer;
+}
+
+
+static void checkHalfDiffRow(const KernelVariant& variant,
+                             const int32 width, const int32 misalignment,
+                             const Pattern pattern) {
+  const int32 stride = width + 5;
+  uint8* const src_buffer = new uint8[kMaxMisalignment + 2 * stride];
+  int32* const dest_buffer =
+      new int32[kMaxMisalignment + width + kGuardSize];
+
+  uint8* const src = src_buffer + misalignment;
+  int32* const dest = dest_buffer + misalignment;
+  fillPixels(src, 2 * stride, pattern);
+  memset(dest_buffer, kGuard,
+         (kMaxMisalignment + width + kGuardSize) * sizeof(*dest_buffer));
+
+  int32 guard;
+  memset(&guard, kGuard, sizeof(guard));
+
+  // The second row is read from an odd offset too, as derivativeX() does.
+  const uint8* const first = src;
+  const uint8* const second = src + stride + (misalignment & 1);
+  const int32 done = variant.half_diff(first, second, dest, 0, width);
+
+  if (done < 0 || done > width || width - done >= variant.vector_size) {
+    reportFailure("halfDiffRow", variant.name, width, misalignment, pattern,
+                  -1, width, done);
+  }
+
+  for (int32 x = 0; x < done; ++x) {
+    const int32 expected = halfDiffPixel(first[x], second[x]);
+    if (dest[x] != expected) {
+      reportFailure("halfDiffRow", variant.name, width, misalignment, pattern,
+                    x, expected, dest[x]);
+    }
+  }
+
+  for (int32 x = -misalignment; x < width + kGuardSize; ++x) {
+    if ((x < 0 || x >= done) && dest[x] != guard) {
+      reportFailure("halfDiffRow", "guard", width, misalignment, pattern,
+                    x, guard, dest[x]);
+    }
+  }
+
+  delete[] src_buffer;
+  delete[] dest_buffer;
+}
+
+
+// Checks the Image operations, whose scalar loops finish off what the kernels
+// leave, against a straightforward scalar version with clipping everywhere.
+static void checkImageOperations(const int32 width, const int32 height,
+                                 const Pattern pattern) {
+  Image<uint8> original(width, height);
+  fillPixels(original.getPixelPtr(0, 0), width * height, pattern);
+
+  const int32 half_width = (width + 1) / 2;
+  const int32 half_height = (height + 1) / 2;
+  Image<uint8> downsampled(half_width, half_height);
+  downsampled.downsampleSmoothed3x3(original);
+
+  for (int32 y = 0; y < half_height; ++y) {
+    const int32 orig_y = clip(2 * y, 0, height - 1);
+    const uint8* const row_min =
+        original.getPixelPtrConst(0, clip(orig_y - 1, 0, height - 1));
+    const uint8* const row_center = original.getPixelPtrConst(0, orig_y);
+    const uint8* const row_max =
+        original.getPixelPtrConst(0, clip(orig_y + 1, 0, height - 1));
+
+    for (int32 x = 0; x < half_width; ++x) {
+      const int32 orig_x = clip(2 * x, 0, width - 1);
+      const int32 min_x = clip(orig_x - 1, 0, width - 1);
+      const int32 max_x = clip(orig_x + 1, 0, width - 1);
+      const int32 sum = row_center[orig_x] * 4 +
+          (row_center[min_x] + row_center[max_x] +
+           row_min[orig_x] + row_max[orig_x]) * 2 +
+          row_min[min_x] + row_min[max_x] + row_max[min_x] + row_max[max_x];
+
+      if (downsampled.getPixel(x, y) != (sum >> 4)) {
+        reportFailure("Image::downsampleSmoothed3x3", "image", width, 0,
+                      pattern, y * half_width + x, sum >> 4,
+                      downsampled.getPixel(x, y));
+      }
+    }
+  }
+
+  if (width < 2) {
+    // derivativeX() needs two columns.
+    return;
+  }
+
+  Image<int32> derivative_x(width, height);
+  Image<int32> derivative_y(width, height);
+  derivative_x.derivativeX(original);
+  derivative_y.derivativeY(original);
+
+  for (int32 y = 0; y < height; ++y) {
+    for (int32 x = 0; x < width; ++x) {
+      const int32 expected_x = halfDiffPixel(
+          original.getPixel(clip(x - 1, 0, width - 1), y),
+          original.getPixel(clip(x + 1, 0, width - 1), y));
+      const int32 expected_y = halfDiffPixel(
+          original.getPixel(x, clip(y - 1, 0, height - 1)),
+          original.getPixel(x, clip(y + 1, 0, height - 1)));
+
+      if (derivative_x.getPixel(x, y) != expected_x) {
+        reportFailure("Image::derivativeX", "image", width, 0, pattern,
+                      y * width + x, expected_x, derivative_x.getPixel(x, y));
+      }
+      if (derivative_y.getPixel(x, y) != expected_y) {
+        reportFailure("Image::derivativeY", "image", width, 0, pattern,
+                      y * width + x, expected_y, derivative_y.getPixel(x, y));
+      }
+    }
+  }
+}
+
+
+#ifdef HAVE_X86
+// Runs the SSE2 FAST circle test at every position where all 16 lanes and their
+// circles are within a frame of the given size, from the first row it can
+// reach to the last, and compares each lane with the scalar test. The frame is
+// allocated without any slack, so reads past either end are out of bounds.
+static void checkFastCircles(const int32 width, const int32 height,
+                             const Pattern pattern,
+                             int32* const num_passed,
+                             int32* const num_tested) {
+  static const int32 kRadius = 3;
+
+  if (width < 16 + 2 * kRadius) {
+    return;
+  }
+
+  uint8* const pixels = new uint8[width * height];
+  fillPixels(pixels, width * height, pattern);
+
+  int32 short_offsets[FAST_SHORT_CIRCLE_PERIMETER];
+  int32 full_offsets[FAST_FULL_CIRCLE_PERIMETER];
+  makeFastCircleOffsets(width, short_offsets, full_offsets);
+
+  for (int32 y = kRadius; y < height - kRadius; ++y) {
+    for (int32 x = kRadius; x + 16 + kRadius <= width; ++x) {
+      const uint8* const center_ptr = pixels + y * width + x;
+      const int32 passed =
+          testCircles16(center_ptr, short_offsets, full_offsets);
+
+      for (int32 lane = 0; lane < 16; ++lane) {
+        const int32 expected =
+            testFastCircles(center_ptr + lane, short_offsets, full_offsets);
+        const int32 actual = (passed >> lane) & 1;
+
+        if (actual != expected) {
+          reportFailure("testCircles16", "sse2", width, 0, pattern,
+                        y * width + x + lane, expected, actual);
+        }
+
+        *num_passed += actual;
+        *num_tested += 1;
+      }
+    }
+  }
+
+  delete[] pixels;
+}
+#endif
+
+
+// calculateG() sums in a different order when vectorized, so it can only
+// match the scalar sums to within rounding.
+static void checkCalculateG() {
+  for (int32 count = 0; count <= 67; ++count) {
+    float32 vals_x[67];
+    float32 vals_y[67];
+    double expected[4] = { 0.0, 0.0, 0.0, 0.0 };
+    // The rounding error is bounded by the sum of the terms' magnitudes.
+    double magnitude[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+    for (int32 i = 0; i < count; ++i) {
+      vals_x[i] = (rand() % 511 - 255) / 2.0f;
+      vals_y[i] = (rand() % 511 - 255) / 2.0f;
+      expected[0] += vals_x[i] * vals_x[i];
+      expected[1] += vals_x[i] * vals_y[i];
+      expected[3] += vals_y[i] * vals_y[i];
+      magnitude[1] += fabs(vals_x[i] * vals_y[i]);
+    }
+    expected[2] = expected[1];
+    magnitude[0] = expected[0];
+    magnitude[2] = magnitude[1];
+    magnitude[3] = expected[3];
+
+    float G[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    calculateG(vals_x, vals_y, count, G);
+
+    for (int32 i = 0; i < 4; ++i) {
+      if (fabs(G[i] - expected[i]) > 1e-5 * (magnitude[i] + 1.0)) {
+        if (num_failures++ < 20) {
+          fprintf(stderr, "FAIL calculateG: %d values: G[%d] expected %f, "
+                  "got %f\n", count, i, expected[i], G[i]);
+        }
+      }
+    }
+  }
+}
+
+
+static int32 runChecks() {
+  int32 num_checked = 0;
+
+  for (int32 v = 0; v < kNumVariants; ++v) {
+    const KernelVariant& variant = kVariants[v];
+    if (!variant.supported()) {
+      printf("# %s: not supported by this CPU, skipped\n", variant.name);
+      continue;
+    }
+
+    for (int32 w = 0; w < kNumWidths; ++w) {
+      for (int32 misalignment = 0; misalignment < kMaxMisalignment;
+           ++misalignment) {
+        for (int32 p = 0; p < NUM_PATTERNS; ++p) {
+          checkDownsampleRow(variant, kWidths[w], misalignment, Pattern(p));
+          checkHalfDiffRow(variant, kWidths[w], misalignment, Pattern(p));
+          num_checked += 2;
+        }
+      }
+    }
+  }
+
+  for (int32 w = 0; w < kNumWidths; ++w) {
+    for (int32 p = 0; p < NUM_PATTERNS; ++p) {
+      checkImageOperations(kWidths[w], 1 + (kWidths[w] % 7), Pattern(p));
+      checkImageOperations(kWidths[w], 17, Pattern(p));
+      num_checked += 2;
+    }
+  }
+
+#ifdef HAVE_X86
+  int32 num_passed = 0;
+  int32 num_tested = 0;
+
+  for (int32 w = 0; w < kNumWidths; ++w) {
+    for (int32 p = 0; p < NUM_PATTERNS; ++p) {
+      checkFastCircles(kWidths[w], 7 + (kWidths[w] % 5), Pattern(p),
+                       &num_passed, &num_tested);
+      num_checked += 1;
+    }
+  }
+
+  // Random pixels are dark or bright enough often enough for some to pass.
+  if (num_passed == 0 || num_passed == num_tested) {
+    ++num_failures;
+    fprintf(stderr, "FAIL testCircles16: %d of %d pixels passed, so the "
+            "comparison proves nothing\n", num_passed, num_tested);
+  }
+#endif
+
+  checkCalculateG();
+  return num_checked + 1;
+}
+
+
+// Times each supported variant of each kernel over frame sized rows.
+static void runBenchmarks(const int32 width, const int32 num_rows) {
+  const int32 src_width = 2 * width + 1;
+  uint8* const src = new uint8[3 * src_width];
+  uint8* const dest = new uint8[width];
+  int32* const diffs = new int32[width];
+  fillPixels(src, 3 * src_width, PATTERN_RANDOM);
+
+  printf("# %d pixel rows, %d per variant\n", width, num_rows);
+  printf("# record\tkernel\tvariant\tns_per_pixel\tspeedup\n");
+
+  double scalar_ns[2] = { 0.0, 0.0 };
+
+  for (int32 v = 0; v < kNumVariants; ++v) {
+    const KernelVariant& variant = kVariants[v];
+    if (!variant.supported()) {
+      continue;
+    }
+
+    const int32 end_x = min(width, src_width / 2);
+    int64 start_us = currentTimeMicros();
+    for (int32 row = 0; row < num_rows; ++row) {
+      variant.downsample(src, src + src_width, src + 2 * src_width,
+                         dest, 1, end_x);
+    }
+    const double downsample_ns =
+        (currentTimeMicros() - start_us) * 1000.0 / num_rows / width;
+
+    start_us = currentTimeMicros();
+    for (int32 row = 0; row < num_rows; ++row) {
+      variant.half_diff(src, src + src_width, diffs, 0, width);
+    }
+    const double half_diff_ns =
+        (currentTimeMicros() - start_us) * 1000.0 / num_rows / width;
+
+    if (v == 0) {
+      scalar_ns[0] = downsample_ns;
+      scalar_ns[1] = half_diff_ns;
+    }
+
+    printf("kernel\tdownsampleSmoothed3x3\t%s\t%.3f\t%.2f\n", variant.name,
+           downsample_ns, downsample_ns > 0 ? scalar_ns[0] / downsample_ns : 0);
+    printf("kernel\thalfDiffRow\t%s\t%.3f\t%.2f\n", variant.name,
+           half_diff_ns, half_diff_ns > 0 ? scalar_ns[1] / half_diff_ns : 0);
+    fflush(stdout);
+  }
+
+  delete[] src;
+  delete[] dest;
+  delete[] diffs;
+}
+
+
+static void printUsage(const char* const program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "\n"
+          "Checks the x86 vector kernels of the optical flow pyramid and the\n"
+          "FAST circle test against the scalar code, or times the kernels.\n"
+          "\n"
+          "  -b, --benchmark         time the kernels instead of checking them\n"
+          "  -w, --width=N           row width for -b (default 640)\n"
+          "  -r, --rows=N            rows per variant for -b (default 100000)\n",
+          program);
+}
+
+
+int main(int argc, char** argv) {
+  bool benchmark = false;
+  int32 width = 640;
+  int32 num_rows = 100000;
+
+  static const struct option kOptions[] = {
+    { "benchmark", no_argument, NULL, 'b' },
+    { "width", required_argument, NULL, 'w' },
+    { "rows", required_argument, NULL, 'r' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "bw:r:h", kOptions, NULL)) != -1) {
+    switch (option) {
+      case 'b':
+        benchmark = true;
+        break;
+      case 'w':
+        width = atoi(optarg);
+        break;
+      case 'r':
+        num_rows = atoi(optarg);
+        break;
+      default:
+        printUsage(argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind < argc || width <= 0 || num_rows <= 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+#ifndef HAVE_X86
+  printf("# not an x86 build: only the scalar code is exercised\n");
+#endif
+
+  if (benchmark) {
+    runBenchmarks(width, num_rows);
+    return 0;
+  }
+
+  srand(1);
+  const int32 num_checked = runChecks();
+
+  if (num_failures > 0) {
+    printf("%d mismatches in %d checks\n", num_failures, num_checked);
+    return 1;
+  }
+
+  printf("all %d checks passed\n", num_checked);
+  return 0;
+}
@@ -2,7 +2,9 @@ LOCAL_PATH:= $(call my-dir)
 
 include $(CLEAR_VARS)
 
-LOCAL_SRC_FILES := time_log.cpp
+LOCAL_SRC_FILES := stage_timer.cpp \
+                   time_log.cpp \
+                   worker_pool.cpp
 
 LOCAL_CFLAGS := -Wall \
                 -DHAVE_MALLOC_H \
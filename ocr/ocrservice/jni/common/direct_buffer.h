@@ -0,0 +1,61 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Access to camera frames passed from Java in direct ByteBuffers. Unlike
+// byte arrays, these can be read in place, so a single preview buffer can be
+// handed to several native libraries without being copied for each one.
+
+#ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_DIRECT_BUFFER_H_
+#define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_DIRECT_BUFFER_H_
+
+#include <jni.h>
+
+#include "utils.h"
+#include "types.h"
+
+// Returns the luminance plane held in a direct ByteBuffer, whose rows are
+// stride bytes apart, or NULL if the buffer isn't direct or is too small to
+// hold width x height pixels. The pointer is valid for as long as the Java
+// buffer is.
+inline static const uint8* getDirectFrame(JNIEnv* const env,
+                                          const jobject buffer,
+                                          const int32 width,
+                                          const int32 height,
+                                          const int32 stride) {
+  if (buffer == NULL || width <= 0 || height <= 0 || stride < width) {
+    LOGE("Invalid frame: %dx%d, stride %d", width, height, stride);
+    return NULL;
+  }
+
+  const uint8* const pixels =
+      static_cast<const uint8*>(env->GetDirectBufferAddress(buffer));
+  if (pixels == NULL) {
+    LOGE("Frame buffer is not a direct buffer");
+    return NULL;
+  }
+
+  const jlong capacity = env->GetDirectBufferCapacity(buffer);
+  const jlong needed = static_cast<jlong>(stride) * (height - 1) + width;
+  if (capacity < needed) {
+    LOGE("Frame buffer holds %lld bytes, needs %lld",
+         static_cast<long long>(capacity), static_cast<long long>(needed));
+    return NULL;
+  }
+
+  return pixels;
+}
+
+#endif  // JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_DIRECT_BUFFER_H_
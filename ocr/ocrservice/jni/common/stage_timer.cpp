@@ -0,0 +1,372 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "utils.h"
+
+#include "stage_timer.h"
+
+// Bits of each time below its leading one that pick the bucket within an
+// octave.
+static const int32 kFractionBits = 2;
+static const int32 kBucketsPerOctave = 1 << kFractionBits;
+
+// Times of one stage on one thread. Only the owning thread adds to these, but
+// snapshots read them from other threads, so every access is atomic. 64 bit
+// atomics aren't available on every ABI, so the total is kept in 32 bit
+// halves which are read consistently using the buffer's sequence count.
+struct ThreadStageCounts {
+  uint32 buckets[NUM_TIME_BUCKETS];
+  uint32 total_us_low;
+  uint32 total_us_high;
+  int32 max_us;
+
+  // The total when the times were last reset, which is subtracted from it.
+  // Guarded by stage_mutex.
+  int64 reset_total_us;
+};
+
+struct ThreadStageTimes {
+  // Buffers are never freed, so the list only ever grows at its head.
+  ThreadStageTimes* next;
+
+  // Non-zero while a live thread owns the buffer. The counts of a thread that
+  // has exited stay in the totals, and the buffer is handed to the next new
+  // thread to record.
+  int32 in_use;
+
+  // Odd while the owning thread is updating a total.
+  uint32 sequence;
+
+  int64 lap_start_us;
+
+  ThreadStageCounts stages[MAX_STAGES];
+};
+
+// Registered stage names, in id order. Names are written before num_stages
+// is raised to include them.
+static const char* stage_names[MAX_STAGES];
+static int32 num_stages = 0;
+static pthread_mutex_t stage_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static ThreadStageTimes* thread_times_list = NULL;
+static pthread_key_t thread_times_key;
+static pthread_once_t thread_times_once = PTHREAD_ONCE_INIT;
+
+
+// Reads a value of at most pointer size which another thread may be writing.
+// Anything that thread wrote before storing the value is visible too.
+template <typename T>
+static inline T atomicRead(T* const value) {
+#ifdef __ATOMIC_ACQUIRE
+  return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#else
+  const T result = *static_cast<volatile T*>(value);
+  __sync_synchronize();
+  return result;
+#endif
+}
+
+
+// Reads the total of a stage on the calling thread or any other.
+static int64 readTotal(ThreadStageTimes* const times,
+                       ThreadStageCounts* const counts) {
+  uint32 sequence;
+  uint32 low;
+  uint32 high;
+
+  do {
+    sequence = atomicRead(&times->sequence);
+    low = atomicRead(&counts->total_us_low);
+    high = atomicRead(&counts->total_us_high);
+  } while ((sequence & 1) != 0 || atomicRead(&times->sequence) != sequence);
+
+  return static_cast<int64>((static_cast<uint64>(high) << 32) | low);
+}
+
+
+static void releaseThreadStageTimes(void* const times) {
+  __sync_lock_release(&static_cast<ThreadStageTimes*>(times)->in_use);
+}
+
+
+static void createThreadTimesKey() {
+  pthread_key_create(&thread_times_key, releaseThreadStageTimes);
+}
+
+
+// Returns the calling thread's buffer, claiming one on first use.
+static ThreadStageTimes* getThreadStageTimes() {
+  pthread_once(&thread_times_once, createThreadTimesKey);
+
+  ThreadStageTimes* times =
+      static_cast<ThreadStageTimes*>(pthread_getspecific(thread_times_key));
+  if (times != NULL) {
+    return times;
+  }
+
+  // Reuse the buffer of a thread that has exited if there is one.
+  for (times = atomicRead(&thread_times_list);
+       times != NULL; times = times->next) {
+    if (__sync_bool_compare_and_swap(&times->in_use, 0, 1)) {
+      break;
+    }
+  }
+
+  if (times == NULL) {
+    times = static_cast<ThreadStageTimes*>(
+        calloc(1, sizeof(ThreadStageTimes)));
+    if (times == NULL) {
+      LOGE("Couldn't allocate stage times!");
+      return NULL;
+    }
+    times->in_use = 1;
+
+    ThreadStageTimes* head;
+    do {
+      head = atomicRead(&thread_times_list);
+      times->next = head;
+    } while (!__sync_bool_compare_and_swap(&thread_times_list, head, times));
+  }
+
+  times->lap_start_us = 0;
+  pthread_setspecific(thread_times_key, times);
+  return times;
+}
+
+
+static inline int32 getBucket(const int64 duration_us) {
+  if (duration_us < kBucketsPerOctave) {
+    return max(static_cast<int32>(duration_us), 0);
+  }
+
+  const int32 octave = 63 - __builtin_clzll(duration_us);
+  const int32 fraction =
+      (duration_us >> (octave - kFractionBits)) & (kBucketsPerOctave - 1);
+
+  return min((octave - kFractionBits + 1) * kBucketsPerOctave + fraction,
+             NUM_TIME_BUCKETS - 1);
+}
+
+
+// The shortest time that falls in a bucket. Passing NUM_TIME_BUCKETS gives
+// the end of the last bucket.
+static inline int64 getBucketStart(const int32 bucket) {
+  if (bucket < kBucketsPerOctave) {
+    return bucket;
+  }
+
+  const int32 octave = bucket / kBucketsPerOctave + kFractionBits - 1;
+  return static_cast<int64>(kBucketsPerOctave + bucket % kBucketsPerOctave) <<
+      (octave - kFractionBits);
+}
+
+
+static void addStageTime(ThreadStageTimes* const times, const int32 stage,
+                         const int64 duration_us) {
+  if (stage < 0 || stage >= MAX_STAGES) {
+    return;
+  }
+
+  ThreadStageCounts* const counts = times->stages + stage;
+  __sync_fetch_and_add(&counts->buckets[getBucket(duration_us)], 1);
+
+  // Only this thread writes the halves, so they can't change under it.
+  const uint64 total_us =
+      ((static_cast<uint64>(counts->total_us_high) << 32) |
+       counts->total_us_low) + duration_us;
+
+  __sync_fetch_and_add(&times->sequence, 1);
+  __sync_lock_test_and_set(&counts->total_us_low,
+                           static_cast<uint32>(total_us));
+  __sync_lock_test_and_set(&counts->total_us_high,
+                           static_cast<uint32>(total_us >> 32));
+  __sync_fetch_and_add(&times->sequence, 1);
+
+  if (duration_us > atomicRead(&counts->max_us)) {
+    __sync_lock_test_and_set(&counts->max_us,
+                             static_cast<int32>(min(duration_us, 0x7fffffffLL)));
+  }
+}
+
+
+int32 getStageId(const char* const name) {
+  pthread_mutex_lock(&stage_mutex);
+
+  const int32 count = getNumStages();
+  int32 stage = 0;
+  while (stage < count && strcmp(stage_names[stage], name) != 0) {
+    ++stage;
+  }
+
+  if (stage == count) {
+    if (count < MAX_STAGES) {
+      stage_names[stage] = name;
+      __sync_fetch_and_add(&num_stages, 1);
+    } else {
+      LOGE("Too many stages, not timing %s!", name);
+      stage = -1;
+    }
+  }
+
+  pthread_mutex_unlock(&stage_mutex);
+  return stage;
+}
+
+
+const char* getStageName(const int32 stage) {
+  return stage >= 0 && stage < getNumStages() ? stage_names[stage] : NULL;
+}
+
+
+int32 getNumStages() {
+  return atomicRead(&num_stages);
+}
+
+
+int64 recordStageTime(const int32 stage, const int64 start_us) {
+  const int64 duration_us = currentTimeMicros() - start_us;
+
+  ThreadStageTimes* const times = getThreadStageTimes();
+  if (times != NULL) {
+    addStageTime(times, stage, duration_us);
+  }
+
+  return duration_us;
+}
+
+
+void startStageLap() {
+  ThreadStageTimes* const times = getThreadStageTimes();
+  if (times != NULL) {
+    times->lap_start_us = currentTimeMicros();
+  }
+}
+
+
+int64 lapStage(const int32 stage) {
+  ThreadStageTimes* const times = getThreadStageTimes();
+  if (times == NULL || times->lap_start_us == 0) {
+    return -1;
+  }
+
+  const int64 now_us = currentTimeMicros();
+  const int64 duration_us = now_us - times->lap_start_us;
+  times->lap_start_us = now_us;
+
+  addStageTime(times, stage, duration_us);
+  return duration_us;
+}
+
+
+int32 getStageTimes(StageTimes* const stages) {
+  pthread_mutex_lock(&stage_mutex);
+  const int32 count = getNumStages();
+
+  memset(stages, 0, count * sizeof(*stages));
+  for (int32 stage = 0; stage < count; ++stage) {
+    stages[stage].name = stage_names[stage];
+  }
+
+  for (ThreadStageTimes* times = atomicRead(&thread_times_list);
+       times != NULL; times = times->next) {
+    for (int32 stage = 0; stage < count; ++stage) {
+      ThreadStageCounts* const counts = times->stages + stage;
+      StageTimes* const merged = stages + stage;
+
+      for (int32 i = 0; i < NUM_TIME_BUCKETS; ++i) {
+        const uint32 bucket_count = atomicRead(&counts->buckets[i]);
+        merged->buckets[i] += bucket_count;
+        merged->count += bucket_count;
+      }
+      merged->total_us += readTotal(times, counts) - counts->reset_total_us;
+      merged->max_us = max(merged->max_us, atomicRead(&counts->max_us));
+    }
+  }
+
+  pthread_mutex_unlock(&stage_mutex);
+  return count;
+}
+
+
+void resetStageTimes() {
+  pthread_mutex_lock(&stage_mutex);
+
+  for (ThreadStageTimes* times = atomicRead(&thread_times_list);
+       times != NULL; times = times->next) {
+    for (int32 stage = 0; stage < MAX_STAGES; ++stage) {
+      ThreadStageCounts* const counts = times->stages + stage;
+
+      for (int32 i = 0; i < NUM_TIME_BUCKETS; ++i) {
+        __sync_lock_test_and_set(&counts->buckets[i], 0);
+      }
+      counts->reset_total_us = readTotal(times, counts);
+      __sync_lock_test_and_set(&counts->max_us, 0);
+    }
+  }
+
+  pthread_mutex_unlock(&stage_mutex);
+}
+
+
+float32 getStagePercentile(const StageTimes& stage, const float32 fraction) {
+  if (stage.count == 0) {
+    return 0.0f;
+  }
+
+  // Find the bucket holding the rank, then assume the times in it are spread
+  // evenly.
+  const float32 rank = fraction * stage.count;
+  int64 below = 0;
+  for (int32 i = 0; i < NUM_TIME_BUCKETS; ++i) {
+    if (stage.buckets[i] == 0 || below + stage.buckets[i] < rank) {
+      below += stage.buckets[i];
+      continue;
+    }
+
+    const int64 start_us = getBucketStart(i);
+    const int64 end_us = getBucketStart(i + 1);
+    const float32 time_us = start_us +
+        (end_us - start_us) * (rank - below) / stage.buckets[i];
+
+    return min(time_us, static_cast<float32>(stage.max_us)) / 1000.0f;
+  }
+
+  return stage.max_us / 1000.0f;
+}
+
+
+int32 getStageSummaries(float32* const summaries) {
+  StageTimes* const stages = new StageTimes[MAX_STAGES];
+  const int32 count = getStageTimes(stages);
+
+  for (int32 i = 0; i < count; ++i) {
+    const StageTimes& stage = stages[i];
+    float32* const summary = summaries + i * STAGE_SUMMARY_STEP;
+
+    summary[0] = stage.count;
+    summary[1] = stage.count > 0 ? stage.total_us / 1000.0f / stage.count : 0;
+    summary[2] = getStagePercentile(stage, 0.5f);
+    summary[3] = getStagePercentile(stage, 0.9f);
+    summary[4] = getStagePercentile(stage, 0.99f);
+    summary[5] = stage.max_us / 1000.0f;
+  }
+
+  delete[] stages;
+  return count;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Latency histograms for named processing stages, cheap enough to leave on in
+// release builds. Each thread records into its own buffer without locking, and
+// a snapshot sums the buffers of every thread that has recorded so far.
+//
+// Typical use is either a scoped timer:
+//
+//   {
+//     SCOPED_TIMER("Compute signature");
+//     ...
+//   }
+//
+// or laps through a sequence of stages on one thread:
+//
+//   static const int32 kEdgeStage = getStageId("Edge thresholding");
+//   startStageLap();
+//   ...
+//   lapStage(kEdgeStage);
+
+#ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_STAGE_TIMER_H_
+#define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_STAGE_TIMER_H_
+
+#include <time.h>
+
+#include "types.h"
+
+// Upper bound on the number of distinct stage names.
+#define MAX_STAGES 64
+
+// Histogram buckets are 1us wide up to 4us, then a quarter of an octave wide.
+// Times beyond the last bucket (about 2s) are counted in it.
+#define NUM_TIME_BUCKETS 80
+
+// Number of values per stage written by getStageSummaries(): the count, then
+// the mean, median, 90th and 99th percentile and maximum times in ms.
+#define STAGE_SUMMARY_STEP 6
+
+// Wall clock time, which unlike thread CPU time includes any time spent
+// waiting for work handed to other threads.
+inline static int64 currentTimeMicros() {
+  struct timespec tm;
+  clock_gettime(CLOCK_MONOTONIC, &tm);
+  return tm.tv_sec * 1000000LL + tm.tv_nsec / 1000;
+}
+
+// Merged times of one stage across all threads.
+struct StageTimes {
+  const char* name;
+  int64 count;
+  int64 total_us;
+  int32 max_us;
+  uint32 buckets[NUM_TIME_BUCKETS];
+};
+
+// Returns the id of the stage with the given name, registering it if it's
+// new. The name must outlive the process, e.g. a string literal. Ids are
+// handed out in order from 0 and never reused. Returns -1 if MAX_STAGES
+// stages already exist, and times recorded against -1 are dropped.
+//
+// This takes a lock, so look ids up once and keep them.
+int32 getStageId(const char* const name);
+
+// Returns the name of a registered stage.
+const char* getStageName(const int32 stage);
+
+// Returns the number of stages registered so far.
+int32 getNumStages();
+
+// Records the time since start_us against a stage for the calling thread,
+// and returns it.
+int64 recordStageTime(const int32 stage, const int64 start_us);
+
+// Starts a new sequence of laps on the calling thread.
+void startStageLap();
+
+// Records the time since the calling thread's previous lap (or
+// startStageLap()) against a stage and starts the next lap. Returns the time
+// recorded, or -1 if no lap had been started on this thread.
+int64 lapStage(const int32 stage);
+
+// Merges the times every thread has recorded into stages, which must hold
+// MAX_STAGES entries, and returns the number of stages written. Entry i is
+// stage id i. Threads may record while this runs, in which case their newest
+// times might be only partly included.
+int32 getStageTimes(StageTimes* const stages);
+
+// Clears the times of every stage. Times recorded by other threads while
+// this runs may survive in part, so call it between batches of work.
+void resetStageTimes();
+
+// Estimates the time in ms below which the given fraction of a stage's times
+// fall. The answer is accurate to the width of a histogram bucket.
+float32 getStagePercentile(const StageTimes& stage, const float32 fraction);
+
+// Writes STAGE_SUMMARY_STEP values for each stage to summaries, which must
+// hold MAX_STAGES * STAGE_SUMMARY_STEP values, and returns the number of
+// stages written.
+int32 getStageSummaries(float32* const summaries);
+
+// Records the lifetime of the timer against a stage.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(const int32 stage) :
+      stage_(stage),
+      start_us_(currentTimeMicros()) {}
+
+  ~ScopedTimer() {
+    recordStageTime(stage_, start_us_);
+  }
+
+ private:
+  const int32 stage_;
+  const int64 start_us_;
+};
+
+#define STAGE_TIMER_CONCAT_INNER(a, b) a ## b
+#define STAGE_TIMER_CONCAT(a, b) STAGE_TIMER_CONCAT_INNER(a, b)
+
+// Times the rest of the enclosing scope as the named stage. The stage id is
+// looked up on first use only.
+#define SCOPED_TIMER(name) \
+    static const int32 STAGE_TIMER_CONCAT(_stage_, __LINE__) = \
+        getStageId(name); \
+    ScopedTimer STAGE_TIMER_CONCAT(_scoped_timer_, __LINE__)( \
+        STAGE_TIMER_CONCAT(_stage_, __LINE__))
+
+#endif  // JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_STAGE_TIMER_H_
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Conversions of stage timing snapshots to Java arrays, shared by the native
+// libraries. Each library links its own copy of the common code, so each one
+// reports only the stages it timed itself.
+
+#ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_STAGE_TIMER_JNI_H_
+#define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_STAGE_TIMER_JNI_H_
+
+#include <jni.h>
+
+#include "types.h"
+#include "stage_timer.h"
+
+// Returns STAGE_SUMMARY_STEP floats for each stage timed so far, in stage id
+// order. See getStageSummaries().
+inline static jfloatArray getStageSummariesArray(JNIEnv* const env) {
+  float32* const summaries = new float32[MAX_STAGES * STAGE_SUMMARY_STEP];
+  const int32 num_values = getStageSummaries(summaries) * STAGE_SUMMARY_STEP;
+
+  jfloatArray ret = env->NewFloatArray(num_values);
+  if (ret != NULL) {
+    env->SetFloatArrayRegion(ret, 0, num_values, summaries);
+  }
+
+  delete[] summaries;
+  return ret;
+}
+
+// Returns the names of the stages registered so far, in stage id order.
+// Stages are never removed, so names fetched after a summary always cover
+// every stage in it.
+inline static jobjectArray getStageNamesArray(JNIEnv* const env) {
+  const int32 num_stages = getNumStages();
+
+  jobjectArray ret = env->NewObjectArray(
+      num_stages, env->FindClass("java/lang/String"), NULL);
+  if (ret == NULL) {
+    return NULL;
+  }
+
+  for (int32 i = 0; i < num_stages; ++i) {
+    jstring name = env->NewStringUTF(getStageName(i));
+    env->SetObjectArrayElement(ret, i, name);
+    env->DeleteLocalRef(name);
+  }
+
+  return ret;
+}
+
+#endif  // JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_STAGE_TIMER_JNI_H_
@@ -20,12 +20,112 @@
 #include "time_log.h"
 
 #ifdef LOG_TIME
-// Storage for logging functionality.
-int32 num_time_logs = 0;
-LogEntry time_logs[NUM_LOGS];
+#include <pthread.h>
 
-int32 num_avg_entries = 0;
-AverageEntry avg_entries[NUM_LOGS];
+struct LogEntry {
+  int32 stage;
+  int64 duration_us;
+};
 
-float32 running_total = 0.0f;
+// Storage for keeping track of one thread's values.
+struct ThreadTimeLog {
+  int32 num_time_logs;
+  LogEntry time_logs[NUM_LOGS];
+
+  // Running averages by stage id (each entry may not be printed out each
+  // frame).
+  float32 average_durations[MAX_STAGES];
+  bool has_average[MAX_STAGES];
+  float32 running_total;
+};
+
+static pthread_key_t time_log_key;
+static pthread_once_t time_log_once = PTHREAD_ONCE_INIT;
+
+
+static void createTimeLogKey() {
+  pthread_key_create(&time_log_key, free);
+}
+
+
+static ThreadTimeLog* getThreadTimeLog() {
+  pthread_once(&time_log_once, createTimeLogKey);
+
+  ThreadTimeLog* log =
+      static_cast<ThreadTimeLog*>(pthread_getspecific(time_log_key));
+  if (log == NULL) {
+    log = static_cast<ThreadTimeLog*>(calloc(1, sizeof(ThreadTimeLog)));
+    pthread_setspecific(time_log_key, log);
+  }
+  return log;
+}
+
+
+inline static float32 blend(float32 old_val, float32 new_val) {
+  return ALPHA * old_val + (1.0f - ALPHA) * new_val;
+}
+
+
+void resetTimeLog() {
+  startStageLap();
+
+  ThreadTimeLog* const log = getThreadTimeLog();
+  if (log != NULL) {
+    log->num_time_logs = 0;
+  }
+}
+
+
+void appendTimeLog(const int32 stage, const int64 duration_us) {
+  ThreadTimeLog* const log = getThreadTimeLog();
+  if (log == NULL) {
+    return;
+  }
+
+  if (log->num_time_logs >= NUM_LOGS) {
+    LOGE("Out of log entries!");
+    return;
+  }
+
+  log->time_logs[log->num_time_logs].stage = stage;
+  log->time_logs[log->num_time_logs].duration_us = duration_us;
+  ++log->num_time_logs;
+}
+
+
+void printTimeLog() {
+  ThreadTimeLog* const log = getThreadTimeLog();
+  if (log == NULL) {
+    return;
+  }
+
+  float32 total_time = 0.0f;
+
+  for (int i = 0; i < log->num_time_logs; ++i) {
+    const LogEntry& entry = log->time_logs[i];
+    const float32 curr_time = entry.duration_us / 1000.0f;
+    total_time += curr_time;
+
+    if (entry.stage < 0) {
+      LOGD("%32s:    %6.2fms", "(untracked stage)", curr_time);
+      continue;
+    }
+
+    float32* const avg_time = log->average_durations + entry.stage;
+    if (log->has_average[entry.stage]) {
+      *avg_time = blend(*avg_time, curr_time);
+    } else {
+      *avg_time = curr_time;
+      log->has_average[entry.stage] = true;
+    }
+
+    LOGD("%32s:    %6.2fms    %6.2fms",
+         getStageName(entry.stage), curr_time, *avg_time);
+  }
+
+  log->running_total = blend(log->running_total, total_time);
+
+  LOGD("TOTAL TIME:                          %6.2fms    %6.2fms\n",
+       total_time, log->running_total);
+}
 #endif
@@ -12,10 +12,12 @@
 typedef unsigned char uint8;
 typedef unsigned short uint16;
 typedef unsigned int uint32;
+typedef unsigned long long uint64;
 
 typedef signed char int8;
 typedef short int16;
 typedef signed int int32;
+typedef signed long long int64;
 typedef float float32;
 
 #endif // JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_NATIVE_TYPES_H_
@@ -12,6 +12,10 @@
 #include <arm_neon.h>
 #endif
 
+#ifdef HAVE_X86
+#include <immintrin.h>
+#endif
+
 #include <math.h>
 #include "types.h"
 
@@ -57,6 +61,17 @@ inline bool supportsNeon() {
 }
 #endif
 
+#ifdef HAVE_X86
+// Runtime checks for the x86 vector extensions beyond the ABI baseline.
+inline bool supportsSse41() {
+  return __builtin_cpu_supports("sse4.1");
+}
+
+inline bool supportsAvx2() {
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
 #ifndef max
 #define max(a, b) (((a) > (b)) ? (a) : (b))
 #endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include "utils.h"
+
+#include "worker_pool.h"
+
+WorkerPool* WorkerPool::shared_ = NULL;
+pthread_once_t WorkerPool::shared_once_ = PTHREAD_ONCE_INIT;
+
+WorkerPool::WorkerPool(const int32 num_threads) :
+    num_threads_(0),
+    first_job_(NULL),
+    last_job_(NULL),
+    stopping_(false) {
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&work_available_, NULL);
+  pthread_cond_init(&work_done_, NULL);
+
+  const int32 thread_limit = min(num_threads, MAX_WORKER_THREADS);
+
+  while (num_threads_ < thread_limit) {
+    if (pthread_create(&threads_[num_threads_], NULL, threadMain, this) != 0) {
+      LOGW("Only started %d of %d worker threads.", num_threads_, thread_limit);
+      break;
+    }
+
+    ++num_threads_;
+  }
+}
+
+
+WorkerPool::~WorkerPool() {
+  pthread_mutex_lock(&mutex_);
+  stopping_ = true;
+  pthread_cond_broadcast(&work_available_);
+  pthread_mutex_unlock(&mutex_);
+
+  for (int32 i = 0; i < num_threads_; ++i) {
+    pthread_join(threads_[i], NULL);
+  }
+
+  pthread_cond_destroy(&work_done_);
+  pthread_cond_destroy(&work_available_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+
+int32 WorkerPool::getDefaultThreadCount() {
+  const long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (num_processors <= 1) {
+    return 0;
+  }
+
+  return min(static_cast<int32>(num_processors) - 1, MAX_WORKER_THREADS);
+}
+
+
+WorkerPool* WorkerPool::getShared() {
+  pthread_once(&shared_once_, createShared);
+  return shared_;
+}
+
+
+void WorkerPool::createShared() {
+  shared_ = new WorkerPool(getDefaultThreadCount());
+}
+
+
+void WorkerPool::start(WorkerJob* const job, const WorkerTask task,
+                       void* const data, const int32 count) {
+  job->task_ = task;
+  job->data_ = data;
+  job->count_ = count;
+  job->next_index_ = 0;
+  job->num_done_ = 0;
+  job->next_job_ = NULL;
+
+  if (count <= 0) {
+    return;
+  }
+
+  if (num_threads_ == 0) {
+    // Nobody to hand it to, so just do it now.
+    for (int32 i = 0; i < count; ++i) {
+      task(data, i);
+    }
+
+    job->next_index_ = job->num_done_ = count;
+    return;
+  }
+
+  pthread_mutex_lock(&mutex_);
+
+  if (last_job_ != NULL) {
+    last_job_->next_job_ = job;
+  } else {
+    first_job_ = job;
+  }
+  last_job_ = job;
+
+  pthread_cond_broadcast(&work_available_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+
+void WorkerPool::wait(WorkerJob* const job) {
+  pthread_mutex_lock(&mutex_);
+
+  while (runOneIndex(job)) {
+  }
+
+  while (job->num_done_ < job->count_) {
+    pthread_cond_wait(&work_done_, &mutex_);
+  }
+
+  pthread_mutex_unlock(&mutex_);
+}
+
+
+bool WorkerPool::runOneIndex(WorkerJob* const job) {
+  if (job->next_index_ >= job->count_) {
+    return false;
+  }
+
+  const int32 index = job->next_index_++;
+
+  if (job->next_index_ == job->count_) {
+    // Everything's been claimed, so the other threads can move on.
+    unlinkJob(job);
+  }
+
+  pthread_mutex_unlock(&mutex_);
+  job->task_(job->data_, index);
+  pthread_mutex_lock(&mutex_);
+
+  if (++job->num_done_ == job->count_) {
+    pthread_cond_broadcast(&work_done_);
+  }
+
+  return true;
+}
+
+
+void WorkerPool::unlinkJob(WorkerJob* const job) {
+  WorkerJob* previous = NULL;
+  WorkerJob* current = first_job_;
+
+  while (current != job) {
+    previous = current;
+    current = current->next_job_;
+  }
+
+  if (previous != NULL) {
+    previous->next_job_ = job->next_job_;
+  } else {
+    first_job_ = job->next_job_;
+  }
+
+  if (last_job_ == job) {
+    last_job_ = previous;
+  }
+
+  job->next_job_ = NULL;
+}
+
+
+void* WorkerPool::threadMain(void* const data) {
+  WorkerPool* const pool = static_cast<WorkerPool*>(data);
+
+  pthread_mutex_lock(&pool->mutex_);
+
+  while (true) {
+    if (pool->first_job_ != NULL) {
+      pool->runOneIndex(pool->first_job_);
+    } else if (pool->stopping_) {
+      break;
+    } else {
+      pthread_cond_wait(&pool->work_available_, &pool->mutex_);
+    }
+  }
+
+  pthread_mutex_unlock(&pool->mutex_);
+  return NULL;
+}
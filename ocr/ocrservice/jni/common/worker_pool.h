@@ -0,0 +1,127 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A small persistent pool of threads for running independent pieces of work
+// in parallel, either while the caller waits or in the background.
+
+#ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_WORKER_POOL_H_
+#define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_WORKER_POOL_H_
+
+#include <pthread.h>
+
+#include "types.h"
+
+// Upper bound on the number of threads a pool will start.
+#define MAX_WORKER_THREADS 4
+
+// Function run for each index of a job.
+typedef void (*WorkerTask)(void* const data, const int32 index);
+
+// A batch of work: task(data, i) is run once for every i in [0, count), in no
+// particular order and possibly concurrently. Jobs are owned by the caller and
+// must stay alive until they've been waited for.
+class WorkerJob {
+ public:
+  WorkerJob() :
+      task_(NULL),
+      data_(NULL),
+      count_(0),
+      next_index_(0),
+      num_done_(0),
+      next_job_(NULL) {}
+
+ private:
+  friend class WorkerPool;
+
+  WorkerTask task_;
+  void* data_;
+  int32 count_;
+
+  // Bookkeeping, guarded by the pool's mutex.
+  int32 next_index_;
+  int32 num_done_;
+  WorkerJob* next_job_;
+};
+
+class WorkerPool {
+ public:
+  // Starts up to num_threads threads. If none can be started, jobs are run on
+  // the calling thread.
+  explicit WorkerPool(const int32 num_threads);
+
+  // Waits for the threads to finish the queued jobs, then stops them.
+  ~WorkerPool();
+
+  // Queues a job and returns without waiting for it.
+  void start(WorkerJob* const job, const WorkerTask task, void* const data,
+             const int32 count);
+
+  // Blocks until every index of a started job has been run. The calling
+  // thread helps out with any indices not yet claimed.
+  void wait(WorkerJob* const job);
+
+  // Runs task(data, i) for every i in [0, count) and returns when all are done.
+  void run(const WorkerTask task, void* const data, const int32 count) {
+    WorkerJob job;
+    start(&job, task, data, count);
+    wait(&job);
+  }
+
+  // The number of threads a job can be spread across, including the caller.
+  inline int32 getParallelism() const {
+    return num_threads_ + 1;
+  }
+
+  // A thread count suited to the number of processors, leaving one for the
+  // caller.
+  static int32 getDefaultThreadCount();
+
+  // The pool every part of the process shares, so that the threads running
+  // at once stay within the number of processors. Created with the default
+  // thread count on first use, and kept for the life of the process. Jobs may
+  // be run on it from within its own tasks.
+  static WorkerPool* getShared();
+
+ private:
+  static void* threadMain(void* const pool);
+
+  static void createShared();
+
+  static WorkerPool* shared_;
+  static pthread_once_t shared_once_;
+
+  // Claims and runs one index of the job. Must be called with the mutex held,
+  // which is released while the task runs. Returns false if nothing was left
+  // to claim.
+  bool runOneIndex(WorkerJob* const job);
+
+  void unlinkJob(WorkerJob* const job);
+
+  pthread_t threads_[MAX_WORKER_THREADS];
+  int32 num_threads_;
+
+  pthread_mutex_t mutex_;
+  pthread_cond_t work_available_;
+  pthread_cond_t work_done_;
+
+  // Jobs with indices still to be claimed, oldest first.
+  WorkerJob* first_job_;
+  WorkerJob* last_job_;
+
+  bool stopping_;
+};
+
+#endif  // JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_COMMON_WORKER_POOL_H_
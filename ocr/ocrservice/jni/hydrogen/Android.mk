@@ -20,7 +20,11 @@ LOCAL_SRC_FILES += \
 
 LOCAL_C_INCLUDES += \
   $(LOCAL_PATH)/src \
-  $(LOCAL_PATH)/include/leptonica
+  $(LOCAL_PATH)/include/leptonica \
+  $(LOCAL_PATH)/../common
+
+LOCAL_STATIC_LIBRARIES += \
+  common
 
 LOCAL_LDLIBS += \
   -llog
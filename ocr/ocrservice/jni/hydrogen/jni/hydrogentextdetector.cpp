@@ -16,6 +16,7 @@
 
 #include "common.h"
 #include "hydrogentextdetector.h"
+#include "stage_timer_jni.h"
 
 #define DEBUG_MODE false
 
@@ -257,6 +258,22 @@ void Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeClear(
   ptr->Clear();
 }
 
+jfloatArray Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeGetStageTimes(
+    JNIEnv *env,
+    jclass clazz) {
+  if (DEBUG_MODE) LOGV(__FUNCTION__);
+
+  return getStageSummariesArray(env);
+}
+
+jobjectArray Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeGetStageNames(
+    JNIEnv *env,
+    jclass clazz) {
+  if (DEBUG_MODE) LOGV(__FUNCTION__);
+
+  return getStageNamesArray(env);
+}
+
 #ifdef __cplusplus
 }
 #endif  /* __cplusplus */
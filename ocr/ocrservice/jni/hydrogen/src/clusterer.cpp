@@ -15,6 +15,9 @@
  */
 
 #include <malloc.h>
+#include <math.h>
+#include <string.h>
+
 #include "leptonica.h"
 #include "clusterer.h"
 #include "validator.h"
@@ -255,12 +258,163 @@ l_int32 MergePairFragments(PIX *pix8, PIXA *clusters, PIXA *pixa, l_uint8 *remov
   return count;
 }
 
+/* Components are sorted into horizontal bands of about this many average
+ * component heights.
+ */
+#define BAND_HEIGHT_RATIO 1.0
+
+/* An index of components by vertical extent. The image is cut into horizontal
+ * bands, and each component is listed in every band that its extent touches,
+ * so only components listed in a shared band can share an edge. Each band
+ * lists its components in index order, which is also left-to-right order.
+ */
+struct BandIndex {
+  l_int32 top;
+  l_int32 band_h;
+  l_int32 nbands;
+  /* members[starts[b]] to members[starts[b + 1] - 1] are listed in band b */
+  l_int32 *starts;
+  l_int32 *members;
+  /* First and last band of each component */
+  l_int32 *first;
+  l_int32 *last;
+};
+
+static void BandIndexDestroy(BandIndex **pindex) {
+  BandIndex *index = *pindex;
+
+  free(index->starts);
+  free(index->members);
+  free(index->first);
+  free(index->last);
+  free(index);
+
+  *pindex = NULL;
+}
+
+/*
+ *  Indexes the components of pixa that aren't removed. The vertical extent of
+ *  a component with box (y, h) runs from y + h * min(0, edge) to
+ *  y + h * max(1, edge), covering both its box and any edge a validator
+ *  measures as a fraction edge of its height. Returns NULL if memory runs
+ *  out.
+ */
+static BandIndex *BandIndexCreate(PIXA *pixa, l_uint8 *remove, l_float32 edge) {
+  l_int32 n, i, b, y, h, lo, hi, total_h, count, bottom;
+  l_int32 *fill;
+  BandIndex *index;
+
+  PROCNAME("BandIndexCreate");
+
+  n = pixaGetCount(pixa);
+
+  if ((index = (BandIndex *) calloc(1, sizeof(BandIndex))) == NULL)
+    return (BandIndex *) ERROR_PTR("index not made", procName, NULL);
+
+  index->first = (l_int32 *) malloc(n * sizeof(l_int32));
+  index->last = (l_int32 *) malloc(n * sizeof(l_int32));
+  if (!index->first || !index->last) {
+    BandIndexDestroy(&index);
+    return (BandIndex *) ERROR_PTR("extents not made", procName, NULL);
+  }
+
+  /* Compute extents, padded by a pixel to absorb float rounding in the
+   * validators.
+   */
+  index->top = 0;
+  bottom = 0;
+  total_h = 0;
+  count = 0;
+  for (i = 0; i < n; i++) {
+    pixaGetBoxGeometry(pixa, i, NULL, &y, NULL, &h);
+    index->first[i] = y + (l_int32) floor(h * L_MIN(0.0, edge)) - 1;
+    index->last[i] = y + (l_int32) ceil(h * L_MAX(1.0, edge)) + 1;
+
+    if (remove[i])
+      continue;
+
+    if (count == 0 || index->first[i] < index->top)
+      index->top = index->first[i];
+    if (count == 0 || index->last[i] > bottom)
+      bottom = index->last[i];
+    total_h += h;
+    count++;
+  }
+
+  index->band_h = L_MAX(1, (l_int32) (BAND_HEIGHT_RATIO * total_h / L_MAX(1, count)));
+  index->nbands = (bottom - index->top) / index->band_h + 1;
+
+  /* Convert extents to band numbers, then count members of each band */
+  if ((index->starts = (l_int32 *) calloc(index->nbands + 1, sizeof(l_int32))) == NULL) {
+    BandIndexDestroy(&index);
+    return (BandIndex *) ERROR_PTR("starts not made", procName, NULL);
+  }
+
+  for (i = 0; i < n; i++) {
+    lo = (index->first[i] - index->top) / index->band_h;
+    hi = (index->last[i] - index->top) / index->band_h;
+    index->first[i] = L_MAX(0, lo);
+    index->last[i] = L_MIN(index->nbands - 1, hi);
+
+    if (remove[i])
+      continue;
+
+    for (b = index->first[i]; b <= index->last[i]; b++)
+      index->starts[b + 1]++;
+  }
+
+  for (b = 0; b < index->nbands; b++)
+    index->starts[b + 1] += index->starts[b];
+
+  /* Fill bands in index order */
+  index->members = (l_int32 *) malloc(L_MAX(1, index->starts[index->nbands]) * sizeof(l_int32));
+  fill = (l_int32 *) malloc(index->nbands * sizeof(l_int32));
+  if (!index->members || !fill) {
+    free(fill);
+    BandIndexDestroy(&index);
+    return (BandIndex *) ERROR_PTR("members not made", procName, NULL);
+  }
+
+  memcpy(fill, index->starts, index->nbands * sizeof(l_int32));
+  for (i = 0; i < n; i++) {
+    if (remove[i])
+      continue;
+
+    for (b = index->first[i]; b <= index->last[i]; b++)
+      index->members[fill[b]++] = i;
+  }
+  free(fill);
+
+  return index;
+}
+
+/*
+ *  Returns the position in members of the first component listed in band b
+ *  with an index greater than i.
+ */
+static l_int32 BandIndexFirstAfter(BandIndex *index, l_int32 b, l_int32 i) {
+  l_int32 lo = index->starts[b];
+  l_int32 hi = index->starts[b + 1];
+
+  while (lo < hi) {
+    l_int32 mid = (lo + hi) / 2;
+
+    if (index->members[mid] <= i)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
 l_int32 RemoveInvalidPairs(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove,
                            HydrogenTextDetector::TextDetectorParameters &params) {
-  l_int32 i, j, n, count;
+  l_int32 i, j, k, b, n, count, partner;
   l_float32 pair_conf;
   l_uint8 *has_partner;
   BOX *b1, *b2;
+  BandIndex *index;
 
   PROCNAME("pixRemoveInvalidPairs");
 
@@ -276,41 +430,61 @@ l_int32 RemoveInvalidPairs(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove,
     return 0;
   }
 
-  has_partner = (l_uint8 *) calloc(n, sizeof(l_uint8));
+  if ((has_partner = (l_uint8 *) calloc(n, sizeof(l_uint8))) == NULL)
+    return ERROR_INT("has_partner not made", procName, -1);
+
   count = 0;
 
+  /* Partners must overlap vertically */
+  if ((index = BandIndexCreate(pixa, remove, 1.0)) == NULL) {
+    free(has_partner);
+    return ERROR_INT("index not made", procName, -1);
+  }
+
   for (i = 0; i < n; i++) {
     if (remove[i])
       continue;
 
     b1 = pixaGetBox(pixa, i, L_CLONE);
 
-    /* Search right for a partner for i */
-    for (j = i + 1; j < n; j++) {
-      if (remove[j])
-        continue;
+    /* Search right for the first partner for i, which may be listed in any
+     * of the bands i is.
+     */
+    partner = -1;
+    for (b = index->first[i]; b <= index->last[i]; b++) {
+      for (k = BandIndexFirstAfter(index, b, i); k < index->starts[b + 1]; k++) {
+        j = index->members[k];
 
-      b2 = pixaGetBox(pixa, j, L_CLONE);
+        if (partner >= 0 && j >= partner)
+          break;
 
-      /* Check whether this is a valid pair */
-      if (!ValidatePair(b1, b2, &pair_conf, params)) {
-        boxDestroy(&b2);
-        continue;
-      }
+        b2 = pixaGetBox(pixa, j, L_CLONE);
 
-      // We don't need to adjust confidence values here, since we'll
-      // generate cluster pairs and use those later.
+        /* Check whether this is a valid pair */
+        if (ValidatePair(b1, b2, &pair_conf, params)) {
+          partner = j;
+        }
+
+        // We don't need to adjust confidence values here, since we'll
+        // generate cluster pairs and use those later.
 
-      boxDestroy(&b2);
+        boxDestroy(&b2);
+
+        if (partner == j)
+          break;
+      }
+    }
 
+    if (partner >= 0) {
       has_partner[i] = 1;
-      has_partner[j] = 1;
-      break;
+      has_partner[partner] = 1;
     }
 
     boxDestroy(&b1);
   }
 
+  BandIndexDestroy(&index);
+
   for (i = 0; i < n; i++) {
     if (!has_partner[i]) {
       remove[i] = 1;
@@ -328,13 +502,14 @@ l_int32 RemoveInvalidPairs(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove,
 
 l_int32 GenerateClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove, l_int32 **pleft,
                                 l_int32 **pright, HydrogenTextDetector::TextDetectorParameters &params) {
-  l_int32 n, i, j;
+  l_int32 n, i, j, k, b;
   l_int32 xi, yi, wi, hi, maxd;
   l_int32 xj, yj, wj, hj;
   l_int32 dx, dy, d, mind, minj;
   l_int32 *left, *right;
   l_float32 clusterpair_conf, minconf;
   BOX *b1, *b2;
+  BandIndex *index;
   bool too_far;
 
   PROCNAME("GenerateClusterPartners");
@@ -361,6 +536,11 @@ l_int32 GenerateClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *rem
 
   left = (l_int32 *) malloc(n * sizeof(l_int32));
   right = (l_int32 *) malloc(n * sizeof(l_int32));
+  if (!left || !right) {
+    free(left);
+    free(right);
+    return ERROR_INT("left and right not made", procName, -1);
+  }
 
   /* Initialize left and right arrays */
   for (i = 0; i < n; i++) {
@@ -368,6 +548,13 @@ l_int32 GenerateClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *rem
     right[i] = -2;
   }
 
+  /* Neighbors must share part of a vertical edge */
+  if ((index = BandIndexCreate(pixa, remove, params.cluster_shared_edge)) == NULL) {
+    free(left);
+    free(right);
+    return ERROR_INT("index not made", procName, -1);
+  }
+
   /* For each component, check all possible neighbors to find the most likely
    * right neighbor. If that right neighbor already has a left neighbor, insert
    * the component to the right of the existing neighbor and the left of the
@@ -384,36 +571,49 @@ l_int32 GenerateClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *rem
     maxd = L_MAX(wi, hi);
     minconf = 0.0;
 
-    /* Search for closest right neighbor */
-    for (j = i + 1; j < n; j++) {
-      if (remove[j])
-        continue;
-
-      pixaGetBoxGeometry(pixa, j, &xj, &yj, &wj, &hj);
-      b2 = pixaGetBox(pixa, j, L_CLONE);
+    /* Search for closest right neighbor, visiting each candidate only in the
+     * first band it shares with i.
+     */
+    for (b = index->first[i]; b <= index->last[i]; b++) {
+      for (k = BandIndexFirstAfter(index, b, i); k < index->starts[b + 1]; k++) {
+        j = index->members[k];
 
-      if (!ValidateClusterPair(b1, b2, &too_far, &clusterpair_conf, params)) {
-        if (too_far)
-          break;
-        else
+        if (L_MAX(index->first[i], index->first[j]) != b)
           continue;
-      }
 
-      /* calculate spacing between i and j */
-      dx = xj - (xi + wi);
-      dy = (yj + hj) - (yi + hi);
-      d = dx * dx + dy * dy;
-
-      /* If we haven't found a neighbor OR we're the closest neighbor, update
-       * i's record for most likely neighbor.
-       */
-      if (mind < 0 || d < mind) {
-        mind = d;
-        minj = j;
-        minconf = clusterpair_conf;
+        pixaGetBoxGeometry(pixa, j, &xj, &yj, &wj, &hj);
+        b2 = pixaGetBox(pixa, j, L_CLONE);
+
+        if (!ValidateClusterPair(b1, b2, &too_far, &clusterpair_conf, params)) {
+          boxDestroy(&b2);
+
+          /* Candidates are sorted by x, so the rest are too far as well */
+          if (too_far)
+            break;
+          else
+            continue;
+        }
+
+        boxDestroy(&b2);
+
+        /* calculate spacing between i and j */
+        dx = xj - (xi + wi);
+        dy = (yj + hj) - (yi + hi);
+        d = dx * dx + dy * dy;
+
+        /* If we haven't found a neighbor OR we're the closest neighbor, update
+         * i's record for most likely neighbor. Ties go to the leftmost.
+         */
+        if (mind < 0 || d < mind || (d == mind && j < minj)) {
+          mind = d;
+          minj = j;
+          minconf = clusterpair_conf;
+        }
       }
     }
 
+    boxDestroy(&b1);
+
     /* If we found a valid neighbor, go ahead and use it. */
     if (mind >= 0) {
       j = left[minj];
@@ -436,6 +636,8 @@ l_int32 GenerateClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *rem
     }
   }
 
+  BandIndexDestroy(&index);
+
   *pleft = left;
   *pright = right;
 
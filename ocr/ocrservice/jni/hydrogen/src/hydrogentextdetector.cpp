@@ -23,18 +23,50 @@
 #include "clusterer.h"
 #include "thresholder.h"
 #include "utilities.h"
+#include "stage_timer.h"
+
+/* Input and results of one polarity pass of ExtractTextRegions() */
+struct PolarityPass {
+  HydrogenTextDetector *detector;
+  PIX *pix8;
+  PIX *edges;
+  char debug_prefix[255];
+  PIXA *clusters;
+  NUMA *confs;
+};
+
+/* Stages timed in the latency histograms of stage_timer.h */
+static const int32 kEdgeStage = getStageId("Edge thresholding");
+static const int32 kSkewStage = getStageId("Skew correction");
+static const int32 kExtractStage = getStageId("Text region extraction");
+static const int32 kPolarityPassStage = getStageId("Polarity pass");
+static const int32 kDetectTextStage = getStageId("DetectText()");
 
 HydrogenTextDetector::HydrogenTextDetector() {
   pixs_ = NULL;
   text_areas_ = NULL;
   text_confs_ = NULL;
+  worker_pool_ = WorkerPool::getShared();
 }
 
 HydrogenTextDetector::~HydrogenTextDetector() {
   Clear();
 }
 
-PIXA *HydrogenTextDetector::ExtractTextRegions(PIX *pix8, PIX *edges, NUMA **pconfs) {
+void HydrogenTextDetector::SetWorkerPool(WorkerPool *pool) {
+  worker_pool_ = pool;
+}
+
+void HydrogenTextDetector::ExtractTextRegionsTask(void *data, const int32 index) {
+  PolarityPass *pass = (PolarityPass *) data + index;
+  ScopedTimer timer(kPolarityPassStage);
+
+  pass->clusters = pass->detector->ExtractTextRegions(pass->pix8, pass->edges, pass->debug_prefix,
+                                                      &pass->confs);
+}
+
+PIXA *HydrogenTextDetector::ExtractTextRegions(PIX *pix8, PIX *edges, const char *debug_prefix,
+                                               NUMA **pconfs) {
   l_int32 result;
 
   if (parameters_.debug) fprintf(stderr, "ExtractTextRegions()\n");
@@ -44,7 +76,6 @@ PIXA *HydrogenTextDetector::ExtractTextRegions(PIX *pix8, PIX *edges, NUMA **pco
     return NULL;
   }
 
-  clock_t timer = clock();
   NUMA *connconfs;
   PIXA *conncomp;
 
@@ -56,7 +87,7 @@ PIXA *HydrogenTextDetector::ExtractTextRegions(PIX *pix8, PIX *edges, NUMA **pco
   if (parameters_.debug && parameters_.out_dir[0] != '\0' && result > 0) {
     PIX *temp = pixaDisplayHeatmap(conncomp, pix8->w, pix8->h, connconfs);
     char filename[255];
-    sprintf(filename, "%s/%d_validsingles.jpg", parameters_.out_dir, (int) timer);
+    sprintf(filename, "%s_validsingles.jpg", debug_prefix);
     pixWriteImpliedFormat(filename, temp, 85, 0);
   }
 
@@ -71,7 +102,7 @@ PIXA *HydrogenTextDetector::ExtractTextRegions(PIX *pix8, PIX *edges, NUMA **pco
   if (parameters_.debug && parameters_.out_dir[0] != '\0' && result > 0) {
     PIX *temp = pixaDisplayRandomCmapFiltered(conncomp, pix8->w, pix8->h, remove);
     char filename[255];
-    sprintf(filename, "%s/%d_validpairs.jpg", parameters_.out_dir, (int) timer);
+    sprintf(filename, "%s_validpairs.jpg", debug_prefix);
     pixWriteImpliedFormat(filename, temp, 85, 0);
   }
 
@@ -85,7 +116,7 @@ PIXA *HydrogenTextDetector::ExtractTextRegions(PIX *pix8, PIX *edges, NUMA **pco
   if (parameters_.debug && parameters_.out_dir[0] != '\0' && result > 0) {
     PIX *temp = pixaDisplayHeatmap(clusters, pix8->w, pix8->h, clusterconfs);
     char filename[255];
-    sprintf(filename, "%s/%d_validclusters.jpg", parameters_.out_dir, (int) timer);
+    sprintf(filename, "%s_validclusters.jpg", debug_prefix);
     pixWriteImpliedFormat(filename, temp, 85, 0);
   }
 
@@ -150,6 +181,9 @@ void HydrogenTextDetector::DetectText() {
 
   clock_t timer = clock();
 
+  const int64 start_us = currentTimeMicros();
+  startStageLap();
+
   PIX *pix8 = pixConvertTo8(pixs_, false);
 
   if (parameters_.debug && parameters_.out_dir[0] != '\0') {
@@ -160,7 +194,10 @@ void HydrogenTextDetector::DetectText() {
 
   PIX *edges;
   pixEdgeAdaptiveThreshold(pix8, &edges, parameters_.edge_tile_x, parameters_.edge_tile_y,
-                           parameters_.edge_thresh, parameters_.edge_avg_thresh);
+                           parameters_.edge_thresh, parameters_.edge_avg_thresh, worker_pool_);
+
+  l_int32 edge_millis = (l_int32) (lapStage(kEdgeStage) / 1000);
+  if (parameters_.debug) fprintf(stderr, "Edge thresholding took %d ms\n", edge_millis);
 
   if (parameters_.debug && parameters_.out_dir[0] != '\0') {
     char filename[255];
@@ -173,6 +210,9 @@ void HydrogenTextDetector::DetectText() {
   PIX *deskew = DetectAndFixSkew(edges);
   pixDestroy(&edges);
 
+  l_int32 skew_millis = (l_int32) (lapStage(kSkewStage) / 1000);
+  if (parameters_.debug) fprintf(stderr, "Skew correction took %d ms\n", skew_millis);
+
   if (parameters_.debug && parameters_.out_dir[0] != '\0') {
     char filename[255];
     sprintf(filename, "%s/%d_deskew.jpg", parameters_.out_dir, (int) timer);
@@ -182,22 +222,41 @@ void HydrogenTextDetector::DetectText() {
     pixDestroy(&deskew8);
   }
 
-  NUMA *confs;
-  PIXA *clusters = ExtractTextRegions(pix8, deskew, &confs);
+  // Text may be dark on light or light on dark, so look for it in both the
+  // edge image and its inverse. The two passes are independent, and each has
+  // its own copy of every image it uses, since leptonica doesn't lock them.
+  // Their debug images are told apart by polarity.
+  static const char *const kPolarityNames[2] = { "dark", "light" };
+
+  PolarityPass passes[2];
+  passes[0].pix8 = pix8;
+  passes[0].edges = deskew;
+  passes[1].pix8 = pixCopy(NULL, pix8);
+  passes[1].edges = pixInvert(NULL, deskew);
+
+  for (int i = 0; i < 2; i++) {
+    passes[i].detector = this;
+    snprintf(passes[i].debug_prefix, sizeof(passes[i].debug_prefix), "%s/%d_%s",
+             parameters_.out_dir, (int) timer, kPolarityNames[i]);
+  }
 
-  if (parameters_.debug) fprintf(stderr, "Inverting image...\n");
-  pixInvert(deskew, deskew);
+  worker_pool_->run(ExtractTextRegionsTask, passes, 2);
 
-  NUMA *invconfs;
-  PIXA *invclusters = ExtractTextRegions(pix8, deskew, &invconfs);
+  l_int32 extract_millis = (l_int32) (lapStage(kExtractStage) / 1000);
+  if (parameters_.debug) fprintf(stderr, "Text region extraction took %d ms\n", extract_millis);
+
+  pixDestroy(&passes[1].edges);
+  pixDestroy(&passes[1].pix8);
   pixDestroy(&deskew);
   pixDestroy(&pix8);
 
-  pixaJoin(clusters, invclusters, 0, 0);
-  pixaDestroy(&invclusters);
+  PIXA *clusters = passes[0].clusters;
+  pixaJoin(clusters, passes[1].clusters, 0, 0);
+  pixaDestroy(&passes[1].clusters);
 
-  numaJoin(confs, invconfs);
-  numaDestroy(&invconfs);
+  NUMA *confs = passes[0].confs;
+  numaJoin(confs, passes[1].confs);
+  numaDestroy(&passes[1].confs);
 
   text_areas_ = pixaCopy(clusters, L_CLONE);
   pixaDestroy(&clusters);
@@ -211,6 +270,9 @@ void HydrogenTextDetector::DetectText() {
     sprintf(filename, "%s/heatmap.jpg", parameters_.out_dir);
     pixWriteImpliedFormat(filename, temp, 85, 0);
   }
+
+  l_int32 total_millis = (l_int32) (recordStageTime(kDetectTextStage, start_us) / 1000);
+  if (parameters_.debug) fprintf(stderr, "DetectText() took %d ms\n", total_millis);
 }
 
 void HydrogenTextDetector::Clear() {
@@ -18,6 +18,7 @@
 #define HYDROGEN_HYDROGENTEXTDETECTOR_H_
 
 #include "leptonica.h"
+#include "worker_pool.h"
 
 class HydrogenTextDetector {
 public:
@@ -129,6 +130,10 @@ public:
 
   TextDetectorParameters *GetMutableParameters();
 
+  // Sets the threads detection runs on, which default to the process-wide
+  // pool. A pool without threads runs every stage on the calling thread.
+  void SetWorkerPool(WorkerPool *pool);
+
 private:
   TextDetectorParameters parameters_;
 
@@ -140,9 +145,15 @@ private:
   NUMA *text_confs_;
   // Detected skew angle
   l_float32 skew_angle_;
+  // Threads shared by the detection stages, not owned
+  WorkerPool *worker_pool_;
 
   // Function to extract text areas from a PIX
-  PIXA *ExtractTextRegions(PIX *pix8, PIX *edges, NUMA **pconfs);
+  // Debug images are written to files starting with debug_prefix.
+  PIXA *ExtractTextRegions(PIX *pix8, PIX *edges, const char *debug_prefix, NUMA **pconfs);
+
+  // Worker task running one polarity pass of ExtractTextRegions
+  static void ExtractTextRegionsTask(void *data, const int32 index);
 
   // Function to detect and fix text skew
   PIX *DetectAndFixSkew(PIX *pixs);
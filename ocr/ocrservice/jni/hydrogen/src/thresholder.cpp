@@ -15,9 +15,69 @@
  */
 
 #include <math.h>
+#include <stdlib.h>
 
 #include "leptonica.h"
 #include "thresholder.h"
+#include "worker_pool.h"
+
+/* Tiles thresholded by one call, along with their parameters */
+struct TileThresholdJob {
+  PIXTILING *pt;
+  l_int32 nx;
+  l_float32 score_fract;
+  l_float32 fdr_thresh;
+  l_int32 edge_thresh;
+  l_int32 edge_avg_thresh;
+
+  /* Binarized tiles in row order, or NULL where a tile is left blank */
+  PIX **tiles;
+};
+
+/*
+ *  Runs task over count tiles, on pool if there is one.
+ */
+static void RunTileJob(WorkerPool *pool, WorkerTask task, TileThresholdJob *job,
+                       l_int32 count) {
+  if (pool) {
+    pool->run(task, job, count);
+  } else {
+    for (l_int32 i = 0; i < count; i++)
+      task(job, i);
+  }
+}
+
+/*
+ *  Paints the binarized tiles of a job into pixd, in row order, and destroys
+ *  them. Tiles may share words of pixd, so this is never done concurrently.
+ */
+static void PaintTiles(PIX *pixd, TileThresholdJob *job, l_int32 ny) {
+  for (l_int32 y = 0; y < ny; y++) {
+    for (l_int32 x = 0; x < job->nx; x++) {
+      PIX **pixb = &job->tiles[y * job->nx + x];
+
+      if (*pixb) {
+        pixTilingPaintTile(pixd, y, x, *pixb, job->pt);
+        pixDestroy(pixb);
+      }
+    }
+  }
+}
+
+static void FisherThresholdTile(void *data, const int32 index) {
+  TileThresholdJob *job = (TileThresholdJob *) data;
+  l_float32 fdr;
+  l_int32 t;
+  PIX *pixt;
+
+  pixt = pixTilingGetTile(job->pt, index / job->nx, index % job->nx);
+  pixGetFisherThresh(pixt, job->score_fract, &fdr, &t);
+
+  if (fdr > job->fdr_thresh)
+    job->tiles[index] = pixThresholdToBinary(pixt, t);
+
+  pixDestroy(&pixt);
+}
 
 /*!
  *  pixFisherAdaptiveThreshold()
@@ -27,14 +87,15 @@
  *              sx, sy (desired tile dimensions; actual size may vary)
  *              scorefract (fraction of the max Otsu score; typ. 0.1)
  *              fdrthresh (threshold for Fisher's Discriminant Rate; typ. 5.0)
+ *              pool (<optional> tiles are thresholded in parallel on this)
  *      Return: 0 if OK, 1 on error
  */
 l_int32 pixFisherAdaptiveThreshold(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int32 tile_y,
-                                l_float32 score_fract, l_float32 thresh) {
-  l_float32 fdr;
-  l_int32 w, h, d, nx, ny, x, y, t;
-  PIX *pixb, *pixd, *pixt;
+                                l_float32 score_fract, l_float32 thresh, WorkerPool *pool) {
+  l_int32 w, h, d, nx, ny;
+  PIX *pixd;
   PIXTILING *pt;
+  TileThresholdJob job;
 
   PROCNAME("pixFisherAdaptiveThreshold");
 
@@ -53,20 +114,15 @@ l_int32 pixFisherAdaptiveThreshold(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int
   ny = L_MAX(1, h / tile_y);
   pt = pixTilingCreate(pixs, nx, ny, 0, 0, 0, 0);
   pixd = pixCreate(w, h, 1);
-  for (y = 0; y < ny; y++) {
-    for (x = 0; x < nx; x++) {
-      pixt = pixTilingGetTile(pt, y, x);
-      pixGetFisherThresh(pixt, score_fract, &fdr, &t);
-
-      if (fdr > thresh) {
-        pixb = pixThresholdToBinary(pixt, t);
-        pixTilingPaintTile(pixd, y, x, pixb, pt);
-        pixDestroy(&pixb);
-      }
 
-      pixDestroy(&pixt);
-    }
-  }
+  job.pt = pt;
+  job.nx = nx;
+  job.score_fract = score_fract;
+  job.fdr_thresh = thresh;
+  job.tiles = (PIX **) calloc(nx * ny, sizeof(PIX *));
+  RunTileJob(pool, FisherThresholdTile, &job, nx * ny);
+  PaintTiles(pixd, &job, ny);
+  free(job.tiles);
 
   pixTilingDestroy(&pt);
 
@@ -321,6 +377,22 @@ l_uint8 pixEdgeMax(PIX *pixs, l_int32 *pmax, l_int32 *pavg) {
   return 0;
 }
 
+static void EdgeThresholdTile(void *data, const int32 index) {
+  TileThresholdJob *job = (TileThresholdJob *) data;
+  l_int32 t, max, avg;
+  PIX *pixt;
+
+  pixt = pixTilingGetTile(job->pt, index / job->nx, index % job->nx);
+  pixEdgeMax(pixt, &max, &avg);
+
+  if (max > job->edge_thresh && avg > job->edge_avg_thresh) {
+    pixSplitDistributionFgBg(pixt, 0.0, 1, &t, NULL, NULL, 0);
+    job->tiles[index] = pixThresholdToBinary(pixt, t);
+  }
+
+  pixDestroy(&pixt);
+}
+
 /*!
  *  pixEdgeAdaptiveThreshold()
  *
@@ -329,13 +401,15 @@ l_uint8 pixEdgeMax(PIX *pixs, l_int32 *pmax, l_int32 *pavg) {
  *              tile_x, tile_y (desired tile dimensions; actual size may vary)
  *              thresh
  *              avg_thresh
+ *              pool (<optional> tiles are thresholded in parallel on this)
  *      Return: 0 if OK, 1 on error
  */
 l_uint8 pixEdgeAdaptiveThreshold(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int32 tile_y,
-                                  l_int32 thresh, l_int32 avg_thresh) {
-  l_int32 w, h, d, nx, ny, x, y, t, max, avg;
-  PIX *pixb, *pixd, *pixt;
+                                  l_int32 thresh, l_int32 avg_thresh, WorkerPool *pool) {
+  l_int32 w, h, d, nx, ny;
+  PIX *pixd;
   PIXTILING *pt;
+  TileThresholdJob job;
 
   PROCNAME("pixEdgeAdaptiveThreshold");
 
@@ -354,21 +428,15 @@ l_uint8 pixEdgeAdaptiveThreshold(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int32
   ny = L_MAX(1, h / tile_y);
   pt = pixTilingCreate(pixs, nx, ny, 0, 0, 0, 0);
   pixd = pixCreate(w, h, 1);
-  for (y = 0; y < ny; y++) {
-    for (x = 0; x < nx; x++) {
-      pixt = pixTilingGetTile(pt, y, x);
-      pixEdgeMax(pixt, &max, &avg);
-
-      if (max > thresh && avg > avg_thresh) {
-        pixSplitDistributionFgBg(pixt, 0.0, 1, &t, NULL, NULL, 0);
-        pixb = pixThresholdToBinary(pixt, t);
-        pixTilingPaintTile(pixd, y, x, pixb, pt);
-        pixDestroy(&pixb);
-      }
 
-      pixDestroy(&pixt);
-    }
-  }
+  job.pt = pt;
+  job.nx = nx;
+  job.edge_thresh = thresh;
+  job.edge_avg_thresh = avg_thresh;
+  job.tiles = (PIX **) calloc(nx * ny, sizeof(PIX *));
+  RunTileJob(pool, EdgeThresholdTile, &job, nx * ny);
+  PaintTiles(pixd, &job, ny);
+  free(job.tiles);
 
   pixTilingDestroy(&pt);
 
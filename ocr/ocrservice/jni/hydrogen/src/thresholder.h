@@ -19,10 +19,13 @@
 
 #include "leptonica.h"
 
+class WorkerPool;
+
 l_int32 pixGetFisherThresh(PIX *pixs, l_float32 scorefract, l_float32 *pfdr, l_int32 *pthresh);
 
 l_int32 pixFisherAdaptiveThreshold(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int32 tile_y,
-                                l_float32 score_fract, l_float32 thresh);
+                                l_float32 score_fract, l_float32 thresh,
+                                WorkerPool *pool = NULL);
 
 PIX *pixThreshedSobelEdgeFilter(PIX *pixs, l_int32 threshold);
 
@@ -31,6 +34,7 @@ l_uint8 pixGradientEnergy(PIX *pixs, PIX *mask, l_float32 *pdensity);
 l_uint8 pixEdgeMax(PIX *pixs, l_int32 *pmax, l_int32 *pavg);
 
 l_uint8 pixEdgeAdaptiveThreshold(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int32 tile_y,
-                                 l_int32 thresh, l_int32 avg_thresh);
+                                 l_int32 thresh, l_int32 avg_thresh,
+                                 WorkerPool *pool = NULL);
 
 #endif /* HYDROGEN_THRESHOLDER_H_ */
@@ -14,6 +14,10 @@ ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
   LOCAL_STATIC_LIBRARIES += cpufeatures
 endif
 
+ifneq ($(filter x86 x86_64,$(TARGET_ARCH_ABI)),)
+  LOCAL_CFLAGS += -DHAVE_X86=1
+endif
+
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/../common
 
 LOCAL_STATIC_LIBRARIES += common
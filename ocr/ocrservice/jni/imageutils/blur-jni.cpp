@@ -22,6 +22,8 @@
 
 #include "types.h"
 #include "time_log.h"
+#include "direct_buffer.h"
+#include "stage_timer_jni.h"
 #include "blur.h"
 
 #ifdef __cplusplus
@@ -32,6 +34,19 @@ JNIEXPORT jboolean JNICALL
 Java_com_googlecode_eyesfree_opticflow_ImageBlur_isBlurred(
     JNIEnv* env, jclass clazz, jbyteArray input, jint width, jint height);
 
+JNIEXPORT jboolean JNICALL
+Java_com_googlecode_eyesfree_opticflow_ImageBlur_isBlurredDirect(
+    JNIEnv* env, jclass clazz, jobject input, jint width, jint height,
+    jint rowStride);
+
+JNIEXPORT jfloatArray JNICALL
+Java_com_googlecode_eyesfree_opticflow_ImageBlur_getStageTimes(
+    JNIEnv* env, jclass clazz);
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_googlecode_eyesfree_opticflow_ImageBlur_getStageNames(
+    JNIEnv* env, jclass clazz);
+
 #ifdef __cplusplus
 }
 #endif
@@ -47,7 +62,7 @@ Java_com_googlecode_eyesfree_opticflow_ImageBlur_isBlurred(
 
   resetTimeLog();
   int blurred = IsBlurred(reinterpret_cast<uint8*>(i),
-                          width, height, &blur, &extent);
+                          width, height, width, &blur, &extent);
   timeLog("Finished image blur detection");
   printTimeLog();
 
@@ -55,3 +70,35 @@ Java_com_googlecode_eyesfree_opticflow_ImageBlur_isBlurred(
 
   return blurred ? JNI_TRUE : JNI_FALSE;
 }
+
+JNIEXPORT jboolean JNICALL
+Java_com_googlecode_eyesfree_opticflow_ImageBlur_isBlurredDirect(
+    JNIEnv* env, jclass clazz, jobject input, jint width, jint height,
+    jint rowStride) {
+  const uint8* const i = getDirectFrame(env, input, width, height, rowStride);
+  if (i == NULL) {
+    return JNI_FALSE;
+  }
+
+  float blur = 0;
+  float extent = 0;
+
+  resetTimeLog();
+  int blurred = IsBlurred(i, width, height, rowStride, &blur, &extent);
+  timeLog("Finished image blur detection");
+  printTimeLog();
+
+  return blurred ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jfloatArray JNICALL
+Java_com_googlecode_eyesfree_opticflow_ImageBlur_getStageTimes(
+    JNIEnv* env, jclass clazz) {
+  return getStageSummariesArray(env);
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_googlecode_eyesfree_opticflow_ImageBlur_getStageNames(
+    JNIEnv* env, jclass clazz) {
+  return getStageNamesArray(env);
+}
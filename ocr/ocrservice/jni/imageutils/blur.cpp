@@ -19,8 +19,8 @@
 // This library contains image processing method to detect
 // image blurriness.
 //
-// This library is *not* thread safe because static memory is
-// used for performance.
+// Scratch memory is allocated per call, so the detector may be run
+// from several threads at once.
 //
 // A method to detect whether a given image is blurred or not.
 // The algorithm is based on H. Tong, M. Li, H. Zhang, J. He,
@@ -29,13 +29,16 @@
 //
 // To achieve better performance on client side, the method
 // is running on four 128x128 portions which compose the 256x256
-// central area of the given image. On Nexus One, average time
-// to process a single image is ~5 milliseconds.
+// central area of the given image. The four portions are processed
+// in parallel where more than one core is available. On Nexus One,
+// average time to process a single image is ~5 milliseconds.
 
 #include <math.h>
+#include <string.h>
 
 #include "blur.h"
 #include "utils.h"
+#include "worker_pool.h"
 
 static const int kDecomposition = 3;
 static const int kThreshold = 35;
@@ -44,81 +47,151 @@ static const float kMinZero = 0.05;
 static const int kMaximumWidth = 256;
 static const int kMaximumHeight = 256;
 
-static int32 _smatrix[kMaximumWidth * kMaximumHeight];
-static int32 _arow[kMaximumWidth > kMaximumHeight ?
-    kMaximumWidth : kMaximumHeight];
+// Number of adjacent columns transformed together by the vector code.
+static const int kStripWidth = 4;
+
+// Size of the scratch buffer needed by the 1D transforms, enough for
+// a strip of kStripWidth full columns.
+static const int kBufferSize = kStripWidth *
+    (kMaximumWidth > kMaximumHeight ? kMaximumWidth : kMaximumHeight);
+
+#ifdef HAVE_X86
+// Halves each lane, rounding toward zero like integer division does.
+inline __m128i HalveTowardZero(const __m128i sum) {
+  return _mm_srai_epi32(_mm_add_epi32(sum, _mm_srli_epi32(sum, 31)), 1);
+}
+#endif
 
 // Does Haar Wavelet Transformation in place on a given row of a matrix.
 // The matrix is in size of matrix_height * matrix_width and represented
 // in a linear array. Parameter offset_row indicates transformation is
 // performed on which row. offset_column and num_columns indicate column
-// range of the given row.
+// range of the given row. An odd last column is left untouched. buffer
+// must hold at least num_columns values.
 inline void Haar1DX(int* matrix, int matrix_height, int matrix_width,
-    int offset_row, int offset_column, int num_columns) {
-  int32* ptr_a = _arow;
+    int offset_row, int offset_column, int num_columns, int32* buffer) {
   int32* ptr_matrix = matrix + offset_row * matrix_width + offset_column;
   int half_num_columns = num_columns / 2;
 
-  int32* a_tmp = ptr_a;
-  int32* matrix_tmp = ptr_matrix;
-  for (int j = 0; j < half_num_columns; ++j) {
-    *a_tmp++ = (matrix_tmp[0] + matrix_tmp[1]) / 2;
-    matrix_tmp += 2;
+  int j = 0;
+#ifdef HAVE_X86
+  for (; j + 4 <= half_num_columns; j += 4) {
+    const __m128 first = _mm_castsi128_ps(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(ptr_matrix + 2 * j)));
+    const __m128 second = _mm_castsi128_ps(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(ptr_matrix + 2 * j + 4)));
+
+    const __m128i even = _mm_castps_si128(
+        _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0)));
+    const __m128i odd = _mm_castps_si128(
+        _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1)));
+
+    const __m128i average = HalveTowardZero(_mm_add_epi32(even, odd));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(buffer + j), average);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(buffer + half_num_columns + j),
+        _mm_sub_epi32(even, average));
   }
+#endif
 
-  int32* average = ptr_a;
-  a_tmp = ptr_a + half_num_columns;
-  matrix_tmp = ptr_matrix;
-  for (int j = 0; j < half_num_columns; ++j) {
-    *a_tmp++ = *matrix_tmp - *average++;
-    matrix_tmp += 2;
+  for (; j < half_num_columns; ++j) {
+    const int32 average = (ptr_matrix[2 * j] + ptr_matrix[2 * j + 1]) / 2;
+    buffer[j] = average;
+    buffer[half_num_columns + j] = ptr_matrix[2 * j] - average;
   }
 
-  memcpy(ptr_matrix, ptr_a, sizeof(int32) * num_columns);
+  memcpy(ptr_matrix, buffer, sizeof(int32) * half_num_columns * 2);
 }
 
 // Does Haar Wavelet Transformation in place on a given column of a matrix.
+// An odd last row is left untouched. buffer must hold at least num_rows
+// values.
 inline void Haar1DY(int* matrix, int matrix_height, int matrix_width,
-    int offset_column, int offset_row, int num_rows) {
-  int32* ptr_a = _arow;
+    int offset_column, int offset_row, int num_rows, int32* buffer) {
   int32* ptr_matrix = matrix + offset_row * matrix_width + offset_column;
   int half_num_rows = num_rows / 2;
-  int two_line_width = matrix_width * 2;
 
-  int32* a_tmp = ptr_a;
-  int32* matrix_tmp = ptr_matrix;
+  const int32* matrix_tmp = ptr_matrix;
   for (int j = 0; j < half_num_rows; ++j) {
-    *a_tmp++ = (matrix_tmp[matrix_width] + matrix_tmp[0]) / 2;
-    matrix_tmp += two_line_width;
+    const int32 average = (matrix_tmp[matrix_width] + matrix_tmp[0]) / 2;
+    buffer[j] = average;
+    buffer[half_num_rows + j] = matrix_tmp[0] - average;
+    matrix_tmp += matrix_width * 2;
   }
 
-  int32* average = ptr_a;
-  a_tmp = ptr_a + half_num_rows;
-  matrix_tmp = ptr_matrix;
-  for (int j = 0; j < num_rows; j += 2) {
-    *a_tmp++ = *matrix_tmp - *average++;
-    matrix_tmp += two_line_width;
+  for (int j = 0; j < half_num_rows * 2; ++j) {
+    *ptr_matrix = buffer[j];
+    ptr_matrix += matrix_width;
+  }
+}
+
+#ifdef HAVE_X86
+// Same as Haar1DY, but for kStripWidth adjacent columns at once. buffer
+// must hold at least kStripWidth * num_rows values.
+inline void Haar1DYStrip(int* matrix, int matrix_height, int matrix_width,
+    int offset_column, int offset_row, int num_rows, int32* buffer) {
+  int32* ptr_matrix = matrix + offset_row * matrix_width + offset_column;
+  int half_num_rows = num_rows / 2;
+
+  const int32* matrix_tmp = ptr_matrix;
+  for (int j = 0; j < half_num_rows; ++j) {
+    const __m128i top =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(matrix_tmp));
+    const __m128i bottom = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(matrix_tmp + matrix_width));
+
+    const __m128i average = HalveTowardZero(_mm_add_epi32(bottom, top));
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(buffer + j * kStripWidth), average);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(
+        buffer + (half_num_rows + j) * kStripWidth),
+        _mm_sub_epi32(top, average));
+    matrix_tmp += matrix_width * 2;
   }
 
-  for (int j = 0; j < num_rows; ++j) {
-    *ptr_matrix = *ptr_a++;
+  for (int j = 0; j < half_num_rows * 2; ++j) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr_matrix),
+        _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(buffer + j * kStripWidth)));
     ptr_matrix += matrix_width;
   }
 }
+#endif
+
+// Does Haar Wavelet Transformation in place on every column within the
+// given area of a matrix.
+inline void HaarColumns(int* matrix, int matrix_height, int matrix_width,
+    int offset_column, int num_columns, int offset_row, int num_rows,
+    int32* buffer) {
+  int i = offset_column;
+
+#ifdef HAVE_X86
+  for (; i + kStripWidth <= offset_column + num_columns; i += kStripWidth) {
+    Haar1DYStrip(matrix, matrix_height, matrix_width,
+                 i, offset_row, num_rows, buffer);
+  }
+#endif
+
+  for (; i < offset_column + num_columns; ++i) {
+    Haar1DY(matrix, matrix_height, matrix_width,
+            i, offset_row, num_rows, buffer);
+  }
+}
 
 // Does Haar Wavelet Transformation in place for a specified area of
 // a matrix. The matrix size is specified by matrix_width and matrix_height.
 // The area on which the transformation is performed is specified by
 // offset_column, num_columns, offset_row and num_rows.
 void Haar2D(int* matrix, int matrix_height, int matrix_width,
-    int offset_column, int num_columns, int offset_row, int num_rows) {
+    int offset_column, int num_columns, int offset_row, int num_rows,
+    int32* buffer) {
   for (int i = offset_row; i < offset_row + num_rows; ++i) {
-    Haar1DX(matrix, matrix_height, matrix_width, i, offset_column, num_columns);
+    Haar1DX(matrix, matrix_height, matrix_width, i, offset_column, num_columns,
+            buffer);
   }
 
-  for (int i = offset_column; i < offset_column + num_columns; ++i){
-    Haar1DY(matrix, matrix_height, matrix_width, i, offset_row, num_rows);
-  }
+  HaarColumns(matrix, matrix_height, matrix_width,
+              offset_column, num_columns, offset_row, num_rows, buffer);
 }
 
 // Reads in a given matrix, does first round HWT and outputs result
@@ -127,42 +200,59 @@ void Haar2D(int* matrix, int matrix_height, int matrix_width,
 // columns. The transformation is performed on the given area specified
 // by offset_column, num_columns, offset_row, num_rows. After
 // transformation, the output matrix has num_columns columns and
-// num_rows rows.
+// num_rows rows. An odd last column or row is copied through untouched.
 void HwtFirstRound(const uint8* const data, int height, int width,
     int offset_column, int num_columns,
-    int offset_row, int num_rows, int32* matrix) {
-  int32* ptr_a = _arow;
+    int offset_row, int num_rows, int32* matrix, int32* buffer) {
   const uint8* ptr_data = data + offset_row * width + offset_column;
   int half_num_columns = num_columns / 2;
   for (int i = 0; i < num_rows; ++i) {
-    int32* a_tmp = ptr_a;
-    const uint8* data_tmp = ptr_data;
-    for (int j = 0; j < half_num_columns; ++j) {
-      *a_tmp++ = (int32) ((data_tmp[0] + data_tmp[1]) / 2);
-      data_tmp += 2;
+    int32* ptr_matrix = matrix + i * num_columns;
+
+    int j = 0;
+#ifdef HAVE_X86
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low_bytes = _mm_set1_epi16(0xff);
+    for (; j + 8 <= half_num_columns; j += 8) {
+      const __m128i pixels =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr_data + 2 * j));
+
+      // Pixel sums fit comfortably in 16 bits, and are never negative.
+      const __m128i even = _mm_and_si128(pixels, low_bytes);
+      const __m128i odd = _mm_srli_epi16(pixels, 8);
+      const __m128i average = _mm_srli_epi16(_mm_add_epi16(even, odd), 1);
+      const __m128i difference = _mm_sub_epi16(even, average);
+
+      __m128i* const averages = reinterpret_cast<__m128i*>(ptr_matrix + j);
+      _mm_storeu_si128(averages, _mm_unpacklo_epi16(average, zero));
+      _mm_storeu_si128(averages + 1, _mm_unpackhi_epi16(average, zero));
+
+      // Differences may be negative, so sign extend them.
+      __m128i* const differences =
+          reinterpret_cast<__m128i*>(ptr_matrix + half_num_columns + j);
+      _mm_storeu_si128(differences,
+          _mm_srai_epi32(_mm_unpacklo_epi16(zero, difference), 16));
+      _mm_storeu_si128(differences + 1,
+          _mm_srai_epi32(_mm_unpackhi_epi16(zero, difference), 16));
     }
+#endif
 
-    int32* average = ptr_a;
-    a_tmp = ptr_a + half_num_columns;
-    data_tmp = ptr_data;
-    for (int j = 0; j < half_num_columns; ++j) {
-      *a_tmp++ = *data_tmp - *average++;
-      data_tmp += 2;
+    for (; j < half_num_columns; ++j) {
+      const int32 average = (ptr_data[2 * j] + ptr_data[2 * j + 1]) / 2;
+      ptr_matrix[j] = average;
+      ptr_matrix[half_num_columns + j] = ptr_data[2 * j] - average;
     }
 
-    int32* ptr_matrix = matrix + i * num_columns;
-    a_tmp = ptr_a;
-    for (int j = 0; j < num_columns; ++j) {
-      *ptr_matrix++ = *a_tmp++;
+    if (num_columns & 1) {
+      ptr_matrix[num_columns - 1] = ptr_data[num_columns - 1];
     }
 
     ptr_data += width;
   }
 
   // Column transformation does not involve input data.
-  for (int i = 0; i < num_columns; ++i) {
-    Haar1DY(matrix, num_rows, num_columns, i, 0, num_rows);
-  }
+  HaarColumns(matrix, num_rows, num_columns,
+              0, num_columns, 0, num_rows, buffer);
 }
 
 // Returns the weight of a given point in a certain scale of a matrix
@@ -308,51 +398,84 @@ int DetectBlur(int* matrix, int width, int height,
   return per < kMinZero;
 }
 
-// Detects blurriness of a given portion of a luminance matrix.
+// Detects blurriness of a given portion of a luminance matrix whose rows are
+// stride bytes apart. matrix must hold width_wanted * height_wanted values,
+// and buffer kBufferSize values.
 int IsBlurredInner(const uint8* const luminance,
-    const int width, const int height,
+    const int stride, const int height,
     const int left, const int top,
     const int width_wanted, const int height_wanted,
+    int32* const matrix, int32* const buffer,
     float* const blur, float* const extent) {
-  int32* matrix = _smatrix;
-
-  HwtFirstRound(luminance, height, width,
-                left, width_wanted, top, height_wanted, matrix);
+  HwtFirstRound(luminance, height, stride,
+                left, width_wanted, top, height_wanted, matrix, buffer);
   Haar2D(matrix, height_wanted, width_wanted,
-         0, width_wanted >> 1, 0, height_wanted >> 1);
+         0, width_wanted >> 1, 0, height_wanted >> 1, buffer);
   Haar2D(matrix, height_wanted, width_wanted,
-         0, width_wanted >> 2, 0, height_wanted >> 2);
+         0, width_wanted >> 2, 0, height_wanted >> 2, buffer);
 
   int blurred = DetectBlur(matrix, width_wanted, height_wanted, blur, extent);
 
   return blurred;
 }
 
+// The central area is split into four quadrants, numbered in row order,
+// each of which is evaluated independently.
+static const int kNumQuadrants = 4;
+
+struct QuadrantJob {
+  const uint8* luminance;
+  int stride;
+  int height;
+  int left;
+  int top;
+  int quadrant_width;
+  int quadrant_height;
+
+  // Space for one transformed matrix per quadrant.
+  int32* matrices;
+
+  float blur[kNumQuadrants];
+  float extent[kNumQuadrants];
+};
+
+static void IsBlurredQuadrant(void* const data, const int32 index) {
+  QuadrantJob* const job = static_cast<QuadrantJob*>(data);
+  const int quadrant_size = job->quadrant_width * job->quadrant_height;
+
+  int32 buffer[kBufferSize];
+  IsBlurredInner(job->luminance, job->stride, job->height,
+                 job->left + (index & 1) * job->quadrant_width,
+                 job->top + (index >> 1) * job->quadrant_height,
+                 job->quadrant_width, job->quadrant_height,
+                 job->matrices + index * quadrant_size, buffer,
+                 &job->blur[index], &job->extent[index]);
+}
+
 int IsBlurred(const uint8* const luminance,
-    const int width, const int height, float* const blur, float* const extent) {
+    const int width, const int height, const int stride,
+    float* const blur, float* const extent) {
 
   int desired_width = min(kMaximumWidth, width);
   int desired_height = min(kMaximumHeight, height);
-  int left = (width - desired_width) >> 1;
-  int top = (height - desired_height) >> 1;
-
-  float conf1, extent1;
-  int blur1 = IsBlurredInner(luminance, width, height,
-      left, top, desired_width >> 1, desired_height >> 1, &conf1, &extent1);
-  float conf2, extent2;
-  int blur2 = IsBlurredInner(luminance, width, height,
-      left + (desired_width >> 1), top, desired_width >> 1, desired_height >> 1,
-      &conf2, &extent2);
-  float conf3, extent3;
-  int blur3 = IsBlurredInner(luminance, width, height,
-      left, top + (desired_height >> 1), desired_width >> 1,
-      desired_height >> 1, &conf3, &extent3);
-  float conf4, extent4;
-  int blur4 = IsBlurredInner(luminance, width, height,
-      left + (desired_width >> 1), top + (desired_height >> 1),
-      desired_width >> 1, desired_height >> 1, &conf4, &extent4);
-
-  *blur = (conf1 + conf2 + conf3 + conf4) / 4;
-  *extent = (extent1 + extent2 + extent3 + extent4) / 4;
+
+  QuadrantJob job;
+  job.luminance = luminance;
+  job.stride = stride;
+  job.height = height;
+  job.left = (width - desired_width) >> 1;
+  job.top = (height - desired_height) >> 1;
+  job.quadrant_width = desired_width >> 1;
+  job.quadrant_height = desired_height >> 1;
+  job.matrices = new int32[
+      kNumQuadrants * job.quadrant_width * job.quadrant_height];
+
+  WorkerPool::getShared()->run(IsBlurredQuadrant, &job, kNumQuadrants);
+
+  delete[] job.matrices;
+
+  *blur = (job.blur[0] + job.blur[1] + job.blur[2] + job.blur[3]) / 4;
+  *extent =
+      (job.extent[0] + job.extent[1] + job.extent[2] + job.extent[3]) / 4;
   return *blur < kMinZero;
 }
@@ -22,6 +22,8 @@
 
 #include "types.h"
 #include "time_log.h"
+#include "utils.h"
+#include "direct_buffer.h"
 #include "similar.h"
 
 #ifdef __cplusplus
@@ -33,13 +35,36 @@ Java_com_googlecode_eyesfree_opticflow_ImageBlur_computeSignature(
     JNIEnv* env, jclass clazz, jbyteArray input, jint width, jint height,
     jintArray signatureBuffer);
 
+JNIEXPORT jintArray JNICALL
+Java_com_googlecode_eyesfree_opticflow_ImageBlur_computeSignatureDirect(
+    JNIEnv* env, jclass clazz, jobject input, jint width, jint height,
+    jint rowStride, jintArray signatureBuffer);
+
 JNIEXPORT jint JNICALL
 Java_com_googlecode_eyesfree_opticflow_ImageBlur_diffSignature(
     JNIEnv* env, jclass clazz, jintArray signature1, jintArray signature2);
+
+JNIEXPORT jint JNICALL
+Java_com_googlecode_eyesfree_opticflow_ImageBlur_diffSignatures(
+    JNIEnv* env, jclass clazz, jintArray reference, jintArray candidates,
+    jintArray diffs);
 #ifdef __cplusplus
 }
 #endif
 
+// Copies sig into signatureBuffer, or into a new array if signatureBuffer
+// is missing or the wrong size, and returns the array written.
+static jintArray StoreSignature(JNIEnv* env, const uint32* const sig,
+                                jintArray signatureBuffer) {
+  jintArray ret = signatureBuffer;
+  if (ret == NULL || env->GetArrayLength(ret) != SIGNATURE_SIZE) {
+    ret = env->NewIntArray(SIGNATURE_SIZE);
+  }
+  env->SetIntArrayRegion(ret, 0, SIGNATURE_SIZE,
+                         reinterpret_cast<const jint*>(sig));
+  return ret;
+}
+
 JNIEXPORT jintArray JNICALL
 Java_com_googlecode_eyesfree_opticflow_ImageBlur_computeSignature(
     JNIEnv* env, jclass clazz, jbyteArray input, jint width, jint height,
@@ -47,26 +72,35 @@ Java_com_googlecode_eyesfree_opticflow_ImageBlur_computeSignature(
   jboolean inputCopy = JNI_FALSE;
   jbyte* const i = env->GetByteArrayElements(input, &inputCopy);
 
-  int sig_len = 0;
+  uint32 sig[SIGNATURE_SIZE];
 
   resetTimeLog();
-  uint32_t* sig = ComputeSignature(reinterpret_cast<uint8*>(i),
-      width, height, &sig_len);
+  ComputeSignature(reinterpret_cast<uint8*>(i), width, height, width, sig);
   timeLog("Finished image signature computation");
   printTimeLog();
 
   env->ReleaseByteArrayElements(input, i, JNI_ABORT);
 
-  jintArray ret = signatureBuffer;
-  if (ret == NULL || env->GetArrayLength(ret) != sig_len) {
-    ret = env->NewIntArray(sig_len);
-  }
-  jint* body = env->GetIntArrayElements(ret, 0);
-  for (int i = 0; i < sig_len; ++i) {
-    body[i] = sig[i];
+  return StoreSignature(env, sig, signatureBuffer);
+}
+
+JNIEXPORT jintArray JNICALL
+Java_com_googlecode_eyesfree_opticflow_ImageBlur_computeSignatureDirect(
+    JNIEnv* env, jclass clazz, jobject input, jint width, jint height,
+    jint rowStride, jintArray signatureBuffer) {
+  const uint8* const i = getDirectFrame(env, input, width, height, rowStride);
+  if (i == NULL) {
+    return NULL;
   }
-  env->ReleaseIntArrayElements(ret, body, 0);
-  return ret;
+
+  uint32 sig[SIGNATURE_SIZE];
+
+  resetTimeLog();
+  ComputeSignature(i, width, height, rowStride, sig);
+  timeLog("Finished image signature computation");
+  printTimeLog();
+
+  return StoreSignature(env, sig, signatureBuffer);
 }
 
 JNIEXPORT jint JNICALL
@@ -84,3 +118,31 @@ Java_com_googlecode_eyesfree_opticflow_ImageBlur_diffSignature(
 
   return diff;
 }
+
+JNIEXPORT jint JNICALL
+Java_com_googlecode_eyesfree_opticflow_ImageBlur_diffSignatures(
+    JNIEnv* env, jclass clazz, jintArray reference, jintArray candidates,
+    jintArray diffs) {
+  const int size = env->GetArrayLength(reference);
+  if (size == 0) {
+    return -1;
+  }
+  const int num_candidates = env->GetArrayLength(candidates) / size;
+
+  jint* ref = env->GetIntArrayElements(reference, 0);
+  jint* cands = env->GetIntArrayElements(candidates, 0);
+  jint* cand_diffs = new jint[num_candidates];
+
+  int best = DiffMany(ref, cands, num_candidates, size, cand_diffs);
+
+  env->ReleaseIntArrayElements(reference, ref, JNI_ABORT);
+  env->ReleaseIntArrayElements(candidates, cands, JNI_ABORT);
+
+  if (diffs != NULL) {
+    const int num_diffs = min(num_candidates, env->GetArrayLength(diffs));
+    env->SetIntArrayRegion(diffs, 0, num_diffs, cand_diffs);
+  }
+  delete[] cand_diffs;
+
+  return best;
+}
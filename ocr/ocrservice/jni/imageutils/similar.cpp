@@ -19,8 +19,8 @@
 // This library contains image processing method to estimate
 // similarity of two given images.
 //
-// This library is *not* thread safe because static memory is
-// used for performance.
+// No static memory is used, so both methods may be called from
+// several threads at once.
 //
 // Two methods are provided to estimate the similarity of two
 // given images. ComputeSignature() is used to compute the
@@ -33,6 +33,8 @@
 // For performance consideration, 480x480 of central area of
 // a given image is used for signature computation.
 
+#include <string.h>
+
 #include "similar.h"
 #include "utils.h"
 
@@ -40,98 +42,132 @@
 // For performance consideration, it's specified in format of
 // number of left shift bits rather than color numbers directly.
 // e.g. kShiftColors 4 means (1 << 4 == 16) colors are used.
-static const int kShiftColors = 4;
+static const int kShiftColors = SIGNATURE_COLOR_BITS;
+static const int kNumColors = 1 << kShiftColors;
 static const int kDesiredWidthForSignature = 480;
 static const int kDesiredHeightForSignature = 480;
-static uint8 _colors[kDesiredHeightForSignature * kDesiredWidthForSignature];
-// The final signature contains both color information of
-// inner and outer pixels, and total pixel count at last.
-static uint32_t _signature[1 + (1 << kShiftColors) * 2];
 
-uint32_t* ComputeSignatureInner(const uint8* const luminance,
-    int width, int height,
-    int left, int top, int desired_width, int desired_height, int* size) {
-  int num_colors = 1 << kShiftColors;
+// Two luminance values have the same quantized color when they agree
+// in these bits.
+static const uint8 kColorMask = (0xff << (8 - kShiftColors)) & 0xff;
+
+// Signature entries are counted in this many interleaved histograms,
+// so that runs of one color don't serialize on a single counter.
+static const int kNumHistograms = 4;
 
-  memset(_signature, 0, sizeof(int32) * num_colors * 2);
+// Computes the signature entry of each pixel in [start, end) of a row:
+// its quantized color, offset by kNumColors when it's an inner pixel
+// (having same quantized color as its 4 neighbours) rather than an outer
+// one (at least one of his 4 neighbours has different color).
+static void ComputeKeys(const uint8* const ptr_lumi, const int stride,
+                        const int start, const int end, uint8* const keys) {
+  int j = start;
 
-  // Build quantized color map for input image. For each possible lumiance
-  // value from 0 to 255, quantize it into more coarse value.
 #ifdef HAVE_ARMEABI_V7A
   if (supportsNeon()) {
-    for (int i = 0; i < desired_height; ++i) {
-      uint8* ptr_colors = _colors + i * desired_width;
-      const uint8* ptr_lumi = luminance + (i + top) * width + left;
-      int itrs = desired_width / 8;
-      for (int j = 0; j < itrs; ++j) {
-        // Load 8 bytes from ptr_lumi into neon vector
-        uint8x8_t lumix8 = vld1_u8(ptr_lumi);
-        // Batch right shift every elements (8 - kShiftColors) bits
-        // in the vector
-        uint8x8_t colorx8 = vshr_n_u8(lumix8, 8 - kShiftColors);
-        // Store above result into our own memory starting from ptr_colors
-        vst1_u8(ptr_colors, colorx8);
-
-        ptr_lumi += 8;
-        ptr_colors += 8;
-      }
+    const uint8x16_t color_mask = vdupq_n_u8(kColorMask);
+    const uint8x16_t inner_offset = vdupq_n_u8(kNumColors);
+    for (; j + 16 <= end; j += 16) {
+      const uint8x16_t y = vld1q_u8(ptr_lumi + j);
+      uint8x16_t differences = veorq_u8(y, vld1q_u8(ptr_lumi + j - 1));
+      differences =
+          vorrq_u8(differences, veorq_u8(y, vld1q_u8(ptr_lumi + j + 1)));
+      differences = vorrq_u8(differences,
+                             veorq_u8(y, vld1q_u8(ptr_lumi + j - stride)));
+      differences = vorrq_u8(differences,
+                             veorq_u8(y, vld1q_u8(ptr_lumi + j + stride)));
+
+      // All ones wherever a neighbour has a different color.
+      const uint8x16_t outer = vtstq_u8(differences, color_mask);
+      vst1q_u8(keys + j, vorrq_u8(vshrq_n_u8(y, 8 - kShiftColors),
+                                  vbicq_u8(inner_offset, outer)));
     }
-  } else {
+  }
 #endif
-    int shift_bits = 8 - kShiftColors;  // equals to 256/num_colors
-    for (int i = 0; i < desired_height; ++i) {
-      uint8* ptr_colors = &_colors[i * desired_width];
-      const uint8* ptr_lumi = luminance + (i + top) * width + left;
-      for (int j = 0; j < desired_width; ++j) {
-        *ptr_colors++ = *ptr_lumi++ >> shift_bits;
-      }
-    }
-#ifdef HAVE_ARMEABI_V7A
+
+#ifdef HAVE_X86
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i color_mask = _mm_set1_epi8(kColorMask);
+  const __m128i color_bits = _mm_set1_epi8(kNumColors - 1);
+  const __m128i inner_offset = _mm_set1_epi8(kNumColors);
+  for (; j + 16 <= end; j += 16) {
+    const __m128i y =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr_lumi + j));
+    __m128i differences = _mm_xor_si128(y, _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(ptr_lumi + j - 1)));
+    differences = _mm_or_si128(differences, _mm_xor_si128(y, _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(ptr_lumi + j + 1))));
+    differences = _mm_or_si128(differences, _mm_xor_si128(y, _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(ptr_lumi + j - stride))));
+    differences = _mm_or_si128(differences, _mm_xor_si128(y, _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(ptr_lumi + j + stride))));
+
+    // All ones wherever every neighbour has the same color.
+    const __m128i inner =
+        _mm_cmpeq_epi8(_mm_and_si128(differences, color_mask), zero);
+    const __m128i color = _mm_and_si128(
+        _mm_srli_epi16(y, 8 - kShiftColors), color_bits);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(keys + j),
+        _mm_or_si128(color, _mm_and_si128(inner, inner_offset)));
   }
 #endif
 
-  // Go through each pixel, decide it is a inner pixel (having same
-  // quantized color as its 4 neighbours) or an outer one (at least one of
-  // his 4 neighbours has different color), update signature respectively.
+  for (; j < end; ++j) {
+    const uint8 y = ptr_lumi[j];
+    const uint8 differences = (y ^ ptr_lumi[j - 1]) | (y ^ ptr_lumi[j + 1]) |
+        (y ^ ptr_lumi[j - stride]) | (y ^ ptr_lumi[j + stride]);
+    keys[j] = (y >> (8 - kShiftColors)) +
+        ((differences & kColorMask) == 0 ? kNumColors : 0);
+  }
+}
+
+void ComputeSignatureInner(const uint8* const luminance,
+    int stride, int height,
+    int left, int top, int desired_width, int desired_height,
+    uint32* const signature) {
+  uint32 histograms[kNumHistograms][kNumColors * 2];
+  memset(histograms, 0, sizeof(histograms));
+
+  // Go through each pixel, decide it is a inner pixel or an outer one,
+  // and update signature respectively.
+  uint8 keys[kDesiredWidthForSignature];
   int h = desired_height - 1;
   int w = desired_width - 1;
   for (int i = 1; i < h; ++i) {
-    uint8* ptr_colors = _colors + i * desired_width;
-    for (int j = 1; j < w; ++j) {
-      int inner = 0;
-      uint8 y = ptr_colors[j];
-      uint8 yleft = ptr_colors[j - 1];
-      if (y == yleft) {
-        uint8 yright = ptr_colors[j + 1];
-        if (y == yright) {
-          uint8 yup = ptr_colors[j - desired_width];
-          if (y == yup) {
-            uint8 ydown = ptr_colors[j + desired_width];
-            if (y == ydown) {
-              inner = 1;
-            }
-          }
-        }
+    const uint8* ptr_lumi = luminance + (i + top) * stride + left;
+    ComputeKeys(ptr_lumi, stride, 1, w, keys);
+
+    int j = 1;
+    for (; j + kNumHistograms <= w; j += kNumHistograms) {
+      for (int k = 0; k < kNumHistograms; ++k) {
+        ++histograms[k][keys[j + k]];
       }
-      _signature[inner * num_colors + y] += 1;
+    }
+    for (; j < w; ++j) {
+      ++histograms[0][keys[j]];
     }
   }
 
-  *size = sizeof(_signature) / sizeof(uint32);
-  _signature[*size - 1] = (desired_height - 2) * (desired_width - 2);
+  for (int i = 0; i < kNumColors * 2; ++i) {
+    signature[i] = 0;
+    for (int k = 0; k < kNumHistograms; ++k) {
+      signature[i] += histograms[k][i];
+    }
+  }
 
-  return _signature;
+  signature[SIGNATURE_SIZE - 1] = (desired_height - 2) * (desired_width - 2);
 }
 
-uint32_t* ComputeSignature(const uint8* const luminance,
-    const int width, const int height, int* size) {
+void ComputeSignature(const uint8* const luminance,
+    const int width, const int height, const int stride,
+    uint32* const signature) {
   int desired_width = min(kDesiredWidthForSignature, width);
   int desired_height = min(kDesiredHeightForSignature, height);
   int left = (width - desired_width) >> 1;
   int top = (height - desired_height) >> 1;
 
-  return ComputeSignatureInner(luminance, width, height,
-      left, top, desired_width, desired_height, size);
+  ComputeSignatureInner(luminance, stride, height,
+      left, top, desired_width, desired_height, signature);
 }
 
 int Diff(const int32* const signature1, const int32* const signature2,
@@ -143,3 +179,15 @@ int Diff(const int32* const signature1, const int32* const signature2,
   }
   return diff * 50 / total;
 }
+
+int DiffMany(const int32* const reference, const int32* const candidates,
+    const int num_candidates, const int size, int* const diffs) {
+  int best = -1;
+  for (int i = 0; i < num_candidates; ++i) {
+    diffs[i] = Diff(reference, candidates + i * size, size);
+    if (best < 0 || diffs[i] < diffs[best]) {
+      best = i;
+    }
+  }
+  return best;
+}
@@ -10,11 +10,20 @@
 extern "C" {
 #endif
 
+// Luminance is quantized to (1 << SIGNATURE_COLOR_BITS) colors.
+#define SIGNATURE_COLOR_BITS 4
+
+// Number of values in a signature: a count of inner and outer pixels
+// for each color, then the total pixel count.
+#define SIGNATURE_SIZE (1 + (1 << SIGNATURE_COLOR_BITS) * 2)
+
 // Computes signature of a given image. This signature can be used to
-// compute similarity of two different images. Signature is returned
-// and size is returned via output parameter size.
-uint32* ComputeSignature(const uint8* const luminance,
-                         const int width, const int height, int* size);
+// compute similarity of two different images. Rows of the image are
+// stride bytes apart. The signature is written to signature, which must
+// hold SIGNATURE_SIZE values.
+void ComputeSignature(const uint8* const luminance,
+                      const int width, const int height, const int stride,
+                      uint32* const signature);
 
 // Returns how different two given images (represented by their signatures)
 // are. The input signatures must be in the same size. An integer from 0 to
@@ -23,6 +32,13 @@ uint32* ComputeSignature(const uint8* const luminance,
 int Diff(const int32* const signature1, const int32* const signature2,
          const int size);
 
+// Compares num_candidates signatures, stored one after another in
+// candidates, against reference. The difference of each candidate
+// (as returned by Diff) is written to diffs, and the index of the most
+// similar candidate is returned, or -1 if there are no candidates.
+int DiffMany(const int32* const reference, const int32* const candidates,
+             const int num_candidates, const int size, int* const diffs);
+
 #ifdef __cplusplus
 }
 #endif
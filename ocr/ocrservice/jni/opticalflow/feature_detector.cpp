@@ -25,6 +25,7 @@
 
 #include "image.h"
 #include "feature_detector.h"
+#include "worker_pool.h"
 
 // Threshold for pixels to be considered different.
 #define FAST_DIFF_AMOUNT 10
@@ -32,6 +33,10 @@
 // How far from edge of frame to stop looking for FAST features.
 #define FAST_BORDER_BUFFER 20
 
+// How many contiguous pixels of each FAST circle must differ from the center.
+#define FAST_SHORT_THRESHOLD 3
+#define FAST_FULL_THRESHOLD 12
+
 // Minimum enforced distance between detected features.
 // Default
 #define MIN_FEATURE_DIST_NORMAL 24
@@ -52,51 +57,151 @@
 // discriminating.
 #define SENSITIVITY 0.2f
 
+// Number of candidates each worker scores at a time.
+#define SCORING_BATCH_SIZE 64
+
 namespace flow {
 
+// Reads the gradient window about a pixel straight out of the images. This
+// gives the same values as the interpolating calculateG() does at whole pixel
+// positions, without the cost of interpolating.
+static void calculateGAtPixel(const Image<int32>& I_x, const Image<int32>& I_y,
+                              const int32 x, const int32 y, float32* const G) {
+  static const int32 kWindowDiameter = 2 * HARRIS_WINDOW_SIZE + 1;
+
+  float32 vals_x[kWindowDiameter * kWindowDiameter];
+  float32 vals_y[kWindowDiameter * kWindowDiameter];
+
+  const int32 stride = I_x.getWidth();
+  int32 num_vals = 0;
+
+  // Same order as calculateG(), so that the sums come out the same.
+  for (int32 win_x = -HARRIS_WINDOW_SIZE; win_x <= HARRIS_WINDOW_SIZE; ++win_x) {
+    const int32* column_x =
+        I_x.getPixelPtrConst(x + win_x, y - HARRIS_WINDOW_SIZE);
+    const int32* column_y =
+        I_y.getPixelPtrConst(x + win_x, y - HARRIS_WINDOW_SIZE);
+
+    for (int32 win_y = 0; win_y < kWindowDiameter; ++win_y) {
+      vals_x[num_vals] = *column_x;
+      vals_y[num_vals] = *column_y;
+      ++num_vals;
+
+      column_x += stride;
+      column_y += stride;
+    }
+  }
+
+  calculateG(vals_x, vals_y, num_vals, G);
+}
+
+// Turns an image gradient matrix into a corner score.
+static float32 harrisScore(const float32* const G) {
+  const float32 g_sum = G[0] + G[1] + G[2] + G[3];
+
+  const float32 a = G[0] / g_sum;
+  const float32 b = G[1] / g_sum;
+  const float32 c = G[2] / g_sum;
+  const float32 d = G[3] / g_sum;
+
+  const float32 det = a * d - b * c;
+  const float32 trace = a + d;
+
+  const float32 inner = square(trace) - 4 * det;
+
+  if (inner >= 0.0f) {
+    const float32 square_root_inner = sqrtf(inner);
+    const float32 eig1 = (trace + square_root_inner) / 2.0f;
+    const float32 eig2 = (trace - square_root_inner) / 2.0f;
+    return eig1 * eig2 - SENSITIVITY * square(eig1 + eig2);
+  }
+
+  // Way negative.
+  return -100.0f;
+}
+
+struct ScoringJob {
+  const Image<int32>* I_x;
+  const Image<int32>* I_y;
+  int32 num_candidates;
+  Point2D* candidate_features;
+};
+
+static void scoreFeatureBatch(void* const data, const int32 batch) {
+  const ScoringJob* const job = static_cast<ScoringJob*>(data);
+  const Image<int32>& I_x = *job->I_x;
+  const Image<int32>& I_y = *job->I_y;
+
+  const int32 first = batch * SCORING_BATCH_SIZE;
+  const int32 last = min(first + SCORING_BATCH_SIZE, job->num_candidates);
+
+  for (int32 i = first; i < last; ++i) {
+    Point2D* const feature = job->candidate_features + i;
+
+    // Scored at the pixel it lies on, as harrisFilter() does.
+    const int32 x = feature->x;
+    const int32 y = feature->y;
+
+    if (inRange(x, HARRIS_WINDOW_SIZE, I_x.width_less_one_ - HARRIS_WINDOW_SIZE) &&
+        inRange(y, HARRIS_WINDOW_SIZE, I_x.height_less_one_ - HARRIS_WINDOW_SIZE)) {
+      float32 G[] = { 0, 0, 0, 0 };
+      calculateGAtPixel(I_x, I_y, x, y, G);
+      feature->score = harrisScore(G);
+    } else {
+      feature->score = harrisFilter(I_x, I_y, x, y);
+    }
+  }
+}
+
 void scoreFeatures(const Image<int32>& I_x, const Image<int32>& I_y,
                    const int32 num_candidates,
-                   Point2D* const candidate_features) {
-  // Score all the features
-  for (int32 i = 0; i < num_candidates; ++i) {
-    Point2D* const feature = candidate_features + i;
-    feature->score = harrisFilter(I_x, I_y, feature->x, feature->y);
+                   Point2D* const candidate_features,
+                   WorkerPool* const worker_pool) {
+  // Score all the features, a batch at a time. Each candidate only has its
+  // own score written, so they can be spread across threads.
+  ScoringJob job = { &I_x, &I_y, num_candidates, candidate_features };
+  const int32 num_batches =
+      (num_candidates + SCORING_BATCH_SIZE - 1) / SCORING_BATCH_SIZE;
+
+  if (worker_pool != NULL) {
+    worker_pool->run(scoreFeatureBatch, &job, num_batches);
+  } else {
+    for (int32 batch = 0; batch < num_batches; ++batch) {
+      scoreFeatureBatch(&job, batch);
+    }
   }
 }
 
-// Quicksorts detected features by score and then selects them such that
-// they are separated by a minimum distance.
+// Selects the best scoring features such that they are separated by a minimum
+// distance. Only as many candidates as it takes are pulled off a heap in
+// order of score, rather than sorting all of them.
 int32 sortAndSelect(const int32 num_candidates, const int32 max_features,
                     const Image<bool>& interest_map,
                     Point2D* const candidate_features,
                     Point2D* const final_features,
                     Image<uint8>* const best_feature_map) {
-  qsort(candidate_features, num_candidates);
-
-#ifdef SANITY_CHECKS
-  // Verify that the array got sorted.
-  float32 last_score = -FLT_MAX;
-  for (int32 i = 0; i < num_candidates; ++i) {
-    const float32 curr_score = (candidate_features + i)->score;
-
-    // Scores should be monotonically increasing.
-    CHECK(last_score <= curr_score,
-          "Quicksort failure! %d: %.5f > %d: %.5f",
-          i - 1, last_score, i, curr_score);
-
-    last_score = curr_score;
-  }
-#endif
+  makeHeap(candidate_features, num_candidates);
 
   best_feature_map->clear(false);
 
   int32 num_features = 0;
 
-  for (int32 i = num_candidates - 1; i >= 0; --i) {
-    const Point2D& candidate = candidate_features[i];
+  for (int32 num_left = num_candidates; num_left > 0; --num_left) {
+    // Moves the best remaining candidate just past the end of the heap.
+    popHeap(candidate_features, num_left);
+    const Point2D& candidate = candidate_features[num_left - 1];
+
+#ifdef SANITY_CHECKS
+    // Scores should be monotonically decreasing.
+    CHECK(num_left == num_candidates ||
+          candidate.score <= candidate_features[num_left].score,
+          "Heap failure! %d: %.5f > %d: %.5f",
+          num_left - 1, candidate.score,
+          num_left, candidate_features[num_left].score);
+#endif
 
-    // Since features are sorted, the first 0 or less value means we can stop
-    // looking.
+    // Since features come out in order, the first 0 or less value means we can
+    // stop looking.
     if (candidate.score <= 0.0f) {
       break;
     }
@@ -200,6 +305,52 @@ inline int32 testCircle(const int32 circle_perimeter, const int32 threshold,
   return 0;
 }
 
+void makeFastCircleOffsets(const int32 width, int32* const short_offsets,
+                           int32* const full_offsets) {
+  /*
+   // Reference for a circle of diameter 7.
+   const int32 circle[] = {0, 0, 1, 1, 1, 0, 0,
+                           0, 1, 0, 0, 0, 1, 0,
+                           1, 0, 0, 0, 0, 0, 1,
+                           1, 0, 0, 0, 0, 0, 1,
+                           1, 0, 0, 0, 0, 0, 1,
+                           0, 1, 0, 0, 0, 1, 0,
+                           0, 0, 1, 1, 1, 0, 0};
+   const int32 circle_offset[] =
+       {2, 3, 4, 8, 12, 14, 20, 21, 27, 28, 34, 36, 40, 44, 45, 46};
+   */
+
+  // Quick test of compass directions.  Any length 16 circle with a break of up
+  // to 4 pixels will have at least 3 of these 4 pixels active.
+  static const int32 short_circle_x[] = { -3,  0, +3,  0 };
+  static const int32 short_circle_y[] = {  0, -3,  0, +3 };
+
+  for (int i = 0; i < FAST_SHORT_CIRCLE_PERIMETER; ++i) {
+    short_offsets[i] = short_circle_x[i] + short_circle_y[i] * width;
+  }
+
+  // Large circle values.
+  static const int32 full_circle_x[] =
+      { -1,  0, +1, +2, +3, +3, +3, +2, +1, +0, -1, -2, -3, -3, -3, -2 };
+  static const int32 full_circle_y[] =
+      { -3, -3, -3, -2, -1,  0, +1, +2, +3, +3, +3, +2, +1, +0, -1, -2 };
+
+  for (int i = 0; i < FAST_FULL_CIRCLE_PERIMETER; ++i) {
+    full_offsets[i] = full_circle_x[i] + full_circle_y[i] * width;
+  }
+}
+
+bool testFastCircles(const uint8* const center_ptr,
+                     const int32* const short_offsets,
+                     const int32* const full_offsets) {
+  // Only do the full test if it meets the quick minimum requirements test.
+  // A non-zero score means the feature was found.
+  return testCircle(FAST_SHORT_CIRCLE_PERIMETER, FAST_SHORT_THRESHOLD,
+                    center_ptr, short_offsets) != 0 &&
+         testCircle(FAST_FULL_CIRCLE_PERIMETER, FAST_FULL_THRESHOLD,
+                    center_ptr, full_offsets) != 0;
+}
+
 // Creates features in a regular grid, regardless of image contents.
 int32 seedFeatures(const Image<uint8>& frame,
                    const int32 num_x, const int32 num_y,
@@ -238,73 +389,111 @@ float32 harrisFilter(const Image<int32>& I_x, const Image<int32>& I_y,
   float32 G[] = { 0, 0, 0, 0 };
   calculateG(HARRIS_WINDOW_SIZE, x, y, I_x, I_y, G);
 
-  const float32 g_sum = G[0] + G[1] + G[2] + G[3];
-
-  const float32 a = G[0] / g_sum;
-  const float32 b = G[1] / g_sum;
-  const float32 c = G[2] / g_sum;
-  const float32 d = G[3] / g_sum;
+  return harrisScore(G);
+}
 
-  const float32 det = a * d - b * c;
-  const float32 trace = a + d;
+// Records a FAST feature at the given pixel.
+inline void markFastFeature(uint8* const center_ptr, const int32 frame_width) {
+  // Increase the feature count on this pixel and the pixels in all
+  // 4 cardinal directions.
+  *center_ptr += 5;
+  *(center_ptr - 1) += 1;
+  *(center_ptr + 1) += 1;
+  *(center_ptr - frame_width) += 1;
+  *(center_ptr + frame_width) += 1;
+}
 
-  const float32 inner = square(trace) - 4 * det;
+#ifdef HAVE_X86
+// Compares the pixels at an offset from 16 adjacent centers with the centers.
+// Lanes are all ones where a pixel is NOT more than FAST_DIFF_AMOUNT above
+// (or below) its center, which is what the run counting below wants.
+inline void compareCircle16(const __m128i center, const uint8* const ptr,
+                            __m128i* const not_above,
+                            __m128i* const not_below) {
+  const __m128i diff_amount = _mm_set1_epi8(FAST_DIFF_AMOUNT);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i pixel = _mm_loadu_si128((const __m128i*) ptr);
+
+  // Saturating subtraction leaves zero unless the difference is past the
+  // threshold.
+  *not_above = _mm_cmpeq_epi8(
+      _mm_subs_epu8(_mm_subs_epu8(pixel, center), diff_amount), zero);
+  *not_below = _mm_cmpeq_epi8(
+      _mm_subs_epu8(_mm_subs_epu8(center, pixel), diff_amount), zero);
+}
 
-  if (inner >= 0.0f) {
-    const float32 square_root_inner = sqrtf(inner);
-    const float32 eig1 = (trace + square_root_inner) / 2.0f;
-    const float32 eig2 = (trace - square_root_inner) / 2.0f;
-    return eig1 * eig2 - SENSITIVITY * square(eig1 + eig2);
+// Runs both FAST circle tests on 16 adjacent pixels at once, and returns a bit
+// mask of the ones that pass, which are exactly those for which the scalar
+// testFastCircles() returns true.
+int32 testCircles16(const uint8* const center_ptr,
+                    const int32* const short_offsets,
+                    const int32* const full_offsets) {
+  const __m128i center = _mm_loadu_si128((const __m128i*) center_ptr);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+
+  // Any 3 of the 4 compass points are contiguous, so the short test only has
+  // to count them. The masks are -1 for each point that doesn't differ.
+  __m128i num_not_above = zero;
+  __m128i num_not_below = zero;
+
+  for (int32 i = 0; i < 4; ++i) {
+    __m128i not_above;
+    __m128i not_below;
+    compareCircle16(center, center_ptr + short_offsets[i],
+                    &not_above, &not_below);
+
+    num_not_above = _mm_add_epi8(num_not_above, not_above);
+    num_not_below = _mm_add_epi8(num_not_below, not_below);
   }
 
-  // Way negative.
-  return -100.0f;
-}
+  // At most one of the four may fail to differ.
+  const __m128i max_not = _mm_set1_epi8(-2);
+  const int32 short_passed = _mm_movemask_epi8(
+      _mm_or_si128(_mm_cmpgt_epi8(num_not_above, max_not),
+                   _mm_cmpgt_epi8(num_not_below, max_not)));
 
-// FAST feature detector.
-int32 findFastFeatures(const Image<uint8>& frame, const int32 max_num_features,
-                       Point2D* const features,
-                       Image<uint8>* const best_feature_map) {
-  /*
-   // Reference for a circle of diameter 7.
-   const int32 circle[] = {0, 0, 1, 1, 1, 0, 0,
-                           0, 1, 0, 0, 0, 1, 0,
-                           1, 0, 0, 0, 0, 0, 1,
-                           1, 0, 0, 0, 0, 0, 1,
-                           1, 0, 0, 0, 0, 0, 1,
-                           0, 1, 0, 0, 0, 1, 0,
-                           0, 0, 1, 1, 1, 0, 0};
-   const int32 circle_offset[] =
-       {2, 3, 4, 8, 12, 14, 20, 21, 27, 28, 34, 36, 40, 44, 45, 46};
-   */
+  if (short_passed == 0) {
+    return 0;
+  }
 
-  // Quick test of compass directions.  Any length 16 circle with a break of up
-  // to 4 pixels will have at least 3 of these 4 pixels active.
-  static const int32 short_circle_perimeter = 4;
-  static const int32 short_threshold = 3;
-  static const int32 short_circle_x[] = { -3,  0, +3,  0 };
-  static const int32 short_circle_y[] = {  0, -3,  0, +3 };
+  __m128i not_above[16];
+  __m128i not_below[16];
 
-  // Precompute image offsets.
-  int32 short_offsets[short_circle_perimeter];
-  for (int i = 0; i < short_circle_perimeter; ++i) {
-    short_offsets[i] = short_circle_x[i] + short_circle_y[i] * frame.getWidth();
+  for (int32 i = 0; i < 16; ++i) {
+    compareCircle16(center, center_ptr + full_offsets[i],
+                    not_above + i, not_below + i);
   }
 
-  // Large circle values.
-  static const int32 full_circle_perimeter = 16;
-  static const int32 full_threshold = 12;
-  static const int32 full_circle_x[] =
-      { -1,  0, +1, +2, +3, +3, +3, +2, +1, +0, -1, -2, -3, -3, -3, -2 };
-  static const int32 full_circle_y[] =
-      { -3, -3, -3, -2, -1,  0, +1, +2, +3, +3, +3, +2, +1, +0, -1, -2 };
+  // Find the longest runs above and below, going around again far enough to
+  // catch runs split by the start of the circle.
+  __m128i run_above = zero;
+  __m128i run_below = zero;
+  __m128i longest_run = zero;
+
+  for (int32 i = 0; i < 16 + 12 - 1; ++i) {
+    const int32 index = i < 16 ? i : i - 16;
 
-  // Precompute image offsets.
-  int32 full_offsets[full_circle_perimeter];
-  for (int i = 0; i < full_circle_perimeter; ++i) {
-    full_offsets[i] = full_circle_x[i] + full_circle_y[i] * frame.getWidth();
+    run_above = _mm_andnot_si128(not_above[index], _mm_add_epi8(run_above, one));
+    run_below = _mm_andnot_si128(not_below[index], _mm_add_epi8(run_below, one));
+    longest_run = _mm_max_epu8(longest_run, _mm_max_epu8(run_above, run_below));
   }
 
+  const int32 full_failed = _mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_subs_epu8(longest_run, _mm_set1_epi8(12 - 1)), zero));
+
+  return short_passed & ~full_failed & 0xFFFF;
+}
+#endif
+
+// FAST feature detector.
+int32 findFastFeatures(const Image<uint8>& frame, const int32 max_num_features,
+                       Point2D* const features,
+                       Image<uint8>* const best_feature_map) {
+  int32 short_offsets[FAST_SHORT_CIRCLE_PERIMETER];
+  int32 full_offsets[FAST_FULL_CIRCLE_PERIMETER];
+  makeFastCircleOffsets(frame.getWidth(), short_offsets, full_offsets);
+
   const int frame_width = frame.getWidth();
 
   const int end_y = frame.getHeight() - FAST_BORDER_BUFFER;
@@ -317,29 +506,28 @@ int32 findFastFeatures(const Image<uint8>& frame, const int32 max_num_features,
     const uint8* curr_pixel_ptr =
         frame.getPixelPtrConst(FAST_BORDER_BUFFER, img_y);
 
-    for (int32 img_x = FAST_BORDER_BUFFER; img_x < end_x; ++img_x) {
-      // Only insert it if it meets the quick minimum requirements test.
-      if (testCircle(short_circle_perimeter, short_threshold,
-                     curr_pixel_ptr, short_offsets) != 0) {
-
-        // Longer test for actual feature score..
-        const int32 fast_score = testCircle(full_circle_perimeter,
-                                            full_threshold,
-                                            curr_pixel_ptr,
-                                            full_offsets);
-
-        // Non-zero score means the feature was found.
-        if (fast_score != 0) {
-          uint8* const center_ptr = best_feature_map->getPixelPtr(img_x, img_y);
-
-          // Increase the feature count on this pixel and the pixels in all
-          // 4 cardinal directions.
-          *center_ptr += 5;
-          *(center_ptr - 1) += 1;
-          *(center_ptr + 1) += 1;
-          *(center_ptr - frame_width) += 1;
-          *(center_ptr + frame_width) += 1;
-        }
+    int32 img_x = FAST_BORDER_BUFFER;
+
+#ifdef HAVE_X86
+    // SSE2 is part of the x86 ABI baseline, so this needs no runtime check.
+    for (; img_x + 16 <= end_x; img_x += 16) {
+      int32 passed = testCircles16(curr_pixel_ptr, short_offsets, full_offsets);
+
+      while (passed != 0) {
+        const int32 bit = __builtin_ctz(passed);
+        markFastFeature(best_feature_map->getPixelPtr(img_x + bit, img_y),
+                        frame_width);
+        passed &= passed - 1;
+      }
+
+      curr_pixel_ptr += 16;
+    }
+#endif
+
+    for (; img_x < end_x; ++img_x) {
+      if (testFastCircles(curr_pixel_ptr, short_offsets, full_offsets)) {
+        markFastFeature(best_feature_map->getPixelPtr(img_x, img_y),
+                        frame_width);
       }
 
       ++curr_pixel_ptr;
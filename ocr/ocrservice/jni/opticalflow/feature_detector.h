@@ -4,6 +4,8 @@
 #ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_FEATURE_DETECTOR_H_
 #define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_FEATURE_DETECTOR_H_
 
+class WorkerPool;
+
 namespace flow {
 
 // Add features along a regular grid.
@@ -17,6 +19,29 @@ int32 seedFeatures(const Image<uint8>& frame,
 float32 harrisFilter(const Image<int32>& I_x, const Image<int32>& I_y,
                      const int32 x, const int32 y);
 
+// The number of pixels in the compass point and full circles which the FAST
+// tests compare with their center.
+#define FAST_SHORT_CIRCLE_PERIMETER 4
+#define FAST_FULL_CIRCLE_PERIMETER 16
+
+// Fill in the offsets of the FAST circle pixels from their center, in a frame
+// of the given width.
+void makeFastCircleOffsets(const int32 width, int32* const short_offsets,
+                           int32* const full_offsets);
+
+// Whether the pixel passes both FAST circle tests.
+bool testFastCircles(const uint8* const center_ptr,
+                     const int32* const short_offsets,
+                     const int32* const full_offsets);
+
+#ifdef HAVE_X86
+// The FAST circle tests for 16 adjacent pixels at once, using SSE2.  Returns a
+// bit mask of the pixels which pass, lowest bit first.
+int32 testCircles16(const uint8* const center_ptr,
+                    const int32* const short_offsets,
+                    const int32* const full_offsets);
+#endif
+
 // Scan the frame for potential features using the FAST feature detector.
 int32 findFastFeatures(const Image<uint8>& frame,
                        const int32 max_num_features,
@@ -24,10 +49,12 @@ int32 findFastFeatures(const Image<uint8>& frame,
                        Image<uint8>* const best_feature_map);
 
 // Score a bunch of candidate features.  Assigns the scores to the input
-// candidate_features array entries.
+// candidate_features array entries.  The work is spread across worker_pool if
+// one is given.
 void scoreFeatures(const Image<int32>& I_x, const Image<int32>& I_y,
                    const int32 num_candidates,
-                   Point2D* const candidate_features);
+                   Point2D* const candidate_features,
+                   WorkerPool* const worker_pool);
 
 // Copy the best features (with local non-max suppression) from
 // candidate_features to final_features.
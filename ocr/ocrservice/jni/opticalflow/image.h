@@ -4,6 +4,8 @@
 #ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_IMAGE_H_
 #define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_IMAGE_H_
 
+#include <string.h>
+
 #include "optical_flow_utils.h"
 
 // TODO(andrewharp): Make this a cast to uint32 if/when we go unsigned for
@@ -31,6 +33,237 @@
 
 namespace flow {
 
+#ifdef HAVE_X86
+// Vectorized row kernels for the per-frame pyramid and gradient computations.
+// Each one handles a leading run of the pixels it's given and returns how far
+// it got, leaving the rest to the scalar code in Image, which also remains the
+// reference implementation. Results are bit-exact with the scalar code.
+
+// Vertical [1 2 1] sums of 8 adjacent columns.
+__attribute__((target("sse4.1")))
+inline __m128i sumColumns121Sse41(const uint8* const row_min,
+                                  const uint8* const row_center,
+                                  const uint8* const row_max) {
+  const __m128i top =
+      _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*) row_min));
+  const __m128i center =
+      _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*) row_center));
+  const __m128i bottom =
+      _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*) row_max));
+
+  return _mm_add_epi16(_mm_add_epi16(top, bottom), _mm_slli_epi16(center, 1));
+}
+
+// Horizontal [1 2 1] sums of the column sums at every other column. Each 32 bit
+// lane of sums holds columns (2k, 2k+1) and of sums_before (2k-1, 2k).
+__attribute__((target("sse4.1")))
+inline __m128i sumPairs121Sse41(const __m128i sums, const __m128i sums_before) {
+  const __m128i low_half = _mm_set1_epi32(0xFFFF);
+
+  return _mm_add_epi32(
+      _mm_add_epi32(_mm_and_si128(sums_before, low_half),
+                    _mm_srli_epi32(sums, 16)),
+      _mm_slli_epi32(_mm_and_si128(sums, low_half), 1));
+}
+
+// Downsamples 8 pixels at a time. Every source column read must be unclipped,
+// which holds for 1 <= x and x + 8 <= source width / 2.
+__attribute__((target("sse4.1")))
+inline int32 downsampleSmoothed3x3Sse41(const uint8* const row_min,
+                                        const uint8* const row_center,
+                                        const uint8* const row_max,
+                                        uint8* const dest,
+                                        int32 x, const int32 end_x) {
+  for (; x + 8 <= end_x; x += 8) {
+    const int32 orig_x = x << 1;
+
+    const __m128i sums_1 = sumColumns121Sse41(
+        row_min + orig_x, row_center + orig_x, row_max + orig_x);
+    const __m128i sums_2 = sumColumns121Sse41(
+        row_min + orig_x + 8, row_center + orig_x + 8, row_max + orig_x + 8);
+    const __m128i sums_before_1 = sumColumns121Sse41(
+        row_min + orig_x - 1, row_center + orig_x - 1, row_max + orig_x - 1);
+    const __m128i sums_before_2 = sumColumns121Sse41(
+        row_min + orig_x + 7, row_center + orig_x + 7, row_max + orig_x + 7);
+
+    // At most 16 * 255, so the narrowing can't saturate.
+    const __m128i pixel_sums =
+        _mm_packus_epi32(sumPairs121Sse41(sums_1, sums_before_1),
+                         sumPairs121Sse41(sums_2, sums_before_2));
+    const __m128i pixels = _mm_srli_epi16(pixel_sums, 4);
+
+    _mm_storel_epi64((__m128i*) (dest + x), _mm_packus_epi16(pixels, pixels));
+  }
+
+  return x;
+}
+
+// Vertical [1 2 1] sums of 16 adjacent columns.
+__attribute__((target("avx2")))
+inline __m256i sumColumns121Avx2(const uint8* const row_min,
+                                 const uint8* const row_center,
+                                 const uint8* const row_max) {
+  const __m256i top =
+      _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) row_min));
+  const __m256i center =
+      _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) row_center));
+  const __m256i bottom =
+      _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) row_max));
+
+  return _mm256_add_epi16(_mm256_add_epi16(top, bottom),
+                          _mm256_slli_epi16(center, 1));
+}
+
+__attribute__((target("avx2")))
+inline __m256i sumPairs121Avx2(const __m256i sums, const __m256i sums_before) {
+  const __m256i low_half = _mm256_set1_epi32(0xFFFF);
+
+  return _mm256_add_epi32(
+      _mm256_add_epi32(_mm256_and_si256(sums_before, low_half),
+                       _mm256_srli_epi32(sums, 16)),
+      _mm256_slli_epi32(_mm256_and_si256(sums, low_half), 1));
+}
+
+// Downsamples 16 pixels at a time, with the same constraints as the SSE4.1
+// version.
+__attribute__((target("avx2")))
+inline int32 downsampleSmoothed3x3Avx2(const uint8* const row_min,
+                                       const uint8* const row_center,
+                                       const uint8* const row_max,
+                                       uint8* const dest,
+                                       int32 x, const int32 end_x) {
+  for (; x + 16 <= end_x; x += 16) {
+    const int32 orig_x = x << 1;
+
+    const __m256i sums_1 = sumColumns121Avx2(
+        row_min + orig_x, row_center + orig_x, row_max + orig_x);
+    const __m256i sums_2 = sumColumns121Avx2(
+        row_min + orig_x + 16, row_center + orig_x + 16, row_max + orig_x + 16);
+    const __m256i sums_before_1 = sumColumns121Avx2(
+        row_min + orig_x - 1, row_center + orig_x - 1, row_max + orig_x - 1);
+    const __m256i sums_before_2 = sumColumns121Avx2(
+        row_min + orig_x + 15, row_center + orig_x + 15, row_max + orig_x + 15);
+
+    // Packing works within 128 bit lanes, so the middle two quarters come out
+    // swapped and have to be put back in order.
+    const __m256i pixel_sums = _mm256_permute4x64_epi64(
+        _mm256_packus_epi32(sumPairs121Avx2(sums_1, sums_before_1),
+                            sumPairs121Avx2(sums_2, sums_before_2)),
+        _MM_SHUFFLE(3, 1, 2, 0));
+    const __m256i pixels = _mm256_srli_epi16(pixel_sums, 4);
+
+    _mm_storeu_si128((__m128i*) (dest + x),
+                     _mm_packus_epi16(_mm256_castsi256_si128(pixels),
+                                      _mm256_extracti128_si256(pixels, 1)));
+  }
+
+  return x;
+}
+
+// Only 8 bit images have a vector path.
+template <typename T>
+inline int32 downsampleSmoothed3x3Row(const T* const row_min,
+                                      const T* const row_center,
+                                      const T* const row_max,
+                                      T* const dest,
+                                      const int32 x, const int32 end_x) {
+  return x;
+}
+
+inline int32 downsampleSmoothed3x3Row(const uint8* const row_min,
+                                      const uint8* const row_center,
+                                      const uint8* const row_max,
+                                      uint8* const dest,
+                                      int32 x, const int32 end_x) {
+  if (supportsAvx2()) {
+    x = downsampleSmoothed3x3Avx2(row_min, row_center, row_max, dest,
+                                  x, end_x);
+  }
+
+  if (supportsSse41()) {
+    x = downsampleSmoothed3x3Sse41(row_min, row_center, row_max, dest,
+                                   x, end_x);
+  }
+
+  return x;
+}
+
+// Halves the differences between two rows, rounding toward zero as halfDiff()
+// does.
+__attribute__((target("sse4.1")))
+inline __m128i halfDiffSse41(const __m128i diff) {
+  return _mm_srai_epi32(_mm_add_epi32(diff, _mm_srli_epi32(diff, 31)), 1);
+}
+
+__attribute__((target("sse4.1")))
+inline int32 halfDiffRowSse41(const uint8* const first,
+                              const uint8* const second,
+                              int32* const dest,
+                              int32 i, const int32 count) {
+  for (; i + 8 <= count; i += 8) {
+    const __m128i diff = _mm_sub_epi16(
+        _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*) (second + i))),
+        _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*) (first + i))));
+
+    _mm_storeu_si128((__m128i*) (dest + i),
+                     halfDiffSse41(_mm_cvtepi16_epi32(diff)));
+    _mm_storeu_si128((__m128i*) (dest + i + 4),
+                     halfDiffSse41(_mm_cvtepi16_epi32(_mm_srli_si128(diff, 8))));
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2")))
+inline __m256i halfDiffAvx2(const __m256i diff) {
+  return _mm256_srai_epi32(_mm256_add_epi32(diff, _mm256_srli_epi32(diff, 31)),
+                           1);
+}
+
+__attribute__((target("avx2")))
+inline int32 halfDiffRowAvx2(const uint8* const first,
+                             const uint8* const second,
+                             int32* const dest,
+                             int32 i, const int32 count) {
+  for (; i + 16 <= count; i += 16) {
+    const __m256i diff = _mm256_sub_epi16(
+        _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (second + i))),
+        _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (first + i))));
+
+    _mm256_storeu_si256(
+        (__m256i*) (dest + i),
+        halfDiffAvx2(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(diff))));
+    _mm256_storeu_si256(
+        (__m256i*) (dest + i + 8),
+        halfDiffAvx2(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(diff, 1))));
+  }
+
+  return i;
+}
+
+// Only 8 bit sources with 32 bit destinations have a vector path.
+template <typename T, typename U>
+inline int32 halfDiffRow(const U* const first, const U* const second,
+                         T* const dest, const int32 count) {
+  return 0;
+}
+
+inline int32 halfDiffRow(const uint8* const first, const uint8* const second,
+                         int32* const dest, const int32 count) {
+  int32 i = 0;
+
+  if (supportsAvx2()) {
+    i = halfDiffRowAvx2(first, second, dest, i, count);
+  }
+
+  if (supportsSse41()) {
+    i = halfDiffRowSse41(first, second, dest, i, count);
+  }
+
+  return i;
+}
+#endif
+
 // TODO(andrewharp): Make explicit which operations support negative numbers or
 // struct/class types in image data (possibly create fast multi-dim array class
 // for data where pixel arithmetic does not make sense).
@@ -335,7 +568,19 @@ class Image {
       const int32 min_y = clip(orig_y - 1, ZERO, original.height_less_one_);
       const int32 max_y = clip(orig_y + 1, ZERO, original.height_less_one_);
 
-      for (int32 x = 0; x < width_; ++x) {
+#ifdef HAVE_X86
+      // Only the pixels whose windows need clipping are left for the scalar
+      // loop below: the first one, and those past half the source width.
+      const int32 vector_end_x = downsampleSmoothed3x3Row(
+          original.getPixelPtrConst(0, min_y),
+          original.getPixelPtrConst(0, orig_y),
+          original.getPixelPtrConst(0, max_y),
+          getPixelPtr(0, y), 1, min(width_, original.getWidth() / 2));
+#else
+      const int32 vector_end_x = 1;
+#endif
+
+      for (int32 x = 0; x < width_; x = (x == 0) ? vector_end_x : x + 1) {
         const int32 orig_x = clip(2 * x, ZERO, original.width_less_one_);
         const int32 min_x = clip(orig_x - 1, ZERO, original.width_less_one_);
         const int32 max_x = clip(orig_x + 1, ZERO, original.width_less_one_);
@@ -493,7 +738,14 @@ class Image {
       // All the pixels in between.
       const U* const source_prev_pixel = source_row - 1;
       const U* const source_next_pixel = source_row + 1;
-      for (int32 x = 1; x < width_less_one_; ++x) {
+      int32 x = 1;
+
+#ifdef HAVE_X86
+      x += halfDiffRow(source_prev_pixel + x, source_next_pixel + x,
+                       dest_row + x, width_less_one_ - x);
+#endif
+
+      for (; x < width_less_one_; ++x) {
         dest_row[x] = halfDiff(source_prev_pixel[x], source_next_pixel[x]);
       }
     }
@@ -510,7 +762,13 @@ class Image {
       const U* const source_next_pixel =
           original.getPixelPtrConst(0, min(height_less_one_, y + 1));
 
-      for (int32 x = 0; x < width_; ++x) {
+      int32 x = 0;
+
+#ifdef HAVE_X86
+      x = halfDiffRow(source_prev_pixel, source_next_pixel, dest_row, width_);
+#endif
+
+      for (; x < width_; ++x) {
         dest_row[x] = halfDiff(source_prev_pixel[x], source_next_pixel[x]);
       }
     }
@@ -551,12 +809,20 @@ class Image {
   }
 
   // Load this image's data from a data array. The data at pixels is assumed to
-  // have dimensions equivalent to this image's dimensions * factor.
+  // have dimensions equivalent to this image's dimensions * factor, with rows
+  // stride elements apart.
   inline void fromArray(const T* const pixels, const int32 stride,
                         const int32 factor) {
     if (factor == 1) {
       // If not subsampling, memcpy per line should be faster.
-      memcpy(this->image_data_, pixels, num_pixels_ * sizeof(T));
+      if (stride == width_) {
+        memcpy(this->image_data_, pixels, num_pixels_ * sizeof(T));
+      } else {
+        for (int32 y = 0; y < height_; ++y) {
+          memcpy(this->image_data_ + y * width_, pixels + y * stride,
+                 width_ * sizeof(T));
+        }
+      }
       return;
     }
 
@@ -671,8 +937,8 @@ inline static bool markImage(const int32 x, const int32 y,
 inline void calculateG(const float32* const vals_x, const float32* const vals_y,
                        const int32 num_vals, float* const G) {
   // Defined here because we want to keep track of how many values were
-  // processed by NEON, so that we can finish off the remainder the normal
-  // way.
+  // processed by the vector code, so that we can finish off the remainder the
+  // normal way.
   int32 i = 0;
 
 #ifdef HAVE_ARMEABI_V7A
@@ -709,9 +975,9 @@ inline void calculateG(const float32* const vals_x, const float32* const vals_y,
       yy = vmlaq_f32(yy, y, y);
     }
 
-    static float32_t xx_vals[4];
-    static float32_t xy_vals[4];
-    static float32_t yy_vals[4];
+    float32_t xx_vals[4];
+    float32_t xy_vals[4];
+    float32_t yy_vals[4];
 
     vst1q_f32(xx_vals, xx);
     vst1q_f32(xy_vals, xy);
@@ -726,6 +992,42 @@ inline void calculateG(const float32* const vals_x, const float32* const vals_y,
     }
   }
 #endif
+
+#ifdef HAVE_X86
+  // SSE is part of the x86 ABI baseline, so there's no need for a runtime
+  // check. Like the NEON version, this sums four interleaved partial sums.
+  {
+    __m128 xx = _mm_setzero_ps();
+    __m128 xy = _mm_setzero_ps();
+    __m128 yy = _mm_setzero_ps();
+
+    const int32 max_i = num_vals - 4;
+
+    for (; i <= max_i; i += 4) {
+      const __m128 x = _mm_loadu_ps(vals_x + i);
+      const __m128 y = _mm_loadu_ps(vals_y + i);
+
+      xx = _mm_add_ps(xx, _mm_mul_ps(x, x));
+      xy = _mm_add_ps(xy, _mm_mul_ps(x, y));
+      yy = _mm_add_ps(yy, _mm_mul_ps(y, y));
+    }
+
+    float32 xx_vals[4];
+    float32 xy_vals[4];
+    float32 yy_vals[4];
+
+    _mm_storeu_ps(xx_vals, xx);
+    _mm_storeu_ps(xy_vals, xy);
+    _mm_storeu_ps(yy_vals, yy);
+
+    for (int32 j = 0; j < 4; ++j) {
+      G[0] += xx_vals[j];
+      G[1] += xy_vals[j];
+      G[3] += yy_vals[j];
+    }
+  }
+#endif
+
   // Non-accelerated version, also finishes off last few values (< 4) from
   // above.
   for (; i < num_vals; ++i) {
@@ -756,9 +1058,9 @@ inline void calculateG(const int window_size,
   static const int kWindowBufferSize =
       (kMaxWindowRadius * 2 + 1) * (kMaxWindowRadius * 2 + 1);
 
-  // Preallocate buffers statically for efficiency.
-  static float32 vals_x[kWindowBufferSize];
-  static float32 vals_y[kWindowBufferSize];
+  // On the stack so that this can be called from several threads at once.
+  float32 vals_x[kWindowBufferSize];
+  float32 vals_y[kWindowBufferSize];
 
   int32 num_vals = 0;
 
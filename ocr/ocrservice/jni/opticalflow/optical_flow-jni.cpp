@@ -23,6 +23,8 @@
 #include "types.h"
 #include "optical_flow_utils.h"
 #include "time_log.h"
+#include "direct_buffer.h"
+#include "stage_timer_jni.h"
 #include "image.h"
 #include "optical_flow.h"
 
@@ -51,6 +53,16 @@ extern "C" {
       jbyteArray photo_data,
       jlong timestamp);
 
+  JNIEXPORT
+  void
+  JNICALL
+  Java_com_googlecode_eyesfree_opticflow_OpticalFlow_addFrameBufferNative(
+      JNIEnv* env,
+      jobject thiz,
+      jobject photo_buffer,
+      jint row_stride,
+      jlong timestamp);
+
   JNIEXPORT
   void
   JNICALL
@@ -109,6 +121,19 @@ extern "C" {
       JNIEnv* env,
       jobject thiz);
 
+  JNIEXPORT
+  jfloatArray
+  JNICALL
+  Java_com_googlecode_eyesfree_opticflow_OpticalFlow_getStageTimesNative(
+      JNIEnv* env,
+      jclass clazz);
+
+  JNIEXPORT
+  jobjectArray
+  JNICALL
+  Java_com_googlecode_eyesfree_opticflow_OpticalFlow_getStageNamesNative(
+      JNIEnv* env,
+      jclass clazz);
 #ifdef __cplusplus
 }
 #endif
@@ -153,13 +178,44 @@ Java_com_googlecode_eyesfree_opticflow_OpticalFlow_addFrameNative(
   timeLog("Got elements");
 
   // Add the frame to the optical flow object.
-  optical_flow->nextFrame(reinterpret_cast<uint8*>(pixels), timestamp);
+  optical_flow->nextFrame(reinterpret_cast<uint8*>(pixels),
+                          optical_flow->getFrameWidth(), timestamp);
 
   env->ReleaseByteArrayElements(photo_data, pixels, JNI_ABORT);
   timeLog("Released elements");
 }
 
 
+JNIEXPORT
+void
+JNICALL
+Java_com_googlecode_eyesfree_opticflow_OpticalFlow_addFrameBufferNative(
+    JNIEnv* env,
+    jobject thiz,
+    jobject photo_buffer,
+    jint row_stride,
+    jlong timestamp) {
+  CHECK(optical_flow != NULL, "Optical flow not initialized!");
+
+  resetTimeLog();
+  timeLog("Starting optical flow");
+
+  // The frame is read in place, so there's nothing to copy or release.
+  const uint8* const pixels =
+      getDirectFrame(env, photo_buffer, optical_flow->getFrameWidth(),
+                     optical_flow->getFrameHeight(), row_stride);
+
+  timeLog("Got direct buffer");
+
+  if (pixels == NULL) {
+    return;
+  }
+
+  // Add the frame to the optical flow object.
+  optical_flow->nextFrame(pixels, row_stride, timestamp);
+}
+
+
 JNIEXPORT
 void
 JNICALL
@@ -271,4 +327,24 @@ Java_com_googlecode_eyesfree_opticflow_OpticalFlow_resetNative(
   SAFE_DELETE(optical_flow);
 }
 
+
+JNIEXPORT
+jfloatArray
+JNICALL
+Java_com_googlecode_eyesfree_opticflow_OpticalFlow_getStageTimesNative(
+    JNIEnv* env,
+    jclass clazz) {
+  return getStageSummariesArray(env);
+}
+
+
+JNIEXPORT
+jobjectArray
+JNICALL
+Java_com_googlecode_eyesfree_opticflow_OpticalFlow_getStageNamesNative(
+    JNIEnv* env,
+    jclass clazz) {
+  return getStageNamesArray(env);
+}
+
 }  // namespace flow
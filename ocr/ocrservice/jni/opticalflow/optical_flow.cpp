@@ -16,6 +16,8 @@
 
 // Author: Andrew Harp
 
+#include <string.h>
+
 #include "utils.h"
 #include "time_log.h"
 
@@ -28,6 +30,34 @@
 
 namespace flow {
 
+// Per feature tracking work for findCorrespondences().
+struct CorrespondenceJob {
+  const OpticalFlow* optical_flow;
+  FramePair* frame_pair;
+};
+
+
+static void findCorrespondenceTask(void* const data, const int32 i_feat) {
+  const CorrespondenceJob* const job = static_cast<CorrespondenceJob*>(data);
+  FramePair* const frame_pair = job->frame_pair;
+
+  const Point2D* const feature1 = frame_pair->frame1_features_ + i_feat;
+  Point2D* const feature2 = frame_pair->frame2_features_ + i_feat;
+
+  // Each feature only touches its own slots, so the results don't depend on
+  // which thread tracked it.
+  if (job->optical_flow->findFlowAtPoint(feature1->x, feature1->y,
+                                         &feature2->x, &feature2->y)) {
+    frame_pair->optical_flow_found_feature_[i_feat] = true;
+  }
+}
+
+
+static void computePyramidsTask(void* const data, const int32 index) {
+  static_cast<ImageData*>(data)->computePyramids();
+}
+
+
 OpticalFlow::OpticalFlow(const int32 frame_width,
                          const int32 frame_height,
                          const int32 downsample_factor) :
@@ -52,10 +82,15 @@ OpticalFlow::OpticalFlow(const int32 frame_width,
 
   frame1_ = new ImageData(working_size_);
   frame2_ = new ImageData(working_size_);
+
+  worker_pool_ = WorkerPool::getShared();
 }
 
 
 OpticalFlow::~OpticalFlow() {
+  // The pyramid job may still be using the frames.
+  waitForPyramids();
+
   // Delete all image storage.
   SAFE_DELETE(feature_scratch_);
   SAFE_DELETE(interest_map_);
@@ -66,7 +101,11 @@ OpticalFlow::~OpticalFlow() {
 
 
 void OpticalFlow::nextFrame(const uint8* const new_frame,
+                            const int32 stride,
                             const clock_t timestamp) {
+  // Frames may be added without computing flow in between.
+  waitForPyramids();
+
   frame_added_ = false;
   features_computed_ = false;
   flow_computed_ = false;
@@ -93,7 +132,11 @@ void OpticalFlow::nextFrame(const uint8* const new_frame,
     timeLog("Copied data from last run");
   }
 
-  frame2_->init(new_frame, original_size_.width, timestamp, downsample_factor_);
+  frame2_->init(new_frame, stride, timestamp, downsample_factor_);
+
+  // new_frame has been copied, so the rest can happen while the caller moves
+  // on. Feature detection on the previous frame doesn't need these pyramids.
+  worker_pool_->start(&pyramid_job_, computePyramidsTask, frame2_, 1);
 
   // Special case for the first frame: make sure the image ends up in
   // frame1_ so that feature detection can be done on it if desired.
@@ -118,12 +161,19 @@ void OpticalFlow::computeFlow() {
 
   FramePair* const curr_change = &frame_pairs_[geNthIndexFromEnd(0)];
 
+  waitForPyramids();
   findCorrespondences(curr_change);
 
   flow_computed_ = true;
 }
 
 
+void OpticalFlow::waitForPyramids() {
+  worker_pool_->wait(&pyramid_job_);
+  timeLog("Waited for pyramids");
+}
+
+
 void OpticalFlow::findFeatures(const FramePair& prev_change,
                                FramePair* const curr_change) {
   int32 number_of_tmp_features = 0;
@@ -153,7 +203,7 @@ void OpticalFlow::findFeatures(const FramePair& prev_change,
 
   // Score them...
   scoreFeatures(*frame1_->spatial_x_[0], *frame1_->spatial_y_[0],
-                number_of_tmp_features, tmp_features_);
+                number_of_tmp_features, tmp_features_, worker_pool_);
 
   timeLog("Scored features");
 
@@ -205,6 +255,11 @@ void OpticalFlow::computeFeatures(const bool cached_ok) {
   const FramePair& prev_change = frame_pairs_[geNthIndexFromEnd(1)];
   FramePair* const curr_change = &frame_pairs_[geNthIndexFromEnd(0)];
 
+  // The first frame is the one features are found in.
+  if (num_frames_ == 1) {
+    waitForPyramids();
+  }
+
   const int32 num_found_features = prev_change.countFoundFeatures();
   const clock_t ms_since_last_refresh =
       (curr_change->end_time - last_time_fresh_features_);
@@ -264,24 +319,15 @@ void OpticalFlow::findCorrespondences(FramePair* const frame_pair) const {
          sizeof(*frame_pair->optical_flow_found_feature_) * MAX_FEATURES);
   timeLog("Cleared old found features");
 
-  int32 num_features_found = 0;
-
-  // For every feature...
-  for (int32 i_feat = 0; i_feat < frame_pair->number_of_features_; ++i_feat) {
-    Point2D* feature1 = frame_pair->frame1_features_ + i_feat;
-    Point2D* feature2 = frame_pair->frame2_features_ + i_feat;
-
-    if (findFlowAtPoint(feature1->x, feature1->y,
-                        &feature2->x, &feature2->y)) {
-      frame_pair->optical_flow_found_feature_[i_feat] = true;
-      ++num_features_found;
-    }
-  }
+  // The features are independent of each other, so track them in parallel.
+  CorrespondenceJob job = { this, frame_pair };
+  worker_pool_->run(findCorrespondenceTask, &job,
+                    frame_pair->number_of_features_);
 
   timeLog("Found correspondences");
 
   LOGV("Found %d of %d feature correspondences",
-       num_features_found, frame_pair->number_of_features_);
+       frame_pair->countFoundFeatures(), frame_pair->number_of_features_);
 }
 
 
@@ -6,6 +6,7 @@
 
 #include "types.h"
 #include "utils.h"
+#include "worker_pool.h"
 
 // Feature detection.
 #define MAX_TEMP_FEATURES 4096
@@ -83,21 +84,25 @@ class ImageData {
     }
   }
 
+  // Copies in a new frame. The pyramids aren't valid until computePyramids()
+  // has been called.
   void init(const uint8* const new_frame, const int32 stride,
             const clock_t timestamp, const int32 downsample_factor_) {
     timestamp_ = timestamp;
 
     image_->fromArray(new_frame, stride, downsample_factor_);
     timeLog("Downsampled image");
+  }
 
+  // Builds the pyramids from the frame given to init(). This doesn't log times
+  // since it's normally run on a worker thread.
+  void computePyramids() {
     // Create the smoothed pyramids.
     computeSmoothedPyramid(*image_, NUM_LEVELS, pyramid_);
-    timeLog("Created smoothed pyramids");
 
     // Create the spatial derivatives for frame 1.
     computeSpatialPyramid((const Image<uint8>**)pyramid_,
                           NUM_LEVELS, spatial_x_, spatial_y_);
-    timeLog("Created spatial derivatives");
   }
 
   clock_t timestamp_;
@@ -179,11 +184,21 @@ class OpticalFlow {
   //
   // new_frame should be a buffer of grayscale values, one byte per pixel,
   // at the original frame_width and frame_height used to initialize the
-  // OpticalFlow object.  Downsampling will be handled internally.
+  // OpticalFlow object, with rows stride bytes apart.  Downsampling will be
+  // handled internally.
   //
   // time_stamp should be a time in milliseconds that later calls to this and
   // other methods will be relative to.
-  void nextFrame(const uint8* const new_frame, const clock_t timestamp);
+  void nextFrame(const uint8* const new_frame, const int32 stride,
+                 const clock_t timestamp);
+
+  inline int32 getFrameWidth() const {
+    return original_size_.width;
+  }
+
+  inline int32 getFrameHeight() const {
+    return original_size_.height;
+  }
 
   // Find the features in the frame before the current frame.
   // If only one frame exists, features will be found in that frame.
@@ -244,6 +259,10 @@ class OpticalFlow {
     return geNthIndexFromStart(num_frames_ - 1 - offset);
   }
 
+  // Blocks until the pyramids of the most recently added frame, which are built
+  // in the background, are ready.
+  void waitForPyramids();
+
   // Finds features in the previous frame and adds them to curr_change.
   void findFeatures(const FramePair& prev_change,
                     FramePair* const curr_change);
@@ -282,6 +301,11 @@ class OpticalFlow {
   ImageData* frame1_;
   ImageData* frame2_;
 
+  // The shared pool, which spreads feature tracking across threads and builds
+  // the pyramids for each new frame while the caller gets on with other work.
+  WorkerPool* worker_pool_;
+  WorkerJob pyramid_job_;
+
   bool frame_added_;
   bool features_computed_;
   bool flow_computed_;
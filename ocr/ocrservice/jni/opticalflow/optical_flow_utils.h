@@ -185,6 +185,46 @@ void qsort(T* const arr_start, const int32 num_elems) {
   qsort(arr_start + first_part_size, second_part_size);
 }
 
+// Restores the max-heap property below index, assuming both of its subtrees
+// are already heaps.
+template<typename T>
+inline void siftDown(T* const heap, const int32 num_elems, int32 index) {
+  while (true) {
+    const int32 left = 2 * index + 1;
+    if (left >= num_elems) {
+      return;
+    }
+
+    const int32 right = left + 1;
+    const int32 largest =
+        (right < num_elems && heap[left] < heap[right]) ? right : left;
+
+    if (!(heap[index] < heap[largest])) {
+      return;
+    }
+
+    swap(heap + index, heap + largest);
+    index = largest;
+  }
+}
+
+// Arranges an array into a max-heap by score in linear time, so that the best
+// elements can then be pulled off one at a time without sorting the rest.
+template<typename T>
+void makeHeap(T* const arr_start, const int32 num_elems) {
+  for (int32 i = num_elems / 2 - 1; i >= 0; --i) {
+    siftDown(arr_start, num_elems, i);
+  }
+}
+
+// Moves the largest element of a heap of size num_elems to the end of the
+// array, leaving a heap of size num_elems - 1 in front of it.
+template<typename T>
+inline void popHeap(T* const heap, const int32 num_elems) {
+  swap(heap, heap + num_elems - 1);
+  siftDown(heap, num_elems - 1, 0);
+}
+
 }  // namespace flow
 
 #endif // JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_OPTICAL_FLOW_UTILS_H_
@@ -16,6 +16,8 @@
 
 package com.googlecode.eyesfree.opticflow;
 
+import java.nio.ByteBuffer;
+
 /**
  * Wrapper for native image blur detection code. Modified by Alan Viverette from
  * Xiaotao Duan's original source.
@@ -35,6 +37,20 @@ public class ImageBlur {
      */
     public static native boolean isBlurred(byte[] input, int width, int height);
 
+    /**
+     * Tests if an image held in a direct buffer is blurred or not. The buffer
+     * is read in place rather than copied.
+     *
+     * @param input A direct buffer starting with the luminance plane.
+     * @param width The width of the input image.
+     * @param height The height of the input image.
+     * @param rowStride The number of bytes between the starts of rows.
+     * @return true when input image is blurred, false when it is not or the
+     *         buffer is not a direct buffer large enough to hold the image.
+     */
+    public static native boolean isBlurredDirect(
+            ByteBuffer input, int width, int height, int rowStride);
+
     /**
      * Computes signature of a given image.
      *
@@ -52,6 +68,22 @@ public class ImageBlur {
     public static native int[] computeSignature(
             byte[] input, int width, int height, int[] signatureBuffer);
 
+    /**
+     * Computes signature of an image held in a direct buffer, which is read in
+     * place rather than copied.
+     *
+     * @param input A direct buffer starting with the luminance plane.
+     * @param width The width of the input image.
+     * @param height The height of the input image.
+     * @param rowStride The number of bytes between the starts of rows.
+     * @param signatureBuffer A buffer for output signature, as for
+     *            {@link #computeSignature(byte[], int, int, int[])}.
+     * @return Signature of input image, or null if the buffer is not a direct
+     *         buffer large enough to hold the image.
+     */
+    public static native int[] computeSignatureDirect(
+            ByteBuffer input, int width, int height, int rowStride, int[] signatureBuffer);
+
     /**
      * Computes how similar of two given images represented by their signatures.
      *
@@ -60,6 +92,34 @@ public class ImageBlur {
      */
     public static native int diffSignature(int[] signature1, int[] signature2);
 
+    /**
+     * Compares many signatures against a reference in a single call, for
+     * example to find which of a set of stored frames is most like the
+     * current one.
+     *
+     * @param reference The signature to compare against.
+     * @param candidates The signatures to compare, stored one after another.
+     * @param diffs If not null, receives the difference of each candidate
+     *            from the reference, as returned by
+     *            {@link #diffSignature(int[], int[])}.
+     * @return The index of the candidate most similar to the reference, or
+     *         -1 if there are no candidates.
+     */
+    public static native int diffSignatures(int[] reference, int[] candidates, int[] diffs);
+
+    /**
+     * Returns the latency of each stage the image utilities have timed on any
+     * thread since they were loaded, laid out as for
+     * {@link OpticalFlow#getStageTimes()}.
+     */
+    public static native float[] getStageTimes();
+
+    /**
+     * Returns the names of the stages in {@link #getStageTimes()}, in the same
+     * order. Fetch these after the times.
+     */
+    public static native String[] getStageNames();
+
     static {
         System.loadLibrary("imageutils");
     }
@@ -18,6 +18,8 @@ package com.googlecode.eyesfree.opticflow;
 
 import android.graphics.PointF;
 
+import java.nio.ByteBuffer;
+
 /**
  * Interface to native optical flow library.
  *
@@ -27,6 +29,13 @@ import android.graphics.PointF;
  * @author alanv@google.com (Alan Viverette)
  */
 public class OpticalFlow {
+    /**
+     * Number of values per stage returned by {@link #getStageTimes()}: the
+     * number of times recorded, then the mean, median, 90th and 99th
+     * percentile and maximum times in milliseconds.
+     */
+    public static final int STAGE_TIME_STEP = 6;
+
     static {
         System.loadLibrary("lept");
         System.loadLibrary("opticalflow");
@@ -45,6 +54,18 @@ public class OpticalFlow {
         addFrameNative(data, timestamp);
     }
 
+    /**
+     * Adds a frame held in a direct buffer, which is read in place rather than
+     * copied.
+     *
+     * @param data A direct buffer starting with the luminance plane.
+     * @param rowStride The number of bytes between the starts of rows.
+     * @param timestamp The time of the frame, in milliseconds.
+     */
+    public void setImage(ByteBuffer data, int rowStride, long timestamp) {
+        addFrameBufferNative(data, rowStride, timestamp);
+    }
+
     public void computeOpticalFlow() {
         computeFeaturesNative(true);
         computeFlowNative();
@@ -68,12 +89,32 @@ public class OpticalFlow {
         addInterestRegionNative(numX, numY, left, top, right, bottom);
     }
 
+    /**
+     * Returns the latency of each stage the optical flow library has timed on
+     * any thread since it was loaded, {@link #STAGE_TIME_STEP} values per
+     * stage. Percentiles are accurate to within about 10%.
+     */
+    public static float[] getStageTimes() {
+        return getStageTimesNative();
+    }
+
+    /**
+     * Returns the names of the stages in {@link #getStageTimes()}, in the same
+     * order. Stages are only ever added, so names fetched after the times
+     * always cover every stage in them.
+     */
+    public static String[] getStageNames() {
+        return getStageNamesNative();
+    }
+
     /*********************** NATIVE METHODS *************************************/
 
     private native void initNative(int width, int height, int downsampleFactor);
 
     private native void addFrameNative(byte[] data, long timeStamp);
 
+    private native void addFrameBufferNative(ByteBuffer data, int rowStride, long timeStamp);
+
     private native void computeFeaturesNative(boolean cachedOk);
 
     private native void computeFlowNative();
@@ -89,4 +130,8 @@ public class OpticalFlow {
     private native float[] getFeaturesNative(boolean onlyReturnCorrespondingFeatures);
 
     private native void resetNative();
+
+    private static native float[] getStageTimesNative();
+
+    private static native String[] getStageNamesNative();
 }
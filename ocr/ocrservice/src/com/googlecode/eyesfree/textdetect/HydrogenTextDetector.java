@@ -113,6 +113,23 @@ public class HydrogenTextDetector {
         nativeClear(mNative);
     }
 
+    /**
+     * Returns the latency of each stage of text detection timed on any thread
+     * since the library was loaded, laid out as for
+     * {@link com.googlecode.eyesfree.opticflow.OpticalFlow#getStageTimes()}.
+     */
+    public static float[] getStageTimes() {
+        return nativeGetStageTimes();
+    }
+
+    /**
+     * Returns the names of the stages in {@link #getStageTimes()}, in the same
+     * order. Fetch these after the times.
+     */
+    public static String[] getStageNames() {
+        return nativeGetStageNames();
+    }
+
     // ******************
     // * PUBLIC CLASSES *
     // ******************
@@ -257,4 +274,8 @@ public class HydrogenTextDetector {
     private static native void nativeDetectText(int nativePtr);
 
     private static native void nativeClear(int nativePtr);
+
+    private static native float[] nativeGetStageTimes();
+
+    private static native String[] nativeGetStageNames();
 }